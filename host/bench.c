@@ -0,0 +1,433 @@
+/*
+    Microbenchmark of the packet engine on the host.
+
+    The driver is set up the way the receiver task sees it once the unit is open, but without a card: data
+    frames, SDPCM frames and escan events are fed straight into ProcessDataPacket and ProcessPacket, writes
+    go through SendGlomDataPacket into a SendPKT which only counts bytes. Every mix reports packets per
+    second and nanoseconds per packet, and checks that everything fed in arrived where it should.
+
+    Usage: wifipi-bench [-q]    -q runs a short pass, as done by ctest
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <exec/types.h>
+#include <exec/memory.h>
+#include <exec/io.h>
+#include <devices/timer.h>
+#include <devices/sana2.h>
+#include <proto/exec.h>
+
+#include "wifipi.h"
+#include "host.h"
+#include "sdpcm.h"
+
+/* Entry points of packet.c not exported through its headers */
+struct Packet;
+ULONG ProcessPacket(struct SDIO *sdio, struct Packet *pkt);
+int SendGlomDataPacket(struct SDIO *sdio, struct IOSana2Req **ioList, UBYTE count);
+
+#define MAX_GLOM            32
+#define MCAST_RANGES        16
+#define SCAN_NETWORKS       24
+#define SCAN_REPEATS        2
+#define FRAME_BUFFER_SIZE   2048
+
+static struct ExecBase *SysBase;
+static struct WiFiBase *WiFiBase;
+static struct SDIO *SDIO;
+static struct WiFiUnit *Unit;
+static struct Opener *Opener;
+static struct MsgPort *ReplyPort;
+static ULONG Iterations;
+static int Failures;
+
+static UBYTE OurAddr[6] = { 0x02, 0x00, 0x5e, 0x10, 0x00, 0x01 };
+static UBYTE PeerAddr[6] = { 0x02, 0x00, 0x5e, 0x10, 0x00, 0x02 };
+
+static ULONG SentBytes;
+static ULONG SentFrames;
+
+static uint64_t NanoTime(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void Report(const char *name, ULONG packets, uint64_t ns)
+{
+    printf("%-32s %10lu pkt %12.0f pkt/s %10.1f ns/pkt\n", name, (unsigned long)packets,
+        packets * 1e9 / (ns ? ns : 1), (double)ns / (packets ? packets : 1));
+}
+
+static void Check(const char *name, ULONG got, ULONG expected)
+{
+    if (got != expected)
+    {
+        printf("FAIL: %s: got %lu, expected %lu\n", name, (unsigned long)got, (unsigned long)expected);
+        Failures++;
+    }
+}
+
+static BOOL CopyBuffer(APTR to, APTR from, ULONG length)
+{
+    memcpy(to, from, length);
+    return TRUE;
+}
+
+static void CountPKT(UBYTE *pkt, ULONG length, struct SDIO *sdio)
+{
+    (void)sdio;
+
+    if (GetLE16(pkt) != length || (UWORD)~GetLE16(&pkt[2]) != length)
+        Failures++;
+
+    SentBytes += length;
+    SentFrames++;
+}
+
+/* Unit with one opener, as left by OpenDevice and S2_ONLINE. Control messages fail, receiver is not running */
+static void SetupDriver(void)
+{
+    struct timerequest *tr;
+
+    WiFiBase = AllocMem(sizeof(struct WiFiBase), MEMF_PUBLIC | MEMF_CLEAR);
+    WiFiBase->w_SysBase = SysBase;
+    WiFiBase->w_UtilityBase = OpenLibrary((CONST_STRPTR)"utility.library", 0);
+    WiFiBase->w_MemPool = CreatePool(MEMF_FAST | MEMF_CLEAR, 32768, 8192);
+    InitSemaphore(&WiFiBase->w_NetworkListLock);
+    NewMinList(&WiFiBase->w_NetworkList);
+
+    SDIO = AllocMem(sizeof(struct SDIO), MEMF_PUBLIC | MEMF_CLEAR);
+    SDIO->s_WiFiBase = WiFiBase;
+    SDIO->s_SysBase = SysBase;
+    SDIO->s_TXBuffer = AllocMem(MAX_GLOM * FRAME_BUFFER_SIZE, MEMF_PUBLIC | MEMF_CLEAR);
+    SDIO->s_CtrlWaitList = AllocMem(sizeof(struct MinList), MEMF_PUBLIC | MEMF_CLEAR);
+    SDIO->s_Chip = AllocMem(sizeof(struct Chip), MEMF_PUBLIC | MEMF_CLEAR);
+    SDIO->s_Chip->c_D11Type = BRCMU_D11AC_IOTYPE;
+    SDIO->s_MaxTXSeq = 0x80;
+    SDIO->SendPKT = CountPKT;
+    NewMinList(SDIO->s_CtrlWaitList);
+    InitSemaphore(&SDIO->s_Lock);
+    WiFiBase->w_SDIO = SDIO;
+
+    Unit = AllocMem(sizeof(struct WiFiUnit), MEMF_PUBLIC | MEMF_CLEAR);
+    Unit->wu_Base = WiFiBase;
+    NewMinList(&Unit->wu_Openers);
+    NewMinList(&Unit->wu_MulticastRanges);
+    NewMinList(&Unit->wu_TypeTrackers);
+    InitSemaphore(&Unit->wu_Lock);
+    CopyMem(OurAddr, Unit->wu_EtherAddr, 6);
+    CopyMem(OurAddr, Unit->wu_OrigEtherAddr, 6);
+    WiFiBase->w_Unit = Unit;
+
+    /* Ports of the unit task, requests never arrive there during the benchmark */
+    Unit->wu_CmdQueue = CreateMsgPort();
+    Unit->wu_ScanQueue = CreateMsgPort();
+    Unit->wu_ScanContinue = CreateMsgPort();
+    Unit->wu_ScanRiders = CreateMsgPort();
+
+    tr = CreateIORequest(CreateMsgPort(), sizeof(struct timerequest));
+    OpenDevice((CONST_STRPTR)TIMERNAME, UNIT_MICROHZ, &tr->tr_node, 0);
+    Unit->wu_TimerBase = (struct TimerBase *)tr->tr_node.io_Device;
+
+    Opener = AllocMem(sizeof(struct Opener), MEMF_PUBLIC | MEMF_CLEAR);
+    Opener->o_ReadPort.mp_Flags = PA_IGNORE;
+    Opener->o_OrphanListeners.mp_Flags = PA_IGNORE;
+    Opener->o_EventListeners.mp_Flags = PA_IGNORE;
+    NewMinList((struct MinList *)&Opener->o_ReadPort.mp_MsgList);
+    NewMinList((struct MinList *)&Opener->o_OrphanListeners.mp_MsgList);
+    NewMinList((struct MinList *)&Opener->o_EventListeners.mp_MsgList);
+    Opener->o_RXFunc = CopyBuffer;
+    Opener->o_TXFunc = CopyBuffer;
+    AddTail((struct List *)&Unit->wu_Openers, (struct Node *)Opener);
+
+    ReplyPort = CreateMsgPort();
+}
+
+static struct IOSana2Req * NewRequest(UWORD command, ULONG type)
+{
+    struct IOSana2Req *io = CreateIORequest(ReplyPort, sizeof(struct IOSana2Req));
+
+    io->ios2_Req.io_Device = &WiFiBase->w_Device;
+    io->ios2_Req.io_Unit = &Unit->wu_Unit;
+    io->ios2_Req.io_Command = command;
+    io->ios2_PacketType = type;
+    io->ios2_BufferManagement = Opener;
+    io->ios2_Data = AllocMem(FRAME_BUFFER_SIZE, MEMF_PUBLIC | MEMF_CLEAR);
+
+    return io;
+}
+
+static void DeleteRequest(struct IOSana2Req *io)
+{
+    FreeMem(io->ios2_Data, FRAME_BUFFER_SIZE);
+    DeleteIORequest(io);
+}
+
+/* Put replied read requests back on the port they came from. Returns number of requests replied */
+static ULONG Requeue(struct MsgPort *port)
+{
+    struct IOSana2Req *io;
+    ULONG count = 0;
+
+    while ((io = (struct IOSana2Req *)GetMsg(ReplyPort)) != NULL)
+    {
+        AddTail(&port->mp_MsgList, (struct Node *)io);
+        count++;
+    }
+
+    return count;
+}
+
+static void Drain(struct MsgPort *port)
+{
+    struct Node *n;
+
+    while ((n = RemHead(&port->mp_MsgList)) != NULL)
+        DeleteRequest((struct IOSana2Req *)n);
+    while ((n = (struct Node *)GetMsg(ReplyPort)) != NULL)
+        DeleteRequest((struct IOSana2Req *)n);
+}
+
+static void Multicast(UWORD command, const UBYTE *lower, const UBYTE *upper)
+{
+    struct IOSana2Req *io = NewRequest(command, 0);
+
+    io->ios2_Req.io_Flags = IOF_QUICK;
+    CopyMem((APTR)lower, io->ios2_SrcAddr, 6);
+    CopyMem((APTR)upper, io->ios2_DstAddr, 6);
+    HandleRequest(io);
+    DeleteRequest(io);
+}
+
+static void MulticastAddr(UBYTE *addr, UBYTE n)
+{
+    static const UBYTE base[6] = { 0x01, 0x00, 0x5e, 0x00, 0x00, 0x00 };
+
+    CopyMem((APTR)base, addr, 6);
+    addr[5] = n;
+}
+
+/*
+    Data frames handed to ProcessDataPacket, or whole SDPCM frames to ProcessPacket if sdpcm is set. Frames
+    with matching type go to a reader, others to an orphan listener. expectRead tells which one has to get
+    each frame, or none if the frame is dropped.
+*/
+enum Expect { EXPECT_READ, EXPECT_ORPHAN, EXPECT_DROP };
+
+static void BenchRX(const char *name, const UBYTE *dst, UWORD type, ULONG frameLength, BOOL sdpcm, enum Expect expect)
+{
+    UBYTE *frame = AllocMem(FRAME_BUFFER_SIZE, MEMF_PUBLIC | MEMF_CLEAR);
+    UBYTE *pkt = AllocMem(FRAME_BUFFER_SIZE, MEMF_PUBLIC | MEMF_CLEAR);
+    ULONG delivered = 0;
+    ULONG orphans = Unit->wu_Stats.UnknownTypesReceived;
+    struct IOSana2Req *reader = NewRequest(CMD_READ, 0x0800);
+    struct IOSana2Req *orphan = NewRequest(S2_READORPHAN, 0);
+
+    AddTail(&Opener->o_ReadPort.mp_MsgList, (struct Node *)reader);
+    AddTail(&Opener->o_OrphanListeners.mp_MsgList, (struct Node *)orphan);
+
+    BuildEtherFrame(frame, frameLength, dst, PeerAddr, type);
+    BuildDataFrame(pkt, 0, 0x80, frame, frameLength);
+
+    uint64_t start = NanoTime();
+    for (ULONG i = 0; i < Iterations; i++)
+    {
+        if (sdpcm)
+            ProcessPacket(SDIO, (struct Packet *)pkt);
+        else
+            ProcessDataPacket(SDIO, frame, frameLength);
+
+        if (expect == EXPECT_ORPHAN)
+            delivered += Requeue(&Opener->o_OrphanListeners);
+        else
+            delivered += Requeue(&Opener->o_ReadPort);
+    }
+    Report(name, Iterations, NanoTime() - start);
+
+    Check(name, delivered, expect == EXPECT_DROP ? 0 : Iterations);
+    if (expect != EXPECT_DROP)
+    {
+        struct IOSana2Req *io = expect == EXPECT_READ ? reader : orphan;
+
+        Check(name, io->ios2_DataLength, frameLength - 14);
+        Check(name, memcmp(io->ios2_Data, &frame[14], frameLength - 14), 0);
+    }
+    if (expect == EXPECT_ORPHAN)
+        Check(name, Unit->wu_Stats.UnknownTypesReceived - orphans, Iterations);
+
+    Drain(&Opener->o_ReadPort);
+    Drain(&Opener->o_OrphanListeners);
+    FreeMem(frame, FRAME_BUFFER_SIZE);
+    FreeMem(pkt, FRAME_BUFFER_SIZE);
+}
+
+/* Writes of 1500 bytes sent count at a time in one glom frame */
+static void BenchTX(const char *name, UBYTE count)
+{
+    struct IOSana2Req *list[MAX_GLOM];
+    ULONG replied = 0;
+    ULONG frames = SentFrames;
+
+    for (int i = 0; i < count; i++)
+    {
+        list[i] = NewRequest(CMD_WRITE, 0x0800);
+        list[i]->ios2_DataLength = 1500;
+        CopyMem(PeerAddr, list[i]->ios2_DstAddr, 6);
+    }
+
+    ULONG rounds = Iterations / count;
+    uint64_t start = NanoTime();
+    for (ULONG i = 0; i < rounds; i++)
+    {
+        SendGlomDataPacket(SDIO, list, count);
+        while (GetMsg(ReplyPort) != NULL)
+            replied++;
+    }
+    Report(name, rounds * count, NanoTime() - start);
+
+    Check(name, replied, rounds * count);
+    Check(name, SentFrames - frames, rounds);
+
+    for (int i = 0; i < count; i++)
+        DeleteRequest(list[i]);
+}
+
+/*
+    Escan events of SCAN_NETWORKS networks, each one reported SCAN_REPEATS times, followed by completion of
+    the scan. Every event counts as one packet.
+*/
+static void BenchScan(const char *name)
+{
+    static const UBYTE ie[] = {
+        0x00, 0x07, 'b', 'e', 'n', 'c', 'h', '0', '0',
+        0x01, 0x08, 0x82, 0x84, 0x8b, 0x96, 0x0c, 0x12, 0x18, 0x24,
+        0x30, 0x14, 0x01, 0x00, 0x00, 0x0f, 0xac, 0x04, 0x01, 0x00, 0x00, 0x0f, 0xac, 0x04,
+                    0x01, 0x00, 0x00, 0x0f, 0xac, 0x02, 0x0c, 0x00,
+        0x2d, 0x1a, 0xef, 0x01, 0x1b, 0xff, 0xff, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    };
+    UBYTE *events[SCAN_NETWORKS + 1];
+    UBYTE *data = AllocMem(FRAME_BUFFER_SIZE, MEMF_PUBLIC | MEMF_CLEAR);
+    ULONG scans = Iterations / (SCAN_NETWORKS * SCAN_REPEATS + 1);
+    ULONG length;
+
+    if (scans == 0)
+        scans = 1;
+
+    for (int i = 0; i <= SCAN_NETWORKS; i++)
+    {
+        UBYTE bssid[6] = { 0x02, 0x11, 0x22, 0x33, 0x44, i };
+        char ssid[16];
+
+        events[i] = AllocMem(FRAME_BUFFER_SIZE, MEMF_PUBLIC | MEMF_CLEAR);
+        snprintf(ssid, sizeof(ssid), "bench%02d", i);
+
+        if (i < SCAN_NETWORKS)
+            length = BuildEScanResult(data, 1, bssid, ssid, 0x1000 | (1 + i % 13), -40 - i, ie, sizeof(ie));
+        else
+            length = BuildEScanResult(data, 1, NULL, NULL, 0, 0, NULL, 0);
+
+        BuildEvent(events[i], 0, 0x80, PeerAddr, EVENT_ESCAN_RESULT, i < SCAN_NETWORKS ? 8 : 0, 0, data, length);
+    }
+
+    uint64_t start = NanoTime();
+    for (ULONG s = 0; s < scans; s++)
+    {
+        Unit->wu_ScanActive = TRUE;
+        for (int r = 0; r < SCAN_REPEATS; r++)
+        {
+            for (int i = 0; i < SCAN_NETWORKS; i++)
+                ProcessPacket(SDIO, (struct Packet *)events[i]);
+        }
+        ProcessPacket(SDIO, (struct Packet *)events[SCAN_NETWORKS]);
+    }
+    Report(name, scans * (SCAN_NETWORKS * SCAN_REPEATS + 1), NanoTime() - start);
+
+    ULONG cached = 0;
+    struct WiFiNetwork *net;
+    ForeachNode(&WiFiBase->w_NetworkList, net)
+        cached++;
+
+    Check(name, Unit->wu_ScanActive, FALSE);
+    Check(name, cached, SCAN_NETWORKS);
+
+    for (int i = 0; i <= SCAN_NETWORKS; i++)
+        FreeMem(events[i], FRAME_BUFFER_SIZE);
+    FreeMem(data, FRAME_BUFFER_SIZE);
+}
+
+/* S2_ADDMULTICASTADDRESSES and S2_DELMULTICASTADDRESSES of one range, with MCAST_RANGES ranges registered */
+static void BenchMulticast(const char *name)
+{
+    UBYTE lower[6], upper[6];
+    ULONG ops = Iterations / 16;
+
+    MulticastAddr(lower, 0xf0);
+    MulticastAddr(upper, 0xf3);
+
+    uint64_t start = NanoTime();
+    for (ULONG i = 0; i < ops; i++)
+    {
+        Multicast(S2_ADDMULTICASTADDRESSES, lower, upper);
+        Multicast(S2_DELMULTICASTADDRESSES, lower, upper);
+    }
+    Report(name, 2 * ops, NanoTime() - start);
+
+    Check(name, WiFiBase->w_PoolUsage[POOL_MULTICAST].pu_Current, MCAST_RANGES * sizeof(struct MulticastRange));
+}
+
+static void BenchMain(APTR arg)
+{
+    UBYTE addr[6];
+    (void)arg;
+
+    SysBase = HostSysBase;
+    SetupDriver();
+
+    BenchRX("rx unicast 1514", OurAddr, 0x0800, 1514, FALSE, EXPECT_READ);
+    BenchRX("rx unicast 64", OurAddr, 0x0800, 64, FALSE, EXPECT_READ);
+    BenchRX("rx sdpcm unicast 1514", OurAddr, 0x0800, 1514, TRUE, EXPECT_READ);
+    BenchRX("rx sdpcm unicast 64", OurAddr, 0x0800, 64, TRUE, EXPECT_READ);
+    BenchRX("rx orphan 1514", OurAddr, 0x88cc, 1514, FALSE, EXPECT_ORPHAN);
+
+    for (int i = 0; i < MCAST_RANGES; i++)
+    {
+        MulticastAddr(addr, i);
+        Multicast(S2_ADDMULTICASTADDRESS, addr, addr);
+    }
+
+    MulticastAddr(addr, 0);
+    BenchRX("rx multicast hit, 16 ranges", addr, 0x0800, 1514, FALSE, EXPECT_READ);
+    MulticastAddr(addr, 0x80);
+    BenchRX("rx multicast miss, 16 ranges", addr, 0x0800, 1514, FALSE, EXPECT_DROP);
+
+    BenchTX("tx glom 1", 1);
+    BenchTX("tx glom 8", 8);
+    BenchTX("tx glom 32", 32);
+
+    BenchScan("escan events");
+    BenchMulticast("multicast add/del, 16 ranges");
+}
+
+int main(int argc, char **argv)
+{
+    Iterations = 1000000;
+    if (argc > 1 && strcmp(argv[1], "-q") == 0)
+        Iterations = 20000;
+
+    HostInit();
+    HostRun(BenchMain, NULL);
+
+    if (Failures)
+        printf("%d check(s) failed\n", Failures);
+
+    return Failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
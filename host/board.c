@@ -0,0 +1,124 @@
+/*
+    Board of the host build: console, 1MHz system timer and the peripheral address space seen through
+    rd32/wr32. Peripherals are simulated by whoever maps them with HostMapIO, addresses outside of the
+    mapped regions are plain memory.
+*/
+
+#include <stdio.h>
+
+#include "wifipi.h"
+#include "host.h"
+
+#define MAX_REGIONS 16
+
+struct Region {
+    ULONG                   r_Base;
+    ULONG                   r_Size;
+    const struct HostIO *   r_IO;
+    APTR                    r_User;
+};
+
+static struct Region Regions[MAX_REGIONS];
+static int RegionCount;
+static int ConsoleEnabled;
+
+void HostMapIO(ULONG base, ULONG size, const struct HostIO *io, APTR user)
+{
+    Regions[RegionCount].r_Base = base;
+    Regions[RegionCount].r_Size = size;
+    Regions[RegionCount].r_IO = io;
+    Regions[RegionCount].r_User = user;
+    RegionCount++;
+}
+
+void HostConsole(int enabled)
+{
+    ConsoleEnabled = enabled;
+}
+
+static inline struct Region * FindRegion(ULONG address)
+{
+    for (int i = 0; i < RegionCount; i++)
+    {
+        if (address - Regions[i].r_Base < Regions[i].r_Size)
+            return &Regions[i];
+    }
+
+    return NULL;
+}
+
+void putch(UBYTE data, APTR ignore)
+{
+    (void)ignore;
+
+    if (ConsoleEnabled && data != 0)
+        fputc(data, stderr);
+}
+
+struct ExecBase * GetAbsExecBase(void)
+{
+    return HostSysBase;
+}
+
+ULONG timer_us(void)
+{
+    return (ULONG)HostMicros();
+}
+
+ULONG rd32(APTR addr, ULONG offset)
+{
+    ULONG address = (ULONG)(uintptr_t)addr + offset;
+    struct Region *r = FindRegion(address);
+
+    if (r != NULL)
+        return r->r_IO->hio_Read(r->r_User, address - r->r_Base);
+
+    return LE32(*(volatile ULONG *)(uintptr_t)address);
+}
+
+void wr32(APTR addr, ULONG offset, ULONG val)
+{
+    ULONG address = (ULONG)(uintptr_t)addr + offset;
+    struct Region *r = FindRegion(address);
+
+    if (r != NULL)
+        r->r_IO->hio_Write(r->r_User, address - r->r_Base, val);
+    else
+        *(volatile ULONG *)(uintptr_t)address = LE32(val);
+}
+
+/* Big endian accessors see little endian registers byte swapped, as the m68k does */
+
+ULONG rd32be(APTR addr, ULONG offset)
+{
+    return __builtin_bswap32(rd32(addr, offset));
+}
+
+void wr32be(APTR addr, ULONG offset, ULONG val)
+{
+    wr32(addr, offset, __builtin_bswap32(val));
+}
+
+/* FIFO data ports: the word read or written holds the bytes in the memory order of the host */
+
+ULONG rd32fifo(APTR addr, ULONG offset)
+{
+    ULONG address = (ULONG)(uintptr_t)addr + offset;
+    struct Region *r = FindRegion(address);
+
+    if (r != NULL)
+        return r->r_IO->hio_Read(r->r_User, address - r->r_Base);
+
+    return *(volatile ULONG *)(uintptr_t)address;
+}
+
+void wr32fifo(APTR addr, ULONG offset, ULONG val)
+{
+    ULONG address = (ULONG)(uintptr_t)addr + offset;
+    struct Region *r = FindRegion(address);
+
+    if (r != NULL)
+        r->r_IO->hio_Write(r->r_User, address - r->r_Base, val);
+    else
+        *(volatile ULONG *)(uintptr_t)address = val;
+}
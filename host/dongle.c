@@ -0,0 +1,1206 @@
+/*
+    Software dongle: BCM4345 (rev 6, the chip of the Raspberry Pi 4) as seen by the driver over SDIO.
+
+    The card side is a register model of what chip_init touches - CCCR and FBR of function 0, the function 1
+    registers with the backplane window, chipcommon with its EROM, the SDIO device core, the ARM CR4 with its
+    RAM banks and the wrappers of all cores. Writes to RAM are kept, the ARM is considered booted once its
+    wrapper releases it from halt and reset. From then on function 2 carries SDPCM frames in both directions:
+    control requests are answered, escans produce results, data frames are echoed back, and every frame sent
+    to the host advertises the TX window (maxseq) from the credits the firmware has left.
+
+    DongleSDIO puts the model behind the function pointers of struct SDIO, with the same command, block and
+    window arithmetic as sdio.c, so that everything above SDIO runs unchanged.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <exec/types.h>
+#include <exec/memory.h>
+#include <proto/exec.h>
+
+#include "wifipi.h"
+#include "brcm.h"
+#include "brcm_sdio.h"
+#include "brcm_chipcommon.h"
+#include "host.h"
+#include "sdpcm.h"
+#include "dongle.h"
+
+#define CHIP_ID             BRCM_CC_4345_CHIP_ID
+#define CHIP_REV            6
+#define PMU_REV             24
+#define RAM_BASE            0x198000
+#define RAM_BANKS           5
+#define RAM_BANK_INFO       19                  // (19 + 1) * 8 KB per bank
+#define RAM_SIZE            (RAM_BANKS * (RAM_BANK_INFO + 1) * 8192)
+#define EROM_BASE           0x180ff000
+#define WRAP_BASE           (SI_ENUM_BASE_DEFAULT + 0x100000)
+#define SHARED_SIZE         0x400               // sdpcm_shared and console below NVRAM
+#define CONSOLE_SIZE        0x200
+
+/* Wrapper and ARM CR4 registers, as in wifipi.c */
+#define WRAP_IOCTL          0x408
+#define WRAP_RESET_CTL      0x800
+#define IOCTL_CLK           0x0001
+#define IOCTL_FGC           0x0002
+#define IOCTL_CPUHALT       0x0020
+#define CR4_CAP             0x04
+#define CR4_BANKIDX         0x40
+#define CR4_BANKINFO        0x44
+
+#define BCME_UNSUPPORTED    -23
+#define DL_END              0x0004
+
+#define RX_QUEUE_MAX        1024
+#define RX_FRAME_MAX        2048                // Largest single frame the dongle sends
+#define RX_GLOM_MAX         16384               // Largest RX glom superframe
+#define TX_BUFFER_SIZE      65536
+#define CTRL_DATA_MAX       1600
+#define MAX_VARS            64
+#define VAR_SIZE            64
+#define MAX_IOCTLS          320
+
+enum { CORE_CC, CORE_D11, CORE_SDIOD, CORE_CR4, CORE_COUNT };
+
+static const struct {
+    UWORD   id;
+    UBYTE   rev;
+    UBYTE   master;     // Core has a master port, its wrapper is then MWRAP
+} Cores[CORE_COUNT] = {
+    { BCMA_CORE_CHIPCOMMON, 54, 0 },
+    { BCMA_CORE_80211,      42, 1 },
+    { BCMA_CORE_SDIO_DEV,   21, 1 },
+    { BCMA_CORE_ARM_CR4,    7,  1 },
+};
+
+struct Frame {
+    struct Frame *  f_Next;
+    uint64_t        f_Ready;    // HostMicros after which the host may read the frame
+    ULONG           f_Length;
+    UBYTE           f_Data[];
+};
+
+struct Var {
+    char    v_Name[32];
+    ULONG   v_Length;
+    UBYTE   v_Value[VAR_SIZE];
+};
+
+struct Dongle {
+    struct DongleConfig d_Config;
+    struct DongleStats  d_Stats;
+
+    /* Function 0 and 1 */
+    UBYTE           d_F0[0x300];                // CCCR and FBRs of functions 1 and 2
+    UBYTE           d_F1[0x20];                 // Function 1 registers at 0x10000
+    ULONG           d_Window;
+
+    /* Backplane */
+    ULONG           d_Regs[CORE_COUNT][1024];
+    ULONG           d_Wrap[CORE_COUNT][1024];
+    ULONG           d_EROM[32];
+    ULONG           d_EROMSize;
+    ULONG           d_Vector;
+    ULONG           d_RAMWritten;
+    UBYTE *         d_RAM;
+    BOOL            d_Running;
+
+    /* Firmware */
+    UBYTE           d_EtherAddr[6];
+    ULONG           d_Ioctl[MAX_IOCTLS];
+    struct Var      d_Vars[MAX_VARS];
+    ULONG           d_VarCount;
+    BOOL            d_RXGlomOn;
+
+    /* Host to dongle: F2 writes are collected until the frame is complete */
+    UBYTE           d_TXBuffer[TX_BUFFER_SIZE];
+    ULONG           d_TXLength;
+    UBYTE           d_TXSeq;                    // Sequence number expected next
+    uint64_t        d_Credit[256];              // Release times of TX credits in use, oldest first
+    UBYTE           d_CreditHead;
+    UWORD           d_CreditCount;
+
+    /* Dongle to host: queue of frames by ready time and the frame being read */
+    struct Frame *  d_RXQueue;
+    ULONG           d_RXQueued;
+    UBYTE           d_RXFrame[RX_GLOM_MAX];
+    ULONG           d_RXLength;
+    ULONG           d_RXPos;
+    UBYTE           d_RXSeq;
+    UBYTE           d_MaxSeqSent;               // maxseq of the last frame the host read
+};
+
+/* Scan results carry the SSID IE and supported rates, as beacons do */
+static const UBYTE ScanRates[] = { 0x01, 0x08, 0x82, 0x84, 0x8b, 0x96, 0x0c, 0x12, 0x18, 0x24 };
+
+static const char FirmwareVersion[] = "wl0: Oct 19 2026 00:00:00 version 7.45.241 (host dongle) FWID 01-00000000\n";
+
+/* Backplane */
+
+static ULONG RAMRead32(struct Dongle *d, ULONG address)
+{
+    return GetLE32(&d->d_RAM[address - RAM_BASE]);
+}
+
+static void RAMWrite32(struct Dongle *d, ULONG address, ULONG value)
+{
+    PutLE32(&d->d_RAM[address - RAM_BASE], value);
+}
+
+static void BuildEROM(struct Dongle *d)
+{
+    ULONG n = 0;
+
+    for (int i = 0; i < CORE_COUNT; i++)
+    {
+        ULONG nmw = Cores[i].master ? 1 : 0;
+        ULONG wrapType = Cores[i].master ? DMP_SLAVE_TYPE_MWRAP : DMP_SLAVE_TYPE_SWRAP;
+
+        d->d_EROM[n++] = (Cores[i].id << DMP_COMP_PARTNUM_S) | DMP_DESC_COMPONENT;
+        d->d_EROM[n++] = (Cores[i].rev << DMP_COMP_REVISION_S) | ((1 - nmw) << DMP_COMP_NUM_SWRAP_S) |
+                         (nmw << DMP_COMP_NUM_MWRAP_S) | DMP_DESC_COMPONENT;
+        if (nmw)
+            d->d_EROM[n++] = DMP_DESC_MASTER_PORT;
+        d->d_EROM[n++] = (SI_ENUM_BASE_DEFAULT + i * 0x1000) | (DMP_SLAVE_TYPE_SLAVE << DMP_SLAVE_TYPE_S) |
+                         (DMP_SLAVE_SIZE_4K << DMP_SLAVE_SIZE_TYPE_S) | DMP_DESC_ADDRESS;
+        d->d_EROM[n++] = (WRAP_BASE + i * 0x1000) | (wrapType << DMP_SLAVE_TYPE_S) |
+                         (DMP_SLAVE_SIZE_4K << DMP_SLAVE_SIZE_TYPE_S) | DMP_DESC_ADDRESS;
+    }
+
+    d->d_EROM[n++] = DMP_DESC_EOT;
+    d->d_EROMSize = n;
+}
+
+/*
+    Firmware start: check what the host left in RAM, then put the shared structure with a console ring below
+    NVRAM and its address into the last word of RAM, where the NVRAM length token was.
+*/
+static void Boot(struct Dongle *d)
+{
+    ULONG token = RAMRead32(d, RAM_BASE + RAM_SIZE - 4);
+    ULONG words = token & 0xffff;
+    ULONG shared, console;
+
+    d->d_Running = TRUE;
+    d->d_Stats.ds_Booted++;
+    d->d_Stats.ds_ResetVector = d->d_Vector;
+
+    // The token counts the words of NVRAM in front of it
+    if (words != 0 && (token >> 16) == (~words & 0xffff))
+        d->d_Stats.ds_NVRAMBytes = words * 4 + 4;
+
+    d->d_Stats.ds_FirmwareBytes = d->d_RAMWritten - d->d_Stats.ds_NVRAMBytes;
+
+    shared = (RAM_BASE + RAM_SIZE - d->d_Stats.ds_NVRAMBytes - SHARED_SIZE) & ~0xff;
+    console = shared + 0x40;
+
+    memset(&d->d_RAM[shared - RAM_BASE], 0, SHARED_SIZE);
+    RAMWrite32(d, shared, 3);
+    RAMWrite32(d, shared + 5 * 4, console);
+    RAMWrite32(d, console + 2 * 4, console + 0x40);
+    RAMWrite32(d, console + 3 * 4, CONSOLE_SIZE);
+    RAMWrite32(d, console + 4 * 4, sizeof(FirmwareVersion) - 1);
+    memcpy(&d->d_RAM[console + 0x40 - RAM_BASE], FirmwareVersion, sizeof(FirmwareVersion) - 1);
+    RAMWrite32(d, RAM_BASE + RAM_SIZE - 4, shared);
+}
+
+static void CheckBoot(struct Dongle *d)
+{
+    ULONG ioctl = d->d_Wrap[CORE_CR4][WRAP_IOCTL / 4];
+
+    if (!d->d_Running && d->d_RAMWritten != 0 && d->d_Wrap[CORE_CR4][WRAP_RESET_CTL / 4] == 0 &&
+        (ioctl & (IOCTL_CPUHALT | IOCTL_FGC | IOCTL_CLK)) == IOCTL_CLK)
+    {
+        Boot(d);
+    }
+}
+
+static BOOL RXReady(struct Dongle *d);
+
+static ULONG ReadReg(struct Dongle *d, ULONG address)
+{
+    ULONG offset = address & 0xfff;
+    ULONG index = (address - SI_ENUM_BASE_DEFAULT) >> 12;
+
+    if (address < 4)
+        return d->d_Vector;
+
+    if (address - EROM_BASE < d->d_EROMSize * 4)
+        return d->d_EROM[(address - EROM_BASE) / 4];
+
+    if (address - WRAP_BASE < CORE_COUNT * 0x1000)
+        return d->d_Wrap[(address - WRAP_BASE) >> 12][offset / 4];
+
+    if (index >= CORE_COUNT)
+        return 0;
+
+    switch (index)
+    {
+        case CORE_CC:
+            if (offset == CORE_CC_REG(0, chipid))
+                return CHIP_ID | (CHIP_REV << CID_REV_SHIFT) | (SOCI_AI << CID_TYPE_SHIFT);
+            if (offset == CORE_CC_REG(0, capabilities))
+                return CC_CAP_PMU;
+            if (offset == CORE_CC_REG(0, eromptr))
+                return EROM_BASE;
+            if (offset == CORE_CC_REG(0, pmucapabilities))
+                return PMU_REV;
+            break;
+
+        case CORE_SDIOD:
+            if (offset == SD_REG(intstatus))
+                return d->d_Regs[CORE_SDIOD][offset / 4] | (RXReady(d) ? I_HMB_FRAME_IND : 0);
+            break;
+
+        case CORE_CR4:
+            if (offset == CR4_CAP)
+                return RAM_BANKS;
+            if (offset == CR4_BANKINFO)
+                return d->d_Regs[CORE_CR4][CR4_BANKIDX / 4] < RAM_BANKS ? RAM_BANK_INFO : 0;
+            break;
+    }
+
+    return d->d_Regs[index][offset / 4];
+}
+
+static void WriteReg(struct Dongle *d, ULONG address, ULONG value)
+{
+    ULONG offset = address & 0xfff;
+    ULONG index = (address - SI_ENUM_BASE_DEFAULT) >> 12;
+
+    if (address < 4)
+    {
+        d->d_Vector = value;
+    }
+    else if (address - WRAP_BASE < CORE_COUNT * 0x1000)
+    {
+        d->d_Wrap[(address - WRAP_BASE) >> 12][offset / 4] = value;
+        if ((address - WRAP_BASE) >> 12 == CORE_CR4)
+            CheckBoot(d);
+    }
+    else if (index < CORE_COUNT)
+    {
+        // Interrupt status is write one to clear
+        if (index == CORE_SDIOD && offset == SD_REG(intstatus))
+            d->d_Regs[index][offset / 4] &= ~value;
+        else
+            d->d_Regs[index][offset / 4] = value;
+    }
+}
+
+static void Backplane(struct Dongle *d, BOOL write, ULONG address, UBYTE *data, ULONG length)
+{
+    if (address >= RAM_BASE && address + length <= RAM_BASE + RAM_SIZE)
+    {
+        if (write)
+        {
+            memcpy(&d->d_RAM[address - RAM_BASE], data, length);
+            if (!d->d_Running)
+                d->d_RAMWritten += length;
+        }
+        else
+            memcpy(data, &d->d_RAM[address - RAM_BASE], length);
+
+        return;
+    }
+
+    // Registers are accessed as words, narrower accesses are merged into the word
+    for (ULONG i = 0; i < length; )
+    {
+        ULONG a = (address + i) & ~3;
+        ULONG shift = ((address + i) & 3) * 8;
+        ULONG n = 4 - ((address + i) & 3);
+        UBYTE word[4];
+
+        if (n > length - i)
+            n = length - i;
+
+        PutLE32(word, ReadReg(d, a));
+        if (write)
+        {
+            memcpy(&word[shift / 8], &data[i], n);
+            WriteReg(d, a, GetLE32(word));
+        }
+        else
+            memcpy(&data[i], &word[shift / 8], n);
+
+        i += n;
+    }
+}
+
+/* Dongle to host */
+
+static void Queue(struct Dongle *d, const UBYTE *frame, ULONG length, uint64_t ready)
+{
+    struct Frame *f, **p;
+
+    if (d->d_RXQueued >= RX_QUEUE_MAX || length > RX_FRAME_MAX)
+    {
+        d->d_Stats.ds_Dropped++;
+        return;
+    }
+
+    f = malloc(sizeof(struct Frame) + length);
+    f->f_Ready = ready;
+    f->f_Length = length;
+    memcpy(f->f_Data, frame, length);
+
+    for (p = &d->d_RXQueue; *p != NULL && (*p)->f_Ready <= ready; p = &(*p)->f_Next);
+    f->f_Next = *p;
+    *p = f;
+    d->d_RXQueued++;
+}
+
+/* Sequence number the host may not reach: next expected plus the credits not held by frames in flight */
+static UBYTE MaxSeq(struct Dongle *d, uint64_t now)
+{
+    UWORD window = d->d_Config.dc_TXWindow;
+
+    while (d->d_CreditCount != 0 && d->d_Credit[d->d_CreditHead] <= now)
+    {
+        d->d_CreditHead++;
+        d->d_CreditCount--;
+    }
+
+    return d->d_TXSeq + (window > d->d_CreditCount ? window - d->d_CreditCount : 0);
+}
+
+static BOOL RXReady(struct Dongle *d)
+{
+    return d->d_Running && d->d_RXQueue != NULL && d->d_RXQueue->f_Ready <= HostMicros();
+}
+
+static void Stamp(struct Dongle *d, UBYTE *frame, UBYTE maxSeq)
+{
+    frame[4] = d->d_RXSeq++;
+    frame[8] = d->d_Config.dc_FlowControl;
+    frame[9] = maxSeq;
+
+    if (frame[5] == CHANNEL_DATA)
+    {
+        d->d_Stats.ds_RXFrames++;
+        d->d_Stats.ds_RXBytes += GetLE16(frame) - SDPCM_HEADER_LEN - BDC_HEADER_LEN;
+    }
+    else if (frame[5] == CHANNEL_EVENT)
+        d->d_Stats.ds_Events++;
+}
+
+static struct Frame * TakeReady(struct Dongle *d, uint64_t now, ULONG room)
+{
+    struct Frame *f = d->d_RXQueue;
+
+    if (f == NULL || f->f_Ready > now || ((f->f_Length + 3) & ~3) > room)
+        return NULL;
+
+    d->d_RXQueue = f->f_Next;
+    d->d_RXQueued--;
+
+    return f;
+}
+
+/*
+    Start the next frame for the host. Ready frames are sent one by one, or several in one glom superframe
+    once the host enabled RX glom. With nothing to send, a header only frame reopens a TX window the host
+    saw closed. Returns FALSE if there is nothing at all.
+*/
+static BOOL NextRXFrame(struct Dongle *d)
+{
+    uint64_t now = HostMicros();
+    UBYTE maxSeq = MaxSeq(d, now);
+    struct Frame *f;
+
+    d->d_RXLength = 0;
+    d->d_RXPos = 0;
+
+    if (!d->d_Running)
+        return FALSE;
+
+    if (d->d_RXGlomOn && d->d_Config.dc_RXGlom > 1 && d->d_RXQueue != NULL && d->d_RXQueue->f_Next != NULL &&
+        d->d_RXQueue->f_Next->f_Ready <= now)
+    {
+        ULONG length = SDPCM_HEADER_LEN;
+        ULONG count = 0;
+
+        while (count < d->d_Config.dc_RXGlom && (f = TakeReady(d, now, RX_GLOM_MAX - length)) != NULL)
+        {
+            memcpy(&d->d_RXFrame[length], f->f_Data, f->f_Length);
+            Stamp(d, &d->d_RXFrame[length], maxSeq);
+            memset(&d->d_RXFrame[length + f->f_Length], 0, -f->f_Length & 3);
+            length += (f->f_Length + 3) & ~3;
+            count++;
+            free(f);
+        }
+
+        PutSDPCMHeader(d->d_RXFrame, length, CHANNEL_GLOM, d->d_RXFrame[SDPCM_HEADER_LEN + 4], maxSeq,
+                       d->d_Config.dc_FlowControl);
+        d->d_RXLength = length;
+        d->d_Stats.ds_RXGlom++;
+    }
+    else if ((f = TakeReady(d, now, RX_GLOM_MAX)) != NULL)
+    {
+        memcpy(d->d_RXFrame, f->f_Data, f->f_Length);
+        Stamp(d, d->d_RXFrame, maxSeq);
+        d->d_RXLength = f->f_Length;
+        free(f);
+    }
+    else if (d->d_MaxSeqSent == d->d_TXSeq && maxSeq != d->d_TXSeq)
+    {
+        PutSDPCMHeader(d->d_RXFrame, SDPCM_HEADER_LEN, CHANNEL_EVENT, d->d_RXSeq, maxSeq, d->d_Config.dc_FlowControl);
+        d->d_RXLength = SDPCM_HEADER_LEN;
+        d->d_Stats.ds_Credits++;
+    }
+    else
+        return FALSE;
+
+    d->d_MaxSeqSent = maxSeq;
+
+    return TRUE;
+}
+
+/*
+    F2 read. A read continues the frame in progress or starts the next one, but never runs into a second frame:
+    whatever the host reads past the end of the frame is zero, and the frame is done.
+*/
+static void ReadF2(struct Dongle *d, UBYTE *data, ULONG length)
+{
+    ULONG n = 0;
+
+    if (d->d_RXPos < d->d_RXLength || NextRXFrame(d))
+    {
+        n = d->d_RXLength - d->d_RXPos;
+        if (n > length)
+            n = length;
+
+        memcpy(data, &d->d_RXFrame[d->d_RXPos], n);
+        d->d_RXPos += n;
+
+        if (n < length)
+            d->d_RXPos = d->d_RXLength;
+    }
+
+    memset(&data[n], 0, length - n);
+}
+
+/* Host to dongle: control requests */
+
+static struct Var * FindVar(struct Dongle *d, const char *name, BOOL create)
+{
+    for (ULONG i = 0; i < d->d_VarCount; i++)
+    {
+        if (strcmp(d->d_Vars[i].v_Name, name) == 0)
+            return &d->d_Vars[i];
+    }
+
+    if (!create || d->d_VarCount == MAX_VARS || strlen(name) >= sizeof(d->d_Vars[0].v_Name))
+        return NULL;
+
+    strcpy(d->d_Vars[d->d_VarCount].v_Name, name);
+
+    return &d->d_Vars[d->d_VarCount++];
+}
+
+static void StartEScan(struct Dongle *d, const UBYTE *params, ULONG length)
+{
+    static UBYTE data[CTRL_DATA_MAX], frame[RX_FRAME_MAX];
+    UWORD syncID = length >= 8 ? GetLE16(&params[6]) : 0;
+    uint64_t now = HostMicros();
+    ULONG dataLength, frameLength;
+
+    d->d_Stats.ds_Scans++;
+
+    for (UWORD i = 0; i < d->d_Config.dc_ScanNetworks; i++)
+    {
+        UBYTE bssid[6] = { 0x02, 0x11, 0x22, 0x33, i >> 8, i };
+        UBYTE ie[2 + 32 + sizeof(ScanRates)];
+        char ssid[33];
+        ULONG ssidLength = snprintf(ssid, sizeof(ssid), "dongle%02u", i);
+
+        ie[0] = 0;
+        ie[1] = ssidLength;
+        memcpy(&ie[2], ssid, ssidLength);
+        memcpy(&ie[2 + ssidLength], ScanRates, sizeof(ScanRates));
+
+        dataLength = BuildEScanResult(data, syncID, bssid, ssid, 0x1000 | (1 + i % 13), -40 - (i % 50),
+                                      ie, 2 + ssidLength + sizeof(ScanRates));
+        frameLength = BuildEvent(frame, 0, 0, d->d_EtherAddr, EVENT_ESCAN_RESULT, 8, 0, data, dataLength);
+        Queue(d, frame, frameLength, now + (i + 1) * (uint64_t)d->d_Config.dc_ScanInterval);
+    }
+
+    dataLength = BuildEScanResult(data, syncID, NULL, NULL, 0, 0, NULL, 0);
+    frameLength = BuildEvent(frame, 0, 0, d->d_EtherAddr, EVENT_ESCAN_RESULT, 0, 0, data, dataLength);
+    Queue(d, frame, frameLength, now + (d->d_Config.dc_ScanNetworks + 1) * (uint64_t)d->d_Config.dc_ScanInterval);
+}
+
+static LONG SetVar(struct Dongle *d, const char *name, const UBYTE *value, ULONG length)
+{
+    struct Var *v;
+
+    if (strcmp(name, "clmload") == 0 && length >= 12)
+    {
+        d->d_Stats.ds_CLMBytes += GetLE32(&value[4]);
+        if (GetLE16(&value[0]) & DL_END)
+            d->d_Stats.ds_CLMDone++;
+        return 0;
+    }
+
+    if (strcmp(name, "escan") == 0)
+    {
+        StartEScan(d, value, length);
+        return 0;
+    }
+
+    if (strcmp(name, "cur_etheraddr") == 0 && length >= 6)
+        memcpy(d->d_EtherAddr, value, 6);
+    else if (strcmp(name, "bus:rxglom") == 0 && length >= 4)
+        d->d_RXGlomOn = GetLE32(value) != 0;
+
+    if ((v = FindVar(d, name, TRUE)) != NULL)
+    {
+        v->v_Length = length < VAR_SIZE ? length : VAR_SIZE;
+        memcpy(v->v_Value, value, v->v_Length);
+    }
+
+    return 0;
+}
+
+static LONG GetVar(struct Dongle *d, const char *name, UBYTE *out, ULONG length)
+{
+    struct Var *v;
+
+    if (strcmp(name, "cur_etheraddr") == 0)
+        memcpy(out, d->d_EtherAddr, length < 6 ? length : 6);
+    else if (strcmp(name, "ver") == 0)
+        memcpy(out, FirmwareVersion, length < sizeof(FirmwareVersion) ? length : sizeof(FirmwareVersion));
+    else if (strcmp(name, "scan_ver") == 0 && length >= 6)
+        PutLE16(&out[4], ESCAN_REQ_VERSION_V2);
+    else if ((v = FindVar(d, name, FALSE)) != NULL)
+        memcpy(out, v->v_Value, length < v->v_Length ? length : v->v_Length);
+    else
+        return BCME_UNSUPPORTED;
+
+    return 0;
+}
+
+static void Control(struct Dongle *d, const UBYTE *c, ULONG length)
+{
+    static UBYTE reply[CTRL_DATA_MAX], frame[RX_FRAME_MAX];
+    ULONG command, dataLength, frameLength;
+    UWORD flags, id;
+    LONG status = 0;
+
+    if (length < BCDC_HEADER_LEN)
+    {
+        d->d_Stats.ds_FrameErrors++;
+        return;
+    }
+
+    command = GetLE32(&c[0]);
+    dataLength = GetLE32(&c[4]);
+    flags = GetLE16(&c[8]);
+    id = GetLE16(&c[10]);
+
+    if (dataLength > length - BCDC_HEADER_LEN)
+        dataLength = length - BCDC_HEADER_LEN;
+    if (dataLength > CTRL_DATA_MAX)
+        dataLength = CTRL_DATA_MAX;
+
+    memcpy(reply, &c[BCDC_HEADER_LEN], dataLength);
+
+    if (command == BRCMF_C_GET_VAR || command == BRCMF_C_SET_VAR)
+    {
+        char name[64];
+        ULONG nameLength = strnlen((const char *)reply, dataLength);
+
+        if (nameLength >= sizeof(name))
+            nameLength = sizeof(name) - 1;
+        memcpy(name, reply, nameLength);
+        name[nameLength] = 0;
+
+        if (flags & BCDC_FLAG_SET)
+            status = SetVar(d, name, &reply[nameLength + 1], dataLength > nameLength ? dataLength - nameLength - 1 : 0);
+        else
+        {
+            memset(reply, 0, dataLength);
+            status = GetVar(d, name, reply, dataLength);
+        }
+    }
+    else if (command < MAX_IOCTLS)
+    {
+        if (flags & BCDC_FLAG_SET)
+            d->d_Ioctl[command] = dataLength >= 4 ? GetLE32(reply) : 0;
+        else if (dataLength >= 4)
+            PutLE32(reply, command == BRCMF_C_GET_VERSION ? BRCMU_D11AC_IOTYPE : d->d_Ioctl[command]);
+    }
+    else
+        status = BCME_UNSUPPORTED;
+
+    if (status != 0)
+    {
+        flags |= BCDC_FLAG_ERROR;
+        d->d_Stats.ds_CtrlErrors++;
+    }
+
+    frameLength = BuildCtrlReply(frame, 0, 0, command, flags, id, status, reply, dataLength);
+    Queue(d, frame, frameLength, HostMicros() + d->d_Config.dc_CtrlLatency);
+    d->d_Stats.ds_Ctrl++;
+}
+
+/* Host to dongle: data frames take a credit until the firmware sent them */
+
+static void Data(struct Dongle *d, const UBYTE *frame, ULONG length)
+{
+    static UBYTE echo[RX_FRAME_MAX], pkt[RX_FRAME_MAX];
+    uint64_t done = HostMicros() + d->d_Config.dc_DataLatency;
+
+    d->d_Stats.ds_TXFrames++;
+    d->d_Stats.ds_TXBytes += length;
+
+    if (d->d_CreditCount < 256)
+        d->d_Credit[(UBYTE)(d->d_CreditHead + d->d_CreditCount++)] = done;
+
+    if (d->d_Config.dc_Echo && length >= 14 && length + SDPCM_HEADER_LEN + BDC_HEADER_LEN <= RX_FRAME_MAX)
+    {
+        memcpy(&echo[0], &frame[6], 6);
+        memcpy(&echo[6], &frame[0], 6);
+        memcpy(&echo[12], &frame[12], length - 12);
+        Queue(d, pkt, BuildDataFrame(pkt, 0, 0, echo, length), done);
+    }
+}
+
+/* One SDPCM frame of the host, sw is the offset of its software header */
+static void ProcessTXItem(struct Dongle *d, const UBYTE *item, ULONG sw, ULONG length)
+{
+    UBYTE seq = item[sw];
+    UBYTE channel = item[sw + 1] & 0x0f;
+    UBYTE offset = item[sw + 3];
+
+    if (offset < sw + 8 || offset > length)
+    {
+        d->d_Stats.ds_FrameErrors++;
+        return;
+    }
+
+    if (seq != d->d_TXSeq)
+        d->d_Stats.ds_SeqErrors++;
+
+    if (channel == CHANNEL_DATA)
+    {
+        UBYTE ahead = d->d_MaxSeqSent - seq;
+
+        if (ahead == 0 || ahead > 128)
+            d->d_Stats.ds_WindowErrors++;
+    }
+
+    d->d_TXSeq = seq + 1;
+
+    switch (channel)
+    {
+        case CHANNEL_CONTROL:
+            Control(d, &item[offset], length - offset);
+            break;
+
+        case CHANNEL_DATA:
+            if (length - offset < BDC_HEADER_LEN)
+                d->d_Stats.ds_FrameErrors++;
+            else
+                Data(d, &item[offset + BDC_HEADER_LEN], length - offset - BDC_HEADER_LEN);
+            break;
+
+        default:
+            d->d_Stats.ds_FrameErrors++;
+            break;
+    }
+}
+
+/*
+    Complete F2 write of the host. A data offset below the header size means the frame carries TX glom
+    headers (the byte is then gh_LastItem), items follow each other 4 byte aligned up to the last one.
+*/
+static void ProcessTX(struct Dongle *d, const UBYTE *buf, ULONG length)
+{
+    if (buf[7] >= SDPCM_HEADER_LEN)
+    {
+        ProcessTXItem(d, buf, 4, length);
+        return;
+    }
+
+    d->d_Stats.ds_TXGlom++;
+
+    for (ULONG pos = 0; ; )
+    {
+        const UBYTE *item = &buf[pos];
+        ULONG itemLength;
+
+        if (pos + SDPCM_HEADER_LEN + SDPCM_GLOM_HEADER_LEN > length ||
+            (itemLength = GetLE16(&item[4]) + 4) < SDPCM_HEADER_LEN + SDPCM_GLOM_HEADER_LEN ||
+            pos + itemLength > length)
+        {
+            d->d_Stats.ds_FrameErrors++;
+            return;
+        }
+
+        ProcessTXItem(d, item, 4 + SDPCM_GLOM_HEADER_LEN, itemLength);
+
+        if (item[7])
+            return;
+
+        pos += (itemLength + 3) & ~3;
+    }
+}
+
+static void WriteF2(struct Dongle *d, const UBYTE *data, ULONG length)
+{
+    ULONG frameLength;
+
+    if (d->d_TXLength + length > TX_BUFFER_SIZE)
+    {
+        d->d_Stats.ds_FrameErrors++;
+        d->d_TXLength = 0;
+        return;
+    }
+
+    memcpy(&d->d_TXBuffer[d->d_TXLength], data, length);
+    d->d_TXLength += length;
+
+    if (d->d_TXLength < 4)
+        return;
+
+    frameLength = GetLE16(d->d_TXBuffer);
+
+    if ((frameLength ^ GetLE16(&d->d_TXBuffer[2])) != 0xffff || frameLength < SDPCM_HEADER_LEN)
+    {
+        d->d_Stats.ds_FrameErrors++;
+        d->d_TXLength = 0;
+        return;
+    }
+
+    if (d->d_TXLength >= ((frameLength + 3) & ~3))
+    {
+        ProcessTX(d, d->d_TXBuffer, frameLength);
+        d->d_TXLength = 0;
+    }
+}
+
+/* SD commands */
+
+BOOL DongleCMD52(struct Dongle *d, BOOL write, UBYTE function, ULONG address, UBYTE *value)
+{
+    d->d_Stats.ds_CMD52++;
+
+    if (function == SD_FUNC_CIA)
+    {
+        if (address >= sizeof(d->d_F0))
+            return FALSE;
+
+        if (write)
+            d->d_F0[address] = *value;
+        else if (address == BUS_IORDY_REG)
+            *value = d->d_F0[BUS_IOEN_REG] & ((1 << SD_FUNC_BAK) | (d->d_Running ? 1 << SD_FUNC_RAD : 0));
+        else
+            *value = d->d_F0[address];
+
+        return TRUE;
+    }
+
+    if (function != SD_FUNC_BAK)
+        return FALSE;
+
+    if (address < 0x10000)
+    {
+        Backplane(d, write, d->d_Window | (address & SBSDIO_SB_OFT_ADDR_MASK), value, 1);
+        return TRUE;
+    }
+
+    address -= 0x10000;
+    if (address >= sizeof(d->d_F1))
+        return FALSE;
+
+    if (write)
+    {
+        d->d_F1[address] = *value;
+
+        if (address + 0x10000 == SBSDIO_FUNC1_CHIPCLKCSR)
+            d->d_F1[address] &= ~SBSDIO_AVBITS;
+        else if (address + 0x10000 >= SBSDIO_FUNC1_SBADDRLOW && address + 0x10000 <= SBSDIO_FUNC1_SBADDRHIGH)
+        {
+            d->d_Window = (d->d_F1[SBSDIO_FUNC1_SBADDRLOW - 0x10000] << 8 |
+                           d->d_F1[SBSDIO_FUNC1_SBADDRMID - 0x10000] << 16 |
+                           d->d_F1[SBSDIO_FUNC1_SBADDRHIGH - 0x10000] << 24) & ~SBSDIO_SB_OFT_ADDR_MASK;
+        }
+    }
+    else if (address + 0x10000 == SBSDIO_FUNC1_CHIPCLKCSR)
+        *value = d->d_F1[address] | SBSDIO_AVBITS;
+    else
+        *value = d->d_F1[address];
+
+    return TRUE;
+}
+
+BOOL DongleCMD53(struct Dongle *d, BOOL write, UBYTE function, ULONG address, BOOL incr, UBYTE *data, ULONG length)
+{
+    d->d_Stats.ds_CMD53++;
+
+    if (function == SD_FUNC_RAD)
+    {
+        if (!d->d_Running || !(d->d_F0[BUS_IOEN_REG] & (1 << SD_FUNC_RAD)))
+            return FALSE;
+
+        if (write)
+            WriteF2(d, data, length);
+        else
+            ReadF2(d, data, length);
+
+        return TRUE;
+    }
+
+    if (function != SD_FUNC_BAK)
+        return FALSE;
+
+    if (address >= 0x10000 || !incr)
+    {
+        for (ULONG i = 0; i < length; i++)
+        {
+            if (!DongleCMD52(d, write, function, address + (incr ? i : 0), &data[i]))
+                return FALSE;
+        }
+        return TRUE;
+    }
+
+    Backplane(d, write, d->d_Window | (address & SBSDIO_SB_OFT_ADDR_MASK), data, length);
+
+    return TRUE;
+}
+
+/* Dongle */
+
+struct Dongle * DongleCreate(const struct DongleConfig *config)
+{
+    static const struct DongleConfig defaults = {
+        .dc_CtrlLatency = 200,
+        .dc_DataLatency = 100,
+        .dc_ScanInterval = 2000,
+        .dc_ScanNetworks = 8,
+        .dc_TXWindow = 16,
+        .dc_RXGlom = 8,
+        .dc_FlowControl = 0,
+        .dc_Echo = 1,
+    };
+    static const UBYTE etherAddr[6] = { 0xdc, 0xa6, 0x32, 0x00, 0x00, 0x01 };
+    struct Dongle *d = calloc(1, sizeof(struct Dongle));
+
+    d->d_Config = config ? *config : defaults;
+    d->d_RAM = calloc(1, RAM_SIZE);
+    memcpy(d->d_EtherAddr, etherAddr, 6);
+
+    for (int i = 0; i < CORE_COUNT; i++)
+        d->d_Wrap[i][WRAP_IOCTL / 4] = IOCTL_CLK;
+
+    BuildEROM(d);
+
+    return d;
+}
+
+void DongleDelete(struct Dongle *d)
+{
+    struct Frame *f;
+
+    while ((f = d->d_RXQueue) != NULL)
+    {
+        d->d_RXQueue = f->f_Next;
+        free(f);
+    }
+
+    free(d->d_RAM);
+    free(d);
+}
+
+struct DongleConfig * DongleConfig(struct Dongle *d)
+{
+    return &d->d_Config;
+}
+
+struct DongleStats * DongleStats(struct Dongle *d)
+{
+    return &d->d_Stats;
+}
+
+const UBYTE * DongleMemory(struct Dongle *d, ULONG address, ULONG length)
+{
+    if (address < RAM_BASE || address + length > RAM_BASE + RAM_SIZE)
+        return NULL;
+
+    return &d->d_RAM[address - RAM_BASE];
+}
+
+void DongleGenerate(struct Dongle *d, ULONG count, ULONG length, const UBYTE *peer)
+{
+    static UBYTE frame[RX_FRAME_MAX], pkt[RX_FRAME_MAX];
+    uint64_t now = HostMicros();
+
+    if (length + SDPCM_HEADER_LEN + BDC_HEADER_LEN > RX_FRAME_MAX)
+        return;
+
+    BuildEtherFrame(frame, length, d->d_EtherAddr, peer, 0x0800);
+
+    for (ULONG i = 0; i < count; i++)
+        Queue(d, pkt, BuildDataFrame(pkt, 0, 0, frame, length), now);
+}
+
+/* SDIO operations, with the arithmetic of sdio.c */
+
+struct DongleSDIO {
+    struct SDIO     ds_SDIO;
+    struct Dongle * ds_Dongle;
+};
+
+#define DONGLE(sdio) (((struct DongleSDIO *)(sdio))->ds_Dongle)
+
+static void Done(struct SDIO *sdio, BOOL success)
+{
+    sdio->s_LastCMDSuccess = success;
+    sdio->s_LastError = success ? 0 : SD_ERR_MASK_CMD_TIMEOUT;
+}
+
+static int DongleIsError(struct SDIO *sdio)
+{
+    return FAIL(sdio);
+}
+
+static UBYTE DongleReadByte(UBYTE function, ULONG address, struct SDIO *sdio)
+{
+    UBYTE value = 0;
+
+    sdio->s_Cmd52Count++;
+    Done(sdio, DongleCMD52(DONGLE(sdio), FALSE, function & 7, address & 0x1ffff, &value));
+
+    return value;
+}
+
+static void DongleWriteByte(UBYTE function, ULONG address, UBYTE value, struct SDIO *sdio)
+{
+    sdio->s_Cmd52Count++;
+    Done(sdio, DongleCMD52(DONGLE(sdio), TRUE, function & 7, address & 0x1ffff, &value));
+}
+
+static void DongleWrite(UBYTE function, ULONG address, void *data, ULONG length, struct SDIO *sdio)
+{
+    sdio->s_Cmd53Count++;
+    Done(sdio, DongleCMD53(DONGLE(sdio), TRUE, function & 7, address & 0x1ffff, TRUE, data, length & 0x1ff));
+}
+
+static void DongleRead(UBYTE function, ULONG address, void *data, ULONG length, struct SDIO *sdio)
+{
+    sdio->s_Cmd53Count++;
+    Done(sdio, DongleCMD53(DONGLE(sdio), FALSE, function & 7, address & 0x1ffff, TRUE, data, length & 0x1ff));
+}
+
+static ULONG DongleBackplaneAddr(ULONG addr, struct SDIO *sdio)
+{
+    ULONG window = addr & ~SBSDIO_SB_OFT_ADDR_MASK;
+
+    if (window != sdio->s_LastBackplaneWindow)
+    {
+        sdio->s_LastBackplaneWindow = window;
+        window >>= 8;
+
+        DongleWriteByte(SD_FUNC_BAK, SBSDIO_FUNC1_SBADDRLOW, window, sdio);
+        DongleWriteByte(SD_FUNC_BAK, SBSDIO_FUNC1_SBADDRMID, window >> 8, sdio);
+        DongleWriteByte(SD_FUNC_BAK, SBSDIO_FUNC1_SBADDRHIGH, window >> 16, sdio);
+    }
+
+    return addr & SBSDIO_SB_OFT_ADDR_MASK;
+}
+
+static void DongleWrite32(ULONG address, ULONG data, struct SDIO *sdio)
+{
+    struct ExecBase *SysBase = sdio->s_SysBase;
+    UBYTE bytes[4];
+
+    PutLE32(bytes, data);
+
+    S_LOCK(sdio);
+    address = DongleBackplaneAddr(address, sdio);
+    DongleWrite(SD_FUNC_BAK, address | SBSDIO_SB_ACCESS_2_4B_FLAG, bytes, 4, sdio);
+    S_UNLOCK(sdio);
+}
+
+static ULONG DongleRead32(ULONG address, struct SDIO *sdio)
+{
+    struct ExecBase *SysBase = sdio->s_SysBase;
+    UBYTE bytes[4];
+
+    S_LOCK(sdio);
+    address = DongleBackplaneAddr(address, sdio);
+    DongleRead(SD_FUNC_BAK, address | SBSDIO_SB_ACCESS_2_4B_FLAG, bytes, 4, sdio);
+    S_UNLOCK(sdio);
+
+    return GetLE32(bytes);
+}
+
+static int DongleBackplaneWrite(ULONG address, const void *data, ULONG length, struct SDIO *sdio)
+{
+    struct ExecBase *SysBase = sdio->s_SysBase;
+    const UBYTE *src = data;
+    int success = 1;
+
+    length = (length + 3) & ~3;
+
+    S_LOCK(sdio);
+
+    while (length != 0 && success)
+    {
+        ULONG offset = address & SBSDIO_SB_OFT_ADDR_MASK;
+        ULONG chunk = SBSDIO_SB_OFT_ADDR_LIMIT - offset;
+
+        if (chunk > length)
+            chunk = length;
+
+        DongleBackplaneAddr(address, sdio);
+
+        while (chunk != 0 && success)
+        {
+            ULONG blocks = chunk / SDIO_BLOCK_SIZE_BAK;
+            ULONG sz;
+
+            if (blocks > SDIO_MAX_BLOCK_COUNT)
+                blocks = SDIO_MAX_BLOCK_COUNT;
+
+            sz = blocks ? blocks * SDIO_BLOCK_SIZE_BAK : chunk;
+
+            sdio->s_Cmd53Count++;
+            Done(sdio, DongleCMD53(DONGLE(sdio), TRUE, SD_FUNC_BAK, (offset | SBSDIO_SB_ACCESS_2_4B_FLAG) & 0x1ffff,
+                                   TRUE, (UBYTE *)src, sz));
+            if (FAIL(sdio))
+                success = 0;
+
+            src += sz;
+            offset += sz;
+            address += sz;
+            chunk -= sz;
+            length -= sz;
+        }
+    }
+
+    S_UNLOCK(sdio);
+
+    return success;
+}
+
+/*
+    Clock control of sdio.c only tracks the state, both the HT request and the SD clock end up in CLK_SDONLY
+    when turned on and CLK_NONE when turned off. The dongle has its clocks always available.
+*/
+static int DongleClkCTRL(UBYTE target, UBYTE pendingOK, struct SDIO *sdio)
+{
+    (void)pendingOK;
+
+    if (sdio->s_ClkState == target)
+        return 1;
+
+    switch (target)
+    {
+        case CLK_AVAIL:
+            sdio->s_ClkState = CLK_SDONLY;
+            break;
+
+        case CLK_SDONLY:
+            sdio->s_ClkState = sdio->s_ClkState == CLK_AVAIL ? CLK_NONE : CLK_SDONLY;
+            break;
+
+        case CLK_NONE:
+            sdio->s_ClkState = CLK_NONE;
+            break;
+    }
+
+    return 1;
+}
+
+static void DongleF2(BOOL write, UBYTE *pkt, ULONG length, struct SDIO *sdio)
+{
+    struct ExecBase *SysBase = sdio->s_SysBase;
+    ULONG blocks, reminder;
+
+    length = (length + 3) & ~3;
+    blocks = length / SDIO_BLOCK_SIZE_RAD;
+    reminder = length % SDIO_BLOCK_SIZE_RAD;
+
+    S_LOCK(sdio);
+
+    if (blocks)
+    {
+        sdio->s_Cmd53Count++;
+        Done(sdio, DongleCMD53(DONGLE(sdio), write, SD_FUNC_RAD, 0, TRUE, pkt, blocks * SDIO_BLOCK_SIZE_RAD));
+        pkt += blocks * SDIO_BLOCK_SIZE_RAD;
+    }
+
+    if (reminder)
+    {
+        sdio->s_Cmd53Count++;
+        Done(sdio, DongleCMD53(DONGLE(sdio), write, SD_FUNC_RAD, 0, TRUE, pkt, reminder));
+    }
+
+    S_UNLOCK(sdio);
+}
+
+static void DongleSendPKT(UBYTE *pkt, ULONG length, struct SDIO *sdio)
+{
+    DongleF2(TRUE, pkt, length, sdio);
+}
+
+static void DongleRecvPKT(UBYTE *pkt, ULONG length, struct SDIO *sdio)
+{
+    DongleF2(FALSE, pkt, length, sdio);
+}
+
+static ULONG DongleGetIntStatus(struct SDIO *sdio)
+{
+    ULONG addr = sdio->s_SDIOC->c_BaseAddress + SD_REG(intstatus);
+    ULONG ints = DongleRead32(addr, sdio);
+
+    DongleWrite32(addr, ints, sdio);
+
+    return ints;
+}
+
+static void DongleDumpTrace(ULONG count, struct SDIO *sdio)
+{
+    (void)count;
+    (void)sdio;
+}
+
+struct SDIO * DongleSDIO(struct Dongle *dongle, struct WiFiBase *WiFiBase)
+{
+    struct ExecBase *SysBase = WiFiBase->w_SysBase;
+    struct DongleSDIO *ds = AllocPooledClear(WiFiBase->w_MemPool, sizeof(struct DongleSDIO));
+    struct SDIO *sdio = &ds->ds_SDIO;
+
+    ds->ds_Dongle = dongle;
+
+    InitSemaphore(&sdio->s_Lock);
+
+    sdio->IsError = DongleIsError;
+    sdio->BackplaneAddr = DongleBackplaneAddr;
+    sdio->WriteByte = DongleWriteByte;
+    sdio->ReadByte = DongleReadByte;
+    sdio->Write = DongleWrite;
+    sdio->Read = DongleRead;
+    sdio->Write32 = DongleWrite32;
+    sdio->Read32 = DongleRead32;
+    sdio->BackplaneWrite = DongleBackplaneWrite;
+    sdio->ClkCTRL = DongleClkCTRL;
+    sdio->SendPKT = DongleSendPKT;
+    sdio->RecvPKT = DongleRecvPKT;
+    sdio->GetIntStatus = DongleGetIntStatus;
+    sdio->DumpTrace = DongleDumpTrace;
+
+    sdio->s_WiFiBase = WiFiBase;
+    sdio->s_SysBase = SysBase;
+    sdio->s_LastCMDSuccess = 1;
+
+    sdio->s_TXBuffer = AllocPooled(WiFiBase->w_MemPool, 65536);
+    sdio->s_RXBuffer = AllocPooled(WiFiBase->w_MemPool, 65536);
+
+    return sdio;
+}
@@ -0,0 +1,79 @@
+#ifndef _DONGLE_H
+#define _DONGLE_H
+
+#include <exec/types.h>
+
+/*
+    Software model of the BCM4345 card as the driver sees it over SDIO: CCCR of function 0, the function 1
+    registers and backplane window, and the firmware behind function 2. It takes firmware and NVRAM through
+    the backplane, boots once the ARM core is released from reset, answers iovars and ioctls, reports escan
+    results and echoes or generates data frames.
+
+    The model has no thread of its own, it acts when the host issues a command. Everything timed (replies,
+    echoed frames, scan results, TX credits) becomes visible to F2 reads once its HostMicros deadline passed.
+*/
+
+struct SDIO;
+struct WiFiBase;
+struct Dongle;
+
+struct DongleConfig {
+    ULONG   dc_CtrlLatency;     // us between control request and its reply
+    ULONG   dc_DataLatency;     // us a data frame takes the firmware to send, its TX credit is held meanwhile
+    ULONG   dc_ScanInterval;    // us between consecutive escan results
+    UWORD   dc_ScanNetworks;    // networks reported by every escan
+    UBYTE   dc_TXWindow;        // frames the host may have in flight, maxseq is advertised from it
+    UBYTE   dc_RXGlom;          // most frames put into one RX glom superframe, 0 or 1 sends them one by one
+    UBYTE   dc_FlowControl;     // flow control bits sent in every frame header
+    UBYTE   dc_Echo;            // data frames of the host are sent back with addresses swapped
+};
+
+struct DongleStats {
+    ULONG   ds_Booted;          // firmware was started by the host
+    ULONG   ds_ResetVector;     // word written to address 0 before the start
+    ULONG   ds_FirmwareBytes;   // bytes written to RAM below NVRAM
+    ULONG   ds_NVRAMBytes;      // NVRAM size with its length token, 0 if the token was not found
+    ULONG   ds_CLMBytes;        // CLM payload received through clmload
+    ULONG   ds_CLMDone;         // clmload chunk with DL_END flag seen
+    ULONG   ds_CMD52;
+    ULONG   ds_CMD53;
+    ULONG   ds_Ctrl;            // control requests answered
+    ULONG   ds_CtrlErrors;      // control requests answered with an error
+    ULONG   ds_Events;          // events sent
+    ULONG   ds_Scans;           // escans started
+    ULONG   ds_TXFrames;        // data frames received from the host
+    ULONG   ds_TXBytes;         // ethernet bytes of these frames
+    ULONG   ds_TXGlom;          // F2 writes carrying TX glom headers
+    ULONG   ds_RXFrames;        // data frames sent to the host
+    ULONG   ds_RXBytes;
+    ULONG   ds_RXGlom;          // glom superframes sent
+    ULONG   ds_Credits;         // header only frames sent to reopen the TX window
+    ULONG   ds_SeqErrors;       // frames of the host out of sequence
+    ULONG   ds_WindowErrors;    // data frames of the host beyond the advertised maxseq
+    ULONG   ds_FrameErrors;     // F2 writes with broken length, checksum or glom chain
+    ULONG   ds_Dropped;         // frames not queued to the host since the queue was full
+};
+
+struct Dongle * DongleCreate(const struct DongleConfig *config);
+void            DongleDelete(struct Dongle *dongle);
+struct DongleConfig * DongleConfig(struct Dongle *dongle);
+struct DongleStats * DongleStats(struct Dongle *dongle);
+
+/* Chip RAM as the backplane sees it, NULL if the range is not within RAM */
+const UBYTE *   DongleMemory(struct Dongle *dongle, ULONG address, ULONG length);
+
+/* Queue count data frames of given length from a peer to the host */
+void            DongleGenerate(struct Dongle *dongle, ULONG count, ULONG length, const UBYTE *peer);
+
+/*
+    Card side of the SD commands. CMD52 returns the byte read, or written. CMD53 moves length bytes from or
+    to data, incrementing the address if incr is set. Both return FALSE if the card would not respond.
+*/
+BOOL            DongleCMD52(struct Dongle *dongle, BOOL write, UBYTE function, ULONG address, UBYTE *value);
+BOOL            DongleCMD53(struct Dongle *dongle, BOOL write, UBYTE function, ULONG address, BOOL incr,
+                            UBYTE *data, ULONG length);
+
+/* SDIO of the driver with all of its operations done by the dongle, in place of sdio_init */
+struct SDIO *   DongleSDIO(struct Dongle *dongle, struct WiFiBase *WiFiBase);
+
+#endif /* _DONGLE_H */
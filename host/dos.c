@@ -0,0 +1,498 @@
+/*
+    dos.library, utility.library and devicetree.resource of the host build. Only what the driver uses:
+    files are read from host directories assigned to Amiga volumes, variables and device tree are set
+    up by the harness before the driver starts.
+*/
+
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <exec/types.h>
+#include <exec/memory.h>
+#include <dos/dos.h>
+#include <dos/dostags.h>
+#include <dos/dosextens.h>
+#include <clib/exec_protos.h>
+#include <clib/dos_protos.h>
+#include <clib/utility_protos.h>
+#include <clib/devicetree_protos.h>
+
+#include "host.h"
+
+#define MAX_FILES   32
+#define MAX_ASSIGNS 8
+#define MAX_VARS    16
+
+static struct Library *HostDOSBase;
+static struct Library *HostUtilityBase;
+static LONG LastError;
+
+/* dos.library */
+
+static FILE *Files[MAX_FILES];
+
+static struct {
+    char    a_Volume[32];
+    char    a_Directory[1024];
+} Assigns[MAX_ASSIGNS];
+
+static struct {
+    char    v_Name[64];
+    char    v_Value[256];
+} Vars[MAX_VARS];
+
+void HostAssign(const char *volume, const char *directory)
+{
+    for (int i = 0; i < MAX_ASSIGNS; i++)
+    {
+        if (Assigns[i].a_Volume[0] == 0 || strcasecmp(Assigns[i].a_Volume, volume) == 0)
+        {
+            snprintf(Assigns[i].a_Volume, sizeof(Assigns[i].a_Volume), "%s", volume);
+            snprintf(Assigns[i].a_Directory, sizeof(Assigns[i].a_Directory), "%s", directory);
+            return;
+        }
+    }
+}
+
+void HostSetVar(const char *name, const char *value)
+{
+    for (int i = 0; i < MAX_VARS; i++)
+    {
+        if (Vars[i].v_Name[0] == 0 || strcasecmp(Vars[i].v_Name, name) == 0)
+        {
+            snprintf(Vars[i].v_Name, sizeof(Vars[i].v_Name), "%s", name);
+            snprintf(Vars[i].v_Value, sizeof(Vars[i].v_Value), "%s", value);
+            return;
+        }
+    }
+}
+
+/* VOLUME:path/file to host path. Volumes without assign are not there */
+static BOOL HostPath(CONST_STRPTR name, char *path, size_t size)
+{
+    const char *colon = strchr((const char *)name, ':');
+
+    if (colon == NULL)
+    {
+        snprintf(path, size, "%s", (const char *)name);
+        return TRUE;
+    }
+
+    for (int i = 0; i < MAX_ASSIGNS && Assigns[i].a_Volume[0]; i++)
+    {
+        if (strlen(Assigns[i].a_Volume) == (size_t)(colon - (const char *)name) &&
+            strncasecmp(Assigns[i].a_Volume, (const char *)name, colon - (const char *)name) == 0)
+        {
+            snprintf(path, size, "%s/%s", Assigns[i].a_Directory, colon + 1);
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+BPTR Dos_Open(struct Library *DOSBase, CONST_STRPTR name, LONG accessMode)
+{
+    char path[1280];
+    FILE *f = NULL;
+    (void)DOSBase;
+
+    if (HostPath(name, path, sizeof(path)))
+    {
+        switch (accessMode)
+        {
+            case MODE_OLDFILE:      f = fopen(path, "rb"); break;
+            case MODE_NEWFILE:      f = fopen(path, "w+b"); break;
+            case MODE_READWRITE:    f = fopen(path, "r+b"); if (!f) f = fopen(path, "w+b"); break;
+        }
+    }
+
+    if (f == NULL)
+    {
+        LastError = ERROR_OBJECT_NOT_FOUND;
+        return 0;
+    }
+
+    for (int i = 0; i < MAX_FILES; i++)
+    {
+        if (Files[i] == NULL)
+        {
+            Files[i] = f;
+            return i + 1;
+        }
+    }
+
+    fclose(f);
+    return 0;
+}
+
+LONG Dos_Close(struct Library *DOSBase, BPTR file)
+{
+    (void)DOSBase;
+
+    if (file <= 0 || file > MAX_FILES || Files[file - 1] == NULL)
+        return DOSFALSE;
+
+    fclose(Files[file - 1]);
+    Files[file - 1] = NULL;
+
+    return DOSTRUE;
+}
+
+LONG Dos_Read(struct Library *DOSBase, BPTR file, APTR buffer, LONG length)
+{
+    (void)DOSBase;
+
+    return fread(buffer, 1, length, Files[file - 1]);
+}
+
+LONG Dos_Write(struct Library *DOSBase, BPTR file, CONST_APTR buffer, LONG length)
+{
+    (void)DOSBase;
+
+    return fwrite(buffer, 1, length, Files[file - 1]);
+}
+
+/* Returns position before the seek, like AmigaDOS does */
+LONG Dos_Seek(struct Library *DOSBase, BPTR file, LONG position, LONG offset)
+{
+    FILE *f = Files[file - 1];
+    LONG old = ftell(f);
+    int whence = offset == OFFSET_BEGINNING ? SEEK_SET : offset == OFFSET_END ? SEEK_END : SEEK_CUR;
+    (void)DOSBase;
+
+    if (fseek(f, position, whence) != 0)
+        return -1;
+
+    return old;
+}
+
+BOOL Dos_AddPart(struct Library *DOSBase, STRPTR dirname, CONST_STRPTR filename, ULONG size)
+{
+    size_t len = strlen((char *)dirname);
+    (void)DOSBase;
+
+    /* Absolute name replaces the directory */
+    if (strchr((const char *)filename, ':'))
+        len = 0;
+    else if (len > 0 && dirname[len - 1] != ':' && dirname[len - 1] != '/')
+    {
+        if (len + 1 >= size)
+            return DOSFALSE;
+        dirname[len++] = '/';
+    }
+
+    if (len + strlen((const char *)filename) + 1 > size)
+        return DOSFALSE;
+
+    strcpy((char *)dirname + len, (const char *)filename);
+
+    return DOSTRUE;
+}
+
+STRPTR Dos_FilePart(struct Library *DOSBase, CONST_STRPTR path)
+{
+    const char *p = (const char *)path;
+    const char *sep = strrchr(p, '/');
+    (void)DOSBase;
+
+    if (sep == NULL)
+        sep = strrchr(p, ':');
+
+    return (STRPTR)(sep ? sep + 1 : p);
+}
+
+void Dos_Delay(struct Library *DOSBase, LONG timeout)
+{
+    (void)DOSBase;
+
+    HostSleep(timeout * (1000000 / TICKS_PER_SECOND));
+}
+
+LONG Dos_GetVar(struct Library *DOSBase, CONST_STRPTR name, STRPTR buffer, LONG size, LONG flags)
+{
+    (void)DOSBase;
+    (void)flags;
+
+    for (int i = 0; i < MAX_VARS && Vars[i].v_Name[0]; i++)
+    {
+        if (strcasecmp(Vars[i].v_Name, (const char *)name) == 0)
+        {
+            snprintf((char *)buffer, size, "%s", Vars[i].v_Value);
+            return strlen((char *)buffer);
+        }
+    }
+
+    LastError = ERROR_OBJECT_NOT_FOUND;
+    return -1;
+}
+
+LONG Dos_IoErr(struct Library *DOSBase)
+{
+    (void)DOSBase;
+
+    return LastError;
+}
+
+struct Process * Dos_CreateNewProc(struct Library *DOSBase, const struct TagItem *tags)
+{
+    struct ExecBase *SysBase = HostSysBase;
+    struct Process *proc = Exec_AllocMem(SysBase, sizeof(struct Process), MEMF_PUBLIC | MEMF_CLEAR);
+    struct MemList *ml = Exec_AllocMem(SysBase, sizeof(struct MemList), MEMF_PUBLIC | MEMF_CLEAR);
+    APTR entry = (APTR)(uintptr_t)Utility_GetTagData(HostUtilityBase, NP_Entry, 0, tags);
+    (void)DOSBase;
+
+    if (entry == NULL)
+    {
+        HostFree(proc);
+        HostFree(ml);
+        return NULL;
+    }
+
+    proc->pr_Task.tc_Node.ln_Type = NT_PROCESS;
+    proc->pr_Task.tc_Node.ln_Name = (char *)(uintptr_t)Utility_GetTagData(HostUtilityBase, NP_Name, (ULONG)(uintptr_t)"New Process", tags);
+    proc->pr_Task.tc_Node.ln_Pri = Utility_GetTagData(HostUtilityBase, NP_Priority, 0, tags);
+    proc->pr_StackSize = Utility_GetTagData(HostUtilityBase, NP_StackSize, 4096, tags);
+
+    ml->ml_NumEntries = 1;
+    ml->ml_ME[0].me_Addr = proc;
+    Exec_NewMinList(SysBase, (struct MinList *)&proc->pr_Task.tc_MemEntry);
+    Exec_AddHead(SysBase, &proc->pr_Task.tc_MemEntry, &ml->ml_Node);
+
+    Exec_AddTask(SysBase, &proc->pr_Task, entry, NULL);
+
+    return proc;
+}
+
+/* utility.library */
+
+struct TagItem * Utility_NextTagItem(struct Library *UtilityBase, struct TagItem **tagListPtr)
+{
+    (void)UtilityBase;
+
+    while (*tagListPtr != NULL)
+    {
+        struct TagItem *ti = *tagListPtr;
+
+        switch (ti->ti_Tag)
+        {
+            case TAG_DONE:
+                *tagListPtr = NULL;
+                return NULL;
+
+            case TAG_IGNORE:
+                *tagListPtr = ti + 1;
+                break;
+
+            case TAG_MORE:
+                *tagListPtr = (struct TagItem *)(uintptr_t)ti->ti_Data;
+                break;
+
+            case TAG_SKIP:
+                *tagListPtr = ti + ti->ti_Data + 1;
+                break;
+
+            default:
+                *tagListPtr = ti + 1;
+                return ti;
+        }
+    }
+
+    return NULL;
+}
+
+struct TagItem * Utility_FindTagItem(struct Library *UtilityBase, Tag tagValue, const struct TagItem *tagList)
+{
+    struct TagItem *state = (struct TagItem *)tagList;
+    struct TagItem *ti;
+
+    while ((ti = Utility_NextTagItem(UtilityBase, &state)) != NULL)
+    {
+        if (ti->ti_Tag == tagValue)
+            return ti;
+    }
+
+    return NULL;
+}
+
+ULONG Utility_GetTagData(struct Library *UtilityBase, Tag tagValue, ULONG defaultVal, const struct TagItem *tagList)
+{
+    struct TagItem *ti = Utility_FindTagItem(UtilityBase, tagValue, tagList);
+
+    return ti ? ti->ti_Data : defaultVal;
+}
+
+ULONG Utility_CallHookPkt(struct Library *UtilityBase, struct Hook *hook, APTR object, APTR paramPacket)
+{
+    (void)UtilityBase;
+
+    return hook->h_Entry(hook, object, paramPacket);
+}
+
+/* devicetree.resource. Keys are known by full path, values are kept in host byte order */
+
+struct DTProperty {
+    struct DTProperty * dp_Next;
+    char *              dp_Name;
+    APTR                dp_Value;
+    ULONG               dp_Length;
+};
+
+struct DTKey {
+    struct DTKey *      dk_Next;
+    char *              dk_Path;
+    struct DTProperty * dk_Properties;
+};
+
+static struct DTKey *DTKeys;
+
+static char * HostStrdup(const char *s)
+{
+    char *d = HostAlloc(strlen(s) + 1);
+
+    strcpy(d, s);
+
+    return d;
+}
+
+static struct DTKey * FindKey(const char *path, size_t length)
+{
+    for (struct DTKey *k = DTKeys; k != NULL; k = k->dk_Next)
+    {
+        if (strlen(k->dk_Path) == length && strncmp(k->dk_Path, path, length) == 0)
+            return k;
+    }
+
+    return NULL;
+}
+
+static struct DTKey * CreateKey(const char *path)
+{
+    struct DTKey *k = FindKey(path, strlen(path));
+
+    if (k == NULL)
+    {
+        k = HostAlloc(sizeof(struct DTKey));
+        k->dk_Path = HostStrdup(path);
+        k->dk_Properties = NULL;
+        k->dk_Next = DTKeys;
+        DTKeys = k;
+    }
+
+    return k;
+}
+
+void HostDTProperty(const char *path, const char *name, const void *value, ULONG length)
+{
+    struct DTKey *k = CreateKey(path);
+    struct DTProperty *p = HostAlloc(sizeof(struct DTProperty));
+
+    p->dp_Name = HostStrdup(name);
+    p->dp_Value = HostAlloc(length ? length : 1);
+    p->dp_Length = length;
+    memcpy(p->dp_Value, value, length);
+
+    p->dp_Next = k->dk_Properties;
+    k->dk_Properties = p;
+}
+
+void HostDTString(const char *path, const char *name, const char *value)
+{
+    HostDTProperty(path, name, value, strlen(value) + 1);
+}
+
+void HostDTCells(const char *path, const char *name, int count, ...)
+{
+    ULONG cells[16];
+    va_list ap;
+
+    va_start(ap, count);
+    for (int i = 0; i < count && i < 16; i++)
+        cells[i] = va_arg(ap, ULONG);
+    va_end(ap);
+
+    HostDTProperty(path, name, cells, count * sizeof(ULONG));
+}
+
+APTR DT_Host_OpenKey(APTR DeviceTreeBase, CONST_STRPTR name)
+{
+    (void)DeviceTreeBase;
+
+    return FindKey((const char *)name, strlen((const char *)name));
+}
+
+void DT_Host_CloseKey(APTR DeviceTreeBase, APTR key)
+{
+    (void)DeviceTreeBase;
+    (void)key;
+}
+
+APTR DT_Host_GetParent(APTR DeviceTreeBase, APTR key)
+{
+    struct DTKey *k = key;
+    const char *slash;
+    (void)DeviceTreeBase;
+
+    if (k == NULL || strcmp(k->dk_Path, "/") == 0)
+        return NULL;
+
+    slash = strrchr(k->dk_Path, '/');
+
+    return FindKey(k->dk_Path, slash == k->dk_Path ? 1 : (size_t)(slash - k->dk_Path));
+}
+
+APTR DT_Host_FindProperty(APTR DeviceTreeBase, APTR key, CONST_STRPTR property)
+{
+    struct DTKey *k = key;
+    (void)DeviceTreeBase;
+
+    if (k == NULL)
+        return NULL;
+
+    for (struct DTProperty *p = k->dk_Properties; p != NULL; p = p->dp_Next)
+    {
+        if (strcmp(p->dp_Name, (const char *)property) == 0)
+            return p;
+    }
+
+    return NULL;
+}
+
+CONST_APTR DT_Host_GetPropValue(APTR DeviceTreeBase, APTR property)
+{
+    (void)DeviceTreeBase;
+
+    return property ? ((struct DTProperty *)property)->dp_Value : NULL;
+}
+
+ULONG DT_Host_GetPropLen(APTR DeviceTreeBase, APTR property)
+{
+    (void)DeviceTreeBase;
+
+    return property ? ((struct DTProperty *)property)->dp_Length : 0;
+}
+
+static struct Library * MakeLibrary(const char *name)
+{
+    struct Library *lib = Exec_AllocMem(HostSysBase, sizeof(struct Library), MEMF_PUBLIC | MEMF_CLEAR);
+
+    lib->lib_Node.ln_Name = (char *)name;
+    lib->lib_Node.ln_Type = NT_LIBRARY;
+    lib->lib_Version = 40;
+
+    HostAddLibrary(lib);
+
+    return lib;
+}
+
+void HostDosInit(void)
+{
+    HostDOSBase = MakeLibrary("dos.library");
+    HostUtilityBase = MakeLibrary("utility.library");
+
+    CreateKey("/");
+    HostAddResource("devicetree.resource", Exec_AllocMem(HostSysBase, sizeof(struct Library), MEMF_PUBLIC | MEMF_CLEAR));
+}
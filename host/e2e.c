@@ -0,0 +1,498 @@
+/*
+    End-to-end test of the driver against the software dongle of dongle.c.
+
+    The device is brought up the way WiFi_BringUp does it, with the SDIO operations done by the dongle instead
+    of the EMMC controller: chip init with EROM scan, firmware, CLM and NVRAM upload from firmware/, packet
+    receiver and unit task. It is then used through exec as any SANA-II client would use it: OpenDevice,
+    S2_CONFIGINTERFACE, S2_GETNETWORKS, CMD_WRITE echoed back by the dongle to CMD_READ one at a time (latency)
+    and in batches (throughput), and frames generated by the dongle (receive throughput). Every phase reports
+    its time and checks what both sides saw, sequence numbers and TX window included.
+
+    With -e the dongle sits behind the register model of the EMMC controller (emmc.c) instead, and the
+    driver talks to it through sdio_init, cmd_int, sdio_sendpkt and sdio_recvpkt as it does on the board.
+
+    Usage: wifipi-e2e [-q] [-e] [-v]    -q runs a short pass, as done by ctest, -v shows the driver log
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <exec/types.h>
+#include <exec/memory.h>
+#include <exec/io.h>
+#include <devices/sana2.h>
+#include <devices/sana2wireless.h>
+#include <utility/tagitem.h>
+#include <proto/exec.h>
+
+#include "wifipi.h"
+#include "brcm.h"
+#include "host.h"
+#include "sdpcm.h"
+#include "dongle.h"
+#include "emmc.h"
+
+#define FIRMWARE_FILE       "cyfmac43455-sdio.bin"
+#define CLM_FILE            "cyfmac43455-sdio.clm_blob"
+#define FRAME_BUFFER_SIZE   2048
+#define BATCH               32
+#define IO_TIMEOUT          5000000
+#define EMMC_BASE           0xfe340000
+
+extern const APTR InitTable[];
+
+static struct ExecBase *SysBase;
+static struct WiFiBase *WiFiBase;
+static struct Dongle *Dongle;
+static struct EMMC *EMMC;
+static struct DongleStats *Stats;
+static struct MsgPort *ReplyPort;
+static struct IOSana2Req *Base;
+static ULONG Rounds;
+static int Failures;
+
+static UBYTE OurAddr[6] = { 0x02, 0x00, 0x5e, 0x10, 0x00, 0x01 };
+static UBYTE PeerAddr[6] = { 0x02, 0x00, 0x5e, 0x10, 0x00, 0x02 };
+
+static void Report(const char *name, ULONG count, ULONG bytes, uint64_t us)
+{
+    printf("%-32s %8lu ops %10.1f us/op", name, (unsigned long)count, (double)us / (count ? count : 1));
+    if (bytes)
+        printf(" %8.2f MB/s", bytes / (double)(us ? us : 1));
+    printf("\n");
+}
+
+static void Check(const char *name, ULONG got, ULONG expected)
+{
+    if (got != expected)
+    {
+        printf("FAIL: %s: got %lu, expected %lu\n", name, (unsigned long)got, (unsigned long)expected);
+        Failures++;
+    }
+}
+
+static BOOL CopyBuffer(APTR to, APTR from, ULONG length)
+{
+    memcpy(to, from, length);
+    return TRUE;
+}
+
+static ULONG FileSize(const char *name)
+{
+    char path[512];
+    struct stat st;
+
+    snprintf(path, sizeof(path), "%s/%s", WIFIPI_FIRMWARE_DIR, name);
+
+    return stat(path, &st) == 0 ? st.st_size : 0;
+}
+
+/* Wait for the request, other tasks run meanwhile. A request which never completes ends the test */
+static void Await(struct IOSana2Req *io, const char *name)
+{
+    uint64_t deadline = HostMicros() + IO_TIMEOUT;
+
+    while (!CheckIO(&io->ios2_Req))
+    {
+        if (HostMicros() > deadline)
+        {
+            printf("FAIL: %s: request not completed\n", name);
+            exit(EXIT_FAILURE);
+        }
+        HostSleep(50);
+    }
+
+    WaitIO(&io->ios2_Req);
+}
+
+static struct IOSana2Req * NewRequest(UWORD command)
+{
+    struct IOSana2Req *io = CreateIORequest(ReplyPort, sizeof(struct IOSana2Req));
+
+    io->ios2_Req.io_Device = Base->ios2_Req.io_Device;
+    io->ios2_Req.io_Unit = Base->ios2_Req.io_Unit;
+    io->ios2_Req.io_Command = command;
+    io->ios2_BufferManagement = Base->ios2_BufferManagement;
+    io->ios2_PacketType = 0x0800;
+    io->ios2_Data = AllocMem(FRAME_BUFFER_SIZE, MEMF_PUBLIC | MEMF_CLEAR);
+
+    return io;
+}
+
+static void DeleteRequest(struct IOSana2Req *io)
+{
+    FreeMem(io->ios2_Data, FRAME_BUFFER_SIZE);
+    DeleteIORequest(io);
+}
+
+static void Write(struct IOSana2Req *io, ULONG length, UBYTE tag)
+{
+    UBYTE *data = io->ios2_Data;
+
+    io->ios2_Req.io_Command = CMD_WRITE;
+    io->ios2_DataLength = length;
+    CopyMem(PeerAddr, io->ios2_DstAddr, 6);
+    for (ULONG i = 0; i < length; i++)
+        data[i] = tag + i;
+
+    SendIO(&io->ios2_Req);
+}
+
+static void Read(struct IOSana2Req *io)
+{
+    io->ios2_Req.io_Command = CMD_READ;
+    io->ios2_DataLength = 0;
+    SendIO(&io->ios2_Req);
+}
+
+/* WiFi_Init and WiFi_BringUp with the dongle in place of sdio_init */
+static BOOL BringUp(void)
+{
+    struct WiFiUnit *unit;
+    struct SDIO *sdio;
+
+    WiFiBase = AllocMem(sizeof(struct WiFiBase), MEMF_PUBLIC | MEMF_CLEAR);
+    WiFiBase->w_Device.dd_Library.lib_Node.ln_Name = (char *)"wifipi.device";
+    WiFiBase->w_Device.dd_Library.lib_Node.ln_Type = NT_DEVICE;
+    WiFiBase->w_Device.dd_Library.lib_Revision = WIFIPI_REVISION;
+    WiFiBase->w_BootStart = HostMicros();
+    WiFiBase->w_MemPool = CreatePool(MEMF_ANY, 16384, 4096);
+    WiFiBase->w_SysBase = SysBase;
+    WiFiBase->w_UtilityBase = OpenLibrary((CONST_STRPTR)"utility.library", 0);
+    WiFiBase->w_DosBase = OpenLibrary((CONST_STRPTR)"dos.library", 0);
+    WiFiBase->w_DeviceTreeBase = OpenResource((CONST_STRPTR)"devicetree.resource");
+    InitSemaphore(&WiFiBase->w_InitLock);
+    InitSemaphore(&WiFiBase->w_NetworkListLock);
+    NewMinList(&WiFiBase->w_NetworkList);
+
+    if (EMMC != NULL)
+    {
+        WiFiBase->w_SDIOBase = (APTR)(uintptr_t)EMMC_BASE;
+        WiFiBase->w_SDIOClock = EMMCConfig(EMMC)->ec_BaseClock;
+        sdio = sdio_init(WiFiBase);
+    }
+    else
+        sdio = DongleSDIO(Dongle, WiFiBase);
+
+    WiFiBase->w_SDIO = sdio;
+
+    if (sdio == NULL || !chip_init(sdio))
+        return FALSE;
+
+    StartPacketReceiver(sdio);
+
+    unit = AllocPooledClear(WiFiBase->w_MemPool, sizeof(struct WiFiUnit));
+    unit->wu_Base = WiFiBase;
+    InitSemaphore(&unit->wu_Lock);
+    NewMinList(&unit->wu_Openers);
+    NewMinList(&unit->wu_MulticastRanges);
+    NewMinList(&unit->wu_TypeTrackers);
+    StartUnitTask(unit);
+    WiFiBase->w_Unit = unit;
+
+    HostAddDevice(&WiFiBase->w_Device, InitTable[1]);
+
+    return TRUE;
+}
+
+static void TestBoot(const char *name)
+{
+    ULONG size = FileSize(FIRMWARE_FILE);
+    uint64_t start = HostMicros();
+    const UBYTE *ram;
+
+    if (!BringUp())
+    {
+        printf("FAIL: %s: chip_init failed\n", name);
+        exit(EXIT_FAILURE);
+    }
+    Report(name, 1, size, HostMicros() - start);
+
+    ram = DongleMemory(Dongle, WiFiBase->w_SDIO->s_Chip->c_RAMBase, size);
+
+    Check(name, Stats->ds_Booted, 1);
+    Check(name, Stats->ds_FirmwareBytes, (size + 3) & ~3);
+    Check(name, Stats->ds_ResetVector, ram ? GetLE32(ram) : 0);
+    Check(name, Stats->ds_NVRAMBytes != 0, TRUE);
+    Check(name, WiFiBase->w_SDIO->s_Chip->c_ChipID, BRCM_CC_4345_CHIP_ID);
+
+    FILE *f = fopen(WIFIPI_FIRMWARE_DIR "/" FIRMWARE_FILE, "rb");
+    UBYTE *image = malloc(size);
+
+    if (f != NULL && fread(image, 1, size, f) == size)
+        Check(name, ram != NULL && memcmp(ram, image, size) == 0, TRUE);
+    else
+        Check(name, 0, size);
+
+    if (f != NULL)
+        fclose(f);
+    free(image);
+}
+
+static void TestOpen(const char *name)
+{
+    static struct TagItem tags[3];
+    uint64_t start = HostMicros();
+
+    tags[0].ti_Tag = S2_CopyToBuff;
+    tags[0].ti_Data = (ULONG)(uintptr_t)CopyBuffer;
+    tags[1].ti_Tag = S2_CopyFromBuff;
+    tags[1].ti_Data = (ULONG)(uintptr_t)CopyBuffer;
+    tags[2].ti_Tag = TAG_DONE;
+
+    Base = CreateIORequest(ReplyPort, sizeof(struct IOSana2Req));
+    Base->ios2_BufferManagement = tags;
+
+    if (OpenDevice((CONST_STRPTR)"wifipi.device", 0, &Base->ios2_Req, 0) != 0)
+    {
+        printf("FAIL: %s: OpenDevice failed\n", name);
+        exit(EXIT_FAILURE);
+    }
+    Report(name, 1, 0, HostMicros() - start);
+
+    start = HostMicros();
+    Base->ios2_Req.io_Command = S2_CONFIGINTERFACE;
+    CopyMem(OurAddr, Base->ios2_SrcAddr, 6);
+    SendIO(&Base->ios2_Req);
+    Await(Base, name);
+    Report("configure interface", 1, 0, HostMicros() - start);
+
+    Check(name, Base->ios2_Req.io_Error, 0);
+    Check(name, memcmp(WiFiBase->w_Unit->wu_EtherAddr, OurAddr, 6), 0);
+    Check(name, Stats->ds_CLMBytes, FileSize(CLM_FILE));
+    Check(name, Stats->ds_CLMDone, 1);
+}
+
+static void TestScan(const char *name)
+{
+    struct IOSana2Req *io = NewRequest(S2_GETNETWORKS);
+    APTR data = io->ios2_Data;
+    APTR pool = CreatePool(MEMF_ANY, 4096, 4096);
+    ULONG scans = Stats->ds_Scans;
+    uint64_t start = HostMicros();
+
+    io->ios2_Data = pool;
+    io->ios2_StatData = NULL;
+    SendIO(&io->ios2_Req);
+    Await(io, name);
+    Report(name, 1, 0, HostMicros() - start);
+
+    Check(name, io->ios2_Req.io_Error, 0);
+    Check(name, io->ios2_DataLength, DongleConfig(Dongle)->dc_ScanNetworks);
+    Check(name, Stats->ds_Scans - scans, 1);
+
+    DeletePool(pool);
+    io->ios2_Data = data;
+    DeleteRequest(io);
+}
+
+/* One frame at a time: write, dongle echoes it back, read gets it */
+static void TestPing(const char *name, ULONG length)
+{
+    struct IOSana2Req *rd = NewRequest(CMD_READ);
+    struct IOSana2Req *wr = NewRequest(CMD_WRITE);
+    ULONG good = 0;
+    uint64_t start = HostMicros();
+
+    for (ULONG i = 0; i < Rounds; i++)
+    {
+        Read(rd);
+        Write(wr, length, i);
+        Await(wr, name);
+        Await(rd, name);
+
+        if (rd->ios2_Req.io_Error == 0 && rd->ios2_DataLength == length &&
+            memcmp(rd->ios2_Data, wr->ios2_Data, length) == 0 && memcmp(rd->ios2_SrcAddr, PeerAddr, 6) == 0)
+            good++;
+    }
+    Report(name, Rounds, 2 * Rounds * length, HostMicros() - start);
+
+    Check(name, good, Rounds);
+
+    DeleteRequest(rd);
+    DeleteRequest(wr);
+}
+
+/* BATCH writes in flight, echoed back to BATCH reads */
+static void TestEcho(const char *name, ULONG length)
+{
+    struct IOSana2Req *rd[BATCH], *wr[BATCH];
+    ULONG batches = Rounds / BATCH ? Rounds / BATCH : 1;
+    ULONG good = 0;
+    ULONG frames = Stats->ds_TXFrames;
+
+    for (int i = 0; i < BATCH; i++)
+    {
+        rd[i] = NewRequest(CMD_READ);
+        wr[i] = NewRequest(CMD_WRITE);
+    }
+
+    uint64_t start = HostMicros();
+    for (ULONG b = 0; b < batches; b++)
+    {
+        for (int i = 0; i < BATCH; i++)
+            Read(rd[i]);
+        for (int i = 0; i < BATCH; i++)
+            Write(wr[i], length, b);
+        for (int i = 0; i < BATCH; i++)
+        {
+            Await(wr[i], name);
+            Await(rd[i], name);
+            if (rd[i]->ios2_Req.io_Error == 0 && rd[i]->ios2_DataLength == length &&
+                memcmp(rd[i]->ios2_Data, wr[i]->ios2_Data, length) == 0)
+                good++;
+        }
+    }
+    Report(name, batches * BATCH, 2 * batches * BATCH * length, HostMicros() - start);
+
+    Check(name, good, batches * BATCH);
+    Check(name, Stats->ds_TXFrames - frames, batches * BATCH);
+
+    for (int i = 0; i < BATCH; i++)
+    {
+        DeleteRequest(rd[i]);
+        DeleteRequest(wr[i]);
+    }
+}
+
+/* Frames generated by the dongle, BATCH at a time */
+static void TestReceive(const char *name, ULONG length)
+{
+    struct IOSana2Req *rd[BATCH];
+    ULONG batches = Rounds / BATCH ? Rounds / BATCH : 1;
+    ULONG good = 0;
+
+    for (int i = 0; i < BATCH; i++)
+        rd[i] = NewRequest(CMD_READ);
+
+    uint64_t start = HostMicros();
+    for (ULONG b = 0; b < batches; b++)
+    {
+        for (int i = 0; i < BATCH; i++)
+            Read(rd[i]);
+
+        // Reads are queued by the time SendIO returns, frames may follow
+        DongleGenerate(Dongle, BATCH, length, PeerAddr);
+
+        for (int i = 0; i < BATCH; i++)
+        {
+            Await(rd[i], name);
+            if (rd[i]->ios2_Req.io_Error == 0 && rd[i]->ios2_DataLength == length - 14)
+                good++;
+        }
+    }
+    Report(name, batches * BATCH, batches * BATCH * length, HostMicros() - start);
+
+    Check(name, good, batches * BATCH);
+
+    for (int i = 0; i < BATCH; i++)
+        DeleteRequest(rd[i]);
+}
+
+static void E2EMain(APTR arg)
+{
+    (void)arg;
+
+    SysBase = HostSysBase;
+    ReplyPort = CreateMsgPort();
+    Stats = DongleStats(Dongle);
+
+    TestBoot("boot");
+    TestOpen("open");
+    TestScan("scan");
+    TestPing("ping 64", 64);
+    TestPing("ping 1500", 1500);
+    TestEcho("echo 1500, 32 in flight", 1500);
+    TestReceive("receive 1514, 32 queued", 1514);
+
+    // Dongle takes 4 frames at a time, the rest waits for credits. Frames come back one by one
+    DongleConfig(Dongle)->dc_TXWindow = 4;
+    DongleConfig(Dongle)->dc_RXGlom = 1;
+    TestEcho("echo 1500, window 4, no rx glom", 1500);
+    TestReceive("receive 1514, no rx glom", 1514);
+
+    printf("dongle: %lu CMD52, %lu CMD53, %lu ctrl, %lu events, %lu tx glom, %lu rx glom, %lu credits\n",
+        (unsigned long)Stats->ds_CMD52, (unsigned long)Stats->ds_CMD53, (unsigned long)Stats->ds_Ctrl,
+        (unsigned long)Stats->ds_Events, (unsigned long)Stats->ds_TXGlom, (unsigned long)Stats->ds_RXGlom,
+        (unsigned long)Stats->ds_Credits);
+
+    Check("sequence errors", Stats->ds_SeqErrors, 0);
+    Check("window errors", Stats->ds_WindowErrors, 0);
+    Check("frame errors", Stats->ds_FrameErrors, 0);
+    Check("dropped frames", Stats->ds_Dropped, 0);
+    Check("rx glom used", Stats->ds_RXGlom != 0, TRUE);
+
+    if (EMMC != NULL)
+    {
+        struct EMMCStats *es = EMMCStats(EMMC);
+
+        printf("emmc: %lu commands, %lu blocks, %lu bytes, SD clock %lu Hz\n", (unsigned long)es->es_Commands,
+            (unsigned long)es->es_Blocks, (unsigned long)es->es_Bytes, (unsigned long)es->es_Clock);
+
+        // CMD8 of sdio_init, SDIO only cards do not answer it
+        Check("emmc errors", es->es_Errors, 1);
+        Check("emmc inhibited commands", es->es_Inhibited, 0);
+        Check("emmc fifo errors", es->es_FIFOErrors, 0);
+        Check("emmc length errors", es->es_LengthErrors, 0);
+        Check("emmc width errors", es->es_WidthErrors, 0);
+        Check("emmc clock glitches", es->es_ClockGlitches, 0);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    char dir[] = "/tmp/wifipi-e2e-XXXXXX";
+    char path[sizeof(dir) + 32];
+    BOOL useEMMC = FALSE;
+
+    Rounds = 2000;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-q") == 0)
+            Rounds = 200;
+        else if (strcmp(argv[i], "-v") == 0)
+            HostConsole(1);
+        else if (strcmp(argv[i], "-e") == 0)
+            useEMMC = TRUE;
+    }
+
+    // DEVS:Firmware is the firmware directory of the repository, RAM:T a scratch directory
+    if (mkdtemp(dir) == NULL)
+    {
+        perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+    snprintf(path, sizeof(path), "%s/Firmware", dir);
+    symlink(WIFIPI_FIRMWARE_DIR, path);
+    snprintf(path, sizeof(path), "%s/T", dir);
+    mkdir(path, 0700);
+
+    HostInit();
+    HostAssign("DEVS", dir);
+    HostAssign("RAM", dir);
+    HostDTString("/", "compatible", "raspberrypi,4-model-b");
+
+    Dongle = DongleCreate(NULL);
+    if (useEMMC)
+    {
+        EMMC = EMMCCreate(Dongle, NULL);
+        EMMCMap(EMMC, EMMC_BASE);
+    }
+    HostRun(E2EMain, NULL);
+
+    snprintf(path, sizeof(path), "%s/T/wifipi.txt", dir);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/T", dir);
+    rmdir(path);
+    snprintf(path, sizeof(path), "%s/Firmware", dir);
+    unlink(path);
+    rmdir(dir);
+
+    if (Failures)
+        printf("%d check(s) failed\n", Failures);
+
+    return Failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,641 @@
+/*
+    Arasan EMMC controller of the Raspberry Pi with the WiFi card on its bus, at register level.
+
+    The controller side keeps the registers sdio.c uses: BLKSIZECNT, ARG1, CMDTM and the responses, the DATA
+    FIFO, STATUS with its inhibit and buffer bits, CONTROL0/1 with resets, clock enables and the divider,
+    INTERRUPT (write 1 to clear) behind IRPT_MASK, and FORCE_IRPT. The card side enumerates as an SDIO only
+    card (no answer to CMD8, OCR on CMD5, RCA on CMD3, selected by CMD7) and passes CMD52 and CMD53 to the
+    dongle. Card bus width is taken from writes to CCCR BICTRL.
+
+    A command goes through the phases a real one does, each raising its INTERRUPT bit once the bus time of
+    the phase passed: response (command complete), every data block (buffer read or write ready), and the
+    end of data or busy (transfer complete). Read data is fetched from the card when the command is issued,
+    write data is handed to the card once the last block was written into the FIFO. Data the card refuses
+    ends in a data timeout.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <exec/types.h>
+
+#include "wifipi.h"
+#include "sdio.h"
+#include "host.h"
+#include "sdpcm.h"
+#include "dongle.h"
+#include "emmc.h"
+
+#define EMMC_REGS_SIZE      0x100
+#define DATA_MAX            (SDIO_MAX_BLOCK_COUNT * 1024)
+
+/* CONTROL1 */
+#define C1_CLK_INTLEN       (1 << 0)
+#define C1_CLK_STABLE       (1 << 1)
+#define C1_CLK_EN           (1 << 2)
+#define C1_CLK_DIVIDER      0xffc0          // Frequency select (15:8) and its upper bits (7:6)
+#define C1_DATA_TOUNIT(x)   (((x) >> 16) & 0xf)
+#define C1_RESETS           (SD_RESET_ALL | SD_RESET_CMD | SD_RESET_DAT)
+
+/* STATUS */
+#define ST_CMD_INHIBIT      (1 << 0)
+#define ST_DAT_INHIBIT      (1 << 1)
+#define ST_WRITE_ACTIVE     (1 << 8)
+#define ST_READ_ACTIVE      (1 << 9)
+#define ST_WRITE_READY      (1 << 10)
+#define ST_READ_READY       (1 << 11)
+#define ST_CARD_INSERTED    (1 << 16)
+#define ST_DAT_LEVEL        (0xf << 20)
+#define ST_CMD_LEVEL        (1 << 24)
+
+/* INTERRUPT, sdio.h has the mask of data timeout wrong */
+#define IRQ_ERROR           0x8000
+#define IRQ_ERRORS          0xffff0000
+#define ERR_CMD_TIMEOUT     (1 << 16)
+#define ERR_CMD_CRC         (1 << 17)
+#define ERR_DATA_TIMEOUT    (1 << 20)
+#define ERR_DATA_CRC        (1 << 21)
+#define CMD_EVENTS          (SD_COMMAND_COMPLETE | ERR_CMD_TIMEOUT | ERR_CMD_CRC)
+
+/* SD bus clocks of the phases: command and response with turnaround, data overhead (start, CRC, end, CRC status) */
+#define CMD_CLOCKS          112
+#define CMD_TIMEOUT_CLOCKS  (CMD_CLOCKS + 64)
+#define DATA_CLOCKS         24
+#define BUSY_CLOCKS         8
+
+/* Card */
+#define CARD_RCA            0x0001
+#define CARD_OCR            0x00ff8000      // 2.0-3.6V
+#define CARD_FUNCTIONS      2
+#define R4_READY            (1UL << 31)
+#define R5_STATE_CMD        0x1000          // Response flags: card in CMD state
+#define R1_STATE_TRAN       (4 << 9)
+
+struct EMMC {
+    struct Dongle *     e_Dongle;
+    struct EMMCConfig   e_Config;
+    struct EMMCStats    e_Stats;
+    ULONG               e_Regs[EMMC_REGS_SIZE / 4];
+    ULONG               e_Interrupt;
+    ULONG               e_Status;           // Inhibit bits
+
+    ULONG               e_Event;            // Interrupt bits of the phase in progress, raised at e_Due
+    uint64_t            e_Due;
+
+    BOOL                e_Busy;             // R1b command, transfer complete follows the response
+    BOOL                e_Data;             // Data phase of a CMD53
+    BOOL                e_Write;
+    BOOL                e_Ready;            // FIFO holds (read) or takes (write) the current block
+    UBYTE               e_DataFault;
+    ULONG               e_Arg;
+    ULONG               e_BlockSize;
+    ULONG               e_Blocks;
+    ULONG               e_Block;
+    ULONG               e_Pos;
+    UBYTE *             e_Buffer;
+
+    BOOL                e_Selected;
+    UWORD               e_RCA;
+    UBYTE               e_CardWidth;
+};
+
+static uint64_t BusTime(struct EMMC *e, ULONG clocks)
+{
+    if (!e->e_Config.ec_BusTiming || e->e_Stats.es_Clock == 0)
+        return 0;
+
+    return (uint64_t)clocks * 1000000 / e->e_Stats.es_Clock;
+}
+
+/* Data timeout counts TMCLK, the base clock, 2^(13 + unit) times */
+static uint64_t DataTimeout(struct EMMC *e)
+{
+    if (!e->e_Config.ec_BusTiming)
+        return 0;
+
+    return ((uint64_t)1 << (13 + C1_DATA_TOUNIT(e->e_Regs[EMMC_CONTROL1 / 4]))) * 1000000 / e->e_Config.ec_BaseClock;
+}
+
+static ULONG BlockClocks(struct EMMC *e)
+{
+    ULONG width = (e->e_Regs[EMMC_CONTROL0 / 4] & 2) ? 4 : 1;
+
+    return e->e_BlockSize * 8 / width + DATA_CLOCKS;
+}
+
+static void Schedule(struct EMMC *e, ULONG bits, uint64_t micros)
+{
+    e->e_Event = bits;
+    e->e_Due = HostMicros() + micros;
+}
+
+static void Raise(struct EMMC *e, ULONG bits)
+{
+    if (bits & IRQ_ERRORS)
+        e->e_Stats.es_Errors++;
+
+    e->e_Interrupt |= bits & e->e_Regs[EMMC_IRPT_MASK / 4];
+}
+
+static void EndData(struct EMMC *e)
+{
+    e->e_Data = FALSE;
+    e->e_Busy = FALSE;
+    e->e_Ready = FALSE;
+    e->e_Status &= ~ST_DAT_INHIBIT;
+}
+
+/* First block of the data phase, once the response is there */
+static void StartData(struct EMMC *e)
+{
+    e->e_Block = 0;
+    e->e_Pos = 0;
+
+    if (e->e_DataFault == EMMC_FAULT_DATA_TIMEOUT)
+        Schedule(e, ERR_DATA_TIMEOUT, DataTimeout(e));
+    else if (e->e_Write)
+    {
+        e->e_Ready = TRUE;
+        Raise(e, SD_BUFFER_WRITE_READY);
+    }
+    else if (e->e_DataFault == EMMC_FAULT_DATA_CRC)
+        Schedule(e, ERR_DATA_CRC, BusTime(e, BlockClocks(e)));
+    else
+        Schedule(e, SD_BUFFER_READ_READY, BusTime(e, BlockClocks(e)));
+}
+
+/* Raise the interrupt of the phase in progress if its time has come, and move on to the next phase */
+static void Advance(struct EMMC *e)
+{
+    ULONG bits = e->e_Event;
+
+    if (bits == 0 || HostMicros() < e->e_Due)
+        return;
+
+    e->e_Event = 0;
+    Raise(e, bits);
+
+    if (bits & IRQ_ERRORS)
+    {
+        e->e_Status &= ~ST_CMD_INHIBIT;
+        EndData(e);
+    }
+    else if (bits & SD_COMMAND_COMPLETE)
+    {
+        e->e_Status &= ~ST_CMD_INHIBIT;
+
+        if (e->e_Data)
+            StartData(e);
+        else if (e->e_Busy)
+            Schedule(e, SD_TRANSFER_COMPLETE, BusTime(e, BUSY_CLOCKS));
+    }
+    else if (bits & (SD_BUFFER_READ_READY | SD_BUFFER_WRITE_READY))
+        e->e_Ready = TRUE;
+    else if (bits & SD_TRANSFER_COMPLETE)
+        EndData(e);
+}
+
+/* Fault to inject into this command, if any. The config counts down, so that the test can see it was used */
+static UBYTE Fault(struct EMMC *e, ULONG index)
+{
+    struct EMMCConfig *c = &e->e_Config;
+
+    if (c->ec_Fault == EMMC_FAULT_NONE || c->ec_FaultCount == 0 || index != c->ec_FaultCommand)
+        return EMMC_FAULT_NONE;
+
+    if (c->ec_FaultAfter != 0)
+    {
+        c->ec_FaultAfter--;
+        return EMMC_FAULT_NONE;
+    }
+
+    c->ec_FaultCount--;
+    e->e_Stats.es_Faults++;
+
+    return c->ec_Fault;
+}
+
+static BOOL CMD52(struct EMMC *e, ULONG arg)
+{
+    BOOL write = (arg >> 31) & 1;
+    UBYTE function = (arg >> 28) & 7;
+    ULONG address = (arg >> 9) & 0x1ffff;
+    UBYTE value = arg & 0xff;
+
+    e->e_Stats.es_CMD52++;
+
+    if (!DongleCMD52(e->e_Dongle, write, function, address, &value))
+        return FALSE;
+
+    if (write && function == SD_FUNC_CIA && address == BUS_BI_CTRL_REG)
+        e->e_CardWidth = (value & 3) == 2 ? 4 : 1;
+
+    e->e_Regs[EMMC_RESP0 / 4] = R5_STATE_CMD | value;
+
+    return TRUE;
+}
+
+/*
+    Set up the data phase of CMD53 from BLKSIZECNT, as the controller does, and check that it moves as many
+    bytes as the card was asked for. A mismatch, or a bus width the card does not use, breaks the data phase
+    the way it would on the bus.
+*/
+static BOOL CMD53(struct EMMC *e, ULONG cmdtm, ULONG arg)
+{
+    BOOL write = (arg >> 31) & 1;
+    BOOL blockMode = (arg >> 27) & 1;
+    ULONG count = arg & 0x1ff;
+    ULONG blkSizeCnt = e->e_Regs[EMMC_BLKSIZECNT / 4];
+    ULONG controllerWidth = (e->e_Regs[EMMC_CONTROL0 / 4] & 2) ? 4 : 1;
+    ULONG cardLength;
+
+    e->e_Stats.es_CMD53++;
+
+    e->e_Write = write;
+    e->e_Arg = arg;
+    e->e_BlockSize = blkSizeCnt & 0x3ff;
+    e->e_Blocks = (cmdtm & SD_CMD_MULTI_BLOCK) ? blkSizeCnt >> 16 : 1;
+
+    if (blockMode)
+        cardLength = count * e->e_BlockSize;
+    else
+        cardLength = count ? count : 512;
+
+    if (e->e_BlockSize == 0 || e->e_Blocks == 0 || e->e_BlockSize * e->e_Blocks != cardLength ||
+        cardLength > DATA_MAX)
+    {
+        e->e_Stats.es_LengthErrors++;
+        e->e_DataFault = EMMC_FAULT_DATA_TIMEOUT;
+        return TRUE;
+    }
+
+    if (controllerWidth != e->e_CardWidth)
+    {
+        e->e_Stats.es_WidthErrors++;
+        e->e_DataFault = EMMC_FAULT_DATA_CRC;
+        return TRUE;
+    }
+
+    // A function which is not ready answers the command, but never sends or takes the data
+    if (!write && !DongleCMD53(e->e_Dongle, FALSE, (arg >> 28) & 7, (arg >> 9) & 0x1ffff, (arg >> 26) & 1,
+                               e->e_Buffer, cardLength))
+        e->e_DataFault = EMMC_FAULT_DATA_TIMEOUT;
+
+    return TRUE;
+}
+
+/* Card side of a command. FALSE if the card stays silent */
+static BOOL Respond(struct EMMC *e, ULONG index, ULONG cmdtm, ULONG arg)
+{
+    switch (index)
+    {
+        case 0:
+            e->e_Selected = FALSE;
+            e->e_RCA = 0;
+            e->e_CardWidth = 1;
+            return TRUE;
+
+        case 3:
+            e->e_RCA = CARD_RCA;
+            e->e_Regs[EMMC_RESP0 / 4] = (ULONG)CARD_RCA << 16;
+            return TRUE;
+
+        case 5:
+            e->e_Regs[EMMC_RESP0 / 4] = R4_READY | (CARD_FUNCTIONS << 28) | CARD_OCR;
+            return TRUE;
+
+        case 7:
+            e->e_Selected = e->e_RCA != 0 && (arg >> 16) == e->e_RCA;
+            e->e_Regs[EMMC_RESP0 / 4] = 0;
+            return e->e_Selected;
+
+        case 13:
+            e->e_Regs[EMMC_RESP0 / 4] = R1_STATE_TRAN;
+            return e->e_RCA != 0 && (arg >> 16) == e->e_RCA;
+
+        case 52:
+            return e->e_Selected && CMD52(e, arg);
+
+        case 53:
+            return e->e_Selected && CMD53(e, cmdtm, arg);
+
+        default:
+            return FALSE;
+    }
+}
+
+static void Command(struct EMMC *e, ULONG cmdtm)
+{
+    ULONG index = (cmdtm >> 24) & 0x3f;
+    BOOL data = (cmdtm & SD_CMD_ISDATA) != 0;
+    UBYTE fault;
+
+    e->e_Stats.es_Commands++;
+
+    // The controller ignores a command written while the lines it needs are in use
+    if ((e->e_Status & ST_CMD_INHIBIT) || (data && (e->e_Status & ST_DAT_INHIBIT)))
+    {
+        e->e_Stats.es_Inhibited++;
+        return;
+    }
+
+    e->e_Status |= ST_CMD_INHIBIT;
+    e->e_Busy = FALSE;
+    e->e_Data = FALSE;
+    e->e_DataFault = EMMC_FAULT_NONE;
+
+    // Without SD clock the command never leaves the controller
+    if (e->e_Stats.es_Clock == 0)
+    {
+        e->e_Stats.es_ClockOff++;
+        return;
+    }
+
+    fault = Fault(e, index);
+
+    if (fault == EMMC_FAULT_HANG)
+        return;
+
+    if (fault == EMMC_FAULT_CMD_TIMEOUT || !Respond(e, index, cmdtm, e->e_Regs[EMMC_ARG1 / 4]))
+    {
+        Schedule(e, ERR_CMD_TIMEOUT, BusTime(e, CMD_TIMEOUT_CLOCKS));
+        return;
+    }
+
+    if (fault == EMMC_FAULT_CMD_CRC)
+    {
+        Schedule(e, ERR_CMD_CRC, BusTime(e, CMD_CLOCKS));
+        return;
+    }
+
+    if (data)
+    {
+        e->e_Data = TRUE;
+        e->e_Status |= ST_DAT_INHIBIT;
+        if (e->e_DataFault == EMMC_FAULT_NONE)
+            e->e_DataFault = fault;
+    }
+    else if ((cmdtm & SD_CMD_RSPNS_TYPE_MASK) == SD_CMD_RSPNS_TYPE_48B)
+    {
+        e->e_Busy = TRUE;
+        e->e_Status |= ST_DAT_INHIBIT;
+    }
+
+    Schedule(e, SD_COMMAND_COMPLETE, BusTime(e, CMD_CLOCKS));
+}
+
+/* Current block went through the FIFO */
+static void BlockDone(struct EMMC *e)
+{
+    e->e_Ready = FALSE;
+    e->e_Pos = 0;
+    e->e_Stats.es_Blocks++;
+    e->e_Stats.es_Bytes += e->e_BlockSize;
+
+    if (e->e_Write && e->e_DataFault == EMMC_FAULT_DATA_CRC)
+    {
+        Schedule(e, ERR_DATA_CRC, BusTime(e, BlockClocks(e)));
+        return;
+    }
+
+    if (++e->e_Block < e->e_Blocks)
+    {
+        Schedule(e, e->e_Write ? SD_BUFFER_WRITE_READY : SD_BUFFER_READ_READY, BusTime(e, BlockClocks(e)));
+        return;
+    }
+
+    if (e->e_Write)
+    {
+        ULONG arg = e->e_Arg;
+
+        if (!DongleCMD53(e->e_Dongle, TRUE, (arg >> 28) & 7, (arg >> 9) & 0x1ffff, (arg >> 26) & 1,
+                         e->e_Buffer, e->e_BlockSize * e->e_Blocks))
+        {
+            Schedule(e, ERR_DATA_TIMEOUT, DataTimeout(e));
+            return;
+        }
+
+        Schedule(e, SD_TRANSFER_COMPLETE, BusTime(e, BlockClocks(e) + BUSY_CLOCKS));
+    }
+    else
+        Schedule(e, SD_TRANSFER_COMPLETE, BusTime(e, BUSY_CLOCKS));
+}
+
+static ULONG ReadFIFO(struct EMMC *e)
+{
+    ULONG value;
+
+    Advance(e);
+
+    if (!e->e_Data || e->e_Write || !e->e_Ready)
+    {
+        e->e_Stats.es_FIFOErrors++;
+        return 0;
+    }
+
+    value = GetLE32(&e->e_Buffer[e->e_Block * e->e_BlockSize + e->e_Pos]);
+    e->e_Pos += 4;
+
+    if (e->e_Pos >= e->e_BlockSize)
+        BlockDone(e);
+
+    return value;
+}
+
+static void WriteFIFO(struct EMMC *e, ULONG value)
+{
+    Advance(e);
+
+    if (!e->e_Data || !e->e_Write || !e->e_Ready)
+    {
+        e->e_Stats.es_FIFOErrors++;
+        return;
+    }
+
+    PutLE32(&e->e_Buffer[e->e_Block * e->e_BlockSize + e->e_Pos], value);
+    e->e_Pos += 4;
+
+    if (e->e_Pos >= e->e_BlockSize)
+        BlockDone(e);
+}
+
+static void ResetAll(struct EMMC *e)
+{
+    memset(e->e_Regs, 0, sizeof(e->e_Regs));
+    e->e_Interrupt = 0;
+    e->e_Status = 0;
+    e->e_Event = 0;
+    e->e_Stats.es_Clock = 0;
+    EndData(e);
+}
+
+static void Control1(struct EMMC *e, ULONG value)
+{
+    ULONG old = e->e_Regs[EMMC_CONTROL1 / 4];
+    ULONG clock = 0;
+
+    if (value & SD_RESET_ALL)
+    {
+        e->e_Stats.es_ResetAll++;
+        ResetAll(e);
+        old = 0;
+        value = 0;
+    }
+
+    if (value & SD_RESET_CMD)
+    {
+        e->e_Stats.es_ResetCMD++;
+        e->e_Status &= ~ST_CMD_INHIBIT;
+        if (e->e_Event & CMD_EVENTS)
+            e->e_Event = 0;
+    }
+
+    if (value & SD_RESET_DAT)
+    {
+        e->e_Stats.es_ResetDAT++;
+        if (e->e_Event & ~CMD_EVENTS)
+            e->e_Event = 0;
+        EndData(e);
+    }
+
+    value &= ~C1_RESETS;
+
+    if ((old & C1_CLK_EN) && (value & C1_CLK_EN) && ((old ^ value) & C1_CLK_DIVIDER))
+        e->e_Stats.es_ClockGlitches++;
+
+    // The internal clock is stable as soon as it is enabled
+    value &= ~C1_CLK_STABLE;
+    if (value & C1_CLK_INTLEN)
+        value |= C1_CLK_STABLE;
+
+    e->e_Regs[EMMC_CONTROL1 / 4] = value;
+
+    // 10 bit divided clock mode, SD clock is base / (2 * N), or base if N is 0
+    if ((value & (C1_CLK_INTLEN | C1_CLK_EN)) == (C1_CLK_INTLEN | C1_CLK_EN))
+    {
+        ULONG n = ((value >> 8) & 0xff) | (((value >> 6) & 3) << 8);
+
+        clock = n ? e->e_Config.ec_BaseClock / (2 * n) : e->e_Config.ec_BaseClock;
+        if (clock != e->e_Stats.es_Clock)
+            e->e_Stats.es_ClockChanges++;
+    }
+
+    e->e_Stats.es_Clock = clock;
+}
+
+static ULONG ReadReg(APTR user, ULONG offset)
+{
+    struct EMMC *e = user;
+
+    switch (offset & ~3)
+    {
+        case EMMC_DATA:
+            return ReadFIFO(e);
+
+        case EMMC_INTERRUPT:
+            Advance(e);
+            return e->e_Interrupt | ((e->e_Interrupt & IRQ_ERRORS) ? IRQ_ERROR : 0);
+
+        case EMMC_STATUS:
+        {
+            ULONG status;
+
+            Advance(e);
+            status = e->e_Status | ST_CARD_INSERTED | ST_DAT_LEVEL | ST_CMD_LEVEL;
+            if (e->e_Data)
+            {
+                status |= e->e_Write ? ST_WRITE_ACTIVE : ST_READ_ACTIVE;
+                if (e->e_Ready)
+                    status |= e->e_Write ? ST_WRITE_READY : ST_READ_READY;
+            }
+            return status;
+        }
+
+        case EMMC_SLOTISR_VER:
+            return (0x99 << 24) | (2 << 16);        // Vendor, SD host specification 3.0
+
+        default:
+            return e->e_Regs[offset / 4];
+    }
+}
+
+static void WriteReg(APTR user, ULONG offset, ULONG value)
+{
+    struct EMMC *e = user;
+
+    switch (offset & ~3)
+    {
+        case EMMC_DATA:
+            WriteFIFO(e, value);
+            break;
+
+        case EMMC_CMDTM:
+            e->e_Regs[EMMC_CMDTM / 4] = value;
+            Advance(e);
+            Command(e, value);
+            break;
+
+        case EMMC_INTERRUPT:
+            e->e_Interrupt &= ~value;
+            break;
+
+        case EMMC_FORCE_IRPT:
+            e->e_Stats.es_Forced++;
+            e->e_Interrupt |= value & ~IRQ_ERROR;
+            break;
+
+        case EMMC_CONTROL1:
+            Control1(e, value);
+            break;
+
+        case EMMC_STATUS:
+        case EMMC_SLOTISR_VER:
+            break;
+
+        default:
+            e->e_Regs[offset / 4] = value;
+            break;
+    }
+}
+
+static const struct HostIO EMMCIO = {
+    ReadReg,
+    WriteReg
+};
+
+struct EMMC * EMMCCreate(struct Dongle *dongle, const struct EMMCConfig *config)
+{
+    static const struct EMMCConfig defaults = {
+        .ec_BaseClock = 200000000,
+        .ec_BusTiming = 1,
+    };
+    struct EMMC *e = calloc(1, sizeof(struct EMMC));
+
+    e->e_Dongle = dongle;
+    e->e_Config = config ? *config : defaults;
+    e->e_Buffer = calloc(1, DATA_MAX);
+    e->e_CardWidth = 1;
+
+    return e;
+}
+
+void EMMCDelete(struct EMMC *e)
+{
+    free(e->e_Buffer);
+    free(e);
+}
+
+struct EMMCConfig * EMMCConfig(struct EMMC *e)
+{
+    return &e->e_Config;
+}
+
+struct EMMCStats * EMMCStats(struct EMMC *e)
+{
+    return &e->e_Stats;
+}
+
+void EMMCMap(struct EMMC *e, ULONG base)
+{
+    HostMapIO(base, EMMC_REGS_SIZE, &EMMCIO, e);
+}
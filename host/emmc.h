@@ -0,0 +1,66 @@
+#ifndef _EMMC_H
+#define _EMMC_H
+
+#include <exec/types.h>
+
+/*
+    Register level model of the Arasan EMMC controller the WiFi card is wired to, with the card side of the
+    commands done by the software dongle (dongle.c). Mapped with HostMapIO at the address the driver gets in
+    w_SDIOBase, it lets sdio_init and everything above it run unchanged.
+
+    Commands, data blocks and transfer completion take the time the SD bus would need at the clock and bus
+    width set by the driver, the matching INTERRUPT bits show up once that time passed. Faults can be injected
+    into a chosen command to get the error bits, or no answer at all, the way a misbehaving card gives them.
+*/
+
+struct Dongle;
+
+enum EMMCFault {
+    EMMC_FAULT_NONE = 0,
+    EMMC_FAULT_CMD_TIMEOUT,     // card does not answer the command
+    EMMC_FAULT_CMD_CRC,         // answer comes with broken CRC
+    EMMC_FAULT_DATA_TIMEOUT,    // data block never comes
+    EMMC_FAULT_DATA_CRC,        // first data block has broken CRC
+    EMMC_FAULT_HANG,            // controller never completes the command, CMD inhibit stays set until reset
+};
+
+struct EMMCConfig {
+    ULONG   ec_BaseClock;       // Hz, clock the SD clock divider runs from
+    UBYTE   ec_BusTiming;       // commands and data take the SD bus time, otherwise they complete at once
+    UBYTE   ec_FaultCommand;    // command index faults are injected into
+    UBYTE   ec_Fault;           // enum EMMCFault
+    ULONG   ec_FaultAfter;      // commands with that index passing before the first fault
+    ULONG   ec_FaultCount;      // faults to inject, then the commands pass again
+};
+
+struct EMMCStats {
+    ULONG   es_Commands;
+    ULONG   es_CMD52;
+    ULONG   es_CMD53;
+    ULONG   es_Blocks;          // data blocks moved through the FIFO
+    ULONG   es_Bytes;
+    ULONG   es_Faults;          // faults injected
+    ULONG   es_Errors;          // error interrupts raised, injected ones included
+    ULONG   es_ResetAll;
+    ULONG   es_ResetCMD;
+    ULONG   es_ResetDAT;
+    ULONG   es_Forced;          // interrupts raised through FORCE_IRPT
+    ULONG   es_Clock;           // SD clock in Hz, 0 if stopped
+    ULONG   es_ClockChanges;    // SD clock started at a new rate
+    ULONG   es_ClockGlitches;   // divider changed while the SD clock was running
+    ULONG   es_ClockOff;        // commands issued with the SD clock stopped
+    ULONG   es_Inhibited;       // commands issued while CMD, or DAT for a data command, inhibit was set
+    ULONG   es_FIFOErrors;      // DATA accessed with no buffer ready for it
+    ULONG   es_LengthErrors;    // CMD53 length and BLKSIZECNT disagree
+    ULONG   es_WidthErrors;     // data moved with bus width of controller and card differing
+};
+
+struct EMMC *       EMMCCreate(struct Dongle *dongle, const struct EMMCConfig *config);
+void                EMMCDelete(struct EMMC *emmc);
+struct EMMCConfig * EMMCConfig(struct EMMC *emmc);
+struct EMMCStats *  EMMCStats(struct EMMC *emmc);
+
+/* Map the registers at given address of the board */
+void                EMMCMap(struct EMMC *emmc, ULONG base);
+
+#endif /* _EMMC_H */
@@ -0,0 +1,304 @@
+/*
+    Regression test and benchmark of the EMMC path of sdio.c, against the register model of emmc.c.
+
+    sdio_init enumerates the dongle through the simulated controller. Then CMD52 and backplane CMD53
+    round trips and multi-block backplane writes are timed at the clock sdio_init set and at a lower one
+    set by switch_clock_rate. Stale interrupts are forced to check that handle_interrupts clears them
+    before the next command, and faults are injected into CMD52 and CMD53 to check that cmd_int reports
+    the error bits, or a timeout, and that the bus recovers after each of them. F2 transfers before the
+    firmware runs have to fail in sdio_sendpkt and sdio_recvpkt.
+
+    Usage: wifipi-emmc [-q] [-v]    -q runs a short pass, as done by ctest, -v shows the driver log
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <exec/types.h>
+#include <exec/memory.h>
+#include <proto/exec.h>
+
+#include "wifipi.h"
+#include "brcm.h"
+#include "host.h"
+#include "dongle.h"
+#include "emmc.h"
+
+#define EMMC_BASE           0xfe340000
+#define RAM_BASE            0x198000        // RAM of the BCM4345 behind the backplane
+#define WRITE_SIZE          262144
+#define ERR_DATA_CRC        (1 << 21)
+
+static struct ExecBase *SysBase;
+static struct WiFiBase *WiFiBase;
+static struct SDIO *SDIO;
+static struct Dongle *Dongle;
+static struct EMMC *EMMC;
+static struct EMMCStats *Stats;
+static UBYTE *Pattern;
+static ULONG Rounds;
+static int Failures;
+
+static void Report(const char *name, ULONG count, ULONG bytes, uint64_t us)
+{
+    printf("%-32s %8lu ops %10.1f us/op", name, (unsigned long)count, (double)us / (count ? count : 1));
+    if (bytes)
+        printf(" %8.2f MB/s", bytes / (double)(us ? us : 1));
+    printf("\n");
+}
+
+static void Check(const char *name, ULONG got, ULONG expected)
+{
+    if (got != expected)
+    {
+        printf("FAIL: %s: got %lu, expected %lu\n", name, (unsigned long)got, (unsigned long)expected);
+        Failures++;
+    }
+}
+
+/* SD clock the model runs at for the divider get_clock_divider picks */
+static ULONG ExpectedClock(ULONG target)
+{
+    ULONG divider = get_clock_divider(WiFiBase->w_SDIOClock, target);
+    ULONG n = ((divider >> 8) & 0xff) | (((divider >> 6) & 3) << 8);
+
+    return n ? WiFiBase->w_SDIOClock / (2 * n) : WiFiBase->w_SDIOClock;
+}
+
+static void Inject(UBYTE command, enum EMMCFault fault)
+{
+    struct EMMCConfig *c = EMMCConfig(EMMC);
+
+    c->ec_FaultCommand = command;
+    c->ec_Fault = fault;
+    c->ec_FaultAfter = 0;
+    c->ec_FaultCount = 1;
+}
+
+static void TestInit(const char *name)
+{
+    uint64_t start = HostMicros();
+
+    WiFiBase = AllocMem(sizeof(struct WiFiBase), MEMF_PUBLIC | MEMF_CLEAR);
+    WiFiBase->w_MemPool = CreatePool(MEMF_ANY, 16384, 4096);
+    WiFiBase->w_SysBase = SysBase;
+    WiFiBase->w_SDIOBase = (APTR)(uintptr_t)EMMC_BASE;
+    WiFiBase->w_SDIOClock = EMMCConfig(EMMC)->ec_BaseClock;
+
+    SDIO = sdio_init(WiFiBase);
+    if (SDIO == NULL)
+    {
+        printf("FAIL: %s: sdio_init failed\n", name);
+        exit(EXIT_FAILURE);
+    }
+    Report(name, 1, 0, HostMicros() - start);
+
+    Check(name, Stats->es_Clock, ExpectedClock(SD_CLOCK_NORMAL));
+    Check(name, Stats->es_ClockChanges, 2);
+    Check(name, Stats->es_ClockGlitches, 0);
+    Check(name, Stats->es_ClockOff, 0);
+    Check(name, Stats->es_Inhibited, 0);
+    Check(name, rd32(SDIO->s_SDIO, EMMC_CONTROL0) & 2, 2);
+    Check(name, SDIO->s_CardRCA, 1);
+
+    // CMD8 is the only command left unanswered
+    Check(name, Stats->es_Errors, 1);
+}
+
+static void TestCMD52(const char *name)
+{
+    ULONG good = 0;
+    uint64_t start = HostMicros();
+
+    for (ULONG i = 0; i < Rounds; i++)
+    {
+        SDIO->WriteByte(SD_FUNC_CIA, BUS_IOEN_REG, 1 << SD_FUNC_BAK, SDIO);
+        if (SDIO->ReadByte(SD_FUNC_CIA, BUS_IOEN_REG, SDIO) == 1 << SD_FUNC_BAK && SUCCESS(SDIO))
+            good++;
+    }
+    Report(name, 2 * Rounds, 0, HostMicros() - start);
+
+    Check(name, good, Rounds);
+}
+
+static void TestRead32(const char *name)
+{
+    ULONG good = 0;
+    uint64_t start = HostMicros();
+
+    for (ULONG i = 0; i < Rounds; i++)
+    {
+        if ((SDIO->Read32(SI_ENUM_BASE_DEFAULT, SDIO) & 0xffff) == BRCM_CC_4345_CHIP_ID && SUCCESS(SDIO))
+            good++;
+    }
+    Report(name, Rounds, 0, HostMicros() - start);
+
+    Check(name, good, Rounds);
+}
+
+static void TestBackplane(const char *name)
+{
+    ULONG count = Rounds / 100 ? Rounds / 100 : 1;
+    ULONG good = 0;
+    ULONG blocks = Stats->es_Blocks;
+    uint64_t start = HostMicros();
+
+    for (ULONG i = 0; i < count; i++)
+    {
+        Pattern[0] = i;
+        if (SDIO->BackplaneWrite(RAM_BASE, Pattern, WRITE_SIZE, SDIO))
+            good++;
+    }
+    Report(name, count, count * WRITE_SIZE, HostMicros() - start);
+
+    const UBYTE *ram = DongleMemory(Dongle, RAM_BASE, WRITE_SIZE);
+
+    Check(name, good, count);
+    Check(name, ram != NULL && memcmp(ram, Pattern, WRITE_SIZE) == 0, TRUE);
+    Check(name, Stats->es_Blocks - blocks, count * WRITE_SIZE / SDIO_BLOCK_SIZE_BAK);
+}
+
+static void TestClock(const char *name)
+{
+    ULONG glitches = Stats->es_ClockGlitches;
+
+    Check(name, switch_clock_rate(WiFiBase->w_SDIOClock, 25000000, SDIO), 0);
+    Check(name, Stats->es_Clock, ExpectedClock(25000000));
+    TestBackplane("backplane write 256K, 25MHz");
+
+    Check(name, switch_clock_rate(WiFiBase->w_SDIOClock, SD_CLOCK_NORMAL, SDIO), 0);
+    Check(name, Stats->es_Clock, ExpectedClock(SD_CLOCK_NORMAL));
+    Check(name, Stats->es_ClockGlitches, glitches);
+}
+
+/* Stale interrupts are cleared by handle_interrupts before the next command, the card interrupt asks for status */
+static void TestInterrupts(const char *name)
+{
+    ULONG commands = Stats->es_Commands;
+    ULONG resets = Stats->es_ResetDAT;
+
+    wr32(SDIO->s_SDIO, EMMC_FORCE_IRPT, SD_COMMAND_COMPLETE | SD_TRANSFER_COMPLETE | SD_BUFFER_READ_READY |
+        SD_CARD_INSERTION | SD_CARD_INTERRUPT | ERR_DATA_CRC);
+
+    SDIO->ReadByte(SD_FUNC_CIA, BUS_IOEN_REG, SDIO);
+
+    Check(name, SUCCESS(SDIO), TRUE);
+    Check(name, Stats->es_Commands - commands, 2);
+    Check(name, Stats->es_ResetDAT - resets, 1);
+    Check(name, rd32(SDIO->s_SDIO, EMMC_INTERRUPT), 0);
+}
+
+static void TestFaults(const char *name)
+{
+    ULONG faults = Stats->es_Faults;
+    ULONG data = 0;
+    uint64_t start;
+
+    Inject(52, EMMC_FAULT_CMD_TIMEOUT);
+    SDIO->ReadByte(SD_FUNC_CIA, BUS_IOEN_REG, SDIO);
+    Check("cmd52 timeout", CMD_TIMEOUT(SDIO), TRUE);
+
+    Inject(52, EMMC_FAULT_CMD_CRC);
+    SDIO->ReadByte(SD_FUNC_CIA, BUS_IOEN_REG, SDIO);
+    Check("cmd52 crc", CMD_CRC(SDIO), TRUE);
+
+    Inject(53, EMMC_FAULT_DATA_TIMEOUT);
+    SDIO->Read32(SI_ENUM_BASE_DEFAULT, SDIO);
+    Check("cmd53 data timeout", DATA_TIMEOUT(SDIO), TRUE);
+
+    Inject(53, EMMC_FAULT_DATA_CRC);
+    SDIO->Read32(SI_ENUM_BASE_DEFAULT, SDIO);
+    Check("cmd53 read data crc", DATA_CRC(SDIO), TRUE);
+
+    Inject(53, EMMC_FAULT_DATA_CRC);
+    Check("cmd53 write data crc", SDIO->BackplaneWrite(RAM_BASE, Pattern, 4096, SDIO), 0);
+    Check("cmd53 write data crc", DATA_CRC(SDIO), TRUE);
+
+    Check("recovered", SDIO->Read32(SI_ENUM_BASE_DEFAULT, SDIO) & 0xffff, BRCM_CC_4345_CHIP_ID);
+
+    // Controller which never completes: cmd_int gives up, switch_clock_rate does not wait forever for inhibit
+    Inject(52, EMMC_FAULT_HANG);
+    start = HostMicros();
+    SDIO->ReadByte(SD_FUNC_CIA, BUS_IOEN_REG, SDIO);
+    Check("cmd52 hang", TIMEOUT(SDIO), TRUE);
+    Check("clock switch on hung bus", switch_clock_rate(WiFiBase->w_SDIOClock, SD_CLOCK_NORMAL, SDIO), -1);
+    Report("hang and clock switch timeout", 1, 0, HostMicros() - start);
+
+    wr32(SDIO->s_SDIO, EMMC_CONTROL1, rd32(SDIO->s_SDIO, EMMC_CONTROL1) | SD_RESET_CMD);
+    wr32(SDIO->s_SDIO, EMMC_INTERRUPT, 0xffffffff);
+    data = SDIO->ReadByte(SD_FUNC_CIA, BUS_IOEN_REG, SDIO);
+    Check("recovered after cmd reset", SUCCESS(SDIO) && data == 1 << SD_FUNC_BAK, TRUE);
+
+    Check(name, Stats->es_Faults - faults, 6);
+    Check(name, Stats->es_FIFOErrors, 0);
+    Check(name, Stats->es_LengthErrors, 0);
+    Check(name, Stats->es_WidthErrors, 0);
+}
+
+/* F2 is not ready before the firmware runs, the card neither takes nor sends data on it */
+static void TestF2(const char *name)
+{
+    UBYTE *buffer = SDIO->s_TXBuffer;
+
+    memset(buffer, 0, 600);
+
+    SDIO->SendPKT(buffer, 600, SDIO);
+    Check(name, DATA_TIMEOUT(SDIO), TRUE);
+
+    SDIO->RecvPKT(buffer, 64, SDIO);
+    Check(name, DATA_TIMEOUT(SDIO), TRUE);
+
+    Check("recovered", SDIO->Read32(SI_ENUM_BASE_DEFAULT, SDIO) & 0xffff, BRCM_CC_4345_CHIP_ID);
+}
+
+static void EMMCMain(APTR arg)
+{
+    (void)arg;
+
+    SysBase = HostSysBase;
+    Stats = EMMCStats(EMMC);
+    Pattern = malloc(WRITE_SIZE);
+    for (ULONG i = 0; i < WRITE_SIZE; i++)
+        Pattern[i] = i * 7 + (i >> 8);
+
+    TestInit("sdio_init");
+    TestCMD52("cmd52");
+    TestRead32("backplane read32");
+    TestBackplane("backplane write 256K");
+    TestClock("switch_clock_rate");
+    TestInterrupts("handle_interrupts");
+    TestFaults("faults");
+    TestF2("f2 before boot");
+
+    printf("emmc: %lu commands, %lu blocks, %lu bytes, %lu errors, SD clock %lu Hz\n",
+        (unsigned long)Stats->es_Commands, (unsigned long)Stats->es_Blocks, (unsigned long)Stats->es_Bytes,
+        (unsigned long)Stats->es_Errors, (unsigned long)Stats->es_Clock);
+
+    free(Pattern);
+}
+
+int main(int argc, char **argv)
+{
+    Rounds = 20000;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-q") == 0)
+            Rounds = 1000;
+        else if (strcmp(argv[i], "-v") == 0)
+            HostConsole(1);
+    }
+
+    HostInit();
+
+    Dongle = DongleCreate(NULL);
+    EMMC = EMMCCreate(Dongle, NULL);
+    EMMCMap(EMMC, EMMC_BASE);
+
+    HostRun(EMMCMain, NULL);
+
+    if (Failures)
+        printf("%d check(s) failed\n", Failures);
+
+    return Failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,1258 @@
+/*
+    exec.library and timer.device of the host build.
+
+    Every task is a pthread, but only one of them runs at a time: whoever holds HostCPU is the running
+    task, and it gives the CPU away only when it waits for signals. This is how the driver sees exec on
+    a single core Amiga as long as nobody preempts it, Forbid/Disable have nothing left to do.
+
+    Everything the driver gets from exec (memory, pools, stacks) comes from an arena below 4 GB, so that
+    the (ULONG) casts of pointers done by the driver keep working on a 64 bit host.
+*/
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include <exec/types.h>
+#include <exec/execbase.h>
+#include <exec/errors.h>
+#include <devices/timer.h>
+#include <dos/dosextens.h>
+#include <clib/exec_protos.h>
+#include <clib/timer_protos.h>
+
+#include "host.h"
+
+#define ARENA_SIZE      (256UL << 20)
+#define ARENA_HINT      0x10000000UL
+#define TASK_STACK_SIZE (1024UL << 10)
+
+#define CHUNK_MAGIC     0x57695069
+#define CHUNK_MIN_SHIFT 5
+#define CHUNK_CLASSES   32
+
+pthread_mutex_t HostCPU = PTHREAD_MUTEX_INITIALIZER;
+
+struct ExecBase *HostSysBase;
+static uint64_t HostStart;
+
+/* Arena */
+
+struct Chunk {
+    ULONG   c_Magic;
+    ULONG   c_Class;
+    ULONG   c_Size;
+    ULONG   c_Pad;
+};
+
+static pthread_mutex_t ArenaLock = PTHREAD_MUTEX_INITIALIZER;
+static UBYTE *ArenaTop;
+static UBYTE *ArenaEnd;
+static struct Chunk *FreeChunks[CHUNK_CLASSES];
+
+static void ArenaInit(void)
+{
+    void *arena;
+
+    arena = mmap((void *)ARENA_HINT, ARENA_SIZE, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED_NOREPLACE, -1, 0);
+#ifdef MAP_32BIT
+    if (arena == MAP_FAILED)
+        arena = mmap(NULL, ARENA_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_32BIT, -1, 0);
+#endif
+
+    if (arena == MAP_FAILED || (uintptr_t)arena + ARENA_SIZE > 0x100000000UL)
+    {
+        fprintf(stderr, "host: cannot map memory arena below 4GB\n");
+        exit(1);
+    }
+
+    ArenaTop = arena;
+    ArenaEnd = ArenaTop + ARENA_SIZE;
+}
+
+APTR HostAlloc(ULONG size)
+{
+    struct Chunk *c;
+    ULONG cls = CHUNK_MIN_SHIFT;
+
+    while ((1UL << cls) < (uint64_t)size + sizeof(struct Chunk))
+        cls++;
+
+    pthread_mutex_lock(&ArenaLock);
+
+    c = FreeChunks[cls];
+    if (c != NULL)
+    {
+        FreeChunks[cls] = *(struct Chunk **)&c[1];
+    }
+    else if (ArenaTop + (1UL << cls) <= ArenaEnd)
+    {
+        c = (struct Chunk *)ArenaTop;
+        ArenaTop += 1UL << cls;
+    }
+
+    pthread_mutex_unlock(&ArenaLock);
+
+    if (c == NULL)
+        return NULL;
+
+    c->c_Magic = CHUNK_MAGIC;
+    c->c_Class = cls;
+    c->c_Size = size;
+
+    return &c[1];
+}
+
+void HostFree(APTR memory)
+{
+    struct Chunk *c = (struct Chunk *)memory - 1;
+
+    if (memory == NULL)
+        return;
+
+    if (c->c_Magic != CHUNK_MAGIC)
+    {
+        fprintf(stderr, "host: freeing %p which was not allocated by exec\n", memory);
+        abort();
+    }
+
+    c->c_Magic = 0;
+
+    pthread_mutex_lock(&ArenaLock);
+    *(struct Chunk **)&c[1] = FreeChunks[c->c_Class];
+    FreeChunks[c->c_Class] = c;
+    pthread_mutex_unlock(&ArenaLock);
+}
+
+ULONG HostAllocSize(APTR memory)
+{
+    return ((struct Chunk *)memory - 1)->c_Size;
+}
+
+/* Time */
+
+uint64_t HostMicros(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000 - HostStart;
+}
+
+void HostSleep(ULONG micros)
+{
+    struct timespec ts = { micros / 1000000, (micros % 1000000) * 1000 };
+
+    pthread_mutex_unlock(&HostCPU);
+    nanosleep(&ts, NULL);
+    pthread_mutex_lock(&HostCPU);
+}
+
+/* Tasks */
+
+struct HostTask {
+    struct HostTask *   ht_Next;
+    struct Task *       ht_Task;
+    pthread_t           ht_Thread;
+    pthread_cond_t      ht_Wake;
+    APTR                ht_Entry;
+    APTR                ht_Stack;
+    uintptr_t           ht_Args[4];
+    BOOL                ht_Finished;
+};
+
+static __thread struct HostTask *ThisHost;
+static struct HostTask *HostTasks;
+
+/* Host side of the task is kept in tc_TrapData which the driver never uses */
+static inline struct HostTask *HostOf(struct Task *task)
+{
+    return task->tc_TrapData;
+}
+
+static void FreeMemEntry(struct Task *task)
+{
+    struct MemList *ml;
+
+    while ((ml = (struct MemList *)Exec_RemHead(HostSysBase, &task->tc_MemEntry)) != NULL)
+    {
+        for (int i = 0; i < ml->ml_NumEntries; i++)
+            HostFree(ml->ml_ME[i].me_Addr);
+        HostFree(ml);
+    }
+}
+
+static void *TaskTrampoline(void *arg)
+{
+    struct HostTask *h = arg;
+    struct Task *task = h->ht_Task;
+
+    pthread_mutex_lock(&HostCPU);
+
+    ThisHost = h;
+    task->tc_State = TS_RUN;
+
+    ((void (*)(uintptr_t, uintptr_t, uintptr_t, uintptr_t))h->ht_Entry)(h->ht_Args[0], h->ht_Args[1], h->ht_Args[2], h->ht_Args[3]);
+
+    /* Task returned, unlink it and release everything it owned */
+    for (struct HostTask **p = &HostTasks; *p != NULL; p = &(*p)->ht_Next)
+    {
+        if (*p == h)
+        {
+            *p = h->ht_Next;
+            break;
+        }
+    }
+
+    task->tc_State = TS_REMOVED;
+    task->tc_TrapData = NULL;
+    FreeMemEntry(task);
+
+    h->ht_Task = NULL;
+    h->ht_Finished = TRUE;
+    h->ht_Next = HostTasks;
+    HostTasks = h;
+
+    pthread_mutex_unlock(&HostCPU);
+
+    return NULL;
+}
+
+/* Join threads of tasks which have finished since the last call */
+static void ReapTasks(void)
+{
+    for (struct HostTask **p = &HostTasks; *p != NULL; )
+    {
+        struct HostTask *h = *p;
+
+        if (h->ht_Finished)
+        {
+            *p = h->ht_Next;
+            pthread_join(h->ht_Thread, NULL);
+            pthread_cond_destroy(&h->ht_Wake);
+            HostFree(h->ht_Stack);
+            free(h);
+        }
+        else
+            p = &h->ht_Next;
+    }
+}
+
+APTR Exec_AddTask(struct ExecBase *SysBase, struct Task *task, APTR initialPC, APTR finalPC)
+{
+    struct HostTask *h = calloc(1, sizeof(struct HostTask));
+    pthread_attr_t attr;
+    (void)finalPC;
+
+    ReapTasks();
+
+    h->ht_Task = task;
+    h->ht_Entry = initialPC;
+    h->ht_Stack = HostAlloc(TASK_STACK_SIZE);
+    pthread_cond_init(&h->ht_Wake, NULL);
+
+    /* Arguments pushed by the creator on the task stack, the way the m68k entry code would find them */
+    if (task->tc_SPReg != NULL)
+    {
+        ULONG *sp = task->tc_SPReg;
+
+        for (int i = 0; i < 4 && (APTR)&sp[i] < task->tc_SPUpper; i++)
+            h->ht_Args[i] = sp[i];
+    }
+
+    if (task->tc_SigAlloc == 0)
+        task->tc_SigAlloc = SYS_SIGALLOC;
+    if (task->tc_MemEntry.lh_Head == NULL)
+        Exec_NewMinList(SysBase, (struct MinList *)&task->tc_MemEntry);
+    task->tc_TrapData = h;
+    task->tc_State = TS_READY;
+
+    h->ht_Next = HostTasks;
+    HostTasks = h;
+
+    /* Stack in the arena, the driver passes addresses of locals around as ULONG */
+    pthread_attr_init(&attr);
+    pthread_attr_setstack(&attr, h->ht_Stack, TASK_STACK_SIZE);
+    pthread_create(&h->ht_Thread, &attr, TaskTrampoline, h);
+    pthread_attr_destroy(&attr);
+
+    return task;
+}
+
+struct Task * Exec_FindTask(struct ExecBase *SysBase, CONST_STRPTR name)
+{
+    (void)SysBase;
+
+    if (name == NULL)
+        return ThisHost ? ThisHost->ht_Task : NULL;
+
+    for (struct HostTask *h = HostTasks; h != NULL; h = h->ht_Next)
+    {
+        if (h->ht_Task && h->ht_Task->tc_Node.ln_Name && strcmp(h->ht_Task->tc_Node.ln_Name, (const char *)name) == 0)
+            return h->ht_Task;
+    }
+
+    return NULL;
+}
+
+ULONG Exec_Wait(struct ExecBase *SysBase, ULONG signalSet)
+{
+    struct Task *task = ThisHost->ht_Task;
+    ULONG got;
+    (void)SysBase;
+
+    task->tc_SigWait = signalSet;
+
+    while ((task->tc_SigRecvd & signalSet) == 0)
+    {
+        task->tc_State = TS_WAIT;
+        pthread_cond_wait(&ThisHost->ht_Wake, &HostCPU);
+    }
+
+    task->tc_State = TS_RUN;
+    task->tc_SigWait = 0;
+
+    got = task->tc_SigRecvd & signalSet;
+    task->tc_SigRecvd &= ~got;
+
+    return got;
+}
+
+void Exec_Signal(struct ExecBase *SysBase, struct Task *task, ULONG signalSet)
+{
+    struct HostTask *h = HostOf(task);
+    (void)SysBase;
+
+    task->tc_SigRecvd |= signalSet;
+
+    if (h != NULL && (task->tc_SigRecvd & task->tc_SigWait))
+        pthread_cond_signal(&h->ht_Wake);
+}
+
+ULONG Exec_SetSignal(struct ExecBase *SysBase, ULONG newSignals, ULONG signalSet)
+{
+    struct Task *task = ThisHost->ht_Task;
+    ULONG old = task->tc_SigRecvd;
+    (void)SysBase;
+
+    task->tc_SigRecvd = (old & ~signalSet) | (newSignals & signalSet);
+
+    return old;
+}
+
+BYTE Exec_AllocSignal(struct ExecBase *SysBase, LONG signalNum)
+{
+    struct Task *task = ThisHost->ht_Task;
+    (void)SysBase;
+
+    if (signalNum < 0)
+    {
+        for (signalNum = 31; signalNum >= 0; signalNum--)
+        {
+            if ((task->tc_SigAlloc & (1UL << signalNum)) == 0)
+                break;
+        }
+
+        if (signalNum < 0)
+            return -1;
+    }
+    else if (task->tc_SigAlloc & (1UL << signalNum))
+        return -1;
+
+    task->tc_SigAlloc |= 1UL << signalNum;
+    task->tc_SigRecvd &= ~(1UL << signalNum);
+
+    return signalNum;
+}
+
+void Exec_FreeSignal(struct ExecBase *SysBase, LONG signalNum)
+{
+    (void)SysBase;
+
+    if (signalNum >= 0 && ThisHost != NULL)
+        ThisHost->ht_Task->tc_SigAlloc &= ~(1UL << signalNum);
+}
+
+/* Only one task runs at a time, there is nothing to exclude */
+
+void Exec_Forbid(struct ExecBase *SysBase) { (void)SysBase; }
+void Exec_Permit(struct ExecBase *SysBase) { (void)SysBase; }
+void Exec_Disable(struct ExecBase *SysBase) { (void)SysBase; }
+void Exec_Enable(struct ExecBase *SysBase) { (void)SysBase; }
+
+/* Lists */
+
+void Exec_AddHead(struct ExecBase *SysBase, struct List *list, struct Node *node)
+{
+    (void)SysBase;
+
+    node->ln_Succ = list->lh_Head;
+    node->ln_Pred = (struct Node *)&list->lh_Head;
+    list->lh_Head->ln_Pred = node;
+    list->lh_Head = node;
+}
+
+void Exec_AddTail(struct ExecBase *SysBase, struct List *list, struct Node *node)
+{
+    (void)SysBase;
+
+    node->ln_Succ = (struct Node *)&list->lh_Tail;
+    node->ln_Pred = list->lh_TailPred;
+    list->lh_TailPred->ln_Succ = node;
+    list->lh_TailPred = node;
+}
+
+void Exec_Remove(struct ExecBase *SysBase, struct Node *node)
+{
+    (void)SysBase;
+
+    node->ln_Pred->ln_Succ = node->ln_Succ;
+    node->ln_Succ->ln_Pred = node->ln_Pred;
+}
+
+struct Node * Exec_RemHead(struct ExecBase *SysBase, struct List *list)
+{
+    struct Node *node = list->lh_Head;
+    (void)SysBase;
+
+    if (node->ln_Succ == NULL)
+        return NULL;
+
+    list->lh_Head = node->ln_Succ;
+    node->ln_Succ->ln_Pred = (struct Node *)&list->lh_Head;
+
+    return node;
+}
+
+void Exec_NewMinList(struct ExecBase *SysBase, struct MinList *list)
+{
+    (void)SysBase;
+
+    list->mlh_Head = (struct MinNode *)&list->mlh_Tail;
+    list->mlh_Tail = NULL;
+    list->mlh_TailPred = (struct MinNode *)&list->mlh_Head;
+}
+
+/* Messages */
+
+struct MsgPort * Exec_CreateMsgPort(struct ExecBase *SysBase)
+{
+    struct MsgPort *port = Exec_AllocMem(SysBase, sizeof(struct MsgPort), MEMF_PUBLIC | MEMF_CLEAR);
+    BYTE sigBit = Exec_AllocSignal(SysBase, -1);
+
+    if (sigBit < 0)
+    {
+        Exec_FreeMem(SysBase, port, sizeof(struct MsgPort));
+        return NULL;
+    }
+
+    port->mp_Node.ln_Type = NT_MSGPORT;
+    port->mp_Flags = PA_SIGNAL;
+    port->mp_SigBit = sigBit;
+    port->mp_SigTask = Exec_FindTask(SysBase, NULL);
+    Exec_NewMinList(SysBase, (struct MinList *)&port->mp_MsgList);
+
+    return port;
+}
+
+void Exec_DeleteMsgPort(struct ExecBase *SysBase, struct MsgPort *port)
+{
+    if (port == NULL)
+        return;
+
+    Exec_FreeSignal(SysBase, port->mp_SigBit);
+    Exec_FreeMem(SysBase, port, sizeof(struct MsgPort));
+}
+
+static void QueueMsg(struct ExecBase *SysBase, struct MsgPort *port, struct Message *message)
+{
+    Exec_AddTail(SysBase, &port->mp_MsgList, &message->mn_Node);
+
+    if ((port->mp_Flags & PF_ACTION) == PA_SIGNAL && port->mp_SigTask != NULL)
+        Exec_Signal(SysBase, port->mp_SigTask, 1UL << port->mp_SigBit);
+}
+
+void Exec_PutMsg(struct ExecBase *SysBase, struct MsgPort *port, struct Message *message)
+{
+    message->mn_Node.ln_Type = NT_MESSAGE;
+    QueueMsg(SysBase, port, message);
+}
+
+struct Message * Exec_GetMsg(struct ExecBase *SysBase, struct MsgPort *port)
+{
+    return (struct Message *)Exec_RemHead(SysBase, &port->mp_MsgList);
+}
+
+void Exec_ReplyMsg(struct ExecBase *SysBase, struct Message *message)
+{
+    if (message->mn_ReplyPort == NULL)
+    {
+        message->mn_Node.ln_Type = NT_FREEMSG;
+        return;
+    }
+
+    message->mn_Node.ln_Type = NT_REPLYMSG;
+    QueueMsg(SysBase, message->mn_ReplyPort, message);
+}
+
+struct Message * Exec_WaitPort(struct ExecBase *SysBase, struct MsgPort *port)
+{
+    while (port->mp_MsgList.lh_Head->ln_Succ == NULL)
+        Exec_Wait(SysBase, 1UL << port->mp_SigBit);
+
+    return (struct Message *)port->mp_MsgList.lh_Head;
+}
+
+/* Semaphores. Waiters queue up in ss_WaitQueue and are all woken on release, each one retries */
+
+void Exec_InitSemaphore(struct ExecBase *SysBase, struct SignalSemaphore *sem)
+{
+    memset(sem, 0, sizeof(struct SignalSemaphore));
+    sem->ss_Link.ln_Type = NT_SIGNALSEM;
+    Exec_NewMinList(SysBase, &sem->ss_WaitQueue);
+}
+
+/* The request stays on the stack of the waiter, it is off the queue again before SemaphoreWait returns */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdangling-pointer"
+static void SemaphoreWait(struct ExecBase *SysBase, struct SignalSemaphore *sem, BOOL shared)
+{
+    struct Task *me = Exec_FindTask(SysBase, NULL);
+    struct SemaphoreRequest req;
+
+    req.sr_Waiter = me;
+    req.sr_Link.mln_Succ = (struct MinNode *)&sem->ss_WaitQueue.mlh_Tail;
+    req.sr_Link.mln_Pred = sem->ss_WaitQueue.mlh_TailPred;
+    sem->ss_WaitQueue.mlh_TailPred->mln_Succ = &req.sr_Link;
+    sem->ss_WaitQueue.mlh_TailPred = &req.sr_Link;
+
+    while (sem->ss_Owner != NULL || (!shared && sem->ss_QueueCount != 0))
+    {
+        Exec_SetSignal(SysBase, 0, SIGF_SINGLE);
+        Exec_Wait(SysBase, SIGF_SINGLE);
+    }
+
+    req.sr_Link.mln_Pred->mln_Succ = req.sr_Link.mln_Succ;
+    req.sr_Link.mln_Succ->mln_Pred = req.sr_Link.mln_Pred;
+}
+#pragma GCC diagnostic pop
+
+void Exec_ObtainSemaphore(struct ExecBase *SysBase, struct SignalSemaphore *sem)
+{
+    struct Task *me = Exec_FindTask(SysBase, NULL);
+
+    if (sem->ss_Owner != me)
+    {
+        if (sem->ss_Owner != NULL || sem->ss_QueueCount != 0)
+            SemaphoreWait(SysBase, sem, FALSE);
+
+        sem->ss_Owner = me;
+    }
+
+    sem->ss_NestCount++;
+}
+
+void Exec_ObtainSemaphoreShared(struct ExecBase *SysBase, struct SignalSemaphore *sem)
+{
+    struct Task *me = Exec_FindTask(SysBase, NULL);
+
+    if (sem->ss_Owner == me)
+    {
+        sem->ss_NestCount++;
+        return;
+    }
+
+    if (sem->ss_Owner != NULL)
+        SemaphoreWait(SysBase, sem, TRUE);
+
+    sem->ss_QueueCount++;
+}
+
+ULONG Exec_AttemptSemaphore(struct ExecBase *SysBase, struct SignalSemaphore *sem)
+{
+    struct Task *me = Exec_FindTask(SysBase, NULL);
+
+    if (sem->ss_Owner == me || (sem->ss_Owner == NULL && sem->ss_QueueCount == 0))
+    {
+        sem->ss_Owner = me;
+        sem->ss_NestCount++;
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+void Exec_ReleaseSemaphore(struct ExecBase *SysBase, struct SignalSemaphore *sem)
+{
+    struct Task *me = Exec_FindTask(SysBase, NULL);
+
+    if (sem->ss_Owner == me)
+    {
+        if (--sem->ss_NestCount != 0)
+            return;
+        sem->ss_Owner = NULL;
+    }
+    else if (--sem->ss_QueueCount != 0)
+        return;
+
+    for (struct MinNode *n = sem->ss_WaitQueue.mlh_Head; n->mln_Succ != NULL; n = n->mln_Succ)
+        Exec_Signal(SysBase, ((struct SemaphoreRequest *)n)->sr_Waiter, SIGF_SINGLE);
+}
+
+/* Memory */
+
+APTR Exec_AllocMem(struct ExecBase *SysBase, ULONG byteSize, ULONG requirements)
+{
+    APTR mem = HostAlloc(byteSize);
+    (void)SysBase;
+
+    if (mem != NULL && (requirements & MEMF_CLEAR))
+        memset(mem, 0, byteSize);
+
+    return mem;
+}
+
+void Exec_FreeMem(struct ExecBase *SysBase, APTR memoryBlock, ULONG byteSize)
+{
+    (void)SysBase;
+    (void)byteSize;
+
+    HostFree(memoryBlock);
+}
+
+APTR Exec_AllocVec(struct ExecBase *SysBase, ULONG byteSize, ULONG requirements)
+{
+    return Exec_AllocMem(SysBase, byteSize, requirements);
+}
+
+void Exec_FreeVec(struct ExecBase *SysBase, APTR memoryBlock)
+{
+    (void)SysBase;
+
+    HostFree(memoryBlock);
+}
+
+/* Pool keeps a list of its allocations, DeletePool returns them all */
+struct HostPool {
+    struct MinList  hp_Blocks;
+    ULONG           hp_Requirements;
+};
+
+APTR Exec_CreatePool(struct ExecBase *SysBase, ULONG requirements, ULONG puddleSize, ULONG threshSize)
+{
+    struct HostPool *pool = HostAlloc(sizeof(struct HostPool));
+    (void)puddleSize;
+    (void)threshSize;
+
+    if (pool != NULL)
+    {
+        Exec_NewMinList(SysBase, &pool->hp_Blocks);
+        pool->hp_Requirements = requirements;
+    }
+
+    return pool;
+}
+
+void Exec_DeletePool(struct ExecBase *SysBase, APTR poolHeader)
+{
+    struct HostPool *pool = poolHeader;
+    struct Node *n;
+
+    if (pool == NULL)
+        return;
+
+    while ((n = Exec_RemHead(SysBase, (struct List *)&pool->hp_Blocks)) != NULL)
+        HostFree(n);
+
+    HostFree(pool);
+}
+
+APTR Exec_AllocPooled(struct ExecBase *SysBase, APTR poolHeader, ULONG memSize)
+{
+    struct HostPool *pool = poolHeader;
+    struct MinNode *n = HostAlloc(sizeof(struct MinNode) + memSize);
+
+    if (n == NULL)
+        return NULL;
+
+    Exec_AddTail(SysBase, (struct List *)&pool->hp_Blocks, (struct Node *)n);
+
+    if (pool->hp_Requirements & MEMF_CLEAR)
+        memset(&n[1], 0, memSize);
+
+    return &n[1];
+}
+
+void Exec_FreePooled(struct ExecBase *SysBase, APTR poolHeader, APTR memory, ULONG memSize)
+{
+    struct MinNode *n = (struct MinNode *)memory - 1;
+    (void)poolHeader;
+    (void)memSize;
+
+    if (memory == NULL)
+        return;
+
+    Exec_Remove(SysBase, (struct Node *)n);
+    HostFree(n);
+}
+
+void Exec_CopyMem(struct ExecBase *SysBase, CONST_APTR source, APTR dest, ULONG size)
+{
+    (void)SysBase;
+
+    memmove(dest, source, size);
+}
+
+APTR Exec_CachePreDMA(struct ExecBase *SysBase, CONST_APTR address, ULONG *length, ULONG flags)
+{
+    (void)SysBase;
+    (void)length;
+    (void)flags;
+
+    return (APTR)address;
+}
+
+void Exec_CachePostDMA(struct ExecBase *SysBase, CONST_APTR address, ULONG *length, ULONG flags)
+{
+    (void)SysBase;
+    (void)address;
+    (void)length;
+    (void)flags;
+}
+
+/* Libraries, resources and devices are looked up by name in the ExecBase lists */
+
+static struct Node * FindName(struct List *list, CONST_STRPTR name)
+{
+    for (struct Node *n = list->lh_Head; n->ln_Succ != NULL; n = n->ln_Succ)
+    {
+        if (strcmp(n->ln_Name, (const char *)name) == 0)
+            return n;
+    }
+
+    return NULL;
+}
+
+void HostAddLibrary(struct Library *library)
+{
+    Exec_AddTail(HostSysBase, &HostSysBase->LibList, &library->lib_Node);
+}
+
+struct HostResource {
+    struct Node     hr_Node;
+    APTR            hr_Base;
+};
+
+void HostAddResource(const char *name, APTR base)
+{
+    struct HostResource *r = Exec_AllocMem(HostSysBase, sizeof(struct HostResource), MEMF_CLEAR);
+
+    r->hr_Node.ln_Name = (char *)name;
+    r->hr_Node.ln_Type = NT_RESOURCE;
+    r->hr_Base = base;
+
+    Exec_AddTail(HostSysBase, &HostSysBase->ResourceList, &r->hr_Node);
+}
+
+APTR Exec_OpenResource(struct ExecBase *SysBase, CONST_STRPTR resName)
+{
+    struct HostResource *r = (struct HostResource *)FindName(&SysBase->ResourceList, resName);
+
+    return r ? r->hr_Base : NULL;
+}
+
+struct Library * Exec_OpenLibrary(struct ExecBase *SysBase, CONST_STRPTR libName, ULONG version)
+{
+    struct Library *lib = (struct Library *)FindName(&SysBase->LibList, libName);
+
+    if (lib != NULL && lib->lib_Version >= version)
+    {
+        lib->lib_OpenCnt++;
+        return lib;
+    }
+
+    return NULL;
+}
+
+void Exec_CloseLibrary(struct ExecBase *SysBase, struct Library *library)
+{
+    (void)SysBase;
+
+    if (library != NULL)
+        library->lib_OpenCnt--;
+}
+
+/* Devices. Host keeps the function table of every device next to its base */
+
+struct HostDevice {
+    struct Device * hd_Device;
+    const APTR *    hd_Functions;
+};
+
+#define DEV_OPEN        0
+#define DEV_CLOSE       1
+#define DEV_BEGIN_IO    4
+#define DEV_ABORT_IO    5
+
+static struct HostDevice HostDevices[8];
+static int HostDeviceCount;
+
+static const APTR * DeviceFunctions(struct Device *device)
+{
+    for (int i = 0; i < HostDeviceCount; i++)
+    {
+        if (HostDevices[i].hd_Device == device)
+            return HostDevices[i].hd_Functions;
+    }
+
+    fprintf(stderr, "host: IO request for unknown device %p\n", (void *)device);
+    abort();
+}
+
+void HostAddDevice(struct Device *device, const APTR *functions)
+{
+    HostDevices[HostDeviceCount].hd_Device = device;
+    HostDevices[HostDeviceCount].hd_Functions = functions;
+    HostDeviceCount++;
+
+    Exec_AddTail(HostSysBase, &HostSysBase->DeviceList, &device->dd_Library.lib_Node);
+}
+
+/* Create device base from the InitTable of a device and run its init function, the way MakeLibrary would */
+struct Device * HostLoadDevice(const char *name, const char *idString, const APTR *initTable)
+{
+    struct Device *base = Exec_AllocMem(HostSysBase, (ULONG)(uintptr_t)initTable[0], MEMF_PUBLIC | MEMF_CLEAR);
+    APTR (*init)(APTR, BPTR, struct ExecBase *) = initTable[3];
+
+    base->dd_Library.lib_Node.ln_Name = (char *)name;
+    base->dd_Library.lib_Node.ln_Type = NT_DEVICE;
+    base->dd_Library.lib_IdString = (APTR)idString;
+
+    pthread_mutex_lock(&HostCPU);
+    base = init(base, 0, HostSysBase);
+    if (base != NULL)
+        HostAddDevice(base, initTable[1]);
+    pthread_mutex_unlock(&HostCPU);
+
+    return base;
+}
+
+BYTE Exec_OpenDevice(struct ExecBase *SysBase, CONST_STRPTR devName, ULONG unitNumber, struct IORequest *ioRequest, ULONG flags)
+{
+    struct Device *device = (struct Device *)FindName(&SysBase->DeviceList, devName);
+
+    if (device == NULL)
+    {
+        ioRequest->io_Error = IOERR_OPENFAIL;
+        return IOERR_OPENFAIL;
+    }
+
+    ioRequest->io_Device = device;
+    ioRequest->io_Error = 0;
+    ((void (*)(struct IORequest *, ULONG, ULONG))DeviceFunctions(device)[DEV_OPEN])(ioRequest, unitNumber, flags);
+
+    if (ioRequest->io_Error != 0)
+        ioRequest->io_Device = NULL;
+
+    return ioRequest->io_Error;
+}
+
+void Exec_CloseDevice(struct ExecBase *SysBase, struct IORequest *ioRequest)
+{
+    (void)SysBase;
+
+    if (ioRequest->io_Device != NULL)
+        ((BPTR (*)(struct IORequest *))DeviceFunctions(ioRequest->io_Device)[DEV_CLOSE])(ioRequest);
+
+    ioRequest->io_Device = NULL;
+}
+
+APTR Exec_CreateIORequest(struct ExecBase *SysBase, struct MsgPort *port, ULONG size)
+{
+    struct IORequest *io;
+
+    if (port == NULL)
+        return NULL;
+
+    io = Exec_AllocMem(SysBase, size, MEMF_PUBLIC | MEMF_CLEAR);
+    if (io != NULL)
+    {
+        io->io_Message.mn_Node.ln_Type = NT_REPLYMSG;
+        io->io_Message.mn_ReplyPort = port;
+        io->io_Message.mn_Length = size;
+    }
+
+    return io;
+}
+
+void Exec_DeleteIORequest(struct ExecBase *SysBase, APTR ioRequest)
+{
+    (void)SysBase;
+
+    HostFree(ioRequest);
+}
+
+static void BeginIO(struct IORequest *ioRequest)
+{
+    ((void (*)(struct IORequest *))DeviceFunctions(ioRequest->io_Device)[DEV_BEGIN_IO])(ioRequest);
+}
+
+BYTE Exec_DoIO(struct ExecBase *SysBase, struct IORequest *ioRequest)
+{
+    ioRequest->io_Flags = IOF_QUICK;
+    ioRequest->io_Message.mn_Node.ln_Type = 0;
+    BeginIO(ioRequest);
+
+    return Exec_WaitIO(SysBase, ioRequest);
+}
+
+void Exec_SendIO(struct ExecBase *SysBase, struct IORequest *ioRequest)
+{
+    (void)SysBase;
+
+    ioRequest->io_Flags = 0;
+    ioRequest->io_Message.mn_Node.ln_Type = 0;
+    BeginIO(ioRequest);
+}
+
+struct IORequest * Exec_CheckIO(struct ExecBase *SysBase, struct IORequest *ioRequest)
+{
+    (void)SysBase;
+
+    if ((ioRequest->io_Flags & IOF_QUICK) == 0 && ioRequest->io_Message.mn_Node.ln_Type == NT_MESSAGE)
+        return NULL;
+
+    return ioRequest;
+}
+
+BYTE Exec_WaitIO(struct ExecBase *SysBase, struct IORequest *ioRequest)
+{
+    if ((ioRequest->io_Flags & IOF_QUICK) == 0)
+    {
+        while (ioRequest->io_Message.mn_Node.ln_Type != NT_REPLYMSG)
+            Exec_Wait(SysBase, 1UL << ioRequest->io_Message.mn_ReplyPort->mp_SigBit);
+
+        /* Reply is still queued on the reply port, take it from there */
+        if (ioRequest->io_Message.mn_Node.ln_Succ != NULL)
+        {
+            Exec_Remove(SysBase, &ioRequest->io_Message.mn_Node);
+            ioRequest->io_Message.mn_Node.ln_Succ = NULL;
+        }
+    }
+
+    return ioRequest->io_Error;
+}
+
+LONG Exec_AbortIO(struct ExecBase *SysBase, struct IORequest *ioRequest)
+{
+    (void)SysBase;
+
+    return ((LONG (*)(struct IORequest *))DeviceFunctions(ioRequest->io_Device)[DEV_ABORT_IO])(ioRequest);
+}
+
+/* timer.device. Requests are sorted by deadline and replied by the timer thread */
+
+struct TimerBase {
+    struct Device   tb_Device;
+};
+
+static struct TimerBase *HostTimerBase;
+static struct List TimerQueue;
+static pthread_cond_t TimerWake;
+
+static inline uint64_t Deadline(struct timerequest *tr)
+{
+    return (uint64_t)tr->tr_time.tv_secs * 1000000 + tr->tr_time.tv_micro;
+}
+
+static void Timer_Open(struct IORequest *io, ULONG unitNumber, ULONG flags)
+{
+    (void)flags;
+
+    if (unitNumber > UNIT_WAITECLOCK)
+        io->io_Error = IOERR_OPENFAIL;
+}
+
+static BPTR Timer_Close(struct IORequest *io)
+{
+    (void)io;
+    return 0;
+}
+
+static void Timer_BeginIO(struct IORequest *io)
+{
+    struct timerequest *tr = (struct timerequest *)io;
+
+    io->io_Error = 0;
+
+    switch (io->io_Command)
+    {
+        case TR_ADDREQUEST:
+        {
+            uint64_t deadline = HostMicros() + (uint64_t)tr->tr_time.tv_secs * 1000000 + tr->tr_time.tv_micro;
+            struct Node *n;
+
+            io->io_Flags &= ~IOF_QUICK;
+            io->io_Message.mn_Node.ln_Type = NT_MESSAGE;
+
+            /* Timer keeps the absolute deadline in tr_time while the request is queued */
+            tr->tr_time.tv_secs = deadline / 1000000;
+            tr->tr_time.tv_micro = deadline % 1000000;
+
+            for (n = TimerQueue.lh_Head; n->ln_Succ != NULL; n = n->ln_Succ)
+            {
+                if (Deadline((struct timerequest *)n) > deadline)
+                    break;
+            }
+
+            /* Insert in front of n */
+            io->io_Message.mn_Node.ln_Succ = n;
+            io->io_Message.mn_Node.ln_Pred = n->ln_Pred;
+            n->ln_Pred->ln_Succ = &io->io_Message.mn_Node;
+            n->ln_Pred = &io->io_Message.mn_Node;
+
+            pthread_cond_signal(&TimerWake);
+            return;
+        }
+
+        case TR_GETSYSTIME:
+            Timer_GetSysTime(HostTimerBase, &tr->tr_time);
+            break;
+
+        default:
+            io->io_Error = IOERR_NOCMD;
+            break;
+    }
+
+    if ((io->io_Flags & IOF_QUICK) == 0)
+        Exec_ReplyMsg(HostSysBase, &io->io_Message);
+}
+
+static LONG Timer_AbortIO(struct IORequest *io)
+{
+    if (io->io_Message.mn_Node.ln_Type == NT_MESSAGE)
+    {
+        Exec_Remove(HostSysBase, &io->io_Message.mn_Node);
+        io->io_Error = IOERR_ABORTED;
+        Exec_ReplyMsg(HostSysBase, &io->io_Message);
+    }
+
+    return 0;
+}
+
+static const APTR TimerFunctions[] = {
+    (APTR)Timer_Open, (APTR)Timer_Close, NULL, NULL, (APTR)Timer_BeginIO, (APTR)Timer_AbortIO
+};
+
+void Timer_GetSysTime(struct TimerBase *TimerBase, struct timeval *dest)
+{
+    uint64_t now = HostMicros();
+    (void)TimerBase;
+
+    dest->tv_secs = now / 1000000;
+    dest->tv_micro = now % 1000000;
+}
+
+static void *TimerThread(void *arg)
+{
+    (void)arg;
+
+    pthread_mutex_lock(&HostCPU);
+
+    while (1)
+    {
+        struct timerequest *tr = (struct timerequest *)TimerQueue.lh_Head;
+
+        if (tr->tr_node.io_Message.mn_Node.ln_Succ == NULL)
+        {
+            pthread_cond_wait(&TimerWake, &HostCPU);
+        }
+        else if (Deadline(tr) <= HostMicros())
+        {
+            Exec_Remove(HostSysBase, &tr->tr_node.io_Message.mn_Node);
+            Exec_ReplyMsg(HostSysBase, &tr->tr_node.io_Message);
+        }
+        else
+        {
+            uint64_t at = HostStart + Deadline(tr);
+            struct timespec ts = { at / 1000000, (at % 1000000) * 1000 };
+
+            pthread_cond_timedwait(&TimerWake, &HostCPU, &ts);
+        }
+    }
+
+    return NULL;
+}
+
+/* RawDoFmt with the Amiga rules: values are 16 bit unless prefixed with 'l', strings are 32 bit pointers */
+
+APTR Exec_RawDoFmt(struct ExecBase *SysBase, CONST_STRPTR formatString, APTR dataStream, void (*putChProc)(), APTR putChData)
+{
+    const char *fmt = (const char *)formatString;
+    UBYTE *data = dataStream;
+    char *out = putChData;
+    (void)SysBase;
+
+#define EMIT(c) do { if (putChProc) ((void (*)(UBYTE, APTR))putChProc)((c), putChData); else *out++ = (c); } while (0)
+
+    for (; *fmt; fmt++)
+    {
+        char buf[16];
+        const char *str = buf;
+        int left = 0, zero = 0, width = 0, limit = -1, isLong = 0;
+        int len;
+        ULONG value = 0;
+
+        if (*fmt != '%')
+        {
+            EMIT(*fmt);
+            continue;
+        }
+
+        fmt++;
+        if (*fmt == '-') { left = 1; fmt++; }
+        if (*fmt == '0') { zero = 1; fmt++; }
+        while (*fmt >= '0' && *fmt <= '9') width = width * 10 + *fmt++ - '0';
+        if (*fmt == '.') { limit = 0; fmt++; while (*fmt >= '0' && *fmt <= '9') limit = limit * 10 + *fmt++ - '0'; }
+        if (*fmt == 'l') { isLong = 1; fmt++; }
+
+        if (*fmt == 0)
+            break;
+
+        if (strchr("dDuUxXc", *fmt))
+        {
+            if (isLong) { memcpy(&value, data, 4); data += 4; }
+            else { UWORD w; memcpy(&w, data, 2); data += 2; value = (*fmt == 'd' || *fmt == 'D') ? (ULONG)(LONG)(WORD)w : w; }
+        }
+
+        switch (*fmt)
+        {
+            case 'd': case 'D':
+                snprintf(buf, sizeof(buf), "%d", (int32_t)value);
+                break;
+            case 'u': case 'U':
+                snprintf(buf, sizeof(buf), "%u", value);
+                break;
+            case 'x':
+                snprintf(buf, sizeof(buf), "%x", value);
+                break;
+            case 'X':
+                snprintf(buf, sizeof(buf), "%X", value);
+                break;
+            case 'c':
+                buf[0] = value; buf[1] = 0;
+                break;
+            case 's':
+                memcpy(&value, data, 4); data += 4;
+                str = value ? (const char *)(uintptr_t)value : "";
+                break;
+            case 'b':
+                data += 4;
+                buf[0] = 0;
+                break;
+            default:
+                buf[0] = *fmt; buf[1] = 0;
+                break;
+        }
+
+        len = strlen(str);
+        if (limit >= 0 && len > limit)
+            len = limit;
+
+        if (!left)
+            for (int i = len; i < width; i++) EMIT(zero ? '0' : ' ');
+        for (int i = 0; i < len; i++)
+            EMIT(str[i]);
+        if (left)
+            for (int i = len; i < width; i++) EMIT(' ');
+    }
+
+    EMIT(0);
+
+#undef EMIT
+
+    return data;
+}
+
+/* Start-up */
+
+static void (*RunEntry)(APTR);
+static APTR RunArg;
+static BOOL RunDone;
+static pthread_cond_t RunCond = PTHREAD_COND_INITIALIZER;
+
+static void RunTask(void)
+{
+    RunEntry(RunArg);
+
+    RunDone = TRUE;
+    pthread_cond_signal(&RunCond);
+}
+
+void HostRun(void (*entry)(APTR), APTR arg)
+{
+    struct Process *proc = Exec_AllocMem(HostSysBase, sizeof(struct Process), MEMF_PUBLIC | MEMF_CLEAR);
+    struct MemList *ml = Exec_AllocMem(HostSysBase, sizeof(struct MemList), MEMF_PUBLIC | MEMF_CLEAR);
+
+    /* Caller runs as a process, the way a program started from the shell would */
+    proc->pr_Task.tc_Node.ln_Name = "host";
+    proc->pr_Task.tc_Node.ln_Type = NT_PROCESS;
+
+    ml->ml_NumEntries = 1;
+    ml->ml_ME[0].me_Addr = proc;
+    Exec_NewMinList(HostSysBase, (struct MinList *)&proc->pr_Task.tc_MemEntry);
+    Exec_AddHead(HostSysBase, &proc->pr_Task.tc_MemEntry, &ml->ml_Node);
+
+    pthread_mutex_lock(&HostCPU);
+
+    RunEntry = entry;
+    RunArg = arg;
+    RunDone = FALSE;
+    Exec_AddTask(HostSysBase, &proc->pr_Task, (APTR)RunTask, NULL);
+
+    while (!RunDone)
+        pthread_cond_wait(&RunCond, &HostCPU);
+
+    pthread_mutex_unlock(&HostCPU);
+}
+
+void HostInit(void)
+{
+    pthread_condattr_t attr;
+    pthread_t timer;
+
+    HostStart = 0;
+    HostStart = HostMicros();
+
+    ArenaInit();
+
+    HostSysBase = Exec_AllocMem(NULL, sizeof(struct ExecBase), MEMF_PUBLIC | MEMF_CLEAR);
+    HostSysBase->LibNode.lib_Node.ln_Name = "exec.library";
+    HostSysBase->LibNode.lib_Version = 40;
+    Exec_NewMinList(HostSysBase, (struct MinList *)&HostSysBase->LibList);
+    Exec_NewMinList(HostSysBase, (struct MinList *)&HostSysBase->ResourceList);
+    Exec_NewMinList(HostSysBase, (struct MinList *)&HostSysBase->DeviceList);
+    Exec_NewMinList(HostSysBase, (struct MinList *)&HostSysBase->PortList);
+
+    Exec_NewMinList(HostSysBase, (struct MinList *)&TimerQueue);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&TimerWake, &attr);
+    pthread_condattr_destroy(&attr);
+
+    HostTimerBase = Exec_AllocMem(HostSysBase, sizeof(struct TimerBase), MEMF_PUBLIC | MEMF_CLEAR);
+    HostTimerBase->tb_Device.dd_Library.lib_Node.ln_Name = TIMERNAME;
+    HostTimerBase->tb_Device.dd_Library.lib_Node.ln_Type = NT_DEVICE;
+    HostAddDevice(&HostTimerBase->tb_Device, TimerFunctions);
+
+    pthread_create(&timer, NULL, TimerThread, NULL);
+    pthread_detach(timer);
+
+    HostDosInit();
+}
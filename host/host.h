@@ -0,0 +1,65 @@
+#ifndef _HOST_H
+#define _HOST_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include <exec/types.h>
+#include <exec/devices.h>
+#include <exec/execbase.h>
+
+/*
+    Host build of the driver: exec, dos, utility, timer.device and devicetree.resource are provided by
+    host/exec.c and host/dos.c, the board (console, system timer, MMIO) by host/board.c.
+*/
+
+/* Owned by the running task. Harness code called from outside of a task has to take it itself */
+extern pthread_mutex_t HostCPU;
+extern struct ExecBase *HostSysBase;
+
+void        HostInit(void);
+void        HostDosInit(void);
+
+/* Run entry(arg) in a new process and return when it returns. Tasks started meanwhile keep running */
+void        HostRun(void (*entry)(APTR), APTR arg);
+
+/* Memory below 4 GB, the same arena exec allocates from */
+APTR        HostAlloc(ULONG size);
+void        HostFree(APTR memory);
+ULONG       HostAllocSize(APTR memory);
+
+/* Monotonic time since HostInit. HostSleep lets other tasks run meanwhile */
+uint64_t    HostMicros(void);
+void        HostSleep(ULONG micros);
+
+/* Make a device from its InitTable and register it, so that OpenDevice finds it */
+struct Device * HostLoadDevice(const char *name, const char *idString, const APTR *initTable);
+
+/* Register a device base set up by the caller, with the function table of its InitTable. Called by a task */
+void        HostAddDevice(struct Device *device, const APTR *functions);
+
+void        HostAddLibrary(struct Library *library);
+void        HostAddResource(const char *name, APTR base);
+
+/* dos.library: VOLUME: is looked up in given host directory, GetVar returns values set here */
+void        HostAssign(const char *volume, const char *directory);
+void        HostSetVar(const char *name, const char *value);
+
+/* devicetree.resource: properties are added one by one, keys are created as needed */
+void        HostDTProperty(const char *path, const char *name, const void *value, ULONG length);
+void        HostDTString(const char *path, const char *name, const char *value);
+void        HostDTCells(const char *path, const char *name, int count, ...);
+
+/*
+    Board: MMIO regions seen through rd32/wr32, console output of the driver. FIFO data ports accessed with
+    rd32fifo/wr32fifo use the same hooks, with the word holding the bytes in host memory order
+*/
+struct HostIO {
+    ULONG   (*hio_Read)(APTR user, ULONG offset);
+    void    (*hio_Write)(APTR user, ULONG offset, ULONG value);
+};
+
+void        HostMapIO(ULONG base, ULONG size, const struct HostIO *io, APTR user);
+void        HostConsole(int enabled);
+
+#endif /* _HOST_H */
@@ -0,0 +1,8 @@
+#ifndef CLIB_ALIB_PROTOS_H
+#define CLIB_ALIB_PROTOS_H
+
+#include <exec/types.h>
+
+/* Nothing of amiga.lib is used by the driver, the header is here so that unit.c compiles */
+
+#endif /* CLIB_ALIB_PROTOS_H */
@@ -0,0 +1,15 @@
+#ifndef CLIB_DEVICETREE_PROTOS_H
+#define CLIB_DEVICETREE_PROTOS_H
+
+#include <exec/types.h>
+
+/* devicetree.resource of the host build (host/dos.c), holds the few keys the driver looks for */
+
+APTR    DT_Host_OpenKey(APTR DeviceTreeBase, CONST_STRPTR name);
+void    DT_Host_CloseKey(APTR DeviceTreeBase, APTR key);
+APTR    DT_Host_GetParent(APTR DeviceTreeBase, APTR key);
+APTR    DT_Host_FindProperty(APTR DeviceTreeBase, APTR key, CONST_STRPTR property);
+CONST_APTR DT_Host_GetPropValue(APTR DeviceTreeBase, APTR property);
+ULONG   DT_Host_GetPropLen(APTR DeviceTreeBase, APTR property);
+
+#endif /* CLIB_DEVICETREE_PROTOS_H */
@@ -0,0 +1,24 @@
+#ifndef CLIB_DOS_PROTOS_H
+#define CLIB_DOS_PROTOS_H
+
+#include <exec/types.h>
+#include <exec/libraries.h>
+#include <dos/dos.h>
+#include <dos/dosextens.h>
+#include <utility/tagitem.h>
+
+/* dos.library of the host build (host/dos.c), files are looked up in the directory tree given to HostAssign */
+
+BPTR    Dos_Open(struct Library *DOSBase, CONST_STRPTR name, LONG accessMode);
+LONG    Dos_Close(struct Library *DOSBase, BPTR file);
+LONG    Dos_Read(struct Library *DOSBase, BPTR file, APTR buffer, LONG length);
+LONG    Dos_Write(struct Library *DOSBase, BPTR file, CONST_APTR buffer, LONG length);
+LONG    Dos_Seek(struct Library *DOSBase, BPTR file, LONG position, LONG offset);
+BOOL    Dos_AddPart(struct Library *DOSBase, STRPTR dirname, CONST_STRPTR filename, ULONG size);
+STRPTR  Dos_FilePart(struct Library *DOSBase, CONST_STRPTR path);
+void    Dos_Delay(struct Library *DOSBase, LONG timeout);
+LONG    Dos_GetVar(struct Library *DOSBase, CONST_STRPTR name, STRPTR buffer, LONG size, LONG flags);
+LONG    Dos_IoErr(struct Library *DOSBase);
+struct Process * Dos_CreateNewProc(struct Library *DOSBase, const struct TagItem *tags);
+
+#endif /* CLIB_DOS_PROTOS_H */
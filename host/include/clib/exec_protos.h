@@ -0,0 +1,78 @@
+#ifndef CLIB_EXEC_PROTOS_H
+#define CLIB_EXEC_PROTOS_H
+
+#include <exec/types.h>
+#include <exec/execbase.h>
+#include <exec/tasks.h>
+#include <exec/ports.h>
+#include <exec/io.h>
+#include <exec/semaphores.h>
+#include <exec/libraries.h>
+#include <exec/devices.h>
+#include <exec/memory.h>
+
+/*
+    exec.library of the host build (host/exec.c). Every call takes the library base first, the macros in
+    proto/exec.h pass SysBase the way the inline stubs of the m68k build do.
+*/
+
+void    Exec_Forbid(struct ExecBase *SysBase);
+void    Exec_Permit(struct ExecBase *SysBase);
+void    Exec_Disable(struct ExecBase *SysBase);
+void    Exec_Enable(struct ExecBase *SysBase);
+
+void    Exec_AddHead(struct ExecBase *SysBase, struct List *list, struct Node *node);
+void    Exec_AddTail(struct ExecBase *SysBase, struct List *list, struct Node *node);
+void    Exec_Remove(struct ExecBase *SysBase, struct Node *node);
+struct Node * Exec_RemHead(struct ExecBase *SysBase, struct List *list);
+void    Exec_NewMinList(struct ExecBase *SysBase, struct MinList *list);
+
+struct Task * Exec_FindTask(struct ExecBase *SysBase, CONST_STRPTR name);
+APTR    Exec_AddTask(struct ExecBase *SysBase, struct Task *task, APTR initialPC, APTR finalPC);
+ULONG   Exec_Wait(struct ExecBase *SysBase, ULONG signalSet);
+void    Exec_Signal(struct ExecBase *SysBase, struct Task *task, ULONG signalSet);
+ULONG   Exec_SetSignal(struct ExecBase *SysBase, ULONG newSignals, ULONG signalSet);
+BYTE    Exec_AllocSignal(struct ExecBase *SysBase, LONG signalNum);
+void    Exec_FreeSignal(struct ExecBase *SysBase, LONG signalNum);
+
+struct MsgPort * Exec_CreateMsgPort(struct ExecBase *SysBase);
+void    Exec_DeleteMsgPort(struct ExecBase *SysBase, struct MsgPort *port);
+void    Exec_PutMsg(struct ExecBase *SysBase, struct MsgPort *port, struct Message *message);
+struct Message * Exec_GetMsg(struct ExecBase *SysBase, struct MsgPort *port);
+void    Exec_ReplyMsg(struct ExecBase *SysBase, struct Message *message);
+struct Message * Exec_WaitPort(struct ExecBase *SysBase, struct MsgPort *port);
+
+void    Exec_InitSemaphore(struct ExecBase *SysBase, struct SignalSemaphore *sem);
+void    Exec_ObtainSemaphore(struct ExecBase *SysBase, struct SignalSemaphore *sem);
+void    Exec_ObtainSemaphoreShared(struct ExecBase *SysBase, struct SignalSemaphore *sem);
+ULONG   Exec_AttemptSemaphore(struct ExecBase *SysBase, struct SignalSemaphore *sem);
+void    Exec_ReleaseSemaphore(struct ExecBase *SysBase, struct SignalSemaphore *sem);
+
+APTR    Exec_AllocMem(struct ExecBase *SysBase, ULONG byteSize, ULONG requirements);
+void    Exec_FreeMem(struct ExecBase *SysBase, APTR memoryBlock, ULONG byteSize);
+APTR    Exec_AllocVec(struct ExecBase *SysBase, ULONG byteSize, ULONG requirements);
+void    Exec_FreeVec(struct ExecBase *SysBase, APTR memoryBlock);
+APTR    Exec_CreatePool(struct ExecBase *SysBase, ULONG requirements, ULONG puddleSize, ULONG threshSize);
+void    Exec_DeletePool(struct ExecBase *SysBase, APTR poolHeader);
+APTR    Exec_AllocPooled(struct ExecBase *SysBase, APTR poolHeader, ULONG memSize);
+void    Exec_FreePooled(struct ExecBase *SysBase, APTR poolHeader, APTR memory, ULONG memSize);
+void    Exec_CopyMem(struct ExecBase *SysBase, CONST_APTR source, APTR dest, ULONG size);
+APTR    Exec_CachePreDMA(struct ExecBase *SysBase, CONST_APTR address, ULONG *length, ULONG flags);
+void    Exec_CachePostDMA(struct ExecBase *SysBase, CONST_APTR address, ULONG *length, ULONG flags);
+
+struct Library * Exec_OpenLibrary(struct ExecBase *SysBase, CONST_STRPTR libName, ULONG version);
+void    Exec_CloseLibrary(struct ExecBase *SysBase, struct Library *library);
+APTR    Exec_OpenResource(struct ExecBase *SysBase, CONST_STRPTR resName);
+BYTE    Exec_OpenDevice(struct ExecBase *SysBase, CONST_STRPTR devName, ULONG unitNumber, struct IORequest *ioRequest, ULONG flags);
+void    Exec_CloseDevice(struct ExecBase *SysBase, struct IORequest *ioRequest);
+APTR    Exec_CreateIORequest(struct ExecBase *SysBase, struct MsgPort *port, ULONG size);
+void    Exec_DeleteIORequest(struct ExecBase *SysBase, APTR ioRequest);
+BYTE    Exec_DoIO(struct ExecBase *SysBase, struct IORequest *ioRequest);
+void    Exec_SendIO(struct ExecBase *SysBase, struct IORequest *ioRequest);
+struct IORequest * Exec_CheckIO(struct ExecBase *SysBase, struct IORequest *ioRequest);
+BYTE    Exec_WaitIO(struct ExecBase *SysBase, struct IORequest *ioRequest);
+LONG    Exec_AbortIO(struct ExecBase *SysBase, struct IORequest *ioRequest);
+
+APTR    Exec_RawDoFmt(struct ExecBase *SysBase, CONST_STRPTR formatString, APTR dataStream, void (*putChProc)(), APTR putChData);
+
+#endif /* CLIB_EXEC_PROTOS_H */
@@ -0,0 +1,13 @@
+#ifndef CLIB_TIMER_PROTOS_H
+#define CLIB_TIMER_PROTOS_H
+
+#include <exec/types.h>
+#include <devices/timer.h>
+
+struct TimerBase;
+
+/* timer.device functions of the host build (host/exec.c) */
+
+void    Timer_GetSysTime(struct TimerBase *TimerBase, struct timeval *dest);
+
+#endif /* CLIB_TIMER_PROTOS_H */
@@ -0,0 +1,16 @@
+#ifndef CLIB_UTILITY_PROTOS_H
+#define CLIB_UTILITY_PROTOS_H
+
+#include <exec/types.h>
+#include <exec/libraries.h>
+#include <utility/tagitem.h>
+#include <utility/hooks.h>
+
+/* utility.library of the host build (host/dos.c) */
+
+ULONG   Utility_GetTagData(struct Library *UtilityBase, Tag tagValue, ULONG defaultVal, const struct TagItem *tagList);
+struct TagItem * Utility_FindTagItem(struct Library *UtilityBase, Tag tagValue, const struct TagItem *tagList);
+struct TagItem * Utility_NextTagItem(struct Library *UtilityBase, struct TagItem **tagListPtr);
+ULONG   Utility_CallHookPkt(struct Library *UtilityBase, struct Hook *hook, APTR object, APTR paramPacket);
+
+#endif /* CLIB_UTILITY_PROTOS_H */
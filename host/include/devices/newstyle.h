@@ -0,0 +1,30 @@
+#ifndef DEVICES_NEWSTYLE_H
+#define DEVICES_NEWSTYLE_H
+
+#include <exec/types.h>
+
+#define NSCMD_DEVICEQUERY   0x4000
+
+struct NSDeviceQueryResult {
+    ULONG   nsdqr_DevQueryFormat;
+    ULONG   nsdqr_SizeAvailable;
+    UWORD   nsdqr_DeviceType;
+    UWORD   nsdqr_DeviceSubType;
+    UWORD * nsdqr_SupportedCommands;
+};
+
+#define NSDEVTYPE_UNKNOWN   0
+#define NSDEVTYPE_GAMEPORT  1
+#define NSDEVTYPE_TIMER     2
+#define NSDEVTYPE_KEYBOARD  3
+#define NSDEVTYPE_INPUT     4
+#define NSDEVTYPE_TRACKDISK 5
+#define NSDEVTYPE_CONSOLE   6
+#define NSDEVTYPE_SANA2     7
+#define NSDEVTYPE_AUDIO     8
+#define NSDEVTYPE_CLIPBOARD 9
+#define NSDEVTYPE_PRINTER   10
+#define NSDEVTYPE_SERIAL    11
+#define NSDEVTYPE_PARALLEL  12
+
+#endif /* DEVICES_NEWSTYLE_H */
@@ -0,0 +1,46 @@
+#ifndef DEVICES_TIMER_H
+#define DEVICES_TIMER_H
+
+#include <exec/types.h>
+#include <exec/io.h>
+
+#define UNIT_MICROHZ    0
+#define UNIT_VBLANK     1
+#define UNIT_ECLOCK     2
+#define UNIT_WAITUNTIL  3
+#define UNIT_WAITECLOCK 4
+
+#define TIMERNAME       "timer.device"
+
+/*
+    The C library of the host has a struct timeval of its own. Its headers have to come first, from here
+    on timeval names the Amiga one.
+*/
+#define timeval AmigaTimeVal
+
+struct timeval {
+    union {
+        ULONG   tv_secs;
+        ULONG   tv_sec;
+    };
+    union {
+        ULONG   tv_micro;
+        ULONG   tv_usec;
+    };
+};
+
+struct EClockVal {
+    ULONG   ev_hi;
+    ULONG   ev_lo;
+};
+
+struct timerequest {
+    struct IORequest    tr_node;
+    struct timeval      tr_time;
+};
+
+#define TR_ADDREQUEST   CMD_NONSTD
+#define TR_GETSYSTIME   (CMD_NONSTD + 1)
+#define TR_SETSYSTIME   (CMD_NONSTD + 2)
+
+#endif /* DEVICES_TIMER_H */
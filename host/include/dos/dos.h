@@ -0,0 +1,44 @@
+#ifndef DOS_DOS_H
+#define DOS_DOS_H
+
+#include <exec/types.h>
+
+typedef LONG    BPTR;
+typedef LONG    BSTR;
+
+#define BADDR(x)    ((APTR)((IPTR)(x) << 2))
+#define MKBADDR(x)  ((BPTR)((IPTR)(x) >> 2))
+
+#define DOSTRUE     (-1L)
+#define DOSFALSE    (0L)
+
+#define MODE_OLDFILE    1005
+#define MODE_NEWFILE    1006
+#define MODE_READWRITE  1004
+
+#define OFFSET_BEGINNING    (-1)
+#define OFFSET_BEGINING     OFFSET_BEGINNING
+#define OFFSET_CURRENT      0
+#define OFFSET_END          1
+
+#define TICKS_PER_SECOND    50
+
+struct DateStamp {
+    LONG    ds_Days;
+    LONG    ds_Minute;
+    LONG    ds_Tick;
+};
+
+#define SIGBREAKB_CTRL_C    12
+#define SIGBREAKB_CTRL_D    13
+#define SIGBREAKB_CTRL_E    14
+#define SIGBREAKB_CTRL_F    15
+
+#define SIGBREAKF_CTRL_C    (1L << SIGBREAKB_CTRL_C)
+#define SIGBREAKF_CTRL_D    (1L << SIGBREAKB_CTRL_D)
+#define SIGBREAKF_CTRL_E    (1L << SIGBREAKB_CTRL_E)
+#define SIGBREAKF_CTRL_F    (1L << SIGBREAKB_CTRL_F)
+
+#define ERROR_OBJECT_NOT_FOUND  205
+
+#endif /* DOS_DOS_H */
@@ -0,0 +1,21 @@
+#ifndef DOS_DOSEXTENS_H
+#define DOS_DOSEXTENS_H
+
+#include <exec/tasks.h>
+#include <exec/ports.h>
+#include <dos/dos.h>
+
+/* Only the leading part of Process, as far as the driver looks into it */
+struct Process {
+    struct Task     pr_Task;
+    struct MsgPort  pr_MsgPort;
+    WORD            pr_Pad;
+    BPTR            pr_SegList;
+    LONG            pr_StackSize;
+    APTR            pr_GlobVec;
+    LONG            pr_TaskNum;
+    BPTR            pr_StackBase;
+    LONG            pr_Result2;
+};
+
+#endif /* DOS_DOSEXTENS_H */
@@ -0,0 +1,7 @@
+#ifndef EXEC_ALERTS_H
+#define EXEC_ALERTS_H
+
+#define AT_DeadEnd      0x80000000
+#define AT_Recovery     0x00000000
+
+#endif /* EXEC_ALERTS_H */
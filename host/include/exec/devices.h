@@ -0,0 +1,21 @@
+#ifndef EXEC_DEVICES_H
+#define EXEC_DEVICES_H
+
+#include <exec/libraries.h>
+#include <exec/ports.h>
+
+struct Device {
+    struct Library  dd_Library;
+};
+
+struct Unit {
+    struct MsgPort  unit_MsgPort;
+    UBYTE           unit_flags;
+    UBYTE           unit_pad;
+    UWORD           unit_OpenCnt;
+};
+
+#define UNITF_ACTIVE    (1 << 0)
+#define UNITF_INTASK    (1 << 1)
+
+#endif /* EXEC_DEVICES_H */
@@ -0,0 +1,15 @@
+#ifndef EXEC_ERRORS_H
+#define EXEC_ERRORS_H
+
+#define IOERR_OPENFAIL      (-1)
+#define IOERR_ABORTED       (-2)
+#define IOERR_NOCMD         (-3)
+#define IOERR_BADLENGTH     (-4)
+#define IOERR_BADADDRESS    (-5)
+#define IOERR_UNITBUSY      (-6)
+#define IOERR_SELFTEST      (-7)
+
+#define ERR_OPENLIBRARY     0x80000000
+#define ERR_OPENDEVICE      0x80000000
+
+#endif /* EXEC_ERRORS_H */
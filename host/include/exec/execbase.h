@@ -0,0 +1,38 @@
+#ifndef EXEC_EXECBASE_H
+#define EXEC_EXECBASE_H
+
+#include <exec/types.h>
+#include <exec/lists.h>
+#include <exec/libraries.h>
+#include <exec/tasks.h>
+#include <exec/ports.h>
+#include <exec/memory.h>
+#include <exec/io.h>
+#include <exec/devices.h>
+#include <exec/semaphores.h>
+
+/* Only the public part of ExecBase, host exec keeps its state elsewhere */
+struct ExecBase {
+    struct Library  LibNode;
+    UWORD           SoftVer;
+    WORD            LowMemChkSum;
+    ULONG           ChkBase;
+    struct Task *   ThisTask;
+    ULONG           IdleCount;
+    ULONG           DispCount;
+    UWORD           Quantum;
+    UWORD           Elapsed;
+    UWORD           SysFlags;
+    BYTE            IDNestCnt;
+    BYTE            TDNestCnt;
+    UWORD           AttnFlags;
+    struct List     MemList;
+    struct List     ResourceList;
+    struct List     DeviceList;
+    struct List     LibList;
+    struct List     PortList;
+    struct List     TaskReady;
+    struct List     TaskWait;
+};
+
+#endif /* EXEC_EXECBASE_H */
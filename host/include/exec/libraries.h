@@ -0,0 +1,35 @@
+#ifndef EXEC_LIBRARIES_H
+#define EXEC_LIBRARIES_H
+
+#include <exec/nodes.h>
+
+#define LIB_VECTSIZE    6
+#define LIB_RESERVED    4
+#define LIB_BASE        (-LIB_VECTSIZE)
+#define LIB_USERDEF     (LIB_BASE - (LIB_RESERVED * LIB_VECTSIZE))
+#define LIB_NONSTD      (LIB_USERDEF)
+
+#define LIB_OPEN        (-6)
+#define LIB_CLOSE       (-12)
+#define LIB_EXPUNGE     (-18)
+#define LIB_EXTFUNC     (-24)
+
+struct Library {
+    struct Node     lib_Node;
+    UBYTE           lib_Flags;
+    UBYTE           lib_pad;
+    UWORD           lib_NegSize;
+    UWORD           lib_PosSize;
+    UWORD           lib_Version;
+    UWORD           lib_Revision;
+    APTR            lib_IdString;
+    ULONG           lib_Sum;
+    UWORD           lib_OpenCnt;
+};
+
+#define LIBF_SUMMING    (1 << 0)
+#define LIBF_CHANGED    (1 << 1)
+#define LIBF_SUMUSED    (1 << 2)
+#define LIBF_DELEXP     (1 << 3)
+
+#endif /* EXEC_LIBRARIES_H */
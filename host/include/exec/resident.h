@@ -0,0 +1,26 @@
+#ifndef EXEC_RESIDENT_H
+#define EXEC_RESIDENT_H
+
+#include <exec/types.h>
+
+struct Resident {
+    UWORD               rt_MatchWord;
+    struct Resident *   rt_MatchTag;
+    APTR                rt_EndSkip;
+    UBYTE               rt_Flags;
+    UBYTE               rt_Version;
+    UBYTE               rt_Type;
+    BYTE                rt_Pri;
+    char *              rt_Name;
+    char *              rt_IdString;
+    APTR                rt_Init;
+};
+
+#define RTC_MATCHWORD   0x4AFC
+
+#define RTF_AUTOINIT    (1 << 7)
+#define RTF_AFTERDOS    (1 << 2)
+#define RTF_SINGLETASK  (1 << 1)
+#define RTF_COLDSTART   (1 << 0)
+
+#endif /* EXEC_RESIDENT_H */
@@ -0,0 +1,24 @@
+#ifndef EXEC_SEMAPHORES_H
+#define EXEC_SEMAPHORES_H
+
+#include <exec/nodes.h>
+#include <exec/lists.h>
+#include <exec/ports.h>
+#include <exec/tasks.h>
+
+struct SemaphoreRequest {
+    struct MinNode  sr_Link;
+    struct Task *   sr_Waiter;
+};
+
+/* Host exec keeps the number of shared holders in ss_QueueCount, exclusive owner in ss_Owner */
+struct SignalSemaphore {
+    struct Node     ss_Link;
+    WORD            ss_NestCount;
+    struct MinList  ss_WaitQueue;
+    struct SemaphoreRequest ss_MultipleLink;
+    struct Task *   ss_Owner;
+    WORD            ss_QueueCount;
+};
+
+#endif /* EXEC_SEMAPHORES_H */
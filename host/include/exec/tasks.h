@@ -0,0 +1,59 @@
+#ifndef EXEC_TASKS_H
+#define EXEC_TASKS_H
+
+#include <exec/nodes.h>
+#include <exec/lists.h>
+
+struct Task {
+    struct Node     tc_Node;
+    UBYTE           tc_Flags;
+    UBYTE           tc_State;
+    BYTE            tc_IDNestCnt;
+    BYTE            tc_TDNestCnt;
+    ULONG           tc_SigAlloc;
+    ULONG           tc_SigWait;
+    ULONG           tc_SigRecvd;
+    ULONG           tc_SigExcept;
+    UWORD           tc_TrapAlloc;
+    UWORD           tc_TrapAble;
+    APTR            tc_ExceptData;
+    APTR            tc_ExceptCode;
+    APTR            tc_TrapData;
+    APTR            tc_TrapCode;
+    APTR            tc_SPReg;
+    APTR            tc_SPLower;
+    APTR            tc_SPUpper;
+    VOID          (*tc_Switch)(VOID);
+    VOID          (*tc_Launch)(VOID);
+    struct List     tc_MemEntry;
+    APTR            tc_UserData;
+};
+
+#define TS_INVALID      0
+#define TS_ADDED        1
+#define TS_RUN          2
+#define TS_READY        3
+#define TS_WAIT         4
+#define TS_EXCEPT       5
+#define TS_REMOVED      6
+
+#define SIGB_ABORT      0
+#define SIGB_CHILD      1
+#define SIGB_BLIT       4
+#define SIGB_SINGLE     4
+#define SIGB_INTUITION  5
+#define SIGB_NET        7
+#define SIGB_DOS        8
+
+#define SIGF_ABORT      (1L << SIGB_ABORT)
+#define SIGF_CHILD      (1L << SIGB_CHILD)
+#define SIGF_BLIT       (1L << SIGB_BLIT)
+#define SIGF_SINGLE     (1L << SIGB_SINGLE)
+#define SIGF_INTUITION  (1L << SIGB_INTUITION)
+#define SIGF_NET        (1L << SIGB_NET)
+#define SIGF_DOS        (1L << SIGB_DOS)
+
+#define SYS_SIGALLOC    0xFFFF
+#define SYS_TRAPALLOC   0x8000
+
+#endif /* EXEC_TASKS_H */
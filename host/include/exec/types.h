@@ -0,0 +1,62 @@
+#ifndef EXEC_TYPES_H
+#define EXEC_TYPES_H
+
+/*
+    Host build stand-in for the NDK header. Sizes follow the m68k target, ULONG and LONG stay 32 bit.
+    Pointers are 64 bit, the host exec keeps every object the driver sees below 4 GB so that the
+    (ULONG) casts done by the driver do not lose anything.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define GLOBAL  extern
+#define IMPORT  extern
+#define STATIC  static
+#define REGISTER register
+
+#ifndef VOID
+#define VOID    void
+#endif
+
+typedef void *          APTR;
+typedef const void *    CONST_APTR;
+typedef int32_t         LONG;
+typedef uint32_t        ULONG;
+typedef uint32_t        LONGBITS;
+typedef int16_t         WORD;
+typedef uint16_t        UWORD;
+typedef uint16_t        WORDBITS;
+typedef signed char     BYTE;
+typedef unsigned char   UBYTE;
+typedef unsigned char   BYTEBITS;
+typedef uint16_t        RPTR;
+typedef unsigned char * STRPTR;
+typedef const unsigned char * CONST_STRPTR;
+typedef char            TEXT;
+typedef short           SHORT;
+typedef unsigned short  USHORT;
+typedef short           COUNT;
+typedef unsigned short  UCOUNT;
+typedef ULONG           CPTR;
+typedef float           FLOAT;
+typedef double          DOUBLE;
+typedef short           BOOL;
+typedef unsigned char   TINY;
+typedef uintptr_t       IPTR;
+
+#ifndef TRUE
+#define TRUE            1
+#endif
+#ifndef FALSE
+#define FALSE           0
+#endif
+#ifndef NULL
+#define NULL            ((void *)0)
+#endif
+
+#define BYTEMASK        0xFF
+
+#define LIBRARY_VERSION 40
+
+#endif /* EXEC_TYPES_H */
@@ -0,0 +1,8 @@
+#ifndef INTUITION_INTUITIONBASE_H
+#define INTUITION_INTUITIONBASE_H
+
+#include <exec/libraries.h>
+
+/* Nothing of intuition.library is used by the driver, the header is here so that wifipi.h compiles */
+
+#endif /* INTUITION_INTUITIONBASE_H */
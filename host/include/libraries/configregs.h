@@ -0,0 +1,8 @@
+#ifndef LIBRARIES_CONFIGREGS_H
+#define LIBRARIES_CONFIGREGS_H
+
+#include <exec/types.h>
+
+/* Nothing of it is used by the driver, the header is here so that mbox.c compiles */
+
+#endif /* LIBRARIES_CONFIGREGS_H */
@@ -0,0 +1,8 @@
+#ifndef LIBRARIES_CONFIGVARS_H
+#define LIBRARIES_CONFIGVARS_H
+
+#include <exec/types.h>
+
+/* Nothing of it is used by the driver, the header is here so that mbox.c compiles */
+
+#endif /* LIBRARIES_CONFIGVARS_H */
@@ -0,0 +1,6 @@
+#ifndef LIBRARIES_DOS_H
+#define LIBRARIES_DOS_H
+
+#include <dos/dos.h>
+
+#endif /* LIBRARIES_DOS_H */
@@ -0,0 +1,8 @@
+#ifndef LIBRARIES_EXPANSIONBASE_H
+#define LIBRARIES_EXPANSIONBASE_H
+
+#include <exec/libraries.h>
+
+/* Nothing of expansion.library is used by the driver, the header is here so that wifipi.h compiles */
+
+#endif /* LIBRARIES_EXPANSIONBASE_H */
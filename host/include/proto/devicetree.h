@@ -0,0 +1,13 @@
+#ifndef PROTO_DEVICETREE_H
+#define PROTO_DEVICETREE_H
+
+#include <clib/devicetree_protos.h>
+
+#define DT_OpenKey(name)                    DT_Host_OpenKey(DeviceTreeBase, (name))
+#define DT_CloseKey(key)                    DT_Host_CloseKey(DeviceTreeBase, (key))
+#define DT_GetParent(key)                   DT_Host_GetParent(DeviceTreeBase, (key))
+#define DT_FindProperty(key, property)      DT_Host_FindProperty(DeviceTreeBase, (key), (property))
+#define DT_GetPropValue(property)           DT_Host_GetPropValue(DeviceTreeBase, (property))
+#define DT_GetPropLen(property)             DT_Host_GetPropLen(DeviceTreeBase, (property))
+
+#endif /* PROTO_DEVICETREE_H */
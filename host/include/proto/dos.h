@@ -0,0 +1,19 @@
+#ifndef PROTO_DOS_H
+#define PROTO_DOS_H
+
+#include <clib/dos_protos.h>
+
+#define Open(name, accessMode)              Dos_Open(DOSBase, (name), (accessMode))
+#define Close(file)                         Dos_Close(DOSBase, (file))
+#define Read(file, buffer, length)          Dos_Read(DOSBase, (file), (buffer), (length))
+#define Write(file, buffer, length)         Dos_Write(DOSBase, (file), (buffer), (length))
+#define Seek(file, position, offset)        Dos_Seek(DOSBase, (file), (position), (offset))
+#define AddPart(dirname, filename, size)    Dos_AddPart(DOSBase, (STRPTR)(dirname), (filename), (size))
+#define FilePart(path)                      Dos_FilePart(DOSBase, (path))
+#define Delay(timeout)                      Dos_Delay(DOSBase, (timeout))
+#define GetVar(name, buffer, size, flags)   Dos_GetVar(DOSBase, (name), (STRPTR)(buffer), (size), (flags))
+#define IoErr()                             Dos_IoErr(DOSBase)
+#define CreateNewProc(tags)                 Dos_CreateNewProc(DOSBase, (tags))
+#define CreateNewProcTags(...)              ({ ULONG _tags[] = { __VA_ARGS__ }; Dos_CreateNewProc(DOSBase, (struct TagItem *)_tags); })
+
+#endif /* PROTO_DOS_H */
@@ -0,0 +1,70 @@
+#ifndef PROTO_EXEC_H
+#define PROTO_EXEC_H
+
+#include <clib/exec_protos.h>
+
+#define Forbid()                            Exec_Forbid(SysBase)
+#define Permit()                            Exec_Permit(SysBase)
+#define Disable()                           Exec_Disable(SysBase)
+#define Enable()                            Exec_Enable(SysBase)
+
+#define AddHead(list, node)                 Exec_AddHead(SysBase, (struct List *)(list), (struct Node *)(node))
+#define AddTail(list, node)                 Exec_AddTail(SysBase, (struct List *)(list), (struct Node *)(node))
+#define Remove(node)                        Exec_Remove(SysBase, (struct Node *)(node))
+#define RemHead(list)                       Exec_RemHead(SysBase, (struct List *)(list))
+#define NewMinList(list)                    Exec_NewMinList(SysBase, (list))
+
+#define FindTask(name)                      Exec_FindTask(SysBase, (name))
+#define AddTask(task, initialPC, finalPC)   Exec_AddTask(SysBase, (task), (APTR)(initialPC), (APTR)(finalPC))
+#define Wait(signalSet)                     Exec_Wait(SysBase, (signalSet))
+#define Signal(task, signalSet)             Exec_Signal(SysBase, (task), (signalSet))
+#define SetSignal(newSignals, signalSet)    Exec_SetSignal(SysBase, (newSignals), (signalSet))
+#define AllocSignal(signalNum)              Exec_AllocSignal(SysBase, (signalNum))
+#define FreeSignal(signalNum)               Exec_FreeSignal(SysBase, (signalNum))
+
+#define CreateMsgPort()                     Exec_CreateMsgPort(SysBase)
+#define DeleteMsgPort(port)                 Exec_DeleteMsgPort(SysBase, (port))
+#define PutMsg(port, message)               Exec_PutMsg(SysBase, (port), (struct Message *)(message))
+#define GetMsg(port)                        Exec_GetMsg(SysBase, (port))
+#define ReplyMsg(message)                   Exec_ReplyMsg(SysBase, (struct Message *)(message))
+#define WaitPort(port)                      Exec_WaitPort(SysBase, (port))
+
+#define InitSemaphore(sem)                  Exec_InitSemaphore(SysBase, (sem))
+#define ObtainSemaphore(sem)                Exec_ObtainSemaphore(SysBase, (sem))
+#define ObtainSemaphoreShared(sem)          Exec_ObtainSemaphoreShared(SysBase, (sem))
+#define AttemptSemaphore(sem)               Exec_AttemptSemaphore(SysBase, (sem))
+#define ReleaseSemaphore(sem)               Exec_ReleaseSemaphore(SysBase, (sem))
+
+#define AllocMem(byteSize, requirements)    Exec_AllocMem(SysBase, (byteSize), (requirements))
+#define FreeMem(memoryBlock, byteSize)      Exec_FreeMem(SysBase, (memoryBlock), (byteSize))
+#define AllocVec(byteSize, requirements)    Exec_AllocVec(SysBase, (byteSize), (requirements))
+#define FreeVec(memoryBlock)                Exec_FreeVec(SysBase, (memoryBlock))
+#define CreatePool(requirements, puddleSize, threshSize) \
+                                            Exec_CreatePool(SysBase, (requirements), (puddleSize), (threshSize))
+#define DeletePool(poolHeader)              Exec_DeletePool(SysBase, (poolHeader))
+#define AllocPooled(poolHeader, memSize)    Exec_AllocPooled(SysBase, (poolHeader), (memSize))
+#define FreePooled(poolHeader, memory, memSize) \
+                                            Exec_FreePooled(SysBase, (poolHeader), (memory), (memSize))
+#define CopyMem(source, dest, size)         Exec_CopyMem(SysBase, (source), (dest), (size))
+#define CachePreDMA(address, length, flags) Exec_CachePreDMA(SysBase, (address), (length), (flags))
+#define CachePostDMA(address, length, flags) \
+                                            Exec_CachePostDMA(SysBase, (address), (length), (flags))
+
+#define OpenLibrary(libName, version)       Exec_OpenLibrary(SysBase, (libName), (version))
+#define CloseLibrary(library)               Exec_CloseLibrary(SysBase, (struct Library *)(library))
+#define OpenResource(resName)               Exec_OpenResource(SysBase, (resName))
+#define OpenDevice(devName, unitNumber, ioRequest, flags) \
+                                            Exec_OpenDevice(SysBase, (devName), (unitNumber), (struct IORequest *)(ioRequest), (flags))
+#define CloseDevice(ioRequest)              Exec_CloseDevice(SysBase, (struct IORequest *)(ioRequest))
+#define CreateIORequest(port, size)         Exec_CreateIORequest(SysBase, (port), (size))
+#define DeleteIORequest(ioRequest)          Exec_DeleteIORequest(SysBase, (ioRequest))
+#define DoIO(ioRequest)                     Exec_DoIO(SysBase, (struct IORequest *)(ioRequest))
+#define SendIO(ioRequest)                   Exec_SendIO(SysBase, (struct IORequest *)(ioRequest))
+#define CheckIO(ioRequest)                  Exec_CheckIO(SysBase, (struct IORequest *)(ioRequest))
+#define WaitIO(ioRequest)                   Exec_WaitIO(SysBase, (struct IORequest *)(ioRequest))
+#define AbortIO(ioRequest)                  Exec_AbortIO(SysBase, (struct IORequest *)(ioRequest))
+
+#define RawDoFmt(formatString, dataStream, putChProc, putChData) \
+                                            Exec_RawDoFmt(SysBase, (formatString), (APTR)(dataStream), (void (*)())(putChProc), (putChData))
+
+#endif /* PROTO_EXEC_H */
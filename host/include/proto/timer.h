@@ -0,0 +1,8 @@
+#ifndef PROTO_TIMER_H
+#define PROTO_TIMER_H
+
+#include <clib/timer_protos.h>
+
+#define GetSysTime(dest)                    Timer_GetSysTime(TimerBase, (dest))
+
+#endif /* PROTO_TIMER_H */
@@ -0,0 +1,13 @@
+#ifndef PROTO_UTILITY_H
+#define PROTO_UTILITY_H
+
+#include <clib/utility_protos.h>
+
+#define GetTagData(tagValue, defaultVal, tagList) \
+                                            Utility_GetTagData(UtilityBase, (tagValue), (defaultVal), (tagList))
+#define FindTagItem(tagValue, tagList)      Utility_FindTagItem(UtilityBase, (tagValue), (tagList))
+#define NextTagItem(tagListPtr)             Utility_NextTagItem(UtilityBase, (tagListPtr))
+#define CallHookPkt(hook, object, paramPacket) \
+                                            Utility_CallHookPkt(UtilityBase, (hook), (APTR)(object), (APTR)(paramPacket))
+
+#endif /* PROTO_UTILITY_H */
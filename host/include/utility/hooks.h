@@ -0,0 +1,17 @@
+#ifndef UTILITY_HOOKS_H
+#define UTILITY_HOOKS_H
+
+#include <exec/types.h>
+#include <exec/nodes.h>
+
+/* Host build calls h_Entry as a plain C function (hook, object, message) */
+struct Hook {
+    struct MinNode  h_MinNode;
+    ULONG         (*h_Entry)();
+    ULONG         (*h_SubEntry)();
+    APTR            h_Data;
+};
+
+typedef struct Hook Hook;
+
+#endif /* UTILITY_HOOKS_H */
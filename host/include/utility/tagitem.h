@@ -0,0 +1,23 @@
+#ifndef UTILITY_TAGITEM_H
+#define UTILITY_TAGITEM_H
+
+#include <exec/types.h>
+
+typedef ULONG Tag;
+
+struct TagItem {
+    Tag     ti_Tag;
+    ULONG   ti_Data;
+};
+
+#define TAG_DONE    (0L)
+#define TAG_END     (0L)
+#define TAG_IGNORE  (1L)
+#define TAG_MORE    (2L)
+#define TAG_SKIP    (3L)
+#define TAG_USER    ((ULONG)(1L << 31))
+
+#define TAGFILTER_AND   0
+#define TAGFILTER_NOT   1
+
+#endif /* UTILITY_TAGITEM_H */
@@ -0,0 +1,357 @@
+/*
+    Test of the LZ4 frame decoder used for compressed firmware images (lz4.c).
+
+    A reference frame made by "lz4 -9" from RefByte() data has to decode to that data, with the header and
+    content checksums accepted. Hand made frames cover a block of literals only, an uncompressed block and
+    matches overlapping their own output. A broken header or content checksum, a match offset before the
+    start of the output, a truncated frame and a write refused by the caller (as FirmwareStreamWrite does
+    past the RAM left for the firmware) all have to fail. Input is fed in small pieces, so that every field
+    gets split across reads.
+
+    Usage: wifipi-lz4
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <exec/types.h>
+
+#include "lz4.h"
+
+#define REF_LENGTH          100000
+#define IN_SIZE             61
+#define OUT_SIZE            131072
+
+/* Made by lz4 -9 from REF_LENGTH bytes of RefByte() */
+static const UBYTE RefFrame[] = {
+    0x04, 0x22, 0x4d, 0x18, 0x64, 0x50, 0x08, 0x3b, 0x03, 0x00, 0x00, 0x2f, 0x04, 0x00, 0x01, 0x00,
+    0xe6, 0x1f, 0x01, 0xfb, 0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0x00, 0x1f, 0x01, 0x01, 0x00, 0x97, 0x1f, 0x02, 0xac, 0x00, 0x3c, 0x0f,
+    0xfb, 0x00, 0xff, 0xff, 0x7c, 0x1f, 0x04, 0xf1, 0x02, 0xe8, 0x0f, 0xfb, 0x00, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x74, 0x1f, 0x02, 0x01, 0x00, 0x47, 0x2f, 0x03,
+    0x02, 0x01, 0x00, 0x8b, 0x0f, 0xfb, 0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x08, 0x1f, 0x05,
+    0xdd, 0x06, 0xe8, 0x0f, 0xfb, 0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xe8, 0x16, 0x03,
+    0x01, 0x00, 0x2f, 0x04, 0x03, 0x01, 0x00, 0xdb, 0x0f, 0xfb, 0x00, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0x93, 0x1f, 0x06, 0xe2, 0x05, 0xff, 0xff, 0xff, 0xff, 0xff, 0x59, 0x1f,
+    0x04, 0x01, 0x00, 0xa2, 0x1f, 0x05, 0xb7, 0x00, 0x31, 0x0f, 0xfb, 0x00, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x1f, 0x1f, 0x07, 0xf6, 0x01, 0xff, 0xcd,
+    0x1f, 0x05, 0x01, 0x00, 0x52, 0x2f, 0x06, 0x05, 0x01, 0x00, 0x80, 0x0f, 0xfb, 0x00, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x01, 0x1f, 0x06,
+    0x01, 0x00, 0x02, 0x2f, 0x07, 0x06, 0x01, 0x00, 0xe6, 0x0f, 0xfb, 0x00, 0x84, 0x1f, 0x09, 0xfb,
+    0x00, 0xe7, 0x1f, 0x06, 0xfb, 0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0x56, 0x1f, 0x07, 0x01, 0x00, 0xad, 0x1f, 0x08, 0xc2, 0x00, 0x26, 0x0f, 0xfb,
+    0x00, 0xff, 0xff, 0xff, 0xff, 0x26, 0x1f, 0x0a, 0xe7, 0x04, 0xe8, 0x0f, 0xfb, 0x00, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xca, 0x1f, 0x08, 0x01, 0x00, 0x5d, 0x2f, 0x09, 0x08,
+    0x01, 0x00, 0x75, 0x0f, 0xfb, 0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xb1, 0x1f, 0x0b,
+    0xd8, 0x07, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x3b, 0x1f, 0x09, 0x01, 0x00, 0x0d, 0x2f,
+    0x0a, 0x09, 0x01, 0x00, 0xc5, 0x0f, 0xfb, 0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0x3d, 0x1f, 0x0c, 0xec, 0x03, 0xff, 0xff, 0xff, 0xaf, 0x1f, 0x0a, 0x01, 0x00,
+    0xb8, 0x1f, 0x0b, 0xcd, 0x00, 0x1b, 0x0f, 0xfb, 0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xc8, 0x1f, 0x0d, 0x7f, 0x00, 0x25, 0x0f, 0x01, 0x00,
+    0x68, 0x2f, 0x0c, 0x0b, 0x01, 0x00, 0x6a, 0x0f, 0xfb, 0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x01, 0x1f, 0x0c, 0x01, 0x00, 0x18, 0x2f,
+    0x0d, 0x0c, 0x01, 0x00, 0xba, 0x0f, 0xfb, 0x00, 0xff, 0xff, 0x44, 0x1f, 0x0f, 0xf1, 0x02, 0xe8,
+    0x0f, 0xfb, 0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xac, 0x1f,
+    0x0d, 0x01, 0x00, 0xc3, 0x1f, 0x0e, 0xd8, 0x00, 0x10, 0x0f, 0xfb, 0x00, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xcf, 0x1f, 0x10, 0xe2, 0x05, 0xe8, 0x0f, 0xfb, 0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0x21, 0x1f, 0x0e, 0x01, 0x00, 0x73, 0x1f, 0x0f, 0x88, 0x00, 0x60, 0x0f, 0xfb, 0x00,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x5b, 0x1f, 0x11, 0xe2, 0x05, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0x91, 0x1f, 0x0f, 0x01, 0x00, 0x23, 0x2f, 0x10, 0x0f, 0x01, 0x00, 0xaf, 0x0f,
+    0xfb, 0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xe6, 0x1f,
+    0x12, 0xf1, 0x02, 0xff, 0xff, 0x06, 0x1f, 0x10, 0x01, 0x00, 0xce, 0x1f, 0x11, 0xe3, 0x00, 0x05,
+    0x0f, 0xfb, 0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0x01, 0x1f, 0x11, 0x01, 0x00, 0x7e, 0x2f, 0x12, 0x11, 0x01, 0x00, 0xc9, 0x1f, 0x14,
+    0xfb, 0x00, 0xe7, 0x1f, 0x11, 0xfb, 0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0x8e, 0x1f, 0x12, 0x01, 0x00, 0x2e, 0x2f, 0x13, 0x12, 0x01, 0x00, 0xa4,
+    0x0f, 0xfb, 0x00, 0xff, 0xff, 0xff, 0xed, 0x1f, 0x15, 0xe7, 0x04, 0xe8, 0x0f, 0xfb, 0x00, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x03, 0x1f, 0x13, 0x01, 0x00, 0xd9, 0x1e,
+    0x14, 0xee, 0x00, 0x0f, 0xfb, 0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x74, 0x1f, 0x16,
+    0xd8, 0x07, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x73, 0x1f, 0x14, 0x01, 0x00, 0x89, 0x1f,
+    0x15, 0x9e, 0x00, 0x4a, 0x0f, 0xfb, 0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0x05, 0x1f, 0x17, 0xe7, 0x04, 0xff, 0xff, 0xff, 0xe7, 0x1f, 0x15, 0x01, 0x00, 0x39,
+    0x2f, 0x16, 0x15, 0x01, 0x00, 0x99, 0x0f, 0xfb, 0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x90, 0x1f, 0x18, 0xfb, 0x00, 0x5c, 0x1f, 0x16, 0x01,
+    0x00, 0xe4, 0x3f, 0x17, 0x16, 0x16, 0xfb, 0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x01, 0x1f, 0x17, 0x01, 0x00, 0x94, 0x1f, 0x18, 0xa9,
+    0x00, 0x3f, 0x0f, 0xfb, 0x00, 0xff, 0xff, 0x0c, 0x1f, 0x1a, 0xf1, 0x02, 0xe8, 0x0f, 0xfb, 0x00,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xe4, 0x1f, 0x18, 0x01, 0x00,
+    0x44, 0x2f, 0x19, 0x18, 0x01, 0x00, 0x8e, 0x0f, 0xfb, 0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0x92,
+    0x50, 0x18, 0x18, 0x18, 0x18, 0x18, 0x00, 0x00, 0x00, 0x00, 0x85, 0x5e, 0xaf, 0x63,
+};
+
+struct Source {
+    const UBYTE *   s_Data;
+    ULONG           s_Length;
+    ULONG           s_Pos;
+    UBYTE           s_Out[OUT_SIZE];
+    ULONG           s_OutLength;
+    ULONG           s_Limit;        // writes past it are refused
+};
+
+static int Failures;
+
+static void Check(const char *name, ULONG got, ULONG expected)
+{
+    if (got != expected)
+    {
+        printf("FAIL: %s: got %lu, expected %lu\n", name, (unsigned long)got, (unsigned long)expected);
+        Failures++;
+    }
+}
+
+static UBYTE RefByte(ULONG i)
+{
+    return ((i >> 12) + (i % 251 == 0) + 3 * (i % 5000 == 0)) & 0xff;
+}
+
+static LONG SourceRead(APTR userData, UBYTE *buffer, ULONG length)
+{
+    struct Source *s = userData;
+
+    if (length > s->s_Length - s->s_Pos)
+        length = s->s_Length - s->s_Pos;
+
+    memcpy(buffer, &s->s_Data[s->s_Pos], length);
+    s->s_Pos += length;
+
+    return length;
+}
+
+static BOOL SourceWrite(APTR userData, ULONG offset, UBYTE *buffer, ULONG length)
+{
+    struct Source *s = userData;
+
+    if (offset != s->s_OutLength || offset + length > s->s_Limit)
+        return FALSE;
+
+    memcpy(&s->s_Out[offset], buffer, length);
+    s->s_OutLength += length;
+
+    return TRUE;
+}
+
+static BOOL Decode(struct Source *s, const UBYTE *data, ULONG length, ULONG limit)
+{
+    static UBYTE in[IN_SIZE];
+    static UBYTE window[LZ4_WINDOW_SIZE];
+    struct LZ4Stream ls;
+
+    memset(&ls, 0, sizeof(ls));
+    s->s_Data = data;
+    s->s_Length = length;
+    s->s_Pos = 0;
+    s->s_OutLength = 0;
+    s->s_Limit = limit;
+
+    ls.ls_UserData = s;
+    ls.ls_Read = SourceRead;
+    ls.ls_Write = SourceWrite;
+    ls.ls_InBuffer = in;
+    ls.ls_InSize = IN_SIZE;
+    ls.ls_Window = window;
+
+    return LZ4_Decompress(&ls);
+}
+
+/* Frame of given blocks, header checksum included, optionally with content size and checksum */
+static ULONG BuildFrame(UBYTE *frame, const UBYTE *blocks, ULONG length, const UBYTE *content, LONG contentLength)
+{
+    struct XXH32State xs;
+    ULONG pos = 4;
+    UBYTE *desc;
+
+    frame[0] = 0x04; frame[1] = 0x22; frame[2] = 0x4d; frame[3] = 0x18;
+    desc = &frame[pos];
+    frame[pos++] = 0x60 | (contentLength >= 0 ? 0x0c : 0);
+    frame[pos++] = 0x40;
+    if (contentLength >= 0)
+    {
+        for (int i = 0; i < 8; i++)
+            frame[pos++] = i < 4 ? (ULONG)contentLength >> (8 * i) : 0;
+    }
+
+    XXH32_Init(&xs, 0);
+    XXH32_Update(&xs, desc, &frame[pos] - desc);
+    frame[pos++] = XXH32_Digest(&xs) >> 8;
+
+    memcpy(&frame[pos], blocks, length);
+    pos += length;
+
+    for (int i = 0; i < 4; i++)
+        frame[pos++] = 0;
+
+    if (contentLength >= 0)
+    {
+        XXH32_Init(&xs, 0);
+        XXH32_Update(&xs, content, contentLength);
+        ULONG sum = XXH32_Digest(&xs);
+        for (int i = 0; i < 4; i++)
+            frame[pos++] = sum >> (8 * i);
+    }
+
+    return pos;
+}
+
+static void TestXXH32(void)
+{
+    struct XXH32State xs;
+    UBYTE data[REF_LENGTH];
+    ULONG whole;
+
+    XXH32_Init(&xs, 0);
+    Check("xxh32 of nothing", XXH32_Digest(&xs), 0x02cc5d05);
+
+    for (ULONG i = 0; i < REF_LENGTH; i++)
+        data[i] = RefByte(i);
+
+    XXH32_Init(&xs, 0);
+    XXH32_Update(&xs, data, REF_LENGTH);
+    whole = XXH32_Digest(&xs);
+
+    /* Same hash when fed in pieces which do not line up with the 16 byte stripes */
+    XXH32_Init(&xs, 0);
+    for (ULONG i = 0; i < REF_LENGTH; i += 7)
+        XXH32_Update(&xs, &data[i], i + 7 > REF_LENGTH ? REF_LENGTH - i : 7);
+    Check("xxh32 in pieces", XXH32_Digest(&xs), whole);
+}
+
+static void TestReference(struct Source *s)
+{
+    UBYTE frame[sizeof(RefFrame)];
+    ULONG mismatch = 0;
+
+    Check("reference decodes", Decode(s, RefFrame, sizeof(RefFrame), OUT_SIZE), TRUE);
+    Check("reference length", s->s_OutLength, REF_LENGTH);
+    for (ULONG i = 0; i < s->s_OutLength; i++)
+        if (s->s_Out[i] != RefByte(i)) mismatch++;
+    Check("reference content", mismatch, 0);
+
+    memcpy(frame, RefFrame, sizeof(frame));
+    frame[sizeof(frame) - 1] ^= 0x01;
+    Check("bad content checksum", Decode(s, frame, sizeof(frame), OUT_SIZE), FALSE);
+
+    memcpy(frame, RefFrame, sizeof(frame));
+    frame[6] ^= 0x01;
+    Check("bad header checksum", Decode(s, frame, sizeof(frame), OUT_SIZE), FALSE);
+
+    Check("truncated frame", Decode(s, RefFrame, sizeof(RefFrame) / 2, OUT_SIZE), FALSE);
+    Check("truncated checksum", Decode(s, RefFrame, sizeof(RefFrame) - 2, OUT_SIZE), FALSE);
+
+    Check("write refused", Decode(s, RefFrame, sizeof(RefFrame), REF_LENGTH - 1), FALSE);
+}
+
+static void TestLiterals(struct Source *s)
+{
+    static const UBYTE text[] = "literals only";
+    UBYTE blocks[64], frame[128];
+    ULONG length, n = sizeof(text) - 1;
+
+    // Compressed block with a single sequence of literals and no match
+    blocks[0] = 1 + n; blocks[1] = 0; blocks[2] = 0; blocks[3] = 0;
+    blocks[4] = n << 4;
+    memcpy(&blocks[5], text, n);
+
+    length = BuildFrame(frame, blocks, 5 + n, text, n);
+    Check("literals decode", Decode(s, frame, length, OUT_SIZE), TRUE);
+    Check("literals length", s->s_OutLength, n);
+    Check("literals content", memcmp(s->s_Out, text, n), 0);
+
+    // Same data as an uncompressed block
+    blocks[0] = n; blocks[1] = 0; blocks[2] = 0; blocks[3] = 0x80;
+    memcpy(&blocks[4], text, n);
+
+    length = BuildFrame(frame, blocks, 4 + n, text, n);
+    Check("uncompressed decode", Decode(s, frame, length, OUT_SIZE), TRUE);
+    Check("uncompressed content", s->s_OutLength == n && memcmp(s->s_Out, text, n) == 0, TRUE);
+
+    // Literal length of 15 + 255 + 10, extended with two bytes
+    {
+        static UBYTE longBlocks[4 + 3 + 280], longFrame[sizeof(longBlocks) + 32], content[280];
+
+        for (int i = 0; i < 280; i++)
+            content[i] = 'a' + i % 26;
+
+        longBlocks[0] = (3 + 280) & 0xff; longBlocks[1] = (3 + 280) >> 8; longBlocks[2] = 0; longBlocks[3] = 0;
+        longBlocks[4] = 0xf0;
+        longBlocks[5] = 255;
+        longBlocks[6] = 10;
+        memcpy(&longBlocks[7], content, 280);
+
+        length = BuildFrame(longFrame, longBlocks, sizeof(longBlocks), content, 280);
+        Check("long literals decode", Decode(s, longFrame, length, OUT_SIZE), TRUE);
+        Check("long literals content", s->s_OutLength == 280 && memcmp(s->s_Out, content, 280) == 0, TRUE);
+    }
+}
+
+static void TestMatches(struct Source *s)
+{
+    static const UBYTE expected[] = "ababababababab!";
+    UBYTE blocks[64], frame[128];
+    ULONG length, n = sizeof(expected) - 1;
+
+    // "ab", then a 12 byte match at offset 2 which reads its own output, then "!"
+    static const UBYTE overlap[] = {
+        12, 0, 0, 0,
+        0x28, 'a', 'b', 2, 0,
+        0x10, '!',
+    };
+    memcpy(blocks, overlap, sizeof(overlap));
+    blocks[0] = sizeof(overlap) - 4;
+
+    length = BuildFrame(frame, blocks, sizeof(overlap), expected, n);
+    Check("overlapping match decode", Decode(s, frame, length, OUT_SIZE), TRUE);
+    Check("overlapping match length", s->s_OutLength, n);
+    Check("overlapping match content", memcmp(s->s_Out, expected, n), 0);
+
+    // Offset 1, run of a single byte
+    static const UBYTE run[] = {
+        0, 0, 0, 0,
+        0x1f, 'x', 1, 0, 100,
+        0x10, '.',
+    };
+    memcpy(blocks, run, sizeof(run));
+    blocks[0] = sizeof(run) - 4;
+
+    length = BuildFrame(frame, blocks, sizeof(run), NULL, -1);
+    Check("run decode", Decode(s, frame, length, OUT_SIZE), TRUE);
+    Check("run length", s->s_OutLength, 1 + 4 + 15 + 100 + 1);
+    Check("run content", s->s_Out[119] == 'x' && s->s_Out[120] == '.', TRUE);
+
+    // Offset 3 with only two bytes of output before it
+    static const UBYTE bad[] = {
+        0, 0, 0, 0,
+        0x20, 'a', 'b', 3, 0,
+        0x10, '!',
+    };
+    memcpy(blocks, bad, sizeof(bad));
+    blocks[0] = sizeof(bad) - 4;
+
+    length = BuildFrame(frame, blocks, sizeof(bad), NULL, -1);
+    Check("offset before output", Decode(s, frame, length, OUT_SIZE), FALSE);
+
+    // Offset 0 is invalid
+    blocks[7] = 0;
+    length = BuildFrame(frame, blocks, sizeof(bad), NULL, -1);
+    Check("offset zero", Decode(s, frame, length, OUT_SIZE), FALSE);
+}
+
+int main(int argc, char **argv)
+{
+    static struct Source s;
+
+    (void)argc;
+    (void)argv;
+
+    TestXXH32();
+    TestReference(&s);
+    TestLiterals(&s);
+    TestMatches(&s);
+
+    if (Failures)
+        printf("%d check(s) failed\n", Failures);
+    else
+        printf("All LZ4 checks passed\n");
+
+    return Failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,69 @@
+/*
+    Packs an NVRAM text file the way the driver does it on load (NVRAM_Compile in nvram.c). The packed file
+    can be put in DEVS:Firmware instead of the text, the driver recognizes it and uploads it as is.
+
+    Usage: wifipi-nvrampack <nvram.txt> <nvram.bin>
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <exec/types.h>
+
+#include "nvram.h"
+
+int main(int argc, char **argv)
+{
+    FILE *in, *out;
+    UBYTE *text, *packed;
+    long length;
+    ULONG size;
+    int ret = EXIT_FAILURE;
+
+    if (argc != 3)
+    {
+        fprintf(stderr, "Usage: %s <nvram.txt> <nvram.bin>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    in = fopen(argv[1], "rb");
+    if (in == NULL)
+    {
+        perror(argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    fseek(in, 0, SEEK_END);
+    length = ftell(in);
+    fseek(in, 0, SEEK_SET);
+
+    text = malloc(length + 1);
+    packed = malloc(NVRAM_MAX_PACKED(length));
+
+    if (fread(text, 1, length, in) != (size_t)length)
+        perror(argv[1]);
+    else if (NVRAM_IsPacked(text, length))
+        fprintf(stderr, "%s: already packed\n", argv[1]);
+    else if ((size = NVRAM_Compile(text, length, packed, NVRAM_MAX_PACKED(length))) == 0)
+        fprintf(stderr, "%s: cannot pack\n", argv[1]);
+    else if ((out = fopen(argv[2], "wb")) == NULL)
+        perror(argv[2]);
+    else
+    {
+        if (fwrite(packed, 1, size, out) == size && fclose(out) == 0)
+        {
+            printf("%s: %ld bytes of text, %lu bytes packed\n", argv[2], length, (unsigned long)size);
+            ret = EXIT_SUCCESS;
+        }
+        else
+        {
+            perror(argv[2]);
+        }
+    }
+
+    free(text);
+    free(packed);
+    fclose(in);
+
+    return ret;
+}
@@ -0,0 +1,182 @@
+/*
+    Test of the NVRAM compiler (nvram.c).
+
+    The same two entries written with LF and CRLF line ends, without newline at the end, and surrounded by
+    comments, empty lines and whitespace have to compile to the same packed form, byte by byte. Input with
+    comments only gives an empty NVRAM. Every destination smaller than the packed size has to make
+    NVRAM_Compile return 0 without writing past it. Compiling in place has to give the same result. The
+    NVRAM files in firmware/ have to compile, and NVRAM_IsPacked has to tell packed data from text and
+    from packed data with a broken trailer.
+
+    Usage: wifipi-nvram
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <exec/types.h>
+
+#include "nvram.h"
+
+#define GUARD               0xa5
+
+static int Failures;
+
+static void Check(const char *name, ULONG got, ULONG expected)
+{
+    if (got != expected)
+    {
+        printf("FAIL: %s: got %lu, expected %lu\n", name, (unsigned long)got, (unsigned long)expected);
+        Failures++;
+    }
+}
+
+/* "a=1" and "bb=22", extra zero, padding and trailer with 3 words */
+static const UBYTE Packed[] = {
+    'a', '=', '1', 0, 'b', 'b', '=', '2', '2', 0, 0, 0,
+    0x03, 0x00, 0xfc, 0xff,
+};
+
+static const char *Texts[] = {
+    "a=1\nbb=22\n",
+    "a=1\r\nbb=22\r\n",
+    "a=1\nbb=22",
+    "a=1\r\nbb=22",
+    "# header\n\n  a=1  \n\t# comment\n\r\n\tbb=22\t\r\n# trailer",
+};
+
+static void TestText(const char *name, const char *text)
+{
+    UBYTE dst[64];
+    UBYTE inPlace[64];
+    ULONG length = strlen(text);
+    ULONG size;
+
+    memset(dst, GUARD, sizeof(dst));
+    size = NVRAM_Compile((const UBYTE *)text, length, dst, sizeof(dst));
+    Check(name, size, sizeof(Packed));
+    Check(name, memcmp(dst, Packed, sizeof(Packed)), 0);
+    Check(name, NVRAM_IsPacked(dst, size), TRUE);
+    Check(name, NVRAM_IsPacked((const UBYTE *)text, length), FALSE);
+
+    /* No destination size short of the packed one is enough, and nothing is written past it */
+    for (ULONG dstSize = 0; dstSize < sizeof(Packed); dstSize++)
+    {
+        memset(dst, GUARD, sizeof(dst));
+        Check(name, NVRAM_Compile((const UBYTE *)text, length, dst, dstSize), 0);
+        Check(name, dst[dstSize], GUARD);
+    }
+
+    /* In place, in a buffer of NVRAM_MAX_PACKED size */
+    memset(inPlace, GUARD, sizeof(inPlace));
+    memcpy(inPlace, text, length);
+    size = NVRAM_Compile(inPlace, length, inPlace, NVRAM_MAX_PACKED(length));
+    Check(name, size, sizeof(Packed));
+    Check(name, memcmp(inPlace, Packed, sizeof(Packed)), 0);
+}
+
+static void TestEmpty(void)
+{
+    static const char *texts[] = { "", "\n\n", "# only\n# comments", "  \r\n\t\r\n" };
+    static const UBYTE empty[] = { 0, 0, 0, 0, 0x01, 0x00, 0xfe, 0xff };
+    UBYTE dst[16];
+
+    for (int i = 0; i < 4; i++)
+    {
+        Check("empty", NVRAM_Compile((const UBYTE *)texts[i], strlen(texts[i]), dst, sizeof(dst)), sizeof(empty));
+        Check("empty", memcmp(dst, empty, sizeof(empty)), 0);
+    }
+}
+
+static void TestIsPacked(void)
+{
+    UBYTE data[sizeof(Packed)];
+
+    Check("packed", NVRAM_IsPacked(Packed, sizeof(Packed)), TRUE);
+    Check("packed, short", NVRAM_IsPacked(Packed, 4), FALSE);
+    Check("packed, unaligned", NVRAM_IsPacked(Packed, sizeof(Packed) - 1), FALSE);
+
+    memcpy(data, Packed, sizeof(data));
+    data[sizeof(data) - 4] = 0x04;
+    Check("packed, wrong length", NVRAM_IsPacked(data, sizeof(data)), FALSE);
+
+    memcpy(data, Packed, sizeof(data));
+    data[sizeof(data) - 1] = 0x00;
+    Check("packed, no inverse", NVRAM_IsPacked(data, sizeof(data)), FALSE);
+
+    memcpy(data, Packed, sizeof(data));
+    data[sizeof(data) - 5] = 'x';
+    Check("packed, no end marker", NVRAM_IsPacked(data, sizeof(data)), FALSE);
+}
+
+static void TestFile(const char *name)
+{
+    char path[512];
+    FILE *f;
+    UBYTE *text, *dst;
+    long length;
+
+    snprintf(path, sizeof(path), "%s/%s", WIFIPI_FIRMWARE_DIR, name);
+    f = fopen(path, "rb");
+    if (f == NULL)
+    {
+        printf("FAIL: %s: cannot open\n", path);
+        Failures++;
+        return;
+    }
+
+    fseek(f, 0, SEEK_END);
+    length = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    text = malloc(length);
+    dst = malloc(NVRAM_MAX_PACKED(length));
+    if (fread(text, 1, length, f) == (size_t)length)
+    {
+        ULONG size = NVRAM_Compile(text, length, dst, NVRAM_MAX_PACKED(length));
+
+        Check(name, size != 0 && size <= (ULONG)NVRAM_MAX_PACKED(length), TRUE);
+        Check(name, NVRAM_IsPacked(dst, size), TRUE);
+        Check(name, NVRAM_IsPacked(text, length), FALSE);
+    }
+    else
+    {
+        printf("FAIL: %s: cannot read\n", path);
+        Failures++;
+    }
+
+    free(text);
+    free(dst);
+    fclose(f);
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+
+    for (int i = 0; i < (int)(sizeof(Texts) / sizeof(Texts[0])); i++)
+    {
+        char name[32];
+
+        snprintf(name, sizeof(name), "text %d", i);
+        TestText(name, Texts[i]);
+    }
+
+    TestEmpty();
+    TestIsPacked();
+
+    TestFile("brcmfmac43430-sdio.txt");
+    TestFile("brcmfmac43436-sdio.txt");
+    TestFile("brcmfmac43436s-sdio.txt");
+    TestFile("brcmfmac43455-sdio.txt");
+    TestFile("brcmfmac43456-sdio.txt");
+
+    if (Failures)
+        printf("%d check(s) failed\n", Failures);
+    else
+        printf("All NVRAM checks passed\n");
+
+    return Failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
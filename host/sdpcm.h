@@ -0,0 +1,176 @@
+#ifndef _SDPCM_H
+#define _SDPCM_H
+
+#include <string.h>
+#include <exec/types.h>
+
+/*
+    Byte level builders of what the dongle sends over F2: SDPCM frames of all channels, BCDC control
+    replies, firmware events and escan results. The wire structures of packet.c are private to it, so
+    the layouts are written out here again, byte by byte and independent of host endianness.
+*/
+
+#define SDPCM_HEADER_LEN        12          // Hardware (4) and software (8) header
+#define SDPCM_GLOM_HEADER_LEN   8           // Hardware extension header of TX glom
+#define BDC_HEADER_LEN          4
+#define BCDC_HEADER_LEN         16
+#define EVENT_HEADER_LEN        72
+#define ESCAN_HEADER_LEN        12
+#define BSSINFO_LEN             126
+
+#define CHANNEL_CONTROL         0
+#define CHANNEL_EVENT           1
+#define CHANNEL_DATA            2
+#define CHANNEL_GLOM            3
+
+#define BCDC_FLAG_ERROR         0x01
+#define BCDC_FLAG_SET           0x02
+
+#define EVENT_SET_SSID          0
+#define EVENT_LINK              16
+#define EVENT_ESCAN_RESULT      69
+
+static inline void PutLE16(UBYTE *p, UWORD v) { p[0] = v; p[1] = v >> 8; }
+static inline void PutLE32(UBYTE *p, ULONG v) { p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24; }
+static inline void PutBE16(UBYTE *p, UWORD v) { p[0] = v >> 8; p[1] = v; }
+static inline void PutBE32(UBYTE *p, ULONG v) { p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v; }
+static inline UWORD GetLE16(const UBYTE *p) { return p[0] | (p[1] << 8); }
+static inline ULONG GetLE32(const UBYTE *p) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((ULONG)p[3] << 24); }
+static inline UWORD GetBE16(const UBYTE *p) { return (p[0] << 8) | p[1]; }
+
+/* SDPCM header of a frame with length bytes in total, payload starts at SDPCM_HEADER_LEN */
+static inline void PutSDPCMHeader(UBYTE *buf, UWORD length, UBYTE channel, UBYTE seq, UBYTE maxSeq, UBYTE flowControl)
+{
+    PutLE16(&buf[0], length);
+    PutLE16(&buf[2], ~length);
+    buf[4] = seq;
+    buf[5] = channel;
+    buf[6] = 0;
+    buf[7] = SDPCM_HEADER_LEN;
+    buf[8] = flowControl;
+    buf[9] = maxSeq;
+    buf[10] = 0;
+    buf[11] = 0;
+}
+
+/* Data frame carrying an ethernet frame behind the BDC header. Returns length of the SDPCM frame */
+static inline ULONG BuildDataFrame(UBYTE *buf, UBYTE seq, UBYTE maxSeq, const UBYTE *frame, ULONG frameLength)
+{
+    ULONG length = SDPCM_HEADER_LEN + BDC_HEADER_LEN + frameLength;
+
+    PutSDPCMHeader(buf, length, CHANNEL_DATA, seq, maxSeq, 0);
+    memset(&buf[SDPCM_HEADER_LEN], 0, BDC_HEADER_LEN);
+    buf[SDPCM_HEADER_LEN] = 0x20;
+    memcpy(&buf[SDPCM_HEADER_LEN + BDC_HEADER_LEN], frame, frameLength);
+
+    return length;
+}
+
+/* Ethernet frame of given length with payload filled with a counter pattern */
+static inline void BuildEtherFrame(UBYTE *frame, ULONG length, const UBYTE *dst, const UBYTE *src, UWORD type)
+{
+    memcpy(&frame[0], dst, 6);
+    memcpy(&frame[6], src, 6);
+    PutBE16(&frame[12], type);
+    for (ULONG i = 14; i < length; i++)
+        frame[i] = i;
+}
+
+/*
+    Firmware event with data attached. Event header is in network order, the data in whatever order the
+    event defines (escan results are little endian). Returns length of the SDPCM frame.
+*/
+static inline ULONG BuildEvent(UBYTE *buf, UBYTE seq, UBYTE maxSeq, const UBYTE *src, ULONG eventType,
+                               ULONG status, ULONG reason, const void *data, ULONG dataLength)
+{
+    ULONG length = SDPCM_HEADER_LEN + BDC_HEADER_LEN + EVENT_HEADER_LEN + dataLength;
+    UBYTE *e = &buf[SDPCM_HEADER_LEN + BDC_HEADER_LEN];
+
+    PutSDPCMHeader(buf, length, CHANNEL_EVENT, seq, maxSeq, 0);
+    memset(&buf[SDPCM_HEADER_LEN], 0, BDC_HEADER_LEN + EVENT_HEADER_LEN);
+
+    memset(&e[0], 0xff, 6);
+    memcpy(&e[6], src, 6);
+    PutBE16(&e[12], 0x886c);
+    PutBE16(&e[14], 0x8001);
+    PutBE16(&e[16], EVENT_HEADER_LEN - 14 + dataLength);
+    e[18] = 0;
+    e[19] = 0x00; e[20] = 0x10; e[21] = 0x18;
+    PutBE16(&e[22], 1);
+    PutBE16(&e[24], 2);
+    PutBE32(&e[28], eventType);
+    PutBE32(&e[32], status);
+    PutBE32(&e[36], reason);
+    PutBE32(&e[44], dataLength);
+    memcpy(&e[48], src, 6);
+    memcpy(&e[54], "wlan0", 5);
+
+    if (dataLength)
+        memcpy(&e[EVENT_HEADER_LEN], data, dataLength);
+
+    return length;
+}
+
+/*
+    Escan result with a single BSS and its IEs, as firmware sends them. Without bssid it is the completion
+    of the scan. Returns length of the data to be passed to BuildEvent.
+*/
+static inline ULONG BuildEScanResult(UBYTE *buf, UWORD syncID, const UBYTE *bssid, const char *ssid,
+                                     UWORD chanSpec, WORD rssi, const UBYTE *ie, ULONG ieLength)
+{
+    ULONG length = ESCAN_HEADER_LEN;
+
+    memset(buf, 0, ESCAN_HEADER_LEN);
+    PutLE32(&buf[4], 109);
+    PutLE16(&buf[8], syncID);
+
+    if (bssid != NULL)
+    {
+        UBYTE *b = &buf[ESCAN_HEADER_LEN];
+        ULONG ssidLength = strlen(ssid);
+
+        memset(b, 0, BSSINFO_LEN);
+        PutLE32(&b[0], 109);
+        PutLE32(&b[4], BSSINFO_LEN + ieLength);
+        memcpy(&b[8], bssid, 6);
+        PutLE16(&b[14], 100);
+        PutLE16(&b[16], 0x0411);
+        b[18] = ssidLength;
+        memcpy(&b[19], ssid, ssidLength);
+        PutLE16(&b[72], chanSpec);
+        PutLE16(&b[78], rssi);
+        b[80] = -92;
+        PutLE16(&b[118], BSSINFO_LEN);
+        PutLE32(&b[120], ieLength);
+        memcpy(&b[BSSINFO_LEN], ie, ieLength);
+
+        PutLE16(&buf[10], 1);
+        length += BSSINFO_LEN + ieLength;
+    }
+
+    PutLE32(&buf[0], length);
+
+    return length;
+}
+
+/* BCDC reply on control channel. data is what the dongle returns for a get, may be NULL */
+static inline ULONG BuildCtrlReply(UBYTE *buf, UBYTE seq, UBYTE maxSeq, ULONG command, UWORD flags, UWORD id,
+                                   LONG status, const void *data, ULONG dataLength)
+{
+    ULONG length = SDPCM_HEADER_LEN + BCDC_HEADER_LEN + dataLength;
+    UBYTE *c = &buf[SDPCM_HEADER_LEN];
+
+    PutSDPCMHeader(buf, length, CHANNEL_CONTROL, seq, maxSeq, 0);
+    PutLE32(&c[0], command);
+    PutLE32(&c[4], dataLength);
+    PutLE16(&c[8], flags);
+    PutLE16(&c[10], id);
+    PutLE32(&c[12], status);
+
+    if (dataLength)
+        memcpy(&c[BCDC_HEADER_LEN], data, dataLength);
+
+    return length;
+}
+
+#endif /* _SDPCM_H */
@@ -9,7 +9,7 @@
 extern "C" {
 #endif
 
-#if defined(__INTELLISENSE__)
+#if defined(__INTELLISENSE__) || !defined(__m68k__)
 #define REGARG(arg, reg) arg
 #else
 #define REGARG(arg, reg) arg asm(reg)
@@ -147,7 +147,42 @@ struct ChannelInfo {
  * @decchspec: decodes chanspec into generic info
  */
 
+/**
+ * struct ChanSpecDecode - precomputed decoding of chanspec upper byte
+ *
+ * Everything but the channel number lives in bits 8..15 of a chanspec, so
+ * each D11 type has a table of 256 entries. Fields not set by the decoder
+ * for given bits are not flagged in cd_Valid and are left untouched.
+ */
+#define CD_BAND				0x01
+#define CD_BANDWIDTH			0x02
+#define CD_SIDEBAND			0x04
+
+struct ChanSpecDecode {
+	BYTE                cd_Offset;	/* control channel minus center one */
+	UBYTE               cd_Valid;
+	UBYTE               cd_Band;
+	BYTE                cd_Bandwidth;
+	BYTE                cd_Sideband;
+};
+
 void EncodeChanSpec(struct ChannelInfo *ci, UBYTE ioType);
 void DecodeChanSpec(struct ChannelInfo *ci, UBYTE ioType);
+void BuildChanSpecTable(struct ChanSpecDecode *table, UBYTE ioType);
+
+static inline void DecodeChanSpecTable(struct ChannelInfo *ci, const struct ChanSpecDecode *table)
+{
+	const struct ChanSpecDecode *cd = &table[ci->ci_CHSpec >> 8];
+
+	ci->ci_CHNum = (UBYTE)(ci->ci_CHSpec & BRCMU_CHSPEC_CH_MASK);
+	ci->ci_ControlChannel = ci->ci_CHNum + cd->cd_Offset;
+
+	if (cd->cd_Valid & CD_BAND)
+		ci->ci_Band = cd->cd_Band;
+	if (cd->cd_Valid & CD_BANDWIDTH)
+		ci->ci_Bandwidth = cd->cd_Bandwidth;
+	if (cd->cd_Valid & CD_SIDEBAND)
+		ci->ci_Sideband = cd->cd_Sideband;
+}
 
 #endif	/* _BRCMU_CHANNELS_H_ */
\ No newline at end of file
@@ -21,4 +21,55 @@
 #define S2SS_ETHERNET_RETRIES        (S2WireType_Ethernet << 16 | 1)
 #define S2SS_ETHERNET_FIFO_UNDERRUNS (S2WireType_Ethernet << 16 | 2)
 
+/* NEW: WiFiPi driver statistics. Histogram buckets are <250us, <1ms, <4ms and slower */
+
+#define S2SS_WIFIPI_RX_BYTES         (S2WireType_Ethernet << 16 | 0x100)
+#define S2SS_WIFIPI_TX_BYTES         (S2WireType_Ethernet << 16 | 0x101)
+#define S2SS_WIFIPI_RX_GLOM_FRAMES   (S2WireType_Ethernet << 16 | 0x102)
+#define S2SS_WIFIPI_RX_GLOM_PACKETS  (S2WireType_Ethernet << 16 | 0x103)
+#define S2SS_WIFIPI_TX_GLOM_FRAMES   (S2WireType_Ethernet << 16 | 0x104)
+#define S2SS_WIFIPI_TX_GLOM_PACKETS  (S2WireType_Ethernet << 16 | 0x105)
+#define S2SS_WIFIPI_SDIO_CMD52       (S2WireType_Ethernet << 16 | 0x106)
+#define S2SS_WIFIPI_SDIO_CMD53       (S2WireType_Ethernet << 16 | 0x107)
+#define S2SS_WIFIPI_POLL_DATA        (S2WireType_Ethernet << 16 | 0x108)
+#define S2SS_WIFIPI_POLL_IDLE        (S2WireType_Ethernet << 16 | 0x109)
+#define S2SS_WIFIPI_TX_PASS_PEAK     (S2WireType_Ethernet << 16 | 0x10a)
+#define S2SS_WIFIPI_CTRL_QUEUE_PEAK  (S2WireType_Ethernet << 16 | 0x10b)
+#define S2SS_WIFIPI_FW_TX_ERRORS     (S2WireType_Ethernet << 16 | 0x10c)
+#define S2SS_WIFIPI_FW_TX_DROPS      (S2WireType_Ethernet << 16 | 0x10d)
+#define S2SS_WIFIPI_FW_RX_ERRORS     (S2WireType_Ethernet << 16 | 0x10e)
+#define S2SS_WIFIPI_FW_RX_DROPS      (S2WireType_Ethernet << 16 | 0x10f)
+#define S2SS_WIFIPI_FW_RX_OVERFLOWS  (S2WireType_Ethernet << 16 | 0x120)
+#define S2SS_WIFIPI_CTRL_RTT         (S2WireType_Ethernet << 16 | 0x110)    /* 4 buckets */
+#define S2SS_WIFIPI_RX_LATENCY       (S2WireType_Ethernet << 16 | 0x118)    /* 4 buckets */
+#define S2SS_WIFIPI_ROAM_SCANS       (S2WireType_Ethernet << 16 | 0x128)
+#define S2SS_WIFIPI_ROAM_ATTEMPTS    (S2WireType_Ethernet << 16 | 0x129)
+#define S2SS_WIFIPI_ROAM_SUCCESSES   (S2WireType_Ethernet << 16 | 0x12a)
+
+/* NEW: WiFiPi bring-up phase durations in microseconds */
+
+#define S2SS_WIFIPI_BOOT_INIT        (S2WireType_Ethernet << 16 | 0x140)
+#define S2SS_WIFIPI_BOOT_DT          (S2WireType_Ethernet << 16 | 0x141)
+#define S2SS_WIFIPI_BOOT_SDIO        (S2WireType_Ethernet << 16 | 0x142)
+#define S2SS_WIFIPI_BOOT_EROM        (S2WireType_Ethernet << 16 | 0x143)
+#define S2SS_WIFIPI_BOOT_FIRMWARE    (S2WireType_Ethernet << 16 | 0x144)
+#define S2SS_WIFIPI_BOOT_CHIP        (S2WireType_Ethernet << 16 | 0x145)
+#define S2SS_WIFIPI_BOOT_TASKS       (S2WireType_Ethernet << 16 | 0x146)
+#define S2SS_WIFIPI_BOOT_CLM         (S2WireType_Ethernet << 16 | 0x147)
+#define S2SS_WIFIPI_BOOT_CONFIG      (S2WireType_Ethernet << 16 | 0x148)
+
+/* NEW: WiFiPi memory usage in bytes, stack high-water marks and memory pool use per subsystem */
+
+#define S2SS_WIFIPI_STACK_RECEIVER   (S2WireType_Ethernet << 16 | 0x150)
+#define S2SS_WIFIPI_STACK_UNIT       (S2WireType_Ethernet << 16 | 0x151)
+#define S2SS_WIFIPI_STACK_LOG        (S2WireType_Ethernet << 16 | 0x152)
+#define S2SS_WIFIPI_POOL_CTRL        (S2WireType_Ethernet << 16 | 0x158)
+#define S2SS_WIFIPI_POOL_SCAN        (S2WireType_Ethernet << 16 | 0x159)
+#define S2SS_WIFIPI_POOL_MULTICAST   (S2WireType_Ethernet << 16 | 0x15a)
+#define S2SS_WIFIPI_POOL_FIRMWARE    (S2WireType_Ethernet << 16 | 0x15b)
+#define S2SS_WIFIPI_POOL_CTRL_PEAK   (S2WireType_Ethernet << 16 | 0x15c)
+#define S2SS_WIFIPI_POOL_SCAN_PEAK   (S2WireType_Ethernet << 16 | 0x15d)
+#define S2SS_WIFIPI_POOL_MULTICAST_PEAK (S2WireType_Ethernet << 16 | 0x15e)
+#define S2SS_WIFIPI_POOL_FIRMWARE_PEAK  (S2WireType_Ethernet << 16 | 0x15f)
+
 #endif
\ No newline at end of file
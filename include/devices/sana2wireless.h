@@ -37,6 +37,29 @@
 /* NEW: Report changes of operational state */
 #define S2INFO_OperState      (TAG_USER + 20)
 
+/* NEW: S2_GETNETWORKS may answer from networks seen within given number of seconds */
+#define S2INFO_MaxAge         (TAG_USER + 21)
+
+/*
+    NEW: S2_GETNETWORKS is replied as soon as new networks are found. ti_Data points to a ULONG which is set
+    to TRUE once the reply completes the scan. Until then the request shall be sent again to collect
+    networks found in the meantime.
+*/
+#define S2INFO_Incremental    (TAG_USER + 22)
+
+/*
+    NEW: S2_GETNETWORKS returns only the selected IEs in S2INFO_InfoElements instead of all of them.
+    ti_Data is a mask of S2IEF_* flags.
+*/
+#define S2INFO_IEFilter       (TAG_USER + 23)
+
+#define S2IEF_RSN       (1 << 0)
+#define S2IEF_WPA       (1 << 1)
+#define S2IEF_HT        (1 << 2)
+#define S2IEF_VHT       (1 << 3)
+#define S2IEF_WMM       (1 << 4)
+#define S2IEF_COUNTRY   (1 << 5)
+
 /* Wireless Commands */
 
 #define S2_GETSIGNALQUALITY 0xc010
@@ -270,6 +270,44 @@ void EncodeChanSpec(struct ChannelInfo *ci, UBYTE ioType)
     }
 }
 
+/* Any value the decoders never produce, marks fields left untouched */
+#define CD_UNSET    0x55
+
+/*
+    Build decode table (256 entries) of given D11 type by running the decoder once over every possible upper byte
+    of chanspec. The channel is picked so that no offset wraps
+*/
+void BuildChanSpecTable(struct ChanSpecDecode *table, UBYTE ioType)
+{
+    void (*decode)(struct ChannelInfo *ch) = ioType == BRCMU_D11N_IOTYPE ? brcmu_d11n_decchspec : brcmu_d11ac_decchspec;
+
+    for (int i=0; i < 256; i++)
+    {
+        struct ChannelInfo ch;
+        struct ChanSpecDecode *cd = &table[i];
+
+        ch.ci_CHSpec = (i << 8) | 128;
+        ch.ci_Band = CD_UNSET;
+        ch.ci_Bandwidth = CD_UNSET;
+        ch.ci_Sideband = CD_UNSET;
+
+        decode(&ch);
+
+        cd->cd_Offset = (BYTE)(ch.ci_ControlChannel - ch.ci_CHNum);
+        cd->cd_Valid = 0;
+        cd->cd_Band = ch.ci_Band;
+        cd->cd_Bandwidth = ch.ci_Bandwidth;
+        cd->cd_Sideband = ch.ci_Sideband;
+
+        if (ch.ci_Band != CD_UNSET)
+            cd->cd_Valid |= CD_BAND;
+        if ((int)ch.ci_Bandwidth != CD_UNSET)
+            cd->cd_Valid |= CD_BANDWIDTH;
+        if ((int)ch.ci_Sideband != CD_UNSET)
+            cd->cd_Valid |= CD_SIDEBAND;
+    }
+}
+
 void DecodeChanSpec(struct ChannelInfo *ci, UBYTE ioType)
 {
     if (ioType == BRCMU_D11N_IOTYPE) {
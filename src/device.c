@@ -29,7 +29,7 @@
 extern const char deviceEnd;
 extern const char deviceName[];
 extern const char deviceIdString[];
-extern const uint32_t InitTable[];
+extern const APTR InitTable[];
 
 const struct Resident RomTag __attribute__((used)) = {
     RTC_MATCHWORD,
@@ -67,8 +67,8 @@ static BPTR WiFi_Expunge(REGARG(struct WiFiBase * WiFiBase, "a6"))
 
     D(bug("[WiFi] WiFi_Expunge()\n"));
 
-    /* If device's open count is 0, remove it from list and free memory */
-    if (WiFiBase->w_Device.dd_Library.lib_OpenCnt == 0)
+    /* If device's open count is 0 and bring-up is not in progress, remove it from list and free memory */
+    if (WiFiBase->w_Device.dd_Library.lib_OpenCnt == 0 && AttemptSemaphore(&WiFiBase->w_InitLock))
     {
         struct MsgPort *port = CreateMsgPort();
         struct timerequest *tr = CreateIORequest(port, sizeof(struct timerequest));
@@ -81,29 +81,61 @@ static BPTR WiFi_Expunge(REGARG(struct WiFiBase * WiFiBase, "a6"))
             OpenDevice((CONST_STRPTR)"timer.device", UNIT_VBLANK, (struct IORequest *)tr, 0);
         }
 
-        /* Stop tasks */
-        D(bug("[WiFi] Killing receiver task\n"));
-        Signal(WiFiBase->w_SDIO->s_ReceiverTask, SIGBREAKF_CTRL_C);
-        D(bug("[WiFi] Killing unit task\n"));
-        Signal(WiFiBase->w_Unit->wu_Task, SIGBREAKF_CTRL_C);
+        /*
+            Stop tasks. They exist only if the bring-up was successful. Unit task goes first, it may be waiting
+            for a reply to a control message which only the receiver can deliver
+        */
+        if (WiFiBase->w_Unit != NULL)
+        {
+            D(bug("[WiFi] Killing unit task\n"));
+            Signal(WiFiBase->w_Unit->wu_Task, SIGBREAKF_CTRL_C);
+
+            while (WiFiBase->w_Unit->wu_Task != 0)
+            {
+                if (tr) {
+                    tr->tr_time.tv_micro = 250000;
+                    tr->tr_time.tv_secs = 0;
+                    tr->tr_node.io_Command = TR_ADDREQUEST;
+                    DoIO(&tr->tr_node);
+                }
+                D(bug("[WiFi] Unit: %08lx\n", (ULONG)WiFiBase->w_Unit->wu_Task));
+            }
+
+            D(bug("[WiFi] Killing receiver task\n"));
+            Signal(WiFiBase->w_SDIO->s_ReceiverTask, SIGBREAKF_CTRL_C);
+
+            while (WiFiBase->w_SDIO->s_ReceiverTask != 0)
+            {
+                if (tr) {
+                    tr->tr_time.tv_micro = 250000;
+                    tr->tr_time.tv_secs = 0;
+                    tr->tr_node.io_Command = TR_ADDREQUEST;
+                    DoIO(&tr->tr_node);
+                }
+                D(bug("[WiFi] Receiver: %08lx\n", (ULONG)WiFiBase->w_SDIO->s_ReceiverTask));
+            }
+        }
+
+        D(bug("[WiFi] Both tasks finished\n"));
+
+        /* Log task goes last, it prints whatever the other tasks left in the ring */
+        if (WiFiBase->w_Log != NULL && WiFiBase->w_Log->l_Task != NULL)
+        {
+            Signal(WiFiBase->w_Log->l_Task, SIGBREAKF_CTRL_C);
 
-        /* Wait for unit and receiver tasks to finish */
-        do {
-            if (tr) {
-                tr->tr_time.tv_micro = 250000;
+            while (WiFiBase->w_Log->l_Task != NULL && tr != NULL)
+            {
+                tr->tr_time.tv_micro = 50000;
                 tr->tr_time.tv_secs = 0;
                 tr->tr_node.io_Command = TR_ADDREQUEST;
                 DoIO(&tr->tr_node);
             }
-            D(bug("[WiFi] Receiver: %08lx, Unit: %08lx\n", (ULONG)WiFiBase->w_SDIO->s_ReceiverTask, (ULONG)WiFiBase->w_Unit->wu_Task));
-        } while(WiFiBase->w_SDIO->s_ReceiverTask != 0 || WiFiBase->w_Unit->wu_Task != 0);
+        }
 
         CloseDevice(&tr->tr_node);
         DeleteIORequest(tr);
         DeleteMsgPort(port);
 
-        D(bug("[WiFi] Both tasks finished\n"));
-
         if (WiFiBase->w_UtilityBase != NULL)
         {
             CloseLibrary(WiFiBase->w_UtilityBase);
@@ -152,6 +184,27 @@ void WiFi_Open(REGARG(struct IOSana2Req * io, "a1"), REGARG(LONG unitNumber, "d0
     {
         error = IOERR_OPENFAIL;
     }
+
+    /*
+        Hardware may still be brought up in the background. Wait for it now. Open count is raised while
+        waiting, otherwise Expunge could free the device as soon as the bring-up releases w_InitLock
+    */
+    if (error == 0)
+    {
+        BOOL ready;
+
+        WiFiBase->w_Device.dd_Library.lib_OpenCnt++;
+        ready = WaitForInit(WiFiBase);
+        WiFiBase->w_Device.dd_Library.lib_OpenCnt--;
+
+        if (!ready)
+        {
+            D(bug("[WiFi] WiFi hardware not available\n"));
+            io->ios2_Req.io_Error = IOERR_OPENFAIL;
+            return;
+        }
+    }
+    unit = WiFiBase->w_Unit;
     
     if (io->ios2_Req.io_Message.mn_Length < sizeof(struct IOSana2Req))
     {
@@ -339,19 +392,19 @@ LONG WiFi_AbortIO(REGARG(struct IOSana2Req *io, "a1"))
     return 0;
 }
 
-static const uint32_t wifipi_functions[] = {
-    (uint32_t)WiFi_Open,
-    (uint32_t)WiFi_Close,
-    (uint32_t)WiFi_Expunge,
-    (uint32_t)WiFi_ExtFunc,
-    (uint32_t)WiFi_BeginIO,
-    (uint32_t)WiFi_AbortIO,
-    -1
+static const APTR wifipi_functions[] = {
+    (APTR)WiFi_Open,
+    (APTR)WiFi_Close,
+    (APTR)WiFi_Expunge,
+    (APTR)WiFi_ExtFunc,
+    (APTR)WiFi_BeginIO,
+    (APTR)WiFi_AbortIO,
+    (APTR)-1
 };
 
-const uint32_t InitTable[4] = {
-    sizeof(struct WiFiBase), 
-    (uint32_t)wifipi_functions, 
-    0, 
-    (uint32_t)WiFi_Init
+const APTR InitTable[4] = {
+    (APTR)sizeof(struct WiFiBase), 
+    (APTR)wifipi_functions, 
+    NULL, 
+    (APTR)WiFi_Init
 };
@@ -1,6 +1,7 @@
 #include <exec/devices.h>
 #include <exec/execbase.h>
 #include <dos/dos.h>
+#include <dos/dostags.h>
 #include <common/compiler.h>
 
 #if defined(__INTELLISENSE__)
@@ -19,6 +20,8 @@
 #include "mbox.h"
 #include "brcm.h"
 #include "packet.h"
+#include "lz4.h"
+#include "nvram.h"
 
 #define D(x) x
 
@@ -148,7 +151,7 @@ int _strncmp(CONST_STRPTR s1, CONST_STRPTR s2, ULONG n)
 
 APTR AllocVecPooled(APTR pool, ULONG byteSize)
 {
-    struct ExecBase *SysBase = *(struct ExecBase **)4UL;
+    struct ExecBase *SysBase = GetAbsExecBase();
     ULONG *buffer = AllocPooled(pool, byteSize + 8);
 
     /* Do not continue on failure! */
@@ -161,7 +164,7 @@ APTR AllocVecPooled(APTR pool, ULONG byteSize)
 
 APTR AllocVecPooledClear(APTR pool, ULONG byteSize)
 {
-    struct ExecBase *SysBase = *(struct ExecBase **)4UL;
+    struct ExecBase *SysBase = GetAbsExecBase();
     ULONG *buffer = AllocPooled(pool, byteSize + 8);
     
     /* Do not continue on failure! */
@@ -178,7 +181,7 @@ APTR AllocVecPooledClear(APTR pool, ULONG byteSize)
 
 APTR AllocPooledClear(APTR pool, ULONG byteSize)
 {
-    struct ExecBase *SysBase = *(struct ExecBase **)4UL;
+    struct ExecBase *SysBase = GetAbsExecBase();
     ULONG *buffer = AllocPooled(pool, byteSize);
 
     /* Do not continue on failure! */
@@ -194,7 +197,7 @@ APTR AllocPooledClear(APTR pool, ULONG byteSize)
 
 void FreeVecPooled(APTR pool, APTR buf)
 {
-    struct ExecBase *SysBase = *(struct ExecBase **)4UL;
+    struct ExecBase *SysBase = GetAbsExecBase();
     
     if (!buf) return;
 
@@ -203,13 +206,408 @@ void FreeVecPooled(APTR pool, APTR buf)
     FreePooled(pool, buffer, length);
 }
 
+/* Bytes taken from the pool by AllocVecPooled, including the size header */
+ULONG VecPooledSize(APTR buf)
+{
+    if (!buf) return 0;
+
+    return *(ULONG *)((ULONG)buf - 8);
+}
+
+/* Account allocation (positive delta) or release (negative delta) of pool memory for given subsystem */
+void PoolUsed(struct WiFiBase *WiFiBase, ULONG user, LONG delta)
+{
+    struct ExecBase *SysBase = WiFiBase->w_SysBase;
+    struct PoolUsage *usage = &WiFiBase->w_PoolUsage[user];
+
+    Disable();
+    usage->pu_Current += delta;
+    if (usage->pu_Current > usage->pu_Peak)
+        usage->pu_Peak = usage->pu_Current;
+    Enable();
+}
+
+void FillStack(ULONG *stack, ULONG count)
+{
+    while (count--)
+        *stack++ = STACK_PATTERN;
+}
+
+/* High-water mark of a stack filled with FillStack. Task must not go away while its stack is checked */
+ULONG StackUsed(struct Task *task)
+{
+    ULONG *ptr = (ULONG *)task->tc_SPLower;
+    ULONG *top = (ULONG *)task->tc_SPUpper;
+
+    while (ptr < top && *ptr == STACK_PATTERN)
+        ptr++;
+
+    return (ULONG)top - (ULONG)ptr;
+}
+
+/* Size of chunks used to stream firmware from disk to the chip RAM */
+#define FIRMWARE_CHUNK_SIZE 16384
+
+/* Open firmware file (with optional suffix) from DEVS:Firmware and get its size. Returns 0 on failure */
+static BPTR OpenFirmwareFile(struct WiFiBase *WiFiBase, STRPTR path, CONST_STRPTR name, CONST_STRPTR suffix, LONG *size)
+{
+    struct ExecBase *SysBase = WiFiBase->w_SysBase;
+    struct Library *DOSBase = WiFiBase->w_DosBase;
+    BPTR file;
+
+    /* Reset path */
+    AddPart(path, (CONST_STRPTR)"DEVS:Firmware", 255);
+    /* Add file name to the path */
+    AddPart(path, name, 255);
+
+    if (suffix != NULL)
+    {
+        ULONG len = _strlen(path);
+        _strncpy(&path[len], suffix, 255 - len);
+    }
+
+    file = Open(path, MODE_OLDFILE);
+    if (file != 0)
+    {
+        Seek(file, 0, OFFSET_END);
+        *size = Seek(file, 0, OFFSET_BEGINING);
+
+        D(bug("[WiFi] Firmware %s file size: %ld bytes\n", (ULONG)FilePart(path), *size));
+    }
+
+    return file;
+}
+
+/* Buffers for firmware, NVRAM and CLM images, accounted as POOL_FIRMWARE */
+static APTR AllocFirmwareBuffer(struct WiFiBase *WiFiBase, ULONG size)
+{
+    APTR buffer = AllocVecPooled(WiFiBase->w_MemPool, size);
+
+    PoolUsed(WiFiBase, POOL_FIRMWARE, VecPooledSize(buffer));
+
+    return buffer;
+}
+
+static void FreeFirmwareBuffer(struct WiFiBase *WiFiBase, APTR buffer)
+{
+    PoolUsed(WiFiBase, POOL_FIRMWARE, -VecPooledSize(buffer));
+    FreeVecPooled(WiFiBase->w_MemPool, buffer);
+}
+
+struct FirmwareStream {
+    struct Chip *   fs_Chip;
+    BPTR            fs_File;
+};
+
+static LONG FirmwareStreamRead(APTR userData, UBYTE *buffer, ULONG length)
+{
+    struct FirmwareStream *fs = userData;
+    struct Library *DOSBase = fs->fs_Chip->c_WiFiBase->w_DosBase;
+
+    return Read(fs->fs_File, buffer, length);
+}
+
+static BOOL FirmwareStreamWrite(APTR userData, ULONG offset, UBYTE *buffer, ULONG length)
+{
+    struct FirmwareStream *fs = userData;
+    struct Chip *chip = fs->fs_Chip;
+    struct SDIO *sdio = chip->c_SDIO;
+    ULONG room = chip->c_RAMSize - chip->c_ConfigSize;
+
+    /* Decompressed image has to stay below the NVRAM area */
+    if (offset > room || length > room - offset)
+    {
+        return FALSE;
+    }
+
+    if (offset == 0)
+    {
+        chip->c_ResetVector = LE32(*(ULONG *)buffer);
+    }
+
+    return sdio->BackplaneWrite(chip->c_RAMBase + offset, buffer, length, sdio);
+}
+
+/*
+    Decompress LZ4 framed firmware on the fly. Decompressed data goes through the 64 KB window
+    of decoder and is written to the chip RAM in chunks
+*/
+static BOOL StreamCompressedFirmware(struct Chip *chip, BPTR file)
+{
+    struct WiFiBase *WiFiBase = chip->c_WiFiBase;
+    struct ExecBase *SysBase = WiFiBase->w_SysBase;
+    struct Library *DOSBase = WiFiBase->w_DosBase;
+    struct FirmwareStream fs;
+    struct LZ4Stream ls;
+    BOOL success = FALSE;
+
+    _bzero(&ls, sizeof(ls));
+
+    fs.fs_Chip = chip;
+    fs.fs_File = file;
+
+    ls.ls_UserData = &fs;
+    ls.ls_Read = FirmwareStreamRead;
+    ls.ls_Write = FirmwareStreamWrite;
+    ls.ls_InSize = FIRMWARE_CHUNK_SIZE;
+    ls.ls_InBuffer = AllocFirmwareBuffer(WiFiBase, FIRMWARE_CHUNK_SIZE);
+    ls.ls_Window = AllocFirmwareBuffer(WiFiBase, LZ4_WINDOW_SIZE);
+
+    if (ls.ls_InBuffer != NULL && ls.ls_Window != NULL)
+    {
+        D(bug("[WiFi] Uploading compressed firmware to %08lx...\n", chip->c_RAMBase));
+
+        success = LZ4_Decompress(&ls);
+
+        if (success)
+        {
+            chip->c_FirmwareSize = ls.ls_OutPos;
+            D(bug("[WiFi] wrote %ld bytes\n", ls.ls_OutPos));
+        }
+        else
+        {
+            D(bug("[WiFi] Firmware decompression failed at output offset %ld\n", ls.ls_OutPos));
+        }
+    }
+    else
+    {
+        D(bug("[WiFi] Error allocating memory\n"));
+    }
+
+    FreeFirmwareBuffer(WiFiBase, ls.ls_InBuffer);
+    FreeFirmwareBuffer(WiFiBase, ls.ls_Window);
+    Close(file);
+
+    return success;
+}
+
+/*
+    Stream .bin file in chunks directly to the chip RAM. Only the reset vector (first word
+    of the image) is kept, the firmware itself never stays in memory. If a <name>.lz4 file
+    exists, it is used instead of the raw image
+*/
+static BOOL StreamFirmware(struct Chip *chip, STRPTR path, CONST_STRPTR name)
+{
+    struct WiFiBase *WiFiBase = chip->c_WiFiBase;
+    struct ExecBase *SysBase = WiFiBase->w_SysBase;
+    struct Library *DOSBase = WiFiBase->w_DosBase;
+    struct SDIO *sdio = chip->c_SDIO;
+    UBYTE *buffer;
+    BPTR file;
+    LONG size;
+    LONG pos;
+
+    /* Prefer compressed image if there is one */
+    file = OpenFirmwareFile(WiFiBase, path, name, (CONST_STRPTR)".lz4", &size);
+    if (file != 0)
+    {
+        return StreamCompressedFirmware(chip, file);
+    }
+
+    file = OpenFirmwareFile(WiFiBase, path, name, NULL, &size);
+    if (file == 0)
+    {
+        D(bug("[WiFi] Error opening firmware BIN file\n"));
+        return FALSE;
+    }
+
+    /* Firmware has to fit below the NVRAM area at the end of chip RAM */
+    if ((ULONG)size > chip->c_RAMSize - chip->c_ConfigSize)
+    {
+        Close(file);
+        D(bug("[WiFi] Firmware of %ld bytes does not fit in %ld bytes of RAM\n", size, chip->c_RAMSize - chip->c_ConfigSize));
+        return FALSE;
+    }
+
+    buffer = AllocFirmwareBuffer(WiFiBase, FIRMWARE_CHUNK_SIZE);
+    if (buffer == NULL)
+    {
+        Close(file);
+        D(bug("[WiFi] Error allocating memory\n"));
+        return FALSE;
+    }
+
+    D(bug("[WiFi] Uploading firmware to %08lx...\n", chip->c_RAMBase));
+
+    for (pos = 0; pos < size; )
+    {
+        LONG len = size - pos;
+
+        if (len > FIRMWARE_CHUNK_SIZE)
+            len = FIRMWARE_CHUNK_SIZE;
+
+        if (Read(file, buffer, len) != len)
+        {
+            D(bug("[WiFi] Something went wrong when reading WiFi firmware\n"));
+            Close(file);
+            FreeFirmwareBuffer(WiFiBase, buffer);
+            return FALSE;
+        }
+
+        if (pos == 0)
+        {
+            chip->c_ResetVector = LE32(*(ULONG *)buffer);
+        }
+
+        if (!sdio->BackplaneWrite(chip->c_RAMBase + pos, buffer, len, sdio))
+        {
+            D(bug("[WiFi] Firmware write error!\n"));
+            Close(file);
+            FreeFirmwareBuffer(WiFiBase, buffer);
+            return FALSE;
+        }
+
+        pos += len;
+    }
+
+    Close(file);
+    FreeFirmwareBuffer(WiFiBase, buffer);
+
+    chip->c_FirmwareSize = size;
+    D(bug("[WiFi] wrote %ld bytes\n", size));
+
+    return TRUE;
+}
+
+/* Load CLM blob. It stays in memory only until it is sent to the firmware by PacketUploadCLM */
+static BOOL LoadCLM(struct Chip *chip, STRPTR path, CONST_STRPTR name)
+{
+    struct WiFiBase *WiFiBase = chip->c_WiFiBase;
+    struct ExecBase *SysBase = WiFiBase->w_SysBase;
+    struct Library *DOSBase = WiFiBase->w_DosBase;
+    UBYTE *buffer;
+    BPTR file;
+    LONG size;
+
+    file = OpenFirmwareFile(WiFiBase, path, name, NULL, &size);
+    if (file == 0)
+    {
+        D(bug("[WiFi] Error opening firmware CLM file\n"));
+        return FALSE;
+    }
+
+    buffer = AllocFirmwareBuffer(WiFiBase, size);
+    if (buffer == NULL)
+    {
+        Close(file);
+        D(bug("[WiFi] Error allocating memory\n"));
+        return FALSE;
+    }
+
+    if (Read(file, buffer, size) != size)
+    {
+        D(bug("[WiFi] Something went wrong when reading WiFi firmware\n"));
+        Close(file);
+        FreeFirmwareBuffer(WiFiBase, buffer);
+        return FALSE;
+    }
+    Close(file);
+
+    chip->c_CLMBase = buffer;
+    chip->c_CLMSize = size;
+
+    return TRUE;
+}
+
+/*
+    Load NVRAM file and bring it to the packed form uploaded to the end of chip RAM. The file can be either in
+    text form, which is compiled here, or already packed, in which case it is used as is. Packed size goes to
+    c_ConfigSize, so that the firmware can be checked against the space left below it
+*/
+static APTR LoadNVRAM(struct Chip *chip, STRPTR path, CONST_STRPTR name)
+{
+    struct WiFiBase *WiFiBase = chip->c_WiFiBase;
+    struct ExecBase *SysBase = WiFiBase->w_SysBase;
+    struct Library *DOSBase = WiFiBase->w_DosBase;
+    UBYTE *buffer;
+    BPTR file;
+    LONG size;
+    ULONG nvramSize;
+
+    file = OpenFirmwareFile(WiFiBase, path, name, NULL, &size);
+    if (file == 0)
+    {
+        D(bug("[WiFi] Error opening firmware TXT file\n"));
+        return NULL;
+    }
+
+    buffer = AllocFirmwareBuffer(WiFiBase, NVRAM_MAX_PACKED(size));
+    if (buffer == NULL)
+    {
+        Close(file);
+        D(bug("[WiFi] Error allocating memory\n"));
+        return NULL;
+    }
+
+    if (Read(file, buffer, size) != size)
+    {
+        D(bug("[WiFi] Something went wrong when reading WiFi firmware\n"));
+        Close(file);
+        FreeFirmwareBuffer(WiFiBase, buffer);
+        return NULL;
+    }
+    Close(file);
+
+    if (NVRAM_IsPacked(buffer, size))
+    {
+        D(bug("[WiFi] NVRAM is already packed\n"));
+        nvramSize = size;
+    }
+    else
+    {
+        /* Compile NVRAM in place, packed form is never larger than NVRAM_MAX_PACKED */
+        nvramSize = NVRAM_Compile(buffer, size, buffer, NVRAM_MAX_PACKED(size));
+        if (nvramSize == 0)
+        {
+            D(bug("[WiFi] Failed to parse NVRAM\n"));
+            FreeFirmwareBuffer(WiFiBase, buffer);
+            return NULL;
+        }
+    }
+
+    if (nvramSize > chip->c_RAMSize)
+    {
+        D(bug("[WiFi] NVRAM of %ld bytes does not fit in chip RAM\n", nvramSize));
+        FreeFirmwareBuffer(WiFiBase, buffer);
+        return NULL;
+    }
+
+    chip->c_ConfigSize = nvramSize;
+
+    return buffer;
+}
+
+/* Upload NVRAM prepared by LoadNVRAM to the end of chip RAM */
+static BOOL UploadNVRAM(struct Chip *chip, APTR nvram)
+{
+    struct ExecBase *SysBase = chip->c_WiFiBase->w_SysBase;
+    struct SDIO *sdio = chip->c_SDIO;
+    ULONG ram_base = chip->c_RAMBase + chip->c_RAMSize - chip->c_ConfigSize;
+
+    D(bug("[WiFi] Uploading NVRAM to %08lx...\n", ram_base));
+
+    if (!sdio->BackplaneWrite(ram_base, nvram, chip->c_ConfigSize, sdio))
+    {
+        D(bug("[WiFi] NVRAM write error!\n"));
+        return FALSE;
+    }
+
+    D(bug("[WiFi] wrote %ld bytes\n", chip->c_ConfigSize));
+
+    return TRUE;
+}
+
+/*
+    Find firmware files matching the chip and load them. The firmware and NVRAM are written
+    directly to the chip RAM, therefore the backplane clock has to be available already.
+*/
 BOOL LoadFirmware(struct Chip *chip)
 {
     struct WiFiBase *WiFiBase = chip->c_WiFiBase;
     struct ExecBase *SysBase = WiFiBase->w_SysBase;
     APTR DeviceTreeBase = WiFiBase->w_DeviceTreeBase;
     struct Library *DOSBase = WiFiBase->w_DosBase;
-
+    BOOL success = FALSE;
 
     BPTR file = Open((CONST_STRPTR)"RAM:T/wifipi.txt", MODE_NEWFILE);
     UBYTE buf[4];
@@ -236,6 +634,7 @@ BOOL LoadFirmware(struct Chip *chip)
 
     /* Firmware name shall never exceed total size of 256 bytes */
     STRPTR path = AllocVecPooled(WiFiBase->w_MemPool, 256);
+    APTR nvram = NULL;
     
     D(bug("[WiFi] Trying to match firmware files for chip ID %04lx rev %lx\n", chip->c_ChipID, chip->c_ChipREV));
 
@@ -270,209 +669,32 @@ BOOL LoadFirmware(struct Chip *chip)
             {
                 if (fw->chipID == chip->c_ChipID && (fw->chipREVMask & (1 << chip->c_ChipREV)) != 0)
                 {
-                    /* We have match. Begin with .bin file as this is the largest one */
-                    BPTR file; 
-                    LONG size;
-                    UBYTE *buffer;
-                    ULONG allocSize;
-                    ULONG dst_pos, src_pos;
-
                     D(bug("[WiFi] ChipID match\n"));
 
-                    /* Reset path */
-                    AddPart(path, (CONST_STRPTR)"DEVS:Firmware", 255);
-                    /* Add bin file to the path */
-                    AddPart(path, fw->binFile, 255);
+                    /* NVRAM goes first, its size limits the space left for the firmware */
+                    nvram = LoadNVRAM(chip, path, fw->txtFile);
 
-                    file = Open(path, MODE_OLDFILE);
-                    if (file == 0)
-                    {
-                        D(bug("[WiFi] Error opening firmware BIN file\n"));
-                        return FALSE;
-                    }
-                    Seek(file, 0, OFFSET_END);
-                    size = Seek(file, 0, OFFSET_BEGINING);
-
-                    D(bug("[WiFi] Firmware %s file size: %ld bytes\n", (ULONG)fw->binFile, size));
-                    allocSize = size;
-                    buffer = AllocVecPooled(WiFiBase->w_MemPool, allocSize);
-                    if (buffer == NULL)
-                    {
-                        Close(file);
-                        D(bug("[WiFi] Error allocating memory\n"));
-                        return FALSE;
-                    }
-                    if (Read(file, buffer, size) != size)
-                    {
-                        D(bug("[WiFi] Something went wrong when reading WiFi firmware\n"));
-                        Close(file);
-                        FreeVecPooled(WiFiBase->w_MemPool, buffer);
-                        return FALSE;
-                    }
-                    Close(file);
-
-                    /* Upload firmware to the WiFi module */
-
-                    chip->c_FirmwareBase = AllocPooled(WiFiBase->w_MemPool, size);
-                    CopyMem(buffer, chip->c_FirmwareBase, size);
-                    chip->c_FirmwareSize = size;
+                    /* Stream .bin file below the NVRAM area */
+                    if (nvram != NULL)
+                        success = StreamFirmware(chip, path, fw->binFile);
 
                     /* If clm_blob file exists, load it */
-                    if (fw->clmFile != NULL)
-                    {
-                        /* Reset path */
-                        AddPart(path, (CONST_STRPTR)"DEVS:Firmware", 255);
-                        /* Add bin file to the path */
-                        AddPart(path, fw->clmFile, 255);
-
-                        file = Open(path, MODE_OLDFILE);
-                        if (file == 0)
-                        {
-                            D(bug("[WiFi] Error opening firmware CLM file\n"));
-                            return FALSE;
-                        }
-                        Seek(file, 0, OFFSET_END);
-                        size = Seek(file, 0, OFFSET_BEGINING);
-
-                        D(bug("[WiFi] Firmware %s file size: %ld bytes\n", (ULONG)fw->clmFile, size));
-                        if ((ULONG)size > allocSize)
-                        {
-                            FreeVecPooled(WiFiBase->w_MemPool, buffer);
-                            allocSize = size;
-                            buffer = AllocVecPooled(WiFiBase->w_MemPool, size);
-                        }
-                        
-                        if (buffer == NULL)
-                        {
-                            Close(file);
-                            D(bug("[WiFi] Error allocating memory\n"));
-                            return FALSE;
-                        }
-                        if (Read(file, buffer, size) != size)
-                        {
-                            D(bug("[WiFi] Something went wrong when reading WiFi firmware\n"));
-                            Close(file);
-                            FreeVecPooled(WiFiBase->w_MemPool, buffer);
-                            return FALSE;
-                        }
-                        Close(file);
-
-                        /* Upload firmware to the WiFi module */
+                    if (success && fw->clmFile != NULL)
+                        success = LoadCLM(chip, path, fw->clmFile);
 
-                        chip->c_CLMBase = AllocPooled(WiFiBase->w_MemPool, size);
-                        CopyMem(buffer, chip->c_CLMBase, size);
-                        chip->c_CLMSize = size;
-                    }
-
-                    /* Load NVRAM file */
-                    /* Reset path */
-                    AddPart(path, (CONST_STRPTR)"DEVS:Firmware", 255);
-                    /* Add bin file to the path */
-                    AddPart(path, fw->txtFile, 255);
+                    /* Upload NVRAM */
+                    if (success)
+                        success = UploadNVRAM(chip, nvram);
 
-                    file = Open(path, MODE_OLDFILE);
-                    if (file == 0)
+                    /* CLM is kept only for a successful load */
+                    if (!success && chip->c_CLMBase != NULL)
                     {
-                        D(bug("[WiFi] Error opening firmware TXT file\n"));
-                        return FALSE;
+                        FreeFirmwareBuffer(WiFiBase, chip->c_CLMBase);
+                        chip->c_CLMBase = NULL;
+                        chip->c_CLMSize = 0;
                     }
-                    Seek(file, 0, OFFSET_END);
-                    size = Seek(file, 0, OFFSET_BEGINING);
 
-                    D(bug("[WiFi] Firmware %s file size: %ld bytes\n", (ULONG)fw->txtFile, size));
-                    if ((ULONG)size > allocSize)
-                    {
-                        FreeVecPooled(WiFiBase->w_MemPool, buffer);
-                        allocSize = size;
-                        buffer = AllocVecPooled(WiFiBase->w_MemPool, size);
-                    }
-                    
-                    if (buffer == NULL)
-                    {
-                        Close(file);
-                        D(bug("[WiFi] Error allocating memory\n"));
-                        return FALSE;
-                    }
-                    if (Read(file, buffer, size) != size)
-                    {
-                        D(bug("[WiFi] Something went wrong when reading WiFi firmware\n"));
-                        Close(file);
-                        FreeVecPooled(WiFiBase->w_MemPool, buffer);
-                        return FALSE;
-                    }
-                    Close(file);
-
-                    /* 
-                        Parse and reformat NVRAM file. It can be done in place since the resulting NVRAM
-                        will be shorter (by comments) or same size (if no commends or whitespace were used)
-                    */
-                    src_pos = dst_pos = 0;
-
-                    do
-                    {
-                        // Remove whitespace and newlines at beginning of the line
-                        while(src_pos < (ULONG)size && (buffer[src_pos] == ' ' || buffer[src_pos] == '\t' || buffer[src_pos] == '\n'))
-                        {
-                            src_pos++;
-                            continue;
-                        }
-                        
-                        // If line begins with '#' then it is a comment, remove until end of line
-                        if (buffer[src_pos] == '#')
-                        {
-                            while(buffer[src_pos] != 10 && src_pos < (ULONG)size) {
-                                src_pos++;
-                            }
-
-                            // Skip new line
-                            src_pos++;
-                            continue;
-                        }
-                        
-                        // Now there is a token, copy it until newline character
-                        while(src_pos < (ULONG)size && buffer[src_pos] != '\n')
-                            buffer[dst_pos++] = buffer[src_pos++];
-                        
-                        // Skip new line
-                        src_pos++;
-                        
-                        // Go back to remove trailing whitespace
-                        while(buffer[--dst_pos] == ' ');
-
-                        dst_pos++;
-
-                        // Apply 0 at the end of the entry
-                        buffer[dst_pos++] = 0;
-
-                    } while(src_pos < (ULONG)size);
-
-                    // put extra 0 at end of config
-                    buffer[dst_pos++] = 0x00;
-
-                    // Pad to 4 byte boundary
-                    while (dst_pos & 3) buffer[dst_pos++] = 0x00;
-
-                    // Get number of words and convert it to a checksum
-                    ULONG words = dst_pos / 4;
-                    words = (words & 0xFFFF) | (~words << 16);
-
-                    // Add checksum at end of NVRAM
-                    buffer[dst_pos++] = words & 0xff;
-                    buffer[dst_pos++] = (words >> 8) & 0xff;
-                    buffer[dst_pos++] = (words >> 16) & 0xff;
-                    buffer[dst_pos++] = (words >> 24) & 0xff;
-
-                    /* Upload NVRAM to WiFi module */
-                    
-                    chip->c_ConfigBase = AllocPooled(WiFiBase->w_MemPool, dst_pos);
-                    CopyMem(buffer, chip->c_ConfigBase, dst_pos);
-                    chip->c_ConfigSize = dst_pos;
-
-                    /* Get rid of temporary buffer */
-                    FreeVecPooled(WiFiBase->w_MemPool, buffer);
-                    FreeVecPooled(WiFiBase->w_MemPool, path);
-                    
-                    return TRUE;
+                    break;
                 }
                 else
                 {
@@ -482,9 +704,13 @@ BOOL LoadFirmware(struct Chip *chip)
         }
     }
 
+    /* NVRAM is not needed anymore */
+    if (nvram != NULL)
+        FreeFirmwareBuffer(WiFiBase, nvram);
+
     FreeVecPooled(WiFiBase->w_MemPool, path);
 
-    return FALSE;
+    return success;
 }
 #if 0
 void ParseConfig(struct WiFiBase *WiFiBase)
@@ -655,24 +881,17 @@ CONST_APTR GetPropValueRecursive(APTR key, CONST_STRPTR property, APTR DeviceTre
     return NULL;
 }
 
-struct WiFiBase * WiFi_Init(REGARG(struct WiFiBase *base, "d0"), REGARG(BPTR seglist, "a0"), 
-                            REGARG(struct ExecBase *SysBase, "a6"))
+/*
+    Hardware bring-up: device tree walk, GPIO and clock setup, SDIO and chip initialization,
+    firmware upload and start of receiver and unit tasks. If successful, w_Unit is set.
+*/
+static void WiFi_BringUp(struct WiFiBase *WiFiBase)
 {
+    struct ExecBase *SysBase = WiFiBase->w_SysBase;
     APTR DeviceTreeBase;
-    struct WiFiBase *WiFiBase = base;
+    ULONG phaseStart = WiFiBase->w_BootStart;
 
-    D(bug("[WiFi] WiFi_Init(%08lx, %08lx, %08lx)\n", (ULONG)base, seglist, (ULONG)SysBase));
-
-    /* Create mem pool for internal use */
-    WiFiBase->w_MemPool = CreatePool(MEMF_ANY, 16384, 4096);
-
-    WiFiBase->w_SegList = seglist;
-    WiFiBase->w_SysBase = SysBase;
-    WiFiBase->w_UtilityBase = OpenLibrary((CONST_STRPTR)"utility.library", 0);
-    WiFiBase->w_Device.dd_Library.lib_Revision = WIFIPI_REVISION;
-    
-    WiFiBase->w_RequestOrig = AllocPooled(WiFiBase->w_MemPool, 512);
-    WiFiBase->w_Request = (APTR)(((ULONG)WiFiBase->w_RequestOrig + 31) & ~31);
+    BOOT_PHASE(WiFiBase, BOOT_INIT, phaseStart);
 
     WiFiBase->w_DeviceTreeBase = DeviceTreeBase = OpenResource((CONST_STRPTR)"devicetree.resource");
 
@@ -900,18 +1119,34 @@ struct WiFiBase * WiFi_Init(REGARG(struct WiFiBase *base, "d0"), REGARG(BPTR seg
         }
         D(bug("\n"));
 
-        if (FindTask(NULL)->tc_Node.ln_Type == NT_PROCESS)
+        StartLogTask(WiFiBase);
+
+        /* Runtime log level may be overridden with ENV:WiFiPi/LogLevel, 0 (errors) to 3 (debug) */
+        if (WiFiBase->w_Log != NULL)
         {
-            WiFiBase->w_DosBase = OpenLibrary((CONST_STRPTR)"dos.library", 0);
+            struct Library *DOSBase = WiFiBase->w_DosBase;
+            TEXT level[4];
+
+            if (GetVar((CONST_STRPTR)"WiFiPi/LogLevel", level, sizeof(level), 0) > 0 && level[0] >= '0' && level[0] <= '3')
+                WiFiBase->w_Log->l_Level = level[0] - '0';
         }
-        else
-            D(bug("[WiFi] I'm a task\n"));
+
+        BOOT_PHASE(WiFiBase, BOOT_DT, phaseStart);
 
         struct SDIO * sdio = sdio_init(WiFiBase);
+
+        BOOT_PHASE(WiFiBase, BOOT_SDIO, phaseStart);
+
         if (sdio)
         {
             WiFiBase->w_SDIO = sdio;
-            if (chip_init(sdio))
+            int chipUp = chip_init(sdio);
+
+            /* EROM scan and firmware upload are timed by chip_init, the chip phase is what remains */
+            BOOT_PHASE(WiFiBase, BOOT_CHIP, phaseStart);
+            WiFiBase->w_BootTime[BOOT_CHIP] -= WiFiBase->w_BootTime[BOOT_EROM] + WiFiBase->w_BootTime[BOOT_FIRMWARE];
+
+            if (chipUp)
             {
                 struct WiFiUnit *unit; 
                 StartPacketReceiver(sdio);
@@ -925,10 +1160,139 @@ struct WiFiBase * WiFi_Init(REGARG(struct WiFiBase *base, "d0"), REGARG(BPTR seg
                 
                 StartUnitTask(unit);
                 WiFiBase->w_Unit = unit;
+
+                BOOT_PHASE(WiFiBase, BOOT_TASKS, phaseStart);
             }
         }
     }
 
+    D(bug("[WiFi] Bring-up done, unit at %08lx\n", (ULONG)WiFiBase->w_Unit));
+    D(bug("[WiFi] Boot phases (us): init %ld, dt %ld, sdio %ld, erom %ld, firmware %ld, chip %ld, tasks %ld\n",
+        WiFiBase->w_BootTime[BOOT_INIT], WiFiBase->w_BootTime[BOOT_DT], WiFiBase->w_BootTime[BOOT_SDIO],
+        WiFiBase->w_BootTime[BOOT_EROM], WiFiBase->w_BootTime[BOOT_FIRMWARE], WiFiBase->w_BootTime[BOOT_CHIP],
+        WiFiBase->w_BootTime[BOOT_TASKS]));
+}
+
+#define INIT_STACKSIZE  32768
+#define INIT_PRIORITY   0
+
+struct InitArgs {
+    struct WiFiBase *   ia_WiFiBase;
+    struct Task *       ia_Caller;
+};
+
+/*
+    Background process doing the hardware bring-up. It holds w_InitLock until the bring-up
+    is complete, so that anyone who needs the hardware can wait for it by obtaining the lock.
+*/
+static void WiFi_InitProcess(void)
+{
+    struct ExecBase *SysBase = GetAbsExecBase();
+    struct InitArgs *args = FindTask(NULL)->tc_UserData;
+    struct WiFiBase *WiFiBase = args->ia_WiFiBase;
+
+    ObtainSemaphore(&WiFiBase->w_InitLock);
+
+    /* Lock obtained, the caller may continue. Do not touch args anymore */
+    Signal(args->ia_Caller, SIGBREAKF_CTRL_F);
+
+    WiFi_BringUp(WiFiBase);
+
+    /*
+        Once the lock is released, Expunge may unload the segment this code lives in. Forbid keeps it away
+        until the process is gone, task removal breaks the Forbid
+    */
+    Forbid();
+    ReleaseSemaphore(&WiFiBase->w_InitLock);
+}
+
+/* Wait until the hardware bring-up is complete. Returns TRUE if the unit is available */
+BOOL WaitForInit(struct WiFiBase *WiFiBase)
+{
+    struct ExecBase *SysBase = WiFiBase->w_SysBase;
+
+    ObtainSemaphore(&WiFiBase->w_InitLock);
+    ReleaseSemaphore(&WiFiBase->w_InitLock);
+
+    return WiFiBase->w_Unit != NULL;
+}
+
+struct WiFiBase * WiFi_Init(REGARG(struct WiFiBase *base, "d0"), REGARG(BPTR seglist, "a0"), 
+                            REGARG(struct ExecBase *SysBase, "a6"))
+{
+    struct WiFiBase *WiFiBase = base;
+
+    D(bug("[WiFi] WiFi_Init(%08lx, %08lx, %08lx)\n", (ULONG)base, seglist, (ULONG)SysBase));
+
+    WiFiBase->w_BootStart = timer_us();
+
+    /* Create mem pool for internal use */
+    WiFiBase->w_MemPool = CreatePool(MEMF_ANY, 16384, 4096);
+
+    WiFiBase->w_SegList = seglist;
+    WiFiBase->w_SysBase = SysBase;
+    WiFiBase->w_UtilityBase = OpenLibrary((CONST_STRPTR)"utility.library", 0);
+    WiFiBase->w_Device.dd_Library.lib_Revision = WIFIPI_REVISION;
+    
+    WiFiBase->w_RequestOrig = AllocPooled(WiFiBase->w_MemPool, 512);
+    WiFiBase->w_Request = (APTR)(((ULONG)WiFiBase->w_RequestOrig + 31) & ~31);
+
+    InitSemaphore(&WiFiBase->w_InitLock);
+    InitSemaphore(&WiFiBase->w_NetworkListLock);
+    _NewList(&WiFiBase->w_NetworkList);
+
+    if (FindTask(NULL)->tc_Node.ln_Type == NT_PROCESS)
+    {
+        WiFiBase->w_DosBase = OpenLibrary((CONST_STRPTR)"dos.library", 0);
+    }
+    else
+        D(bug("[WiFi] I'm a task\n"));
+
+    /*
+        With dos.library available, do the bring-up in background process, so that the system
+        startup does not wait for the WiFi chip. WiFi_Open waits for it if necessary.
+        Otherwise, bring the hardware up now.
+    */
+    if (WiFiBase->w_DosBase != NULL)
+    {
+        struct Library *DOSBase = WiFiBase->w_DosBase;
+        struct InitArgs args;
+        struct Process *proc;
+
+        args.ia_WiFiBase = WiFiBase;
+        args.ia_Caller = FindTask(NULL);
+
+        SetSignal(0, SIGBREAKF_CTRL_F);
+
+        /* Forbid, so that the process does not run before tc_UserData is set */
+        Forbid();
+        proc = CreateNewProcTags(
+            NP_Entry, (ULONG)WiFi_InitProcess,
+            NP_Name, (ULONG)"WiFiPi bring-up",
+            NP_StackSize, INIT_STACKSIZE,
+            NP_Priority, INIT_PRIORITY,
+            TAG_DONE);
+        if (proc != NULL)
+        {
+            proc->pr_Task.tc_UserData = &args;
+        }
+        Permit();
+
+        if (proc != NULL)
+        {
+            D(bug("[WiFi] Bring-up process %08lx started\n", (ULONG)proc));
+            Wait(SIGBREAKF_CTRL_F);
+        }
+        else
+        {
+            WiFi_BringUp(WiFiBase);
+        }
+    }
+    else
+    {
+        WiFi_BringUp(WiFiBase);
+    }
+
     D(bug("[WiFi] WiFi_Init done\n"));
 
     return WiFiBase;
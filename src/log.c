@@ -0,0 +1,193 @@
+#include <exec/types.h>
+#include <exec/execbase.h>
+#include <exec/memory.h>
+#include <dos/dos.h>
+
+#if defined(__INTELLISENSE__)
+#include <clib/exec_protos.h>
+#else
+#include <proto/exec.h>
+#endif
+
+#include "wifipi.h"
+#include "log.h"
+
+#define D(x) x
+
+void LogPut(struct WiFiBase *WiFiBase, const char *format, const ULONG *args, ULONG count)
+{
+    struct ExecBase *SysBase = WiFiBase->w_SysBase;
+    struct Log *log = WiFiBase->w_Log;
+    struct LogRecord *rec;
+    BOOL wake;
+
+    if (count > LOG_MAX_ARGS)
+        count = LOG_MAX_ARGS;
+
+    Disable();
+
+    if (log->l_Head - log->l_Tail >= LOG_RING_SIZE)
+    {
+        log->l_Dropped++;
+        Enable();
+        return;
+    }
+
+    rec = &log->l_Ring[log->l_Head & (LOG_RING_SIZE - 1)];
+    rec->lr_Format = format;
+    for (ULONG i = 0; i < count; i++)
+        rec->lr_Args[i] = args[i];
+
+    // Log task drains until the ring is empty, it needs a signal only if there was nothing to do
+    wake = log->l_Head == log->l_Tail;
+    log->l_Head++;
+
+    Enable();
+
+    if (wake && log->l_Task)
+        Signal(log->l_Task, SIGBREAKF_CTRL_E);
+}
+
+void LogHexDump(struct WiFiBase *WiFiBase, const char *format, const UBYTE *data, ULONG length)
+{
+    for (ULONG pos = 0; pos < length; pos += 16)
+    {
+        ULONG args[5];
+        UBYTE *line = (UBYTE *)&args[1];
+
+        args[0] = pos;
+
+        // Last line is padded with zeros
+        for (int i = 0; i < 16; i++)
+            line[i] = (pos + i < length) ? data[pos + i] : 0;
+
+        LogPut(WiFiBase, format, args, 5);
+    }
+}
+
+void LogText(struct WiFiBase *WiFiBase, const char *text, ULONG length)
+{
+    while (length != 0)
+    {
+        ULONG args[LOG_MAX_ARGS];
+        char *chunk = (char *)args;
+        ULONG count = length < sizeof(args) ? length : sizeof(args);
+
+        for (ULONG i = 0; i < sizeof(args); i++)
+            chunk[i] = i < count ? text[i] : 0;
+
+        LogPut(WiFiBase, NULL, args, LOG_MAX_ARGS);
+
+        text += count;
+        length -= count;
+    }
+}
+
+static void LogTask(struct WiFiBase *WiFiBase)
+{
+    struct ExecBase *SysBase = WiFiBase->w_SysBase;
+    struct Log *log = WiFiBase->w_Log;
+    ULONG sigSet;
+
+    do {
+        sigSet = Wait(SIGBREAKF_CTRL_E | SIGBREAKF_CTRL_C);
+
+        while (log->l_Tail != log->l_Head)
+        {
+            struct LogRecord *rec = &log->l_Ring[log->l_Tail & (LOG_RING_SIZE - 1)];
+
+            if (rec->lr_Format != NULL)
+            {
+                RawDoFmt((CONST_STRPTR)rec->lr_Format, rec->lr_Args, (APTR)putch, NULL);
+            }
+            else
+            {
+                const UBYTE *text = (const UBYTE *)rec->lr_Args;
+
+                for (ULONG i = 0; i < sizeof(rec->lr_Args) && text[i] != 0; i++)
+                    putch(text[i], NULL);
+            }
+            log->l_Tail++;
+
+            if (log->l_Dropped)
+            {
+                ULONG dropped;
+
+                // Producers bump the counter with interrupts disabled, take and clear it the same way
+                Disable();
+                dropped = log->l_Dropped;
+                log->l_Dropped = 0;
+                Enable();
+
+                bug("[WiFi] %ld log records dropped\n", dropped);
+            }
+        }
+    } while ((sigSet & SIGBREAKF_CTRL_C) == 0);
+
+    D(bug("[WiFi] Log task used %ld of %ld bytes of stack\n", StackUsed(log->l_Task), LOG_STACK_SIZE * sizeof(ULONG)));
+    log->l_Task = NULL;
+}
+
+void StartLogTask(struct WiFiBase *WiFiBase)
+{
+    struct ExecBase *SysBase = WiFiBase->w_SysBase;
+    APTR entry = (APTR)LogTask;
+    struct Log *log;
+    struct Task *task;
+    struct MemList *ml;
+    ULONG *stack;
+    static const char task_name[] = "WiFiPi Log";
+
+    log = AllocPooledClear(WiFiBase->w_MemPool, sizeof(struct Log));
+    if (log == NULL)
+        return;
+
+    log->l_Level = LOG_DEFAULT_LEVEL;
+
+    task = AllocMem(sizeof(struct Task), MEMF_PUBLIC | MEMF_CLEAR);
+    ml = AllocMem(sizeof(struct MemList) + sizeof(struct MemEntry), MEMF_PUBLIC | MEMF_CLEAR);
+    stack = AllocMem(LOG_STACK_SIZE * sizeof(ULONG), MEMF_PUBLIC);
+
+    if (task == NULL || ml == NULL || stack == NULL)
+    {
+        D(bug("[WiFi] Failed to start log task\n"));
+        if (task) FreeMem(task, sizeof(struct Task));
+        if (ml) FreeMem(ml, sizeof(struct MemList) + sizeof(struct MemEntry));
+        if (stack) FreeMem(stack, LOG_STACK_SIZE * sizeof(ULONG));
+        FreePooled(WiFiBase->w_MemPool, log, sizeof(struct Log));
+        return;
+    }
+
+    // Prepare mem list, put task and its stack there
+    ml->ml_NumEntries = 2;
+    ml->ml_ME[0].me_Un.meu_Addr = task;
+    ml->ml_ME[0].me_Length = sizeof(struct Task);
+
+    ml->ml_ME[1].me_Un.meu_Addr = &stack[0];
+    ml->ml_ME[1].me_Length = LOG_STACK_SIZE * sizeof(ULONG);
+
+    // Fill stack with a pattern, used part of it can be found later with StackUsed
+    FillStack(stack, LOG_STACK_SIZE);
+
+    // Set up stack
+    task->tc_SPLower = &stack[0];
+    task->tc_SPUpper = &stack[LOG_STACK_SIZE];
+
+    // Push WiFiBase on the stack
+    stack = (ULONG *)task->tc_SPUpper;
+    *--stack = (ULONG)WiFiBase;
+    task->tc_SPReg = stack;
+
+    task->tc_Node.ln_Name = (char *)task_name;
+    task->tc_Node.ln_Type = NT_TASK;
+    task->tc_Node.ln_Pri = LOG_TASK_PRIORITY;
+
+    _NewList((struct MinList *)&task->tc_MemEntry);
+    AddHead(&task->tc_MemEntry, &ml->ml_Node);
+
+    // Records written before the task runs are drained on its first signal
+    log->l_Task = task;
+    WiFiBase->w_Log = log;
+
+    AddTask(task, entry, NULL);
+}
@@ -0,0 +1,62 @@
+#ifndef _LOG_H
+#define _LOG_H
+
+#include <exec/types.h>
+#include <exec/tasks.h>
+
+#define LOG_ERROR           0
+#define LOG_WARN            1
+#define LOG_INFO            2
+#define LOG_DEBUG           3
+
+/* Records above LOG_COMPILE_LEVEL are not compiled in, l_Level filters the rest at runtime */
+#define LOG_COMPILE_LEVEL   LOG_DEBUG
+#define LOG_DEFAULT_LEVEL   LOG_INFO
+
+#define LOG_RING_SIZE       256         // Records, has to be a power of two
+#define LOG_MAX_ARGS        6
+#define LOG_TASK_PRIORITY   -10
+#define LOG_STACK_SIZE      (8192 / sizeof(ULONG))
+
+/*
+    Log records keep the format pointer and raw arguments only, formatting is done later by the log task.
+    Format strings and string arguments have to stay valid until then, in practice they must be constants.
+    Records with NULL format carry up to sizeof(lr_Args) bytes of text in place of the arguments.
+*/
+struct LogRecord {
+    const char *        lr_Format;
+    ULONG               lr_Args[LOG_MAX_ARGS];
+};
+
+struct Log {
+    struct Task *       l_Task;
+    ULONG               l_Level;
+    volatile ULONG      l_Head;         // Advanced by writers with interrupts disabled
+    volatile ULONG      l_Tail;         // Advanced by log task only
+    ULONG               l_Dropped;      // Records lost because the ring was full
+    struct LogRecord    l_Ring[LOG_RING_SIZE];
+};
+
+struct WiFiBase;
+
+void LogPut(struct WiFiBase *WiFiBase, const char *format, const ULONG *args, ULONG count);
+void LogHexDump(struct WiFiBase *WiFiBase, const char *format, const UBYTE *data, ULONG length);
+void LogText(struct WiFiBase *WiFiBase, const char *text, ULONG length);
+void StartLogTask(struct WiFiBase *WiFiBase);
+
+#define LOG_ENABLED(base, level) \
+    ((level) <= LOG_COMPILE_LEVEL && (base)->w_Log != NULL && (level) <= (base)->w_Log->l_Level)
+
+#define LOG(base, level, format, ...) \
+    do { if (LOG_ENABLED(base, level)) { ULONG args[] = {0, __VA_ARGS__}; \
+    LogPut(base, format, &args[1], sizeof(args) / sizeof(ULONG) - 1); } } while(0)
+
+/* Format gets offset and four longwords of data, e.g. "[DATA.IN] %04lx: %08lx %08lx %08lx %08lx\n" */
+#define LOG_HEX(base, level, format, data, length) \
+    do { if (LOG_ENABLED(base, level)) LogHexDump(base, format, data, length); } while(0)
+
+/* Copies the text into the ring, for strings which do not live long enough to be passed as %s argument */
+#define LOG_TEXT(base, level, text, length) \
+    do { if (LOG_ENABLED(base, level)) LogText(base, text, length); } while(0)
+
+#endif /* _LOG_H */
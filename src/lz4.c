@@ -0,0 +1,300 @@
+#include <exec/types.h>
+
+#include "lz4.h"
+
+/* Frame descriptor flags */
+#define FLG_VERSION_MASK        0xc0
+#define FLG_VERSION             0x40
+#define FLG_BLOCK_CHECKSUM      0x10
+#define FLG_CONTENT_SIZE        0x08
+#define FLG_CONTENT_CHECKSUM    0x04
+#define FLG_DICT_ID             0x01
+
+#define BLOCK_UNCOMPRESSED      0x80000000
+
+#define PRIME32_1               0x9E3779B1U
+#define PRIME32_2               0x85EBCA77U
+#define PRIME32_3               0xC2B2AE3DU
+#define PRIME32_4               0x27D4EB2FU
+#define PRIME32_5               0x165667B1U
+
+static inline ULONG rotl32(ULONG x, int r)
+{
+    return (x << r) | (x >> (32 - r));
+}
+
+static inline ULONG read_le32(const UBYTE *p)
+{
+    return p[0] | ((ULONG)p[1] << 8) | ((ULONG)p[2] << 16) | ((ULONG)p[3] << 24);
+}
+
+static inline ULONG xxh32_round(ULONG acc, ULONG input)
+{
+    return rotl32(acc + input * PRIME32_2, 13) * PRIME32_1;
+}
+
+void XXH32_Init(struct XXH32State *xs, ULONG seed)
+{
+    xs->xs_Acc[0] = seed + PRIME32_1 + PRIME32_2;
+    xs->xs_Acc[1] = seed + PRIME32_2;
+    xs->xs_Acc[2] = seed;
+    xs->xs_Acc[3] = seed - PRIME32_1;
+    xs->xs_Length = 0;
+    xs->xs_Buffered = 0;
+}
+
+static void xxh32_stripe(struct XXH32State *xs, const UBYTE *p)
+{
+    xs->xs_Acc[0] = xxh32_round(xs->xs_Acc[0], read_le32(p));
+    xs->xs_Acc[1] = xxh32_round(xs->xs_Acc[1], read_le32(p + 4));
+    xs->xs_Acc[2] = xxh32_round(xs->xs_Acc[2], read_le32(p + 8));
+    xs->xs_Acc[3] = xxh32_round(xs->xs_Acc[3], read_le32(p + 12));
+}
+
+void XXH32_Update(struct XXH32State *xs, const UBYTE *data, ULONG length)
+{
+    xs->xs_Length += length;
+
+    // Complete a stripe left over from previous update
+    if (xs->xs_Buffered != 0)
+    {
+        while (length != 0 && xs->xs_Buffered < 16)
+        {
+            xs->xs_Buffer[xs->xs_Buffered++] = *data++;
+            length--;
+        }
+
+        if (xs->xs_Buffered < 16)
+            return;
+
+        xxh32_stripe(xs, xs->xs_Buffer);
+        xs->xs_Buffered = 0;
+    }
+
+    while (length >= 16)
+    {
+        xxh32_stripe(xs, data);
+        data += 16;
+        length -= 16;
+    }
+
+    while (length--)
+        xs->xs_Buffer[xs->xs_Buffered++] = *data++;
+}
+
+ULONG XXH32_Digest(struct XXH32State *xs)
+{
+    const UBYTE *p = xs->xs_Buffer;
+    ULONG left = xs->xs_Buffered;
+    ULONG h;
+
+    if (xs->xs_Length >= 16)
+        h = rotl32(xs->xs_Acc[0], 1) + rotl32(xs->xs_Acc[1], 7) + rotl32(xs->xs_Acc[2], 12) + rotl32(xs->xs_Acc[3], 18);
+    else
+        h = xs->xs_Acc[2] + PRIME32_5;
+
+    h += xs->xs_Length;
+
+    for (; left >= 4; p += 4, left -= 4)
+        h = rotl32(h + read_le32(p) * PRIME32_3, 17) * PRIME32_4;
+
+    for (; left != 0; p++, left--)
+        h = rotl32(h + *p * PRIME32_5, 11) * PRIME32_1;
+
+    h ^= h >> 15;
+    h *= PRIME32_2;
+    h ^= h >> 13;
+    h *= PRIME32_3;
+    h ^= h >> 16;
+
+    return h;
+}
+
+static int lz4_getc(struct LZ4Stream *ls)
+{
+    if (ls->ls_Error)
+        return -1;
+
+    if (ls->ls_InPos == ls->ls_InLength)
+    {
+        LONG len = ls->ls_Read(ls->ls_UserData, ls->ls_InBuffer, ls->ls_InSize);
+        if (len <= 0)
+        {
+            ls->ls_Error = TRUE;
+            return -1;
+        }
+        ls->ls_InLength = len;
+        ls->ls_InPos = 0;
+    }
+
+    return ls->ls_InBuffer[ls->ls_InPos++];
+}
+
+static ULONG lz4_get32(struct LZ4Stream *ls)
+{
+    ULONG val = 0;
+
+    for (int i=0; i < 4; i++)
+        val |= (ULONG)(lz4_getc(ls) & 0xff) << (8 * i);
+
+    return val;
+}
+
+static void lz4_skip(struct LZ4Stream *ls, ULONG count)
+{
+    while (count-- && !ls->ls_Error)
+        lz4_getc(ls);
+}
+
+static void lz4_flush(struct LZ4Stream *ls)
+{
+    ULONG len = ls->ls_OutPos - ls->ls_Flushed;
+
+    if (len != 0 && !ls->ls_Error)
+    {
+        XXH32_Update(&ls->ls_Checksum, &ls->ls_Window[ls->ls_Flushed & LZ4_WINDOW_MASK], len);
+
+        if (!ls->ls_Write(ls->ls_UserData, ls->ls_Flushed, &ls->ls_Window[ls->ls_Flushed & LZ4_WINDOW_MASK], len))
+            ls->ls_Error = TRUE;
+
+        ls->ls_Flushed = ls->ls_OutPos;
+    }
+}
+
+static inline void lz4_putc(struct LZ4Stream *ls, UBYTE c)
+{
+    ls->ls_Window[ls->ls_OutPos & LZ4_WINDOW_MASK] = c;
+    ls->ls_OutPos++;
+
+    // Flush only full chunks, they never wrap around the window
+    if ((ls->ls_OutPos & (LZ4_FLUSH_SIZE - 1)) == 0)
+        lz4_flush(ls);
+}
+
+static void lz4_decode_block(struct LZ4Stream *ls, LONG remaining)
+{
+    while (remaining > 0 && !ls->ls_Error)
+    {
+        int token = lz4_getc(ls);
+        ULONG length = (token >> 4) & 15;
+        int b;
+
+        remaining--;
+
+        // Literals, length extended with bytes while they are equal to 255
+        if (length == 15)
+        {
+            do {
+                b = lz4_getc(ls);
+                remaining--;
+                length += b & 0xff;
+            } while (b == 255);
+        }
+
+        remaining -= length;
+        while (length-- && !ls->ls_Error)
+            lz4_putc(ls, lz4_getc(ls));
+
+        // Last sequence of the block has literals only
+        if (remaining <= 0)
+            break;
+
+        ULONG offset = lz4_getc(ls) & 0xff;
+        offset |= (lz4_getc(ls) & 0xff) << 8;
+        remaining -= 2;
+
+        if (offset == 0 || offset > ls->ls_OutPos)
+        {
+            ls->ls_Error = TRUE;
+            break;
+        }
+
+        // Match, minimal length is 4
+        length = token & 15;
+        if (length == 15)
+        {
+            do {
+                b = lz4_getc(ls);
+                remaining--;
+                length += b & 0xff;
+            } while (b == 255);
+        }
+        length += 4;
+
+        while (length-- && !ls->ls_Error)
+            lz4_putc(ls, ls->ls_Window[(ls->ls_OutPos - offset) & LZ4_WINDOW_MASK]);
+    }
+
+    if (remaining < 0)
+        ls->ls_Error = TRUE;
+}
+
+BOOL LZ4_Decompress(struct LZ4Stream *ls)
+{
+    UBYTE descriptor[10];
+    ULONG descLength = 2;
+    UBYTE flg;
+
+    ls->ls_InPos = ls->ls_InLength = 0;
+    ls->ls_OutPos = ls->ls_Flushed = 0;
+    ls->ls_Error = FALSE;
+
+    if (lz4_get32(ls) != LZ4_MAGIC)
+        return FALSE;
+
+    flg = descriptor[0] = lz4_getc(ls);
+    descriptor[1] = lz4_getc(ls);   // BD byte, block size is irrelevant for a streaming decoder
+
+    // Frames with preset dictionary are not supported
+    if ((flg & FLG_VERSION_MASK) != FLG_VERSION || (flg & FLG_DICT_ID))
+        return FALSE;
+
+    if (flg & FLG_CONTENT_SIZE)
+    {
+        while (descLength < 10)
+            descriptor[descLength++] = lz4_getc(ls);
+    }
+
+    // Header checksum is the second byte of xxHash32 of the descriptor
+    XXH32_Init(&ls->ls_Checksum, 0);
+    XXH32_Update(&ls->ls_Checksum, descriptor, descLength);
+    if (lz4_getc(ls) != ((XXH32_Digest(&ls->ls_Checksum) >> 8) & 0xff))
+        return FALSE;
+
+    XXH32_Init(&ls->ls_Checksum, 0);
+
+    while (!ls->ls_Error)
+    {
+        ULONG blockSize = lz4_get32(ls);
+
+        // End mark
+        if (blockSize == 0)
+            break;
+
+        if (blockSize & BLOCK_UNCOMPRESSED)
+        {
+            blockSize &= ~BLOCK_UNCOMPRESSED;
+            while (blockSize-- && !ls->ls_Error)
+                lz4_putc(ls, lz4_getc(ls));
+        }
+        else
+        {
+            lz4_decode_block(ls, blockSize);
+        }
+
+        if (flg & FLG_BLOCK_CHECKSUM)
+            lz4_skip(ls, 4);
+    }
+
+    lz4_flush(ls);
+
+    if ((flg & FLG_CONTENT_CHECKSUM) && !ls->ls_Error)
+    {
+        ULONG checksum = lz4_get32(ls);
+
+        if (!ls->ls_Error && checksum != XXH32_Digest(&ls->ls_Checksum))
+            ls->ls_Error = TRUE;
+    }
+
+    return !ls->ls_Error;
+}
@@ -0,0 +1,51 @@
+#ifndef _LZ4_H
+#define _LZ4_H
+
+#include <exec/types.h>
+
+#define LZ4_MAGIC           0x184D2204
+#define LZ4_WINDOW_SIZE     65536
+#define LZ4_WINDOW_MASK     (LZ4_WINDOW_SIZE - 1)
+#define LZ4_FLUSH_SIZE      16384
+
+/* xxHash32 state, LZ4 frames use it for the header and content checksums */
+struct XXH32State {
+    ULONG       xs_Acc[4];
+    ULONG       xs_Length;
+    UBYTE       xs_Buffer[16];
+    ULONG       xs_Buffered;
+};
+
+void XXH32_Init(struct XXH32State *xs, ULONG seed);
+void XXH32_Update(struct XXH32State *xs, const UBYTE *data, ULONG length);
+ULONG XXH32_Digest(struct XXH32State *xs);
+
+/*
+    Streaming decoder of LZ4 frames. Compressed data is pulled through ls_Read into ls_InBuffer,
+    decompressed data goes through the 64 KB ls_Window (needed for back references) and is
+    passed to ls_Write in chunks of LZ4_FLUSH_SIZE bytes. Both buffers are provided by caller.
+    Header checksum and, if the frame has one, content checksum are verified. Block checksums
+    are skipped, the content checksum covers the same data.
+*/
+struct LZ4Stream {
+    APTR        ls_UserData;
+    LONG        (*ls_Read)(APTR userData, UBYTE *buffer, ULONG length);
+    BOOL        (*ls_Write)(APTR userData, ULONG offset, UBYTE *buffer, ULONG length);
+
+    UBYTE *     ls_InBuffer;
+    ULONG       ls_InSize;
+    ULONG       ls_InPos;
+    ULONG       ls_InLength;
+
+    UBYTE *     ls_Window;
+    ULONG       ls_OutPos;
+    ULONG       ls_Flushed;
+
+    struct XXH32State ls_Checksum;
+
+    BOOL        ls_Error;
+};
+
+BOOL LZ4_Decompress(struct LZ4Stream *ls);
+
+#endif /* _LZ4_H */
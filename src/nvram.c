@@ -0,0 +1,101 @@
+#include <exec/types.h>
+
+#include "nvram.h"
+
+static inline ULONG nvram_checksum(ULONG length)
+{
+    ULONG words = length / 4;
+    return (words & 0xFFFF) | (~words << 16);
+}
+
+static inline BOOL is_space(UBYTE c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+/* Check if the data is already in the packed form which can be uploaded to the chip as is */
+BOOL NVRAM_IsPacked(const UBYTE *data, ULONG length)
+{
+    ULONG trailer;
+
+    if (length < 8 || (length & 3) != 0)
+        return FALSE;
+
+    trailer = data[length - 4] | (data[length - 3] << 8) | (data[length - 2] << 16) | ((ULONG)data[length - 1] << 24);
+
+    /* The byte just before padding and checksum is always zero */
+    if (trailer != nvram_checksum(length - 4) || data[length - 5] != 0)
+        return FALSE;
+
+    return TRUE;
+}
+
+/*
+    Convert text NVRAM into packed form. Comments, empty lines and leading or trailing whitespace
+    are removed. Source and destination may be the same buffer. Never reads past srcLength and
+    never writes past dstSize. Returns size of packed NVRAM or 0 if it did not fit in dst.
+*/
+ULONG NVRAM_Compile(const UBYTE *src, ULONG srcLength, UBYTE *dst, ULONG dstSize)
+{
+    ULONG src_pos = 0;
+    ULONG dst_pos = 0;
+    ULONG checksum;
+
+    while (src_pos < srcLength)
+    {
+        ULONG start;
+
+        // Remove whitespace and newlines at beginning of the line
+        while (src_pos < srcLength && is_space(src[src_pos]))
+            src_pos++;
+
+        if (src_pos == srcLength)
+            break;
+
+        // If line begins with '#' then it is a comment, remove until end of line
+        if (src[src_pos] == '#')
+        {
+            while (src_pos < srcLength && src[src_pos] != '\n')
+                src_pos++;
+            continue;
+        }
+
+        // Now there is a token, copy it until end of line
+        start = dst_pos;
+        while (src_pos < srcLength && src[src_pos] != '\n' && src[src_pos] != '\r')
+        {
+            if (dst_pos == dstSize)
+                return 0;
+            dst[dst_pos++] = src[src_pos++];
+        }
+
+        // Skip end of line. It has to be done before the entry is terminated in case of in-place parsing
+        if (src_pos < srcLength)
+            src_pos++;
+
+        // Go back to remove trailing whitespace
+        while (dst_pos > start && is_space(dst[dst_pos - 1]))
+            dst_pos--;
+
+        // Apply 0 at the end of the entry
+        if (dst_pos == dstSize)
+            return 0;
+        dst[dst_pos++] = 0;
+    }
+
+    // Extra 0 at end of config, padding to 4 byte boundary and the checksum
+    if (((dst_pos + 4) & ~3) + 4 > dstSize)
+        return 0;
+
+    dst[dst_pos++] = 0;
+    while (dst_pos & 3)
+        dst[dst_pos++] = 0;
+
+    checksum = nvram_checksum(dst_pos);
+    dst[dst_pos++] = checksum & 0xff;
+    dst[dst_pos++] = (checksum >> 8) & 0xff;
+    dst[dst_pos++] = (checksum >> 16) & 0xff;
+    dst[dst_pos++] = (checksum >> 24) & 0xff;
+
+    return dst_pos;
+}
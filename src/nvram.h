@@ -0,0 +1,19 @@
+#ifndef _NVRAM_H
+#define _NVRAM_H
+
+#include <exec/types.h>
+
+/*
+    Packed NVRAM, as expected by the firmware, is a list of zero terminated "key=value" entries
+    followed by an extra zero byte, padded with zeros to 4 byte boundary. At the very end there
+    is a 32-bit little endian word with number of 32-bit words before it in the lower half and
+    its inverse in the upper half.
+
+    A text NVRAM of given size never packs to more than NVRAM_MAX_PACKED(size) bytes.
+*/
+#define NVRAM_MAX_PACKED(size)  ((size) + 12)
+
+BOOL NVRAM_IsPacked(const UBYTE *data, ULONG length);
+ULONG NVRAM_Compile(const UBYTE *src, ULONG srcLength, UBYTE *dst, ULONG dstSize);
+
+#endif /* _NVRAM_H */
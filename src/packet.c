@@ -9,9 +9,11 @@
 #if defined(__INTELLISENSE__)
 #include <clib/exec_protos.h>
 #include <clib/utility_protos.h>
+#include <clib/timer_protos.h>
 #else
 #include <proto/exec.h>
 #include <proto/utility.h>
+#include <proto/timer.h>
 #endif
 
 #include "d11.h"
@@ -209,14 +211,18 @@ struct PacketMessage {
     APTR            pm_RecvBuffer;
     ULONG           pm_RecvSize;
     APTR            pm_PacketData;
+    ULONG           pm_SentTime;        // timer_us() when receiver sent the message out
     struct Packet   pm_PacketHeader[];
 };
 
 
+/* Synchronous bug() output, only compiled in when LOG_DEBUG records are */
+#if LOG_COMPILE_LEVEL >= LOG_DEBUG
 #define D(x) x
+#else
+#define D(x)
+#endif
 
-#define VENDOR_SPECIFIC_IE  221
-#define WLAN_EID_RSN 48
 
 
 
@@ -237,347 +243,1107 @@ static const UBYTE RSN_CIPHER_SUITE_WEP104[] = {0x00, 0x0f, 0xac, 5};
 
 
 
-/* Traverse a string of 1-byte tag/1-byte length/variable-length value
- * triples, returning a pointer to the substring whose first element
- * matches tag
- */
-struct TLV * brcmf_parse_tlvs(void *buf, ULONG buflen, UBYTE key)
+int my_memcmp(const UBYTE *s1, const UBYTE *s2, ULONG len)
+{
+    for (ULONG i=0; i < len; i++)
+    {
+        if (s1[i] > s2[i]) return 1;
+        else if (s1[i] < s2[i]) return -1;
+    }
+    return 0;
+}
+
+/*
+    Walk the IE blob once and remember where the IEs of interest start. First occurrence of every IE wins,
+    IEs truncated by end of the buffer are ignored.
+*/
+void IndexIEs(struct IEIndex *index, const UBYTE *data, ULONG len)
+{
+    ULONG off = 0;
+
+    for (int i=0; i < IE_INDEX_COUNT; i++)
+        index->ii_Offset[i] = IE_NOT_PRESENT;
+
+    while (off + TLV_HDR_LEN <= len)
+    {
+        const UBYTE *ie = &data[off];
+        ULONG ieLen = ie[TLV_LEN_OFF];
+        int slot = -1;
+
+        if (off + TLV_HDR_LEN + ieLen > len || off >= IE_NOT_PRESENT)
+            break;
+
+        switch (ie[0])
+        {
+            case WLAN_EID_RSN:
+                slot = IE_RSN;
+                break;
+
+            case WLAN_EID_HT_CAP:
+                slot = IE_HT;
+                break;
+
+            case WLAN_EID_VHT_CAP:
+                slot = IE_VHT;
+                break;
+
+            case WLAN_EID_COUNTRY:
+                slot = IE_COUNTRY;
+                break;
+
+            case VENDOR_SPECIFIC_IE:
+                if (ieLen >= TLV_OUI_LEN + 1 && !my_memcmp(&ie[TLV_BODY_OFF], (const UBYTE *)WPA_OUI, TLV_OUI_LEN))
+                {
+                    if (ie[TLV_BODY_OFF + TLV_OUI_LEN] == WPA_OUI_TYPE)
+                        slot = IE_WPA;
+                    else if (ie[TLV_BODY_OFF + TLV_OUI_LEN] == WME_OUI_TYPE)
+                        slot = IE_WMM;
+                }
+                break;
+        }
+
+        if (slot >= 0 && index->ii_Offset[slot] == IE_NOT_PRESENT)
+            index->ii_Offset[slot] = off;
+
+        off += TLV_HDR_LEN + ieLen;
+    }
+}
+
+struct TLV * GetIndexedIE(const struct IEIndex *index, UBYTE *data, ULONG slot)
+{
+    if (data == NULL || slot >= IE_INDEX_COUNT || index->ii_Offset[slot] == IE_NOT_PRESENT)
+        return NULL;
+
+    return (struct TLV *)&data[index->ii_Offset[slot]];
+}
+
+/* Total size of indexed IEs selected by mask of (1 << slot) bits, including their headers */
+ULONG IndexedIELength(const struct IEIndex *index, const UBYTE *data, ULONG mask)
+{
+    ULONG length = 0;
+
+    for (int i=0; i < IE_INDEX_COUNT; i++)
+    {
+        if ((mask & (1 << i)) && index->ii_Offset[i] != IE_NOT_PRESENT)
+            length += TLV_HDR_LEN + data[index->ii_Offset[i] + TLV_LEN_OFF];
+    }
+
+    return length;
+}
+
+#define SCANNER_STACKSIZE       (16384 / sizeof(ULONG))
+#define SCANNER_PRIORITY         0
+
+
+#define PACKET_RECV_STACKSIZE   (65536 / sizeof(ULONG))
+#define PACKET_RECV_PRIORITY    5
+
+#define PACKET_WAIT_DELAY_MIN   1000
+#define PACKET_WAIT_DELAY_MAX   100000
+
+#define PACKET_INITIAL_FETCH_SIZE   16
+
+#define CTRL_TIMEOUT            2500000     // us, control message without reply from firmware is failed
+#define CTRL_ERROR_DOWN         36          // BCME_DONGLE_DOWN, index in brcmf_fil_errstr
+
+/*
+    Set PACKET_PROFILE to 1 in order to measure the packet engine on target. Receiver task sums up time spent
+    in fetching and processing received frames and in building and sending glom frames, and reports packets
+    per second and time per packet every PROFILE_INTERVAL.
+*/
+#define PACKET_PROFILE          0
+#define PROFILE_INTERVAL        5000000     // us
+
+#if PACKET_PROFILE
+struct PacketProfile {
+    ULONG   pp_Packets;
+    ULONG   pp_Bytes;
+    ULONG   pp_Transfers;       // SDIO transfers, more than one packet per transfer with glom
+    ULONG   pp_Time;            // us
+};
+
+static struct PacketProfile RXProfile;
+static struct PacketProfile TXProfile;
+static ULONG ProfileStart;
+
+#define PROFILE_BEGIN(t)                ULONG t = timer_us()
+#define PROFILE_END(p, t, n, bytes)     do { (p).pp_Time += timer_us() - (t); (p).pp_Packets += (n); \
+                                             (p).pp_Bytes += (bytes); (p).pp_Transfers++; } while(0)
+
+static void ReportProfile(struct ExecBase *SysBase, const char *name, struct PacketProfile *p, ULONG elapsed)
 {
-    struct TLV *elt = buf;
-    ULONG totlen = buflen;
+    ULONG perSecond = p->pp_Packets * 1000 / (elapsed / 1000);
+    ULONG nsPerPacket = 0;
+    ULONG perTransfer = p->pp_Transfers ? p->pp_Packets * 10 / p->pp_Transfers : 0;
+
+    /* pp_Time * 1000 would overflow past 4.29 s of busy time, scale quotient and remainder separately */
+    if (p->pp_Packets)
+        nsPerPacket = p->pp_Time / p->pp_Packets * 1000 + p->pp_Time % p->pp_Packets * 1000 / p->pp_Packets;
+
+    bug("[WiFi.PROF] %s: %ld pkt/s, %ld B/s, %ld ns/pkt, %ld.%ld pkt/transfer, busy %ld%%\n",
+        (ULONG)name, perSecond, p->pp_Bytes / (elapsed / 1000) * 1000, nsPerPacket,
+        perTransfer / 10, perTransfer % 10, p->pp_Time / (elapsed / 100));
+
+    p->pp_Packets = 0;
+    p->pp_Bytes = 0;
+    p->pp_Transfers = 0;
+    p->pp_Time = 0;
+}
 
-    /* find tagged parameter */
-    while (totlen >= TLV_HDR_LEN) {
-        ULONG len = elt->len;
+static void UpdateProfile(struct ExecBase *SysBase)
+{
+    ULONG elapsed = timer_us() - ProfileStart;
 
-        /* validate remaining totlen */
-        if ((elt->id == key) && (totlen >= (len + TLV_HDR_LEN)))
-            return elt;
+    if (elapsed >= PROFILE_INTERVAL)
+    {
+        if (RXProfile.pp_Packets || TXProfile.pp_Packets)
+        {
+            ReportProfile(SysBase, "RX", &RXProfile, elapsed);
+            ReportProfile(SysBase, "TX", &TXProfile, elapsed);
+        }
+        ProfileStart += elapsed;
+    }
+}
+#else
+#define PROFILE_BEGIN(t)                do { } while(0)
+#define PROFILE_END(p, t, n, bytes)     do { } while(0)
+#define UpdateProfile(sysBase)          do { } while(0)
+#endif
+
+void PacketDump(struct SDIO *sdio, APTR data, char *src);
+
+static inline ULONG NetworkHash(const UBYTE *bssid, UWORD chanSpec, UBYTE ssidLength)
+{
+    /* FNV-1a over BSSID, chanspec and SSID length, folded to the table size */
+    ULONG hash = 2166136261UL;
+
+    for (int i=0; i < 6; i++)
+    {
+        hash ^= bssid[i];
+        hash *= 16777619UL;
+    }
 
-        elt = (struct TLV*)((UBYTE *)elt + (len + TLV_HDR_LEN));
-        totlen -= (len + TLV_HDR_LEN);
+    hash ^= chanSpec;
+    hash *= 16777619UL;
+    hash ^= ssidLength;
+    hash *= 16777619UL;
+
+    return (hash ^ (hash >> 16)) & (SCAN_HASH_SIZE - 1);
+}
+
+static struct WiFiNetwork * FindNetwork(struct WiFiUnit *unit, const UBYTE *bssid, UWORD chanSpec,
+                                        const UBYTE *ssid, UBYTE ssidLength, ULONG hash)
+{
+    /*
+        Two networks are considered the same if:
+        - SSID is same
+        - BSSID is same
+        - Chanspec is the same
+    */
+    for (struct WiFiNetwork *net = unit->wu_ScanHash[hash]; net != NULL; net = net->wn_HashNext)
+    {
+        if (net->wn_ChannelInfo.ci_CHSpec != chanSpec)
+            continue;
+
+        if (net->wn_SSIDLength != ssidLength)
+            continue;
+
+        if (net->wn_BSID[0] != bssid[0] ||
+            net->wn_BSID[1] != bssid[1] ||
+            net->wn_BSID[2] != bssid[2] ||
+            net->wn_BSID[3] != bssid[3] ||
+            net->wn_BSID[4] != bssid[4] ||
+            net->wn_BSID[5] != bssid[5])
+            continue;
+
+        if (_strncmp(net->wn_SSID, ssid, ssidLength) != 0)
+            continue;
+
+        return net;
     }
 
     return NULL;
 }
 
-int my_memcmp(const UBYTE *s1, const UBYTE *s2, ULONG len)
+static void ReleaseScanChunk(struct WiFiBase *WiFiBase, struct ScanChunk *chunk)
 {
-    for (ULONG i=0; i < len; i++)
+    if (chunk != NULL && --chunk->sc_Refs == 0)
     {
-        if (s1[i] > s2[i]) return 1;
-        else if (s1[i] < s2[i]) return -1;
+        PoolUsed(WiFiBase, POOL_SCAN, -VecPooledSize(chunk));
+        FreeVecPooled(WiFiBase->w_MemPool, chunk);
     }
-    return 0;
 }
 
-static int brcmf_tlv_has_ie(UBYTE *ie, UBYTE **tlvs, ULONG *tlvs_len,
-		 const UBYTE *oui, ULONG oui_len, UBYTE type)
+static void FreeNetwork(struct WiFiBase *WiFiBase, struct WiFiNetwork *net)
 {
-    /* If the contents match the OUI and the type */
-    if (ie[TLV_LEN_OFF] >= oui_len + 1 &&
-        !my_memcmp(&ie[TLV_BODY_OFF], oui, oui_len) &&
-        type == ie[TLV_BODY_OFF + oui_len]) {
+    ReleaseScanChunk(WiFiBase, net->wn_Chunk);
+}
+
+/* Make sure the current chunk has room for given number of bytes, so that the whole escan event fits in one */
+static BOOL ReserveScanChunk(struct WiFiUnit *unit, ULONG size)
+{
+    struct WiFiBase *WiFiBase = unit->wu_Base;
+    struct ScanChunk *chunk = unit->wu_ScanChunk;
+
+    if (chunk != NULL && chunk->sc_Size - chunk->sc_Used >= size)
         return TRUE;
+
+    if (size < SCAN_CHUNK_SIZE)
+        size = SCAN_CHUNK_SIZE;
+
+    chunk = AllocVecPooled(WiFiBase->w_MemPool, sizeof(struct ScanChunk) + size);
+    if (chunk == NULL)
+        return FALSE;
+
+    PoolUsed(WiFiBase, POOL_SCAN, VecPooledSize(chunk));
+    chunk->sc_Refs = 1;
+    chunk->sc_Size = size;
+    chunk->sc_Used = 0;
+
+    ReleaseScanChunk(WiFiBase, unit->wu_ScanChunk);
+    unit->wu_ScanChunk = chunk;
+
+    return TRUE;
+}
+
+/*
+    BSS infos in an escan event follow each other by bssi_Length. Returns length of the one at info if it fits in
+    the left bytes of the event and its IEs fit in it, 0 otherwise. IE length is then small enough for the
+    network size computed from it not to wrap.
+*/
+static ULONG BSSInfoLength(const struct BSSInfo *info, ULONG left)
+{
+    ULONG length;
+
+    if (left < sizeof(struct BSSInfo))
+        return 0;
+
+    length = LE32(info->bssi_Length);
+    if (length < sizeof(struct BSSInfo) || length > left)
+        return 0;
+
+    if (LE16(info->bssi_IEOffset) > length || LE32(info->bssi_IELength) > length - LE16(info->bssi_IEOffset))
+        return 0;
+
+    return length;
+}
+
+static struct WiFiNetwork * AllocNetwork(struct WiFiUnit *unit, ULONG ieLength)
+{
+    ULONG size = (sizeof(struct WiFiNetwork) + ieLength + 3) & ~3;
+    struct ScanChunk *chunk;
+    struct WiFiNetwork *net;
+
+    if (!ReserveScanChunk(unit, size))
+        return NULL;
+
+    chunk = unit->wu_ScanChunk;
+    net = (struct WiFiNetwork *)((UBYTE *)chunk->sc_Data + chunk->sc_Used);
+    chunk->sc_Used += size;
+    chunk->sc_Refs++;
+
+    _bzero(net, sizeof(struct WiFiNetwork));
+    net->wn_Chunk = chunk;
+
+    return net;
+}
+
+static void ClearScanResults(struct WiFiUnit *unit)
+{
+    struct WiFiBase *WiFiBase = unit->wu_Base;
+
+    for (ULONG i=0; i < unit->wu_ScanCount; i++)
+    {
+        FreeNetwork(WiFiBase, unit->wu_ScanResults[i]);
+    }
+
+    /* Networks left in the chunk live on in the cache, next scan starts a fresh one */
+    ReleaseScanChunk(WiFiBase, unit->wu_ScanChunk);
+    unit->wu_ScanChunk = NULL;
+
+    /* Result array is kept for the next scan */
+    unit->wu_ScanCount = 0;
+
+    for (int i=0; i < SCAN_HASH_SIZE; i++)
+        unit->wu_ScanHash[i] = NULL;
+}
+
+/* Detach current scan request from the unit. Disabled since CMD_FLUSH or S2_OFFLINE may abort it at any time */
+static struct IOSana2Req * TakeScanRequest(struct WiFiUnit *unit)
+{
+    struct ExecBase *SysBase = unit->wu_Base->w_SysBase;
+    struct IOSana2Req *io;
+
+    Disable();
+    io = unit->wu_ScanRequest;
+    unit->wu_ScanRequest = NULL;
+    Enable();
+
+    return io;
+}
+
+static void ReplyScanRiders(struct WiFiUnit *unit, BOOL failed);
+
+static void FailScan(struct WiFiUnit *unit)
+{
+    struct ExecBase *SysBase = unit->wu_Base->w_SysBase;
+    struct IOSana2Req *io = TakeScanRequest(unit);
+
+    if (io)
+    {
+        io->ios2_WireError = S2WERR_BUFF_ERROR;
+        io->ios2_Req.io_Error = S2ERR_NO_RESOURCES;
+        ReplyMsg((struct Message *)io);
+    }
+    ReplyScanRiders(unit, TRUE);
+
+    unit->wu_ScanWasFull = FALSE;
+    unit->wu_ScanEnded = timer_us();
+
+    ClearScanResults(unit);
+    unit->wu_ScanActive = FALSE;
+    unit->wu_ScanIncremental = FALSE;
+    unit->wu_ScanFinished = FALSE;
+    unit->wu_ScanDelivered = 0;
+}
+
+void UpdateNetwork(struct WiFiUnit *unit, struct BSSInfo *info)
+{
+    struct WiFiBase *WiFiBase = unit->wu_Base;
+    struct SDIO *sdio = WiFiBase->w_SDIO;
+    struct ExecBase *SysBase = WiFiBase->w_SysBase;
+    struct WiFiNetwork *net;
+    ULONG hash;
+
+    /* Ignore event if no scan is active */
+    if (!unit->wu_ScanActive)
+    {
+        return;
+    }
+
+    /* Ignore networks with empty ssid */
+    if (info->bssi_SSIDLength == 0 || info->bssi_SSIDLength > 32)
+        return;
+
+    hash = NetworkHash(info->bssi_ID, LE16(info->bssi_ChanSpec), info->bssi_SSIDLength);
+
+    /* Network seen already during this scan, keep the most recent signal level only */
+    if ((net = FindNetwork(unit, info->bssi_ID, LE16(info->bssi_ChanSpec), info->bssi_SSID, info->bssi_SSIDLength, hash)))
+    {
+        net->wn_RSSI = (WORD)LE16(info->bssi_RSSI);
+        if (info->bssi_PHYNoise != 0)
+            net->wn_Noise = (BYTE)info->bssi_PHYNoise;
+        return;
+    }
+
+    /* Grow the list geometrically, so that the whole scan costs linear time */
+    if (unit->wu_ScanCount == unit->wu_ScanCapacity)
+    {
+        ULONG capacity = unit->wu_ScanCapacity ? 2 * unit->wu_ScanCapacity : SCAN_INITIAL_CAPACITY;
+        struct WiFiNetwork **results = AllocVecPooled(WiFiBase->w_MemPool, capacity * sizeof(APTR));
+
+        if (results == NULL)
+        {
+            FailScan(unit);
+            return;
+        }
+
+        PoolUsed(WiFiBase, POOL_SCAN, VecPooledSize(results));
+
+        if (unit->wu_ScanResults != NULL)
+        {
+            CopyMem(unit->wu_ScanResults, results, unit->wu_ScanCount * sizeof(APTR));
+            PoolUsed(WiFiBase, POOL_SCAN, -VecPooledSize(unit->wu_ScanResults));
+            FreeVecPooled(WiFiBase->w_MemPool, unit->wu_ScanResults);
+        }
+
+        unit->wu_ScanResults = results;
+        unit->wu_ScanCapacity = capacity;
+    }
+
+    /* IEs are stored right behind the network structure, their length was checked by BSSInfoLength */
+    ULONG ieLength = LE32(info->bssi_IELength);
+
+    net = AllocNetwork(unit, ieLength);
+    if (net == NULL)
+    {
+        FailScan(unit);
+        return;
+    }
+
+    CopyMem(info->bssi_ID, net->wn_BSID, 6);
+    CopyMem(info->bssi_SSID, net->wn_SSID, info->bssi_SSIDLength);
+    net->wn_SSIDLength = info->bssi_SSIDLength;
+    net->wn_RSSI = (WORD)LE16(info->bssi_RSSI);
+    net->wn_Noise = (BYTE)info->bssi_PHYNoise;
+    net->wn_BeaconPeriod = LE16(info->bssi_BeaconPeriod);
+    net->wn_Capability = LE16(info->bssi_Capability);
+    net->wn_ChannelInfo.ci_CHSpec = LE16(info->bssi_ChanSpec);
+    if (sdio->s_Chip->c_ChanSpecReady)
+        DecodeChanSpecTable(&net->wn_ChannelInfo, sdio->s_Chip->c_ChanSpecTable);
+    else
+        DecodeChanSpec(&net->wn_ChannelInfo, sdio->s_Chip->c_D11Type);
+
+    if (ieLength)
+    {
+        net->wn_IE = (UBYTE *)(net + 1);
+        net->wn_IELength = ieLength;
+        CopyMem(&((UBYTE*)info)[LE16(info->bssi_IEOffset)], net->wn_IE, ieLength);
     }
+    IndexIEs(&net->wn_IEIndex, net->wn_IE, ieLength);
 
-    if (tlvs == NULL)
+    net->wn_HashNext = unit->wu_ScanHash[hash];
+    unit->wu_ScanHash[hash] = net;
+    unit->wu_ScanResults[unit->wu_ScanCount++] = net;
+}
+
+/*
+    Reply to S2_GETNETWORKS is allocated from the caller's pool in one piece and carved with a bump pointer.
+    All sizes are rounded up to longwords.
+*/
+struct ReplyArena {
+    UBYTE *     ra_Ptr;
+    ULONG       ra_Free;
+};
+
+#define ARENA_SIZE(x)   (((x) + 3) & ~3)
+
+static BOOL ArenaInit(struct ExecBase *SysBase, struct ReplyArena *arena, APTR memPool, ULONG size)
+{
+    arena->ra_Ptr = AllocPooled(memPool, size);
+    arena->ra_Free = arena->ra_Ptr ? size : 0;
+
+    return arena->ra_Ptr != NULL;
+}
+
+static APTR ArenaAlloc(struct ReplyArena *arena, ULONG size)
+{
+    APTR mem = arena->ra_Ptr;
+
+    size = ARENA_SIZE(size);
+    if (size > arena->ra_Free)
+        return NULL;
+
+    arena->ra_Ptr += size;
+    arena->ra_Free -= size;
+
+    return mem;
+}
+
+static ULONG NetworkIELength(struct WiFiNetwork *net, ULONG ieFilter)
+{
+    if (ieFilter != 0)
+        return IndexedIELength(&net->wn_IEIndex, net->wn_IE, ieFilter);
+    else
+        return net->wn_IELength;
+}
+
+/* Arena space needed by BuildNetworkTags for given network */
+static ULONG NetworkTagsSize(struct WiFiNetwork *net, ULONG ieFilter)
+{
+    ULONG ieLength = NetworkIELength(net, ieFilter);
+    ULONG size = ARENA_SIZE(sizeof(struct TagItem) * 16) + ARENA_SIZE(net->wn_SSIDLength + 1) + ARENA_SIZE(6);
+
+    if (ieLength)
+        size += ARENA_SIZE(ieLength + 2);
+
+    return size;
+}
+
+/*
+    Build tag list describing the network. If ieFilter (mask of S2IEF_* flags) is not zero, only the selected
+    IEs are returned, otherwise the whole IE blob is.
+*/
+static struct TagItem * BuildNetworkTags(struct ExecBase *SysBase, struct ReplyArena *arena, struct WiFiNetwork *net, ULONG ieFilter)
+{
+    struct TagItem *tags;
+    struct TagItem *t;
+    UBYTE *ssid;
+    UBYTE *bssid;
+    UWORD *ie = NULL;
+    ULONG ieLength = NetworkIELength(net, ieFilter);
+
+    /* Get memory for TagList, maximal number is number of S2INFO_TAGS plus one */
+    tags = ArenaAlloc(arena, sizeof(struct TagItem) * 16);
+    ssid = ArenaAlloc(arena, net->wn_SSIDLength + 1);
+    bssid = ArenaAlloc(arena, 6);
+    if (ieLength)
+        ie = ArenaAlloc(arena, ieLength + 2);
+
+    if (tags == NULL || ssid == NULL || bssid == NULL || (ieLength && ie == NULL))
+        return NULL;
+
+    ssid[net->wn_SSIDLength] = 0;
+
+    /* Ignore all tags for now */
+    for (int i=0; i < 15; i++) tags[i].ti_Tag = TAG_IGNORE;
+
+    /* Finish with DONE tag*/
+    tags[15].ti_Tag = TAG_DONE;
+    tags[15].ti_Data = 0;
+
+    t = tags;
+
+    CopyMem(net->wn_SSID, ssid, net->wn_SSIDLength);
+    t->ti_Tag = S2INFO_SSID;
+    t->ti_Data = (ULONG)ssid;
+    t++;
+
+    CopyMem(net->wn_BSID, bssid, 6);
+    t->ti_Tag = S2INFO_BSSID;
+    t->ti_Data = (ULONG)bssid;
+    t++;
+
+    t->ti_Tag = S2INFO_BeaconInterval;
+    t->ti_Data = net->wn_BeaconPeriod;
+    t++;
+
+    t->ti_Tag = S2INFO_Signal;
+    t->ti_Data = net->wn_RSSI;
+    t++;
+
+    if (net->wn_Noise != 0)
+    {
+        t->ti_Tag = S2INFO_Noise;
+        t->ti_Data = net->wn_Noise;
+        t++;
+    }
+
+    if (ie != NULL)
+    {
+        *ie = ieLength;
+
+        if (ieFilter == 0)
+        {
+            CopyMem(net->wn_IE, ie + 1, ieLength);
+        }
+        else
+        {
+            UBYTE *dst = (UBYTE *)(ie + 1);
+
+            for (int i=0; i < IE_INDEX_COUNT; i++)
+            {
+                struct TLV *tlv = GetIndexedIE(&net->wn_IEIndex, net->wn_IE, i);
+
+                if ((ieFilter & (1 << i)) && tlv != NULL)
+                {
+                    CopyMem(tlv, dst, TLV_HDR_LEN + tlv->len);
+                    dst += TLV_HDR_LEN + tlv->len;
+                }
+            }
+        }
+
+        t->ti_Tag = S2INFO_InfoElements;
+        t->ti_Data = (ULONG)ie;
+        t++;
+    }
+
+    t->ti_Tag = S2INFO_Capabilities;
+    t->ti_Data = net->wn_Capability;
+    t++;
+
+    t->ti_Tag = S2INFO_Channel;
+    t->ti_Data = net->wn_ChannelInfo.ci_CHNum;
+    t++;
+
+    t->ti_Tag = S2INFO_Band;
+    t->ti_Data = net->wn_ChannelInfo.ci_Band == BRCMU_CHAN_BAND_2G ? S2BAND_B : S2BAND_A;
+    t++;
+
+    return tags;
+}
+
+/* Check if the current scan could have found given network, i.e. it matches SSID, BSSID and channels of the scan */
+static BOOL ScanCovers(struct WiFiUnit *unit, struct WiFiNetwork *net)
+{
+    if (unit->wu_ScanSSIDLength != 0 && (net->wn_SSIDLength != unit->wu_ScanSSIDLength ||
+        _strncmp(net->wn_SSID, unit->wu_ScanSSID, net->wn_SSIDLength) != 0))
+        return FALSE;
+
+    if (unit->wu_ScanHasBSSID)
+    {
+        for (int i=0; i < 6; i++)
+            if (net->wn_BSID[i] != unit->wu_ScanBSSID[i])
+                return FALSE;
+    }
+
+    if (unit->wu_ScanChannelCount != 0)
+    {
+        for (ULONG i=0; i < unit->wu_ScanChannelCount; i++)
+            if (unit->wu_ScanChannels[i] == net->wn_ChannelInfo.ci_CHNum)
+                return TRUE;
+
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+    Move networks found by the scan into the driver-wide cache. Cached networks found again are replaced,
+    the others age and are dropped once missing from too many scans or not seen for too long. Networks the
+    scan could not have found, because of its SSID, BSSID or channel limits, do not age.
+*/
+static void UpdateNetworkCache(struct WiFiUnit *unit)
+{
+    struct WiFiBase *WiFiBase = unit->wu_Base;
+    struct ExecBase *SysBase = WiFiBase->w_SysBase;
+    struct TimerBase *TimerBase = unit->wu_TimerBase;
+    struct WiFiNetwork *net, *next;
+    struct timeval now;
+
+    GetSysTime(&now);
+
+    ObtainSemaphore(&WiFiBase->w_NetworkListLock);
+
+    ForeachNodeSafe(&WiFiBase->w_NetworkList, net, next)
+    {
+        ULONG hash = NetworkHash(net->wn_BSID, net->wn_ChannelInfo.ci_CHSpec, net->wn_SSIDLength);
+
+        if (FindNetwork(unit, net->wn_BSID, net->wn_ChannelInfo.ci_CHSpec, net->wn_SSID, net->wn_SSIDLength, hash) == NULL)
+        {
+            /* Limited scan says nothing about networks outside its limits */
+            if (!ScanCovers(unit, net))
+                continue;
+
+            if (++net->wn_LastUpdated <= NETWORK_CACHE_MISSES && now.tv_sec - net->wn_LastSeen <= NETWORK_CACHE_EXPIRE)
+                continue;
+        }
+
+        Remove((struct Node *)net);
+        FreeNetwork(WiFiBase, net);
+    }
+
+    for (ULONG i=0; i < unit->wu_ScanCount; i++)
+    {
+        net = unit->wu_ScanResults[i];
+        net->wn_HashNext = NULL;
+        net->wn_LastUpdated = 0;
+        net->wn_LastSeen = now.tv_sec;
+        AddTail((struct List *)&WiFiBase->w_NetworkList, (struct Node *)net);
+    }
+
+    /* Only a full scan makes the whole cache fresh */
+    if (unit->wu_ScanSSIDLength == 0 && !unit->wu_ScanLimited)
+        WiFiBase->w_NetworkListUpdated = now.tv_sec;
+
+    ReleaseSemaphore(&WiFiBase->w_NetworkListLock);
+
+    /* Networks are owned by the cache now */
+    unit->wu_ScanCount = 0;
+}
+
+/* Subset of networks a request asks for, given by its S2INFO_SSID, S2INFO_BSSID and S2INFO_Channel tags */
+struct ScanFilter {
+    const UBYTE *   sf_SSID;
+    ULONG           sf_SSIDLength;
+    const UBYTE *   sf_BSSID;
+    UBYTE           sf_Channel;
+};
+
+static void GetScanFilter(struct Library *UtilityBase, struct TagItem *tags, struct ScanFilter *filter)
+{
+    filter->sf_SSID = NULL;
+    filter->sf_SSIDLength = 0;
+    filter->sf_BSSID = NULL;
+    filter->sf_Channel = 0;
+
+    if (tags != NULL)
+    {
+        filter->sf_SSID = (UBYTE *)GetTagData(S2INFO_SSID, 0, tags);
+        if (filter->sf_SSID != NULL)
+            filter->sf_SSIDLength = _strlen(filter->sf_SSID);
+        filter->sf_BSSID = (UBYTE *)GetTagData(S2INFO_BSSID, 0, tags);
+        filter->sf_Channel = GetTagData(S2INFO_Channel, 0, tags);
+    }
+}
+
+static BOOL FilterMatches(struct WiFiNetwork *net, const struct ScanFilter *filter)
+{
+    if (filter == NULL)
+        return TRUE;
+
+    if (filter->sf_SSID != NULL && (net->wn_SSIDLength != filter->sf_SSIDLength ||
+        _strncmp(net->wn_SSID, filter->sf_SSID, filter->sf_SSIDLength) != 0))
         return FALSE;
 
-    /* point to the next ie */
-    ie += ie[TLV_LEN_OFF] + TLV_HDR_LEN;
-    /* calculate the length of the rest of the buffer */
-    *tlvs_len -= (int)(ie - *tlvs);
-    /* update the pointer to the start of the buffer */
-    *tlvs = ie;
+    if (filter->sf_BSSID != NULL && my_memcmp(net->wn_BSID, filter->sf_BSSID, 6) != 0)
+        return FALSE;
 
-    return FALSE;
+    if (filter->sf_Channel != 0 && net->wn_ChannelInfo.ci_CHNum != filter->sf_Channel)
+        return FALSE;
+
+    return TRUE;
 }
 
-struct VsTLV * FindWPAIE(UBYTE *data, ULONG len)
+/*
+    Fill S2_GETNETWORKS reply with given networks matching the filter. Tag lists are built in caller's memory
+    pool in one go.
+*/
+static void BuildScanReply(struct WiFiUnit *unit, struct IOSana2Req *io, struct WiFiNetwork **nets, ULONG count,
+                           const struct ScanFilter *filter)
 {
-    const struct TLV *ie;
+    struct WiFiBase *WiFiBase = unit->wu_Base;
+    struct ExecBase *SysBase = WiFiBase->w_SysBase;
+    struct Library *UtilityBase = WiFiBase->w_UtilityBase;
+    struct TagItem **networks = NULL;
+    struct ReplyArena arena;
+    ULONG ieFilter = 0;
+    ULONG matching = 0;
+    ULONG size = 0;
+
+    if (io->ios2_StatData != NULL)
+        ieFilter = GetTagData(S2INFO_IEFilter, 0, io->ios2_StatData);
+
+    for (ULONG i=0; i < count; i++)
+    {
+        if (FilterMatches(nets[i], filter))
+        {
+            size += NetworkTagsSize(nets[i], ieFilter);
+            matching++;
+        }
+    }
+
+    if (matching)
+    {
+        size += ARENA_SIZE(matching * sizeof(APTR));
+
+        if (ArenaInit(SysBase, &arena, io->ios2_Data, size))
+        {
+            networks = ArenaAlloc(&arena, matching * sizeof(APTR));
+
+            matching = 0;
+            for (ULONG i=0; i < count; i++)
+            {
+                if (FilterMatches(nets[i], filter))
+                    networks[matching++] = BuildNetworkTags(SysBase, &arena, nets[i], ieFilter);
+            }
+        }
+        else
+        {
+            io->ios2_WireError = S2WERR_BUFF_ERROR;
+            io->ios2_Req.io_Error = S2ERR_NO_RESOURCES;
+            matching = 0;
+        }
+    }
+
+    io->ios2_StatData = networks;
+    io->ios2_DataLength = matching;
+}
+
+/*
+    Reply scan request with networks not replied yet. In incremental mode final tells the caller whether the
+    scan is over.
+*/
+static void DeliverScanResults(struct WiFiUnit *unit, BOOL final)
+{
+    struct WiFiBase *WiFiBase = unit->wu_Base;
+    struct ExecBase *SysBase = WiFiBase->w_SysBase;
+    struct Library *UtilityBase = WiFiBase->w_UtilityBase;
+    struct IOSana2Req *io = TakeScanRequest(unit);
+    ULONG *done = NULL;
+    ULONG first = unit->wu_ScanDelivered;
+
+    if (io == NULL)
+        return;
+
+    if (io->ios2_StatData != NULL)
+        done = (ULONG *)GetTagData(S2INFO_Incremental, 0, io->ios2_StatData);
+
+    BuildScanReply(unit, io, &unit->wu_ScanResults[first], unit->wu_ScanCount - first, NULL);
+
+    unit->wu_ScanDelivered = unit->wu_ScanCount;
+
+    if (done != NULL)
+        *done = final;
+
+    ReplyMsg((struct Message *)io);
+}
+
+/* Reply requests which joined the scan in flight, each with the networks it asked for */
+static void ReplyScanRiders(struct WiFiUnit *unit, BOOL failed)
+{
+    struct WiFiBase *WiFiBase = unit->wu_Base;
+    struct ExecBase *SysBase = WiFiBase->w_SysBase;
+    struct Library *UtilityBase = WiFiBase->w_UtilityBase;
+    struct IOSana2Req *io;
+
+    while ((io = (struct IOSana2Req *)GetMsg(unit->wu_ScanRiders)))
+    {
+        if (failed)
+        {
+            io->ios2_WireError = S2WERR_BUFF_ERROR;
+            io->ios2_Req.io_Error = S2ERR_NO_RESOURCES;
+        }
+        else
+        {
+            struct ScanFilter filter;
+
+            GetScanFilter(UtilityBase, io->ios2_StatData, &filter);
+            BuildScanReply(unit, io, unit->wu_ScanResults, unit->wu_ScanCount, &filter);
+        }
+
+        ReplyMsg((struct Message *)io);
+    }
+}
+
+/* Scan is over, reply the request and move found networks into the cache */
+static void CompleteScan(struct WiFiUnit *unit)
+{
+    if (!unit->wu_ScanActive)
+        return;
+
+    DeliverScanResults(unit, TRUE);
+    ReplyScanRiders(unit, FALSE);
+
+    unit->wu_ScanWasFull = unit->wu_ScanSSIDLength == 0 && !unit->wu_ScanLimited;
+    unit->wu_ScanEnded = timer_us();
 
-    while ((ie = brcmf_parse_tlvs(data, len, VENDOR_SPECIFIC_IE)))
-    {
-        if (brcmf_tlv_has_ie((UBYTE *)ie, &data, &len,
-                        WPA_OUI, TLV_OUI_LEN, WPA_OUI_TYPE))
-            return (struct VsTLV *)ie;
-    }
-    return NULL;
+    UpdateNetworkCache(unit);
+    ClearScanResults(unit);
+    unit->wu_ScanActive = FALSE;
+    unit->wu_ScanIncremental = FALSE;
+    unit->wu_ScanFinished = FALSE;
+    unit->wu_ScanDelivered = 0;
 }
 
-#define WPA_VERSION_1   1
-#define WPA_VERSION_2   2
-#define WPA_VERSION_3   4
-
-int SetWPAVersion(struct SDIO *sdio, struct WiFiNetwork *network, ULONG wpa_versions)
+static BOOL NetworkMatches(struct WiFiNetwork *net, const struct ScanFilter *filter, ULONG minSeen)
 {
-    ULONG val = 0;
-    (void)network;
-    (void)wpa_versions;
-
-    if (wpa_versions & WPA_VERSION_1)
-        val = WPA_AUTH_PSK | WPA_AUTH_UNSPECIFIED;
-    else if (wpa_versions & WPA_VERSION_2)
-        val = WPA2_AUTH_PSK | WPA2_AUTH_UNSPECIFIED;
-    else if (wpa_versions & WPA_VERSION_3)
-        val = WPA3_AUTH_SAE_PSK;
-    else
-        val = WPA_AUTH_DISABLED;
+    if (net->wn_LastSeen < minSeen)
+        return FALSE;
 
-    return PacketSetVarInt(sdio, "wpa_auth", val);
+    return FilterMatches(net, filter);
 }
 
-#define SCANNER_STACKSIZE       (16384 / sizeof(ULONG))
-#define SCANNER_PRIORITY         0
+/*
+    Answer S2_GETNETWORKS from the network cache with networks seen within maxAge seconds. Returns 0 if the
+    cache is older than that and the request has to wait for a scan.
+*/
+int GetCachedNetworks(struct IOSana2Req *io, ULONG maxAge)
+{
+    struct WiFiUnit *unit = (struct WiFiUnit *)io->ios2_Req.io_Unit;
+    struct WiFiBase *WiFiBase = unit->wu_Base;
+    struct ExecBase *SysBase = WiFiBase->w_SysBase;
+    struct Library *UtilityBase = WiFiBase->w_UtilityBase;
+    struct TimerBase *TimerBase = unit->wu_TimerBase;
+    struct TagItem *tags = io->ios2_StatData;
+    struct TagItem **networks = NULL;
+    struct ReplyArena arena;
+    struct WiFiNetwork *net;
+    APTR memPool = io->ios2_Data;
+    struct ScanFilter filter;
+    ULONG ieFilter = 0;
+    ULONG minSeen;
+    ULONG count = 0;
+    ULONG size = 0;
+    struct timeval now;
 
+    GetSysTime(&now);
+    minSeen = now.tv_sec > maxAge ? now.tv_sec - maxAge : 0;
 
-#define PACKET_RECV_STACKSIZE   (65536 / sizeof(ULONG))
-#define PACKET_RECV_PRIORITY    5
+    GetScanFilter(UtilityBase, tags, &filter);
+    if (tags != NULL)
+        ieFilter = GetTagData(S2INFO_IEFilter, 0, tags);
 
-#define PACKET_WAIT_DELAY_MIN   1000
-#define PACKET_WAIT_DELAY_MAX   100000
+    ObtainSemaphoreShared(&WiFiBase->w_NetworkListLock);
 
-#define PACKET_INITIAL_FETCH_SIZE   16
+    if (WiFiBase->w_NetworkListUpdated == 0 || WiFiBase->w_NetworkListUpdated < minSeen)
+    {
+        ReleaseSemaphore(&WiFiBase->w_NetworkListLock);
+        return 0;
+    }
 
-void PacketDump(struct SDIO *sdio, APTR data, char *src);
+    ForeachNode(&WiFiBase->w_NetworkList, net)
+    {
+        if (NetworkMatches(net, &filter, minSeen))
+        {
+            size += NetworkTagsSize(net, ieFilter);
+            count++;
+        }
+    }
 
-struct TagItem * FindNetwork(struct WiFiUnit *unit, struct BSSInfo *info)
-{
-    struct WiFiBase *WiFiBase = unit->wu_Base;
-    struct SDIO *sdio = WiFiBase->w_SDIO;
-    struct Library *UtilityBase = WiFiBase->w_UtilityBase;
-    struct IOSana2Req *io = unit->wu_ScanRequest;
-    struct TagItem *found = NULL;
-    struct TagItem **list = (struct TagItem **)io->ios2_StatData;
-    
-    if (list != NULL)
+    if (count)
     {
-        for (ULONG i=0; i < io->ios2_DataLength; i++)
+        size += ARENA_SIZE(count * sizeof(APTR));
+
+        if (ArenaInit(SysBase, &arena, memPool, size))
         {
-            struct TagItem *tags = list[i];
-            UBYTE *bssid;
-            UBYTE *ssid;
-            /*
-                Two networks are considered the same if:
-                - SSID is same
-                - BSSID is same
-                - Channel and band are the same
-            */
-
-            /* Check SSID */
-            ssid = (UBYTE*)GetTagData(S2INFO_SSID, 0, tags);
-            
-            /* Must not be null! */
-            if (ssid == NULL)
-                continue;
+            networks = ArenaAlloc(&arena, count * sizeof(APTR));
 
-            /* SSID length must match */
-            if (_strlen(ssid) != info->bssi_SSIDLength)
-                continue;
+            count = 0;
+            ForeachNode(&WiFiBase->w_NetworkList, net)
+            {
+                if (NetworkMatches(net, &filter, minSeen))
+                    networks[count++] = BuildNetworkTags(SysBase, &arena, net, ieFilter);
+            }
+        }
+        else
+        {
+            io->ios2_WireError = S2WERR_BUFF_ERROR;
+            io->ios2_Req.io_Error = S2ERR_NO_RESOURCES;
+            count = 0;
+        }
+    }
 
-            /* SSID must match */
-            if (_strncmp(ssid, info->bssi_SSID, info->bssi_SSIDLength) != 0)
-                continue;
+    ReleaseSemaphore(&WiFiBase->w_NetworkListLock);
 
-            /* Check BSSID */
-            bssid = (UBYTE*)GetTagData(S2INFO_BSSID, 0, tags);
+    io->ios2_StatData = networks;
+    io->ios2_DataLength = count;
 
-            /* Must not be null */
-            if (bssid == NULL)
-                continue;
-            
-            /* Must be the same */
-            if (bssid[0] != info->bssi_ID[0] ||
-                bssid[1] != info->bssi_ID[1] ||
-                bssid[2] != info->bssi_ID[2] ||
-                bssid[3] != info->bssi_ID[3] ||
-                bssid[4] != info->bssi_ID[4] ||
-                bssid[5] != info->bssi_ID[5])
-                continue;
-            
-            /* Finally, check channel */
-            struct ChannelInfo ci;
-            ci.ci_CHSpec = LE16(info->bssi_ChanSpec);
-            DecodeChanSpec(&ci, sdio->s_Chip->c_D11Type);
-
-            ULONG band = GetTagData(S2INFO_Band, -1, tags);
-            if ((ci.ci_Band == BRCMU_CHAN_BAND_2G && band != S2BAND_B) ||
-                (ci.ci_Band != BRCMU_CHAN_BAND_2G && band != S2BAND_A))
-                continue;
+    return 1;
+}
 
-            ULONG channel = GetTagData(S2INFO_Channel, 0, tags);
-            if (channel != ci.ci_CHNum)
-                continue;
+static struct JoinHint * FindJoinHint(struct WiFiUnit *unit, const UBYTE *ssid, ULONG ssidLength)
+{
+    for (int i=0; i < JOIN_HINT_COUNT; i++)
+    {
+        struct JoinHint *hint = &unit->wu_JoinHints[i];
 
-            found = tags;
-            break;
-        }
+        if (hint->jh_SSIDLength != 0 && hint->jh_SSIDLength == ssidLength &&
+            _strncmp(hint->jh_SSID, ssid, ssidLength) == 0)
+            return hint;
     }
 
-    return found;
+    return NULL;
 }
 
-void UpdateNetwork(struct WiFiUnit *unit, struct BSSInfo *info)
+/* Link is up, remember where the network was found. Chanspec is taken from the network cache */
+static void RememberJoinHint(struct WiFiUnit *unit)
 {
     struct WiFiBase *WiFiBase = unit->wu_Base;
-    struct SDIO *sdio = WiFiBase->w_SDIO;
     struct ExecBase *SysBase = WiFiBase->w_SysBase;
-    struct IOSana2Req *io = unit->wu_ScanRequest;
-    struct TagItem *net;
+    const UBYTE *ssid = unit->wu_JoinParams.ej_SSID.ssid_Value;
+    const UBYTE *bssid = unit->wu_JoinParams.ej_Assoc.ap_BSSID;
+    ULONG ssidLength = LE32(unit->wu_JoinParams.ej_SSID.ssid_Length);
+    struct JoinHint *hint;
+    struct WiFiNetwork *net;
+    UWORD chanSpec = 0;
+
+    if (ssidLength == 0 || ssidLength > 32)
+        return;
 
-    /* Ignore event if no scan request is active */
-    if (io == NULL)
+    ObtainSemaphoreShared(&WiFiBase->w_NetworkListLock);
+    ForeachNode(&WiFiBase->w_NetworkList, net)
     {
-        return;
+        if (net->wn_SSIDLength == ssidLength && _strncmp(net->wn_SSID, ssid, ssidLength) == 0 &&
+            net->wn_BSID[0] == bssid[0] && net->wn_BSID[1] == bssid[1] && net->wn_BSID[2] == bssid[2] &&
+            net->wn_BSID[3] == bssid[3] && net->wn_BSID[4] == bssid[4] && net->wn_BSID[5] == bssid[5])
+        {
+            chanSpec = net->wn_ChannelInfo.ci_CHSpec;
+            break;
+        }
     }
+    ReleaseSemaphore(&WiFiBase->w_NetworkListLock);
 
-    /* Ignore network duplicates, later maybe update them */
-    if ((net = FindNetwork(unit, info)))
+    /* Reuse slot of the same SSID or the least recently used one, then move it to front */
+    hint = FindJoinHint(unit, ssid, ssidLength);
+    if (hint == NULL)
+        hint = &unit->wu_JoinHints[JOIN_HINT_COUNT - 1];
+
+    while (hint != &unit->wu_JoinHints[0])
     {
-        return;
+        hint[0] = hint[-1];
+        hint--;
     }
 
-    /* Ignore networks with empty ssid */
-    if (info->bssi_SSIDLength == 0)
-        return;
+    hint->jh_SSIDLength = ssidLength;
+    CopyMem((APTR)ssid, hint->jh_SSID, ssidLength);
+    CopyMem((APTR)bssid, hint->jh_BSSID, 6);
+    hint->jh_ChanSpec = chanSpec;
 
-    APTR memPool = io->ios2_Data;
-    struct TagItem **networks = NULL;
-    struct TagItem *tags;
+    D(bug("[WiFi] Join hint: %02lx:%02lx:%02lx:%02lx:%02lx:%02lx, chanspec %04lx\n",
+        bssid[0], bssid[1], bssid[2], bssid[3], bssid[4], bssid[5], chanSpec));
+}
 
-    /* Increase tag list counter */
-    io->ios2_DataLength++;
+/*
+    Restrict join to the BSSID and chanspec which worked last time for this SSID. Firmware does not need to
+    search all channels then. If the join fails, it is repeated without the hint.
+*/
+BOOL ApplyJoinHint(struct WiFiUnit *unit)
+{
+    struct ExtJoinParams *jp = &unit->wu_JoinParams;
+    struct JoinHint *hint = FindJoinHint(unit, jp->ej_SSID.ssid_Value, LE32(jp->ej_SSID.ssid_Length));
 
-    /* Get memory for tag list's list */
-    networks = AllocVecPooled(memPool, 4 * io->ios2_DataLength);
-    if (networks == NULL)
-    {
-        io->ios2_WireError = S2WERR_BUFF_ERROR;
-        io->ios2_Req.io_Error = S2ERR_NO_RESOURCES;
-        unit->wu_ScanRequest = NULL;
-        ReplyMsg((struct Message *)io);
-        return;
-    }
+    unit->wu_JoinHinted = FALSE;
 
-    /* 
-        If StatData is not null, copy it now and free. After copy networks[1..] will contain
-        previous data, current network can be stored at networks[0]
-    */
-    if (io->ios2_StatData != NULL)
-    {
-        struct TagItem **src = io->ios2_StatData;
-        for (ULONG i=0; i < io->ios2_DataLength - 1; i++)
-        {
-            networks[i+1] = src[i];
-        }
-        /* Get rid of old taglist */
-        FreeVecPooled(memPool, src);
-    }
+    if (hint == NULL)
+        return FALSE;
 
-    io->ios2_StatData = networks;
-    
-    /* Get memory for TagList, maximal number is number of S2INFO_TAGS plus one */
-    tags = AllocPooled(memPool, sizeof(struct TagItem) * 16);
-    
-    if (tags == NULL)
+    for (int i=0; i < 6; i++)
+        jp->ej_Assoc.ap_BSSID[i] = hint->jh_BSSID[i];
+
+    if (hint->jh_ChanSpec != 0)
     {
-        io->ios2_WireError = S2WERR_BUFF_ERROR;
-        io->ios2_Req.io_Error = S2ERR_NO_RESOURCES;
-        unit->wu_ScanRequest = NULL;
-        ReplyMsg((struct Message *)io);
-        return;
+        jp->ej_Assoc.ap_ChanspecNum = LE32(1);
+        jp->ej_Assoc.ap_ChanSpecList[0] = LE16(hint->jh_ChanSpec);
     }
 
-    /* Ignore all tags for now */
-    for (int i=0; i < 15; i++) tags[i].ti_Tag = TAG_IGNORE;
-    
-    /* Finish with DONE tag*/
-    tags[15].ti_Tag = TAG_DONE;
-    tags[15].ti_Data = 0;
+    unit->wu_JoinHinted = TRUE;
 
-    /* Put the taglist in place */
-    networks[0] = tags;
+    return TRUE;
+}
 
-    /* All is prepared to fill the necessary info */
-    tags->ti_Tag = S2INFO_SSID;
-    tags->ti_Data = (ULONG)AllocPooledClear(memPool, info->bssi_SSIDLength + 1);
-    if (tags->ti_Data == 0)
-    {
-        io->ios2_WireError = S2WERR_BUFF_ERROR;
-        io->ios2_Req.io_Error = S2ERR_NO_RESOURCES;
-        unit->wu_ScanRequest = NULL;
-        ReplyMsg((struct Message *)io);
-        return;
-    }
-    CopyMem(info->bssi_SSID, (APTR)tags->ti_Data, info->bssi_SSIDLength);
-    tags++;
+/*
+    Look for the strongest BSS of current SSID found by the last roam scan. It has to be better than the
+    current one by at least ROAM_DELTA, so that the unit does not bounce between two similar APs.
+*/
+BOOL FindRoamCandidate(struct WiFiUnit *unit, LONG rssi, UBYTE *bssid, UWORD *chanSpec)
+{
+    struct WiFiBase *WiFiBase = unit->wu_Base;
+    struct ExecBase *SysBase = WiFiBase->w_SysBase;
+    struct ExtJoinParams *jp = &unit->wu_JoinParams;
+    ULONG ssidLength = LE32(jp->ej_SSID.ssid_Length);
+    struct WiFiNetwork *net;
+    struct WiFiNetwork *best = NULL;
 
-    tags->ti_Tag = S2INFO_BSSID;
-    tags->ti_Data = (ULONG)AllocPooled(memPool, 6);
-    if (tags->ti_Data == 0)
+    ObtainSemaphoreShared(&WiFiBase->w_NetworkListLock);
+    ForeachNode(&WiFiBase->w_NetworkList, net)
     {
-        io->ios2_WireError = S2WERR_BUFF_ERROR;
-        io->ios2_Req.io_Error = S2ERR_NO_RESOURCES;
-        unit->wu_ScanRequest = NULL;
-        ReplyMsg((struct Message *)io);
-        return;
-    }
-    CopyMem(info->bssi_ID, (APTR)tags->ti_Data, 6);
-    tags++;
+        if (net->wn_LastUpdated != 0 || net->wn_SSIDLength != ssidLength ||
+            _strncmp(net->wn_SSID, jp->ej_SSID.ssid_Value, ssidLength) != 0)
+            continue;
 
-    tags->ti_Tag = S2INFO_BeaconInterval;
-    tags->ti_Data = LE16(info->bssi_BeaconPeriod);
-    tags++;
+        if (net->wn_BSID[0] == jp->ej_Assoc.ap_BSSID[0] && net->wn_BSID[1] == jp->ej_Assoc.ap_BSSID[1] &&
+            net->wn_BSID[2] == jp->ej_Assoc.ap_BSSID[2] && net->wn_BSID[3] == jp->ej_Assoc.ap_BSSID[3] &&
+            net->wn_BSID[4] == jp->ej_Assoc.ap_BSSID[4] && net->wn_BSID[5] == jp->ej_Assoc.ap_BSSID[5])
+            continue;
 
-    tags->ti_Tag = S2INFO_Signal;
-    tags->ti_Data = (WORD)LE16(info->bssi_RSSI);
-    tags++;
+        if (net->wn_RSSI < rssi + ROAM_DELTA)
+            continue;
 
-    if (info->bssi_PHYNoise != 0)
-    {
-        tags->ti_Tag = S2INFO_Noise;
-        tags->ti_Data = (BYTE)info->bssi_PHYNoise;
-        tags++;
+        if (best == NULL || net->wn_RSSI > best->wn_RSSI)
+            best = net;
     }
 
-    if (info->bssi_IELength)
+    if (best != NULL)
     {
-        UWORD length = LE32(info->bssi_IELength);
-        UWORD *data = AllocPooled(memPool, length + 2);
-        if (data == NULL)
-        {
-            io->ios2_WireError = S2WERR_BUFF_ERROR;
-            io->ios2_Req.io_Error = S2ERR_NO_RESOURCES;
-            unit->wu_ScanRequest = NULL;
-            ReplyMsg((struct Message *)io);
-            return;
-        }
-
-        *data = length;
-        CopyMem(&((UBYTE*)info)[LE16(info->bssi_IEOffset)], data + 1, length);
-        
-        tags->ti_Tag = S2INFO_InfoElements;
-        tags->ti_Data = (ULONG)data;
-        tags++;
+        CopyMem(best->wn_BSID, bssid, 6);
+        *chanSpec = best->wn_ChannelInfo.ci_CHSpec;
     }
+    ReleaseSemaphore(&WiFiBase->w_NetworkListLock);
+
+    return best != NULL;
+}
+
+static void RetryJoinWithoutHint(struct WiFiUnit *unit)
+{
+    struct WiFiBase *WiFiBase = unit->wu_Base;
+    struct ExtJoinParams *jp = &unit->wu_JoinParams;
+    struct JoinHint *hint = FindJoinHint(unit, jp->ej_SSID.ssid_Value, LE32(jp->ej_SSID.ssid_Length));
+
+    /* Hint is stale, drop it */
+    if (hint != NULL)
+        hint->jh_SSIDLength = 0;
 
-    tags->ti_Tag = S2INFO_Capabilities;
-    tags->ti_Data = LE16(info->bssi_Capability);
-    tags++;
+    for (int i=0; i < 6; i++)
+        jp->ej_Assoc.ap_BSSID[i] = 0xff;
 
-    struct ChannelInfo ci;
-    ci.ci_CHSpec = LE16(info->bssi_ChanSpec);
-    DecodeChanSpec(&ci, sdio->s_Chip->c_D11Type);
+    jp->ej_Assoc.ap_ChanspecNum = 0;
+    jp->ej_Assoc.ap_ChanSpecList[0] = 0;
 
-    tags->ti_Tag = S2INFO_Channel;
-    tags->ti_Data = ci.ci_CHNum;
-    tags++;
+    unit->wu_JoinHinted = FALSE;
 
-    tags->ti_Tag = S2INFO_Band;
-    tags->ti_Data = ci.ci_Band == BRCMU_CHAN_BAND_2G ? S2BAND_B : S2BAND_A;
-    tags++;
+    PacketSetVarAsync(WiFiBase->w_SDIO, "join", jp, sizeof(struct ExtJoinParams));
 }
 
 void ProcessEvent(struct SDIO *sdio, struct PacketEvent *pe)
@@ -588,120 +1354,160 @@ void ProcessEvent(struct SDIO *sdio, struct PacketEvent *pe)
 
     // pe is in network (BigEndian) order!
     // BUT! pe data is native (LittleEndian) order!
-    switch (pe->e_EventType)
+    ULONG eventType = BE32(pe->e_EventType);
+    ULONG status = BE32(pe->e_Status);
+    ULONG reason = BE32(pe->e_Reason);
+    ULONG dataLen = BE32(pe->e_DataLen);
+
+    switch (eventType)
     {
         case BRCMF_E_ESCAN_RESULT:
         {
             struct EScanResult *escan = (APTR)((ULONG)pe + sizeof(struct PacketEvent));
             //D(bug("[WiFi] EScan result. Length %ld, BSS count %ld\n", LE32(escan->esr_Length), LE16(escan->esr_BSSCount)));
-            
+
+            if (dataLen < sizeof(struct EScanResult))
+                break;
+
             if (escan->esr_BSSCount == LE16(0))
             {
-                // Scan complete
-                if (unit->wu_ScanRequest)
+                // Scan complete. In incremental mode without waiting request the rest is taken by next one
+                if (unit->wu_ScanActive && unit->wu_ScanIncremental && unit->wu_ScanRequest == NULL)
+                    unit->wu_ScanFinished = TRUE;
+                else
+                    CompleteScan(unit);
+                //D(bug("[WiFi] EScan complete\n"));
+            }
+
+            if (escan->esr_BSSCount != LE16(0) && unit->wu_ScanActive)
+            {
+                UBYTE *info = (UBYTE *)escan->esr_BSSInfo;
+                ULONG left = dataLen - sizeof(struct EScanResult);
+                ULONG size = 0;
+                ULONG length;
+
+                for (int i=0; i < LE16(escan->esr_BSSCount); i++)
                 {
-                    ReplyMsg((struct Message *)unit->wu_ScanRequest);
-                    unit->wu_ScanRequest = NULL;
+                    if ((length = BSSInfoLength((APTR)info, left)) == 0)
+                        break;
+
+                    size += (sizeof(struct WiFiNetwork) + LE32(((struct BSSInfo *)info)->bssi_IELength) + 3) & ~3;
+                    info += length;
+                    left -= length;
                 }
-                //D(bug("[WiFi] EScan complete\n"));
+
+                ReserveScanChunk(unit, size);
             }
 
-            for (int i=0; i < LE16(escan->esr_BSSCount); i++)
             {
-                UpdateNetwork(unit, &escan->esr_BSSInfo[i]);
+                UBYTE *info = (UBYTE *)escan->esr_BSSInfo;
+                ULONG left = dataLen - sizeof(struct EScanResult);
+                ULONG length;
+
+                // A malformed entry is dropped together with the rest, there is no telling where the next one starts
+                for (int i=0; i < LE16(escan->esr_BSSCount); i++)
+                {
+                    if ((length = BSSInfoLength((APTR)info, left)) == 0)
+                    {
+                        LOG(base, LOG_WARN, "[WiFi] Dropping malformed BSS info %ld of %ld\n", i, LE16(escan->esr_BSSCount));
+                        break;
+                    }
+
+                    UpdateNetwork(unit, (struct BSSInfo *)info);
+                    info += length;
+                    left -= length;
+                }
             }
+
+            // Incremental mode, pass new networks to the waiting request right away
+            if (unit->wu_ScanIncremental && unit->wu_ScanRequest != NULL && unit->wu_ScanCount > unit->wu_ScanDelivered)
+                DeliverScanResults(unit, FALSE);
             break;
         }
 
         case BRCMF_E_ASSOC:
-            D(bug("[WiFi] E_ASSOC\n"));
+            LOG(base, LOG_DEBUG, "[WiFi] E_ASSOC\n");
             if (unit->wu_AssocIE) FreeVecPooled(base->w_MemPool, unit->wu_AssocIE);
             unit->wu_AssocIE = NULL;
-            unit->wu_AssocIELength = pe->e_DataLen;
+            unit->wu_AssocIELength = dataLen;
             if (unit->wu_AssocIELength)
             {
-                unit->wu_AssocIE = AllocVecPooled(base->w_MemPool, pe->e_DataLen);
+                unit->wu_AssocIE = AllocVecPooled(base->w_MemPool, dataLen);
                 if (unit->wu_AssocIE != NULL)
                 {
-                    CopyMem(((UBYTE*)pe) + sizeof(struct PacketEvent), unit->wu_AssocIE, pe->e_DataLen);
+                    CopyMem(((UBYTE*)pe) + sizeof(struct PacketEvent), unit->wu_AssocIE, dataLen);
                 }
             }
             CopyMem(&pe->e_Address, unit->wu_JoinParams.ej_Assoc.ap_BSSID, 6);
             break;
         
         case BRCMF_E_AUTH:
-            D(bug("[WiFi] E_AUTH "));
-            if (pe->e_Status == 0) {
-                D(bug("OK\n"));
-            }
+            if (status == 0)
+                LOG(base, LOG_INFO, "[WiFi] E_AUTH OK\n");
             else
-            {
-                D(bug("Failed with reason %08lx\n", pe->e_Reason));
-            }
+                LOG(base, LOG_WARN, "[WiFi] E_AUTH failed with reason %08lx\n", reason);
             break;
 
         case BRCMF_E_DISASSOC:
-            D(bug("[WiFi] E_DISASSOC\n"));
+            LOG(base, LOG_INFO, "[WiFi] E_DISASSOC\n");
+            LOG_HEX(base, LOG_DEBUG, "[WiFi]  %04lx: %08lx %08lx %08lx %08lx\n", (UBYTE *)pe, sizeof(struct PacketEvent) + dataLen);
+            break;
+        
+        case BRCMF_E_REASSOC:
+            LOG(base, LOG_INFO, "[WiFi] E_REASSOC\n");
+            if (unit->wu_Roam.rs_State == ROAM_REASSOC)
             {
-                UBYTE *p = (APTR)pe;
-                for (ULONG i=0; i < sizeof(struct PacketEvent) + pe->e_DataLen; i++)
+                if (status == 0)
                 {
-                    if (i % 16 == 0)
-                    bug("[WiFI]  ");
-                    bug(" %02lx", p[i]);
-                    if (i % 16 == 15)
-                        bug("\n");
+                    unit->wu_Roam.rs_Roams++;
+                    unit->wu_Roam.rs_RSSI = 0;
+                    unit->wu_Roam.rs_LowCount = 0;
+                    CopyMem(&pe->e_Address, unit->wu_JoinParams.ej_Assoc.ap_BSSID, 6);
+                    RememberJoinHint(unit);
                 }
-                if ((sizeof(struct PacketEvent) + pe->e_DataLen) % 16)
-                    bug("\n");
+                unit->wu_Roam.rs_State = ROAM_IDLE;
             }
+            LOG_HEX(base, LOG_DEBUG, "[WiFi]  %04lx: %08lx %08lx %08lx %08lx\n", (UBYTE *)pe, sizeof(struct PacketEvent) + dataLen);
             break;
-        
-        case BRCMF_E_REASSOC:
-            D(bug("[WiFi] E_REASSOC\n"));
+
+        case BRCMF_E_SET_SSID:
+            if (status == 0)
             {
-                UBYTE *p = (APTR)pe;
-                for (ULONG i=0; i < sizeof(struct PacketEvent) + pe->e_DataLen; i++)
+                LOG(base, LOG_INFO, "[WiFi] E_SET_SSID OK\n");
+            }
+            else
+            {
+                LOG(base, LOG_WARN, "[WiFi] E_SET_SSID failed with status %ld\n", status);
+                if (unit->wu_JoinHinted)
                 {
-                    if (i % 16 == 0)
-                    bug("[WiFI]  ");
-                    bug(" %02lx", p[i]);
-                    if (i % 16 == 15)
-                        bug("\n");
+                    LOG(base, LOG_INFO, "[WiFi] Retrying join on all channels\n");
+                    RetryJoinWithoutHint(unit);
                 }
-                if ((sizeof(struct PacketEvent) + pe->e_DataLen) % 16)
-                    bug("\n");
             }
             break;
 
         case BRCMF_E_LINK:
-            if (pe->e_Reason)
+            if (reason)
             {
-                D(bug("[WiFi] E_LINK down\n"));
+                LOG(base, LOG_INFO, "[WiFi] E_LINK down\n");
                 unit->wu_Flags &= ~IFF_CONNECTED;
+                unit->wu_Roam.rs_RSSI = 0;
+                unit->wu_Roam.rs_LowCount = 0;
                 ReportEvents(unit, S2EVENT_DISCONNECT);
             }
             else
             {
-                D(bug("[WiFi] E_LINK up\n"));
+                LOG(base, LOG_INFO, "[WiFi] E_LINK up\n");
                 unit->wu_Flags |= IFF_CONNECTED;
+                unit->wu_JoinHinted = FALSE;
+                RememberJoinHint(unit);
                 ReportEvents(unit, S2EVENT_CONNECT);
             }
             break;
 
         default:
-            D(bug("[WiFi] Unhandled event type %ld, status %08lx, reason %08lx\n", pe->e_EventType, pe->e_Status, pe->e_Reason));
-            UBYTE *p = (APTR)pe;
-            for (ULONG i=0; i < sizeof(struct PacketEvent) + pe->e_DataLen; i++)
-            {
-                if (i % 16 == 0)
-                bug("[WiFI]  ");
-                bug(" %02lx", p[i]);
-                if (i % 16 == 15)
-                    bug("\n");
-            }
-            if ((sizeof(struct PacketEvent) + pe->e_DataLen) % 16)
-                bug("\n");
+            LOG(base, LOG_DEBUG, "[WiFi] Unhandled event type %ld, status %08lx, reason %08lx\n", eventType, status, reason);
+            LOG_HEX(base, LOG_DEBUG, "[WiFi]  %04lx: %08lx %08lx %08lx %08lx\n", (UBYTE *)pe, sizeof(struct PacketEvent) + dataLen);
             break;
     }
 }
@@ -768,49 +1574,220 @@ ULONG ProcessPacket(struct SDIO *sdio, struct Packet *pkt)
                         }
                     }
 
-                    // Reply back to sender
-                    ReplyMsg(&m->pm_Message);
-                    break;
-                }
-            }
-            break;
-        }
+                    if (sdio->s_WiFiBase->w_Unit)
+                        sdio->s_WiFiBase->w_Unit->wu_SpecialStats[SS_CTRL_RTT + LatencyBucket(timer_us() - m->pm_SentTime)]++;
+
+                    // Reply back to sender
+                    ReplyMsg(&m->pm_Message);
+                    break;
+                }
+            }
+            break;
+        }
+
+        case SDPCM_EVENT_CHANNEL:
+        {
+            struct PacketEvent *pe = (APTR)&buffer[pkt->c_DataOffset + 4];
+            ULONG eventLength = pktLen > pkt->c_DataOffset + 4 ? pktLen - pkt->c_DataOffset - 4 : 0;
+
+            // Event data has to be in the frame, ProcessEvent trusts e_DataLen
+            if (eventLength >= sizeof(struct PacketEvent) &&
+                BE32(pe->e_DataLen) <= eventLength - sizeof(struct PacketEvent))
+            {
+                if (BE16(pe->e_EthHeader.eh_Type) == ETHERHDR_TYPE_LINK_CTL && 
+                    pe->e_Header.beh_OUI[0] == 0x00 && 
+                    pe->e_Header.beh_OUI[1] == 0x10 && 
+                    pe->e_Header.beh_OUI[2] == 0x18)
+                {
+                    if (BE16(pe->e_Header.beh_UsrSubtype) == BCMETHHDR_SUBTYPE_EVENT)
+                    {
+                        ProcessEvent(sdio, pe);
+                    }
+                }
+            }
+            break;
+        }
+        
+        case SDPCM_DATA_CHANNEL:
+        {
+            UBYTE *frame = (APTR)&buffer[pkt->c_DataOffset + 4];
+            ULONG frameLength = pktLen - pkt->c_DataOffset - 4;
+
+            ProcessDataPacket(sdio, frame, frameLength);
+
+            break;
+        }
+    }
+
+    return pktLen;
+}
+
+int SendGlomDataPacket(struct SDIO *sdio, struct IOSana2Req **ioList, UBYTE count);
+static void StartRoamScan(struct WiFiUnit *unit);
+
+static inline BOOL PortEmpty(struct MsgPort *port)
+{
+    return ((struct MinList *)&port->mp_MsgList)->mlh_Head->mln_Succ == NULL;
+}
+
+/* Queued request can be answered from the scan in flight if that scan covers all networks the request asks for */
+static BOOL CanRideScan(struct WiFiUnit *unit, struct IOSana2Req *io)
+{
+    struct Library *UtilityBase = unit->wu_Base->w_UtilityBase;
+    struct TagItem *tags = io->ios2_StatData;
+    UBYTE *ssid;
+
+    if (unit->wu_ScanLimited)
+        return FALSE;
+
+    if (tags != NULL && FindTagItem(S2INFO_Incremental, tags) != NULL)
+        return FALSE;
+
+    if (unit->wu_ScanSSIDLength == 0)
+        return TRUE;
+
+    ssid = tags ? (UBYTE *)GetTagData(S2INFO_SSID, 0, tags) : NULL;
+
+    return ssid != NULL && _strlen(ssid) == unit->wu_ScanSSIDLength &&
+            _strncmp(ssid, unit->wu_ScanSSID, unit->wu_ScanSSIDLength) == 0;
+}
+
+/* Move requests which can share the scan in flight from scan queue to riders, keeping the order of the others */
+static void CoalesceScanRequests(struct WiFiUnit *unit)
+{
+    struct ExecBase *SysBase = unit->wu_Base->w_SysBase;
+    struct IOSana2Req *io, *next;
+    struct MinList riders;
+
+    if (PortEmpty(unit->wu_ScanQueue))
+        return;
+
+    _NewList((struct List *)&riders);
+
+    Disable();
+    ForeachNodeSafe(&unit->wu_ScanQueue->mp_MsgList, io, next)
+    {
+        if (CanRideScan(unit, io))
+        {
+            Remove((struct Node *)io);
+            AddTail((struct List *)&riders, (struct Node *)io);
+        }
+    }
+    Enable();
+
+    while ((io = (struct IOSana2Req *)RemHead((struct List *)&riders)))
+    {
+        LOG(unit->wu_Base, LOG_DEBUG, "[WiFi.RECV] Request %08lx joins scan in flight\n", (ULONG)io);
+        PutMsg(unit->wu_ScanRiders, (struct Message *)io);
+    }
+}
+
+/*
+    Start a scan if anything waits for one. Requests coming within SCAN_MIN_INTERVAL after a full scan are
+    answered with its results instead. Otherwise the scan waits until transmit was idle for SCAN_TX_IDLE,
+    but no longer than SCAN_MAX_DEFER.
+*/
+static void ScheduleScan(struct WiFiUnit *unit)
+{
+    struct WiFiBase *WiFiBase = unit->wu_Base;
+    struct ExecBase *SysBase = WiFiBase->w_SysBase;
+    struct Library *UtilityBase = WiFiBase->w_UtilityBase;
+    struct IOSana2Req *io;
+    ULONG now = timer_us();
+    BOOL recent = unit->wu_ScanEnded != 0 && (now - unit->wu_ScanEnded) < SCAN_MIN_INTERVAL;
+
+    if (recent && unit->wu_ScanWasFull)
+    {
+        ULONG maxAge = (now - unit->wu_ScanEnded) / 1000000 + 2;
 
-        case SDPCM_EVENT_CHANNEL:
+        while ((io = (struct IOSana2Req *)GetMsg(unit->wu_ScanContinue)) ||
+               (io = (struct IOSana2Req *)GetMsg(unit->wu_ScanQueue)))
         {
-            struct PacketEvent *pe = (APTR)&buffer[pkt->c_DataOffset + 4];
+            if (!GetCachedNetworks(io, maxAge))
+            {
+                StartNetworkScan(unit, io);
+                return;
+            }
 
-            if ((ULONG)(pkt->p_Length - pkt->c_DataOffset) >= sizeof(struct PacketEvent))
+            if (io->ios2_StatData != NULL)
             {
-                if (pe->e_EthHeader.eh_Type == ETHERHDR_TYPE_LINK_CTL && 
-                    pe->e_Header.beh_OUI[0] == 0x00 && 
-                    pe->e_Header.beh_OUI[1] == 0x10 && 
-                    pe->e_Header.beh_OUI[2] == 0x18)
-                {
-                    if (pe->e_Header.beh_UsrSubtype == BCMETHHDR_SUBTYPE_EVENT)
-                    {
-                        ProcessEvent(sdio, pe);
-                    }
-                }
+                ULONG *done = (ULONG *)GetTagData(S2INFO_Incremental, 0, io->ios2_StatData);
+                if (done)
+                    *done = TRUE;
             }
-            break;
+
+            ReplyMsg((struct Message *)io);
         }
-        
-        case SDPCM_DATA_CHANNEL:
-        {
-            UBYTE *frame = (APTR)&buffer[pkt->c_DataOffset + 4];
-            ULONG frameLength = pktLen - pkt->c_DataOffset - 4;
 
-            ProcessDataPacket(sdio, frame, frameLength);
+        /* Cache was just refreshed */
+        unit->wu_ScanRefresh = FALSE;
+    }
 
-            break;
-        }
+    if (PortEmpty(unit->wu_ScanContinue) && PortEmpty(unit->wu_ScanQueue) && !unit->wu_ScanRefresh &&
+        unit->wu_Roam.rs_State != ROAM_SCAN_PENDING)
+    {
+        unit->wu_ScanWaiting = FALSE;
+        return;
     }
 
-    return pktLen;
+    if (!unit->wu_ScanWaiting)
+    {
+        unit->wu_ScanWaiting = TRUE;
+        unit->wu_ScanWaitStart = now;
+    }
+
+    if (recent)
+        return;
+
+    if ((now - unit->wu_LastTX) < SCAN_TX_IDLE && (now - unit->wu_ScanWaitStart) < SCAN_MAX_DEFER)
+        return;
+
+    unit->wu_ScanWaiting = FALSE;
+
+    io = (struct IOSana2Req *)GetMsg(unit->wu_ScanContinue);
+    if (io == NULL)
+        io = (struct IOSana2Req *)GetMsg(unit->wu_ScanQueue);
+
+    if (io || unit->wu_ScanRefresh)
+    {
+        StartNetworkScan(unit, io);
+    }
+    else if (unit->wu_Roam.rs_State == ROAM_SCAN_PENDING)
+    {
+        StartRoamScan(unit);
+    }
 }
 
-int SendGlomDataPacket(struct SDIO *sdio, struct IOSana2Req **ioList, UBYTE count);
+/* Complete control message with an error, used when firmware does not answer or receiver is gone */
+static void FailCtrlMessage(struct PacketMessage *m)
+{
+    struct PacketCmd *c = m->pm_PacketData;
+
+    c->c_Flags |= LE16(BCDC_DCMD_ERROR);
+    c->c_Status = LE32(-CTRL_ERROR_DOWN);
+}
+
+/*
+    Pass control message to the receiver and wait for the reply. Replies are bounded by CTRL_TIMEOUT in the
+    receiver. If the receiver is not running, the message is failed at once.
+*/
+static void CtrlRoundTrip(struct SDIO *sdio, struct PacketMessage *m)
+{
+    struct ExecBase *SysBase = sdio->s_SysBase;
+
+    Forbid();
+    if (sdio->s_ReceiverPort == NULL)
+    {
+        Permit();
+        FailCtrlMessage(m);
+        return;
+    }
+    PutMsg(sdio->s_ReceiverPort, &m->pm_Message);
+    Permit();
+
+    WaitPort(m->pm_Message.mn_ReplyPort);
+    GetMsg(m->pm_Message.mn_ReplyPort);
+}
 
 void PacketReceiver(struct SDIO *sdio, struct Task *caller)
 {
@@ -895,6 +1872,7 @@ void PacketReceiver(struct SDIO *sdio, struct Task *caller)
         if (sigSet & (1 << ctrl->mp_SigBit))
         {
             struct PacketMessage *msg;
+            ULONG waiting = 0;
 
             // Repeat until we run out of the messages
             while(msg = (struct PacketMessage *)GetMsg(ctrl))
@@ -903,8 +1881,18 @@ void PacketReceiver(struct SDIO *sdio, struct Task *caller)
                 AddTail((struct List*)&ctrlWaitList, &msg->pm_Message.mn_Node);
 
                 // Send out the control packet
+                msg->pm_SentTime = timer_us();
                 sdio->SendPKT((APTR)&msg->pm_PacketHeader[0], LE16(msg->pm_PacketHeader[0].p_Length), sdio);
             }
+
+            if (WiFiBase->w_Unit)
+            {
+                ForeachNode(&ctrlWaitList, msg)
+                    waiting++;
+
+                if (waiting > WiFiBase->w_Unit->wu_SpecialStats[SS_CTRL_QUEUE_PEAK])
+                    WiFiBase->w_Unit->wu_SpecialStats[SS_CTRL_QUEUE_PEAK] = waiting;
+            }
         }
 
         // Always check if there are data packets for sending
@@ -913,10 +1901,15 @@ void PacketReceiver(struct SDIO *sdio, struct Task *caller)
             struct IOSana2Req *ioList[32];
             struct IOSana2Req *msg;
             ULONG ioCount = 0;
+            ULONG drained = 0;
             UBYTE maxCount;
 
             maxCount = sdio->s_MaxTXSeq - sdio->s_TXSeq;
-            
+
+            /* Control frames do not wait for the window. If they went past maxseq, the window is closed, not wrapped */
+            if (maxCount & 0x80)
+                maxCount = 0;
+
             /* Make sure we have place in TX */
             if (maxCount)
             {
@@ -927,6 +1920,7 @@ void PacketReceiver(struct SDIO *sdio, struct Task *caller)
 
                     // Put the packet into an array. It will be used later to construct Glom frame
                     ioList[ioCount++] = msg;
+                    drained++;
 
                     if (--maxCount == 0)
                     {
@@ -974,17 +1968,46 @@ void PacketReceiver(struct SDIO *sdio, struct Task *caller)
                     }
                     */
                 }
+
+                if (WiFiBase->w_Unit && drained > WiFiBase->w_Unit->wu_SpecialStats[SS_TX_PASS_PEAK])
+                    WiFiBase->w_Unit->wu_SpecialStats[SS_TX_PASS_PEAK] = drained;
             }
         }
 
-        /* If no scan request is in progress start another one (if needed) */
-        if (WiFiBase->w_Unit && WiFiBase->w_Unit->wu_ScanRequest == NULL)
+        if (WiFiBase->w_Unit)
         {
-            struct IOSana2Req *io = (struct IOSana2Req *)GetMsg(WiFiBase->w_Unit->wu_ScanQueue);
-            if (io)
+            struct WiFiUnit *unit = WiFiBase->w_Unit;
+
+            /* Firmware did not finish the scan in time, give up with whatever was found */
+            if (unit->wu_ScanActive && (timer_us() - unit->wu_ScanStarted) > SCAN_TIMEOUT)
             {
-                StartNetworkScan(io);
+                LOG(WiFiBase, LOG_WARN, "[WiFi.RECV] Scan timed out\n");
+                CompleteScan(unit);
+            }
+
+            /* Follow-up request of incremental scan. Reply at once if there is anything new for it */
+            if (unit->wu_ScanActive && unit->wu_ScanIncremental && unit->wu_ScanRequest == NULL)
+            {
+                struct IOSana2Req *io = (struct IOSana2Req *)GetMsg(unit->wu_ScanContinue);
+                if (io)
+                {
+                    unit->wu_ScanRequest = io;
+
+                    if (unit->wu_ScanFinished)
+                        CompleteScan(unit);
+                    else if (unit->wu_ScanCount > unit->wu_ScanDelivered)
+                        DeliverScanResults(unit, FALSE);
+                }
             }
+
+            if (sendTransfer)
+                unit->wu_LastTX = timer_us();
+
+            /* Requests queued while scan is in flight take its results, otherwise start another scan if needed */
+            if (unit->wu_ScanActive)
+                CoalesceScanRequests(unit);
+            else
+                ScheduleScan(unit);
         }
 
         // Signal from timer.device or from control message port?
@@ -1009,6 +2032,9 @@ void PacketReceiver(struct SDIO *sdio, struct Task *caller)
                 {
                     WaitIO(&tr->tr_node);
                 }
+
+                if (WiFiBase->w_Unit)
+                    WiFiBase->w_Unit->wu_SpecialStats[gotTransfer ? SS_POLL_DATA : SS_POLL_IDLE]++;
             
                 if (gotTransfer || sendTransfer)
                 {
@@ -1042,6 +2068,12 @@ void PacketReceiver(struct SDIO *sdio, struct Task *caller)
                 
                 if ((pktChk | pktLen) == 0xffff)
                 {
+                    ULONG frames = 1;
+                    PROFILE_BEGIN(rxStart);
+
+                    if (WiFiBase->w_Unit)
+                        WiFiBase->w_Unit->wu_RXStart = timer_us();
+
                     // Until now we have fetched PACKET_INITIAL_FETCH_SIZE bytes only. If packet length is larger, fetch 
                     // the rest now
                     if (pktLen > PACKET_INITIAL_FETCH_SIZE)
@@ -1067,20 +2099,27 @@ void PacketReceiver(struct SDIO *sdio, struct Task *caller)
 
                                 if (processed == 0)
                                 {
-                                    D(bug("[WiFi] Last glom element\n"));
+                                    LOG(WiFiBase, LOG_DEBUG, "[WiFi] Last glom element\n");
                                     break;
                                 }
                                 else if (processed == 0xffffffff)
                                 {
-                                    D(bug("[WiFi] Frame error\n"));
+                                    LOG(WiFiBase, LOG_WARN, "[WiFi] Frame error\n");
                                     break;
                                 }
                                 else
                                 {
                                     pos += processed;
                                     pos = (pos + 3) & ~3;
+                                    frames++;
                                 }
                             }
+
+                            if (WiFiBase->w_Unit)
+                            {
+                                WiFiBase->w_Unit->wu_SpecialStats[SS_RX_GLOM_FRAMES]++;
+                                WiFiBase->w_Unit->wu_SpecialStats[SS_RX_GLOM_PACKETS] += frames - 1;
+                            }
                         }
                     }
                     else
@@ -1088,24 +2127,38 @@ void PacketReceiver(struct SDIO *sdio, struct Task *caller)
                         ProcessPacket(sdio, pkt);
                     }
 
+                    PROFILE_END(RXProfile, rxStart, frames, pktLen);
+                    (void)frames;
+
                     // Mark that we have the transfer, we will wait for next one a bit shorter
                     gotTransfer = 1;
                 }
                 else
                 {
-                    D(bug("[WiFi.RECV] Garbage received. Data:\n"));
-                    for (int i=0; i < 256; i++)
-                    {
-                        if (i % 16 == 0)
-                            bug("[WiFi]  ");
-                        bug(" %02lx", buffer[i]);
-                        if (i % 16 == 15)
-                            bug("\n");
-                    }
+                    LOG(WiFiBase, LOG_WARN, "[WiFi.RECV] Garbage received. Data:\n");
+                    LOG_HEX(WiFiBase, LOG_WARN, "[WiFi]  %04lx: %08lx %08lx %08lx %08lx\n", buffer, 256);
                 }
             }
         }
 
+        UpdateProfile(SysBase);
+
+        // Fail control messages the firmware did not answer in time. Wait list is ordered by send time
+        {
+            struct PacketMessage *m;
+            ULONG now = timer_us();
+
+            while ((m = (struct PacketMessage *)ctrlWaitList.mlh_Head)->pm_Message.mn_Node.ln_Succ != NULL &&
+                   now - m->pm_SentTime > CTRL_TIMEOUT)
+            {
+                LOG(WiFiBase, LOG_WARN, "[WiFi.RECV] Control message %ld timed out\n", LE16(((struct PacketCmd *)m->pm_PacketData)->c_ID));
+                Remove(&m->pm_Message.mn_Node);
+                FailCtrlMessage(m);
+                ReplyMsg(&m->pm_Message);
+                sdio->s_CtrlTimeouts++;
+            }
+        }
+
         // Shutdown signal?
         if (sigSet & SIGBREAKF_CTRL_C)
         {
@@ -1121,7 +2174,32 @@ void PacketReceiver(struct SDIO *sdio, struct Task *caller)
     CloseDevice(&tr->tr_node);
     DeleteIORequest(&tr->tr_node);
     DeleteMsgPort(port);
+
+    // No new control messages from now on. Fail the ones which are queued or waiting for reply
+    Forbid();
+    sdio->s_ReceiverPort = NULL;
+    sdio->s_CtrlWaitList = NULL;
+    Permit();
+
+    {
+        struct PacketMessage *m;
+
+        while ((m = (struct PacketMessage *)GetMsg(ctrl)))
+        {
+            FailCtrlMessage(m);
+            ReplyMsg(&m->pm_Message);
+        }
+
+        while ((m = (struct PacketMessage *)RemHead((struct List *)&ctrlWaitList)))
+        {
+            FailCtrlMessage(m);
+            ReplyMsg(&m->pm_Message);
+        }
+    }
+
     DeleteMsgPort(ctrl);
+
+    D(bug("[WiFi.RECV] Receiver used %ld of %ld bytes of stack\n", StackUsed(sdio->s_ReceiverTask), PACKET_RECV_STACKSIZE * sizeof(ULONG)));
     sdio->s_ReceiverTask = NULL;
 }
 
@@ -1137,7 +2215,7 @@ void CopyPacket(struct IOSana2Req *io, UBYTE *packet, ULONG packetLength)
     UBYTE *copyData;
     ULONG copyLength;
 
-    UWORD type = *(UWORD*)&packet[12];
+    UWORD type = BE16(*(UWORD*)&packet[12]);
 
     /* Clear broadcast and multicast flags */
     io->ios2_Req.io_Flags &= ~(SANA2IOF_BCAST | SANA2IOF_MCAST);
@@ -1200,7 +2278,7 @@ void CopyPacket(struct IOSana2Req *io, UBYTE *packet, ULONG packetLength)
         }
         else
         {
-            D(bug("[WiFi] Received frame without data\n"));
+            LOG(WiFiBase, LOG_DEBUG, "[WiFi] Received frame without data\n");
         }
 
         /* Set number of bytes received */
@@ -1210,6 +2288,8 @@ void CopyPacket(struct IOSana2Req *io, UBYTE *packet, ULONG packetLength)
         Remove((struct Node *)io);
         Enable();
         ReplyMsg((struct Message *)io);
+
+        unit->wu_SpecialStats[SS_RX_LATENCY + LatencyBucket(timer_us() - unit->wu_RXStart)]++;
     }
 }
 
@@ -1219,27 +2299,16 @@ void ProcessDataPacket(struct SDIO *sdio, UBYTE *packet, ULONG packetLength)
     struct ExecBase *SysBase = WiFiBase->w_SysBase;
     struct WiFiUnit *unit = WiFiBase->w_Unit;
     int accept = TRUE;
-    UWORD packetType = *(UWORD*)&packet[12];
+    UWORD packetType = BE16(*(UWORD*)&packet[12]);
 
     // Get destination address and check if it is a multicast
-    uint64_t destAddr = ((uint64_t)*(UWORD*)&packet[0] << 32) |
-                        *(ULONG*)&packet[2];
-#if 1
+    uint64_t destAddr = ((uint64_t)BE16(*(UWORD*)&packet[0]) << 32) |
+                        BE32(*(ULONG*)&packet[2]);
     if (packetType == 0x888e)
     {
-        struct ExecBase *SysBase = WiFiBase->w_SysBase;
-        bug("[DATA.IN] Packet in:\n");
-        for (ULONG i=0; i < packetLength; i++)
-        {
-            if (i % 16 == 0)
-                bug("[DATA.IN] %04lx: ", i);
-            bug(" %02lx", packet[i]);
-            if (i % 16 == 15)
-                bug("\n");
-        }
-        if (packetLength % 16 != 0) bug("\n");
+        LOG(WiFiBase, LOG_DEBUG, "[DATA.IN] Packet in, %ld bytes:\n", packetLength);
+        LOG_HEX(WiFiBase, LOG_DEBUG, "[DATA.IN] %04lx: %08lx %08lx %08lx %08lx\n", packet, packetLength);
     }
-#endif
 
     if (destAddr != 0xffffffffffffULL && (destAddr & 0x010000000000ULL))
     {
@@ -1262,6 +2331,7 @@ void ProcessDataPacket(struct SDIO *sdio, UBYTE *packet, ULONG packetLength)
         struct Opener *opener;
 
         unit->wu_Stats.PacketsReceived++;
+        unit->wu_SpecialStats[SS_RX_BYTES] += packetLength;
 
         Disable();
         /* Go through all openers */
@@ -1346,6 +2416,7 @@ int SendGlomDataPacket(struct SDIO *sdio, struct IOSana2Req **ioList, UBYTE coun
     struct ExecBase *SysBase = sdio->s_SysBase;
     struct WiFiUnit *unit = WiFiBase->w_Unit;
     ULONG totalLength = 0;
+    PROFILE_BEGIN(txStart);
 
     struct PacketHeaderHW *pktBase = sdio->s_TXBuffer;
     UBYTE *byteBuffer = sdio->s_TXBuffer;
@@ -1405,7 +2476,7 @@ int SendGlomDataPacket(struct SDIO *sdio, struct IOSana2Req **ioList, UBYTE coun
             for (int i=0; i < 6; i++) ptr[6 + i] = unit->wu_EtherAddr[i];
 
             // Copy packet type
-            *(UWORD*)&ptr[12] = io->ios2_PacketType;
+            *(UWORD*)&ptr[12] = BE16(io->ios2_PacketType);
             ptr+=14;
         }
 
@@ -1416,27 +2487,17 @@ int SendGlomDataPacket(struct SDIO *sdio, struct IOSana2Req **ioList, UBYTE coun
         }
         else
         {
-            D(bug("[WiFi] Sending Frame without data, packet type %04lx\n", io->ios2_PacketType));
+            LOG(WiFiBase, LOG_DEBUG, "[WiFi] Sending Frame without data, packet type %04lx\n", io->ios2_PacketType);
         }
 
-#if 1
         if (io->ios2_PacketType == 0x888e)
         {
             UBYTE *ptr = (UBYTE *)hdr + sizeof(struct PacketHeaderSW) + 4;
             ULONG length = packetLength - sizeof(struct Packet) - sizeof(struct GlomHeader) - 4;
 
-            bug("[DATA.OUT] Packet out:\n");
-            for (ULONG i=0; i < length; i++)
-            {
-                if (i % 16 == 0)
-                    bug("[DATA.OUT] %04lx: ", i);
-                bug(" %02lx", ptr[i]);
-                if (i % 16 == 15)
-                    bug("\n");
-            }
-            if (packetLength % 16 != 0) bug("\n");
+            LOG(WiFiBase, LOG_DEBUG, "[DATA.OUT] Packet out, %ld bytes:\n", length);
+            LOG_HEX(WiFiBase, LOG_DEBUG, "[DATA.OUT] %04lx: %08lx %08lx %08lx %08lx\n", ptr, length);
         }
-#endif
         // Increase total length by packet length (aligned)
         totalLength += (packetLength + 3) & ~3;
     }
@@ -1461,17 +2522,22 @@ int SendGlomDataPacket(struct SDIO *sdio, struct IOSana2Req **ioList, UBYTE coun
     sdio->SendPKT((UBYTE *)pktBase, totalLength, sdio);
 
     for (UBYTE i = 0; i < count; i++) {
+        unit->wu_SpecialStats[SS_TX_BYTES] += ioList[i]->ios2_DataLength;
         ReplyMsg(&ioList[i]->ios2_Req.io_Message);
         unit->wu_Stats.PacketsSent++;
     }
 
+    unit->wu_SpecialStats[SS_TX_GLOM_FRAMES]++;
+    unit->wu_SpecialStats[SS_TX_GLOM_PACKETS] += count;
+
+    PROFILE_END(TXProfile, txStart, count, totalLength);
+
     return 1;
 }
 
 int SendDataPacket(struct SDIO *sdio, struct IOSana2Req *io)
 {
     struct WiFiBase *WiFiBase = sdio->s_WiFiBase;
-    struct ExecBase *SysBase = sdio->s_SysBase;
     struct WiFiUnit *unit = WiFiBase->w_Unit;
     struct Opener *opener = io->ios2_BufferManagement;
 
@@ -1514,7 +2580,7 @@ int SendDataPacket(struct SDIO *sdio, struct IOSana2Req *io)
         for (int i=0; i < 6; i++) ptr[6 + i] = io->ios2_SrcAddr[i];
 
         // Copy packet type
-        *(UWORD*)&ptr[12] = io->ios2_PacketType;
+        *(UWORD*)&ptr[12] = BE16(io->ios2_PacketType);
         ptr+=14;
     }
 
@@ -1525,12 +2591,13 @@ int SendDataPacket(struct SDIO *sdio, struct IOSana2Req *io)
     }
     else
     {
-        D(bug("[WiFi] Sending non-glom Frame without data, packet type %04lx\n", io->ios2_PacketType));
+        LOG(WiFiBase, LOG_DEBUG, "[WiFi] Sending non-glom Frame without data, packet type %04lx\n", io->ios2_PacketType);
     }
     //PacketDump(sdio, p, "WiFi.OUT");
 
     sdio->SendPKT((UBYTE*)p, totLen, sdio);
     unit->wu_Stats.PacketsSent++;
+    unit->wu_SpecialStats[SS_TX_BYTES] += io->ios2_DataLength;
 
     return 1;
 }
@@ -1709,8 +2776,7 @@ void PacketDump(struct SDIO *sdio, APTR data, char *src)
     
         if (LE16(c->c_Flags) & BCDC_DCMD_ERROR)
         {
-            LONG errCode = LE32(c->c_Status);
-            D(bug("[%s]   Command ended with error: %s\n", (ULONG)src, (ULONG)brcmf_fil_errstr[-errCode]));
+            D(bug("[%s]   Command ended with error: %s\n", (ULONG)src, (ULONG)brcmf_fil_errstr[-(LONG)LE32(c->c_Status)]));
         }
 
         data = (APTR)((ULONG)data + sizeof(struct PacketCmd));
@@ -1733,6 +2799,24 @@ void PacketDump(struct SDIO *sdio, APTR data, char *src)
     if (dataLength % 16 != 0) bug("\n");
 }
 
+/* Control messages and their replies, accounted as POOL_CTRL */
+static APTR AllocCtrl(struct WiFiBase *WiFiBase, ULONG size)
+{
+    APTR mem = AllocPooledClear(WiFiBase->w_MemPool, size);
+
+    PoolUsed(WiFiBase, POOL_CTRL, size);
+
+    return mem;
+}
+
+static void FreeCtrl(struct WiFiBase *WiFiBase, APTR mem, ULONG size)
+{
+    struct ExecBase *SysBase = WiFiBase->w_SysBase;
+
+    PoolUsed(WiFiBase, POOL_CTRL, -(LONG)size);
+    FreePooled(WiFiBase->w_MemPool, mem, size);
+}
+
 static int int_strlen(const char *c)
 {
     int len = 0;
@@ -1760,7 +2844,7 @@ int PacketSetVar(struct SDIO *sdio, char *varName, const void *setBuffer, int se
 
     totalLen += varSize;
 
-    mpkt = AllocPooledClear(WiFiBase->w_MemPool, totalLen);
+    mpkt = AllocCtrl(WiFiBase, totalLen);
     pkt = (APTR)&mpkt->pm_PacketHeader[0];
 
     mpkt->pm_Message.mn_ReplyPort = port;
@@ -1802,17 +2886,15 @@ int PacketSetVar(struct SDIO *sdio, char *varName, const void *setBuffer, int se
     CopyMem(varName, &param[0], varSize);
     CopyMem((APTR)setBuffer, &param[varSize], setSize);
 
-    PutMsg(sdio->s_ReceiverPort, &mpkt->pm_Message);
-    WaitPort(port);
-    GetMsg(port);
+    CtrlRoundTrip(sdio, mpkt);
 
     if (c->c_Flags & LE16(BCDC_DCMD_ERROR))
     {
         error_code = LE32(c->c_Status);
-        D(bug("[WiFi] PacketSetVar ended with error. Code: %s", (ULONG)brcmf_fil_errstr[-error_code]));
+        LOG(WiFiBase, LOG_WARN, "[WiFi] PacketSetVar ended with error. Code: %s\n", (ULONG)brcmf_fil_errstr[-error_code]);
     }
 
-    FreePooled(WiFiBase->w_MemPool, mpkt, totalLen);
+    FreeCtrl(WiFiBase, mpkt, totalLen);
     DeleteMsgPort(port);
 
     return error_code;
@@ -1832,7 +2914,7 @@ void PacketSetVarAsync(struct SDIO *sdio, char *varName, const void *setBuffer,
 
     totalLen += varSize;
 
-    pkt = AllocPooledClear(WiFiBase->w_MemPool, totalLen);
+    pkt = AllocCtrl(WiFiBase, totalLen);
 
     struct PacketHeaderHW *hw = (APTR)&pkt[0];
     struct GlomHeader *gl = (APTR)&pkt[4];
@@ -1869,7 +2951,7 @@ void PacketSetVarAsync(struct SDIO *sdio, char *varName, const void *setBuffer,
     // Async - fire the packet and forget
     sdio->SendPKT(pkt, totalLen, sdio);
 
-    FreePooled(WiFiBase->w_MemPool, pkt, totalLen);
+    FreeCtrl(WiFiBase, pkt, totalLen);
 }
 
 int PacketSetVarInt(struct SDIO *sdio, char *varName, ULONG varValue)
@@ -1897,7 +2979,7 @@ int PacketCmdInt(struct SDIO *sdio, ULONG cmd, ULONG cmdValue)
     if (sdio->s_GlomEnabled)
         totalLen += 8;
 
-    mpkt = AllocPooledClear(WiFiBase->w_MemPool, totalLen);
+    mpkt = AllocCtrl(WiFiBase, totalLen);
     pkt = (APTR)&mpkt->pm_PacketHeader[0];
 
     mpkt->pm_Message.mn_ReplyPort = port;
@@ -1939,25 +3021,89 @@ int PacketCmdInt(struct SDIO *sdio, ULONG cmd, ULONG cmdValue)
 
     *param = LE32(cmdValue);
 
-    PutMsg(sdio->s_ReceiverPort, &mpkt->pm_Message);
-    WaitPort(port);
-    GetMsg(port);
+    CtrlRoundTrip(sdio, mpkt);
 
     if (c->c_Flags & LE16(BCDC_DCMD_ERROR))
     {
         error_code = LE32(c->c_Status);
-        D(bug("[WiFi] PacketCmdInt ended with error. Code: %s", (ULONG)brcmf_fil_errstr[-error_code]));
+        LOG(WiFiBase, LOG_WARN, "[WiFi] PacketCmdInt ended with error. Code: %s\n", (ULONG)brcmf_fil_errstr[-error_code]);
     }
 
-    FreePooled(WiFiBase->w_MemPool, mpkt, totalLen);
+    FreeCtrl(WiFiBase, mpkt, totalLen);
     DeleteMsgPort(port);
 
     return error_code;
 }
 
-void PacketCmdIntAsync(struct SDIO *sdio, ULONG cmd, ULONG cmdValue)
+int PacketCmdSet(struct SDIO *sdio, ULONG cmd, const void *setBuffer, int setSize)
 {
     struct ExecBase *SysBase = sdio->s_SysBase;
+    struct WiFiBase *WiFiBase = sdio->s_WiFiBase;
+    UBYTE *pkt;
+    struct MsgPort *port = CreateMsgPort();
+    struct PacketMessage *mpkt;
+    ULONG totalLen = sizeof(struct Packet) + sizeof(struct PacketCmd) + sizeof(struct PacketMessage) + setSize;
+    ULONG error_code = 0;
+
+    if (sdio->s_GlomEnabled)
+        totalLen += 8;
+
+    mpkt = AllocCtrl(WiFiBase, totalLen);
+    pkt = (APTR)&mpkt->pm_PacketHeader[0];
+
+    mpkt->pm_Message.mn_ReplyPort = port;
+    mpkt->pm_Message.mn_Length = totalLen;
+
+    struct PacketHeaderHW *hw = (APTR)&pkt[0];
+    struct GlomHeader *gl = (APTR)&pkt[4];
+    struct PacketHeaderSW *sw = sdio->s_GlomEnabled ? (APTR)&pkt[12] : (APTR)&pkt[4];
+    struct PacketCmd *c = sdio->s_GlomEnabled ? (APTR)&pkt[20] : (APTR)&pkt[12];
+
+    mpkt->pm_PacketData = c;
+
+    UWORD totLen = sizeof(struct Packet) + sizeof(struct PacketCmd) + setSize;
+
+    if (sdio->s_GlomEnabled)
+    {
+        totLen += 8;
+        gl->gh_Length = LE16(totLen - sizeof(struct PacketHeaderHW));
+        gl->gh_ReservedB = 0;
+        gl->gh_LastItem = 1;
+        gl->gh_ReservedW = 0;
+        gl->gh_TailPad = LE16((-totLen) & 3);
+    }
+
+    hw->ph_Length = LE16(totLen);
+    hw->ph_ChkSum = ~hw->ph_Length;
+    sw->c_DataOffset = sizeof(struct Packet);
+    if (sdio->s_GlomEnabled) sw->c_DataOffset += sizeof(struct GlomHeader);
+    sw->c_FlowControl = 0;
+    sw->c_Seq = sdio->s_TXSeq++;
+
+    c->c_Command = LE32(cmd);
+    c->c_Length = LE32(setSize);
+    c->c_Flags = LE16(BCDC_DCMD_SET);
+    c->c_ID = LE16(++(sdio->s_CmdID));
+    c->c_Status = 0;
+
+    CopyMem((APTR)setBuffer, (UBYTE*)c + sizeof(struct PacketCmd), setSize);
+
+    CtrlRoundTrip(sdio, mpkt);
+
+    if (c->c_Flags & LE16(BCDC_DCMD_ERROR))
+    {
+        error_code = LE32(c->c_Status);
+        LOG(WiFiBase, LOG_WARN, "[WiFi] PacketCmdSet ended with error. Code: %s\n", (ULONG)brcmf_fil_errstr[-error_code]);
+    }
+
+    FreeCtrl(WiFiBase, mpkt, totalLen);
+    DeleteMsgPort(port);
+
+    return error_code;
+}
+
+void PacketCmdIntAsync(struct SDIO *sdio, ULONG cmd, ULONG cmdValue)
+{
     struct WiFiBase *WiFiBase = sdio->s_WiFiBase;
     UBYTE *pkt;
     ULONG totalLen = sizeof(struct Packet) + sizeof(struct PacketCmd) + 4;
@@ -1965,7 +3111,7 @@ void PacketCmdIntAsync(struct SDIO *sdio, ULONG cmd, ULONG cmdValue)
     if (sdio->s_GlomEnabled)
         totalLen += 8;
 
-    pkt = AllocPooledClear(WiFiBase->w_MemPool, totalLen);
+    pkt = AllocCtrl(WiFiBase, totalLen);
     
     struct PacketHeaderHW *hw = (APTR)&pkt[0];
     struct GlomHeader *gl = (APTR)&pkt[4];
@@ -2002,7 +3148,7 @@ void PacketCmdIntAsync(struct SDIO *sdio, ULONG cmd, ULONG cmdValue)
     // Fire packet and forget it
     sdio->SendPKT(pkt, totalLen, sdio);
 
-    FreePooled(WiFiBase->w_MemPool, pkt, totalLen);
+    FreeCtrl(WiFiBase, pkt, totalLen);
 }
 
 int PacketCmdIntGet(struct SDIO *sdio, ULONG cmd, ULONG *cmdValue)
@@ -2022,7 +3168,7 @@ int PacketCmdIntGet(struct SDIO *sdio, ULONG cmd, ULONG *cmdValue)
         if (sdio->s_GlomEnabled)
             totalLen += 8;
 
-        mpkt = AllocPooledClear(WiFiBase->w_MemPool, totalLen);
+        mpkt = AllocCtrl(WiFiBase, totalLen);
         pkt = (APTR)&mpkt->pm_PacketHeader[0];
 
         mpkt->pm_Message.mn_ReplyPort = port;
@@ -2064,21 +3210,19 @@ int PacketCmdIntGet(struct SDIO *sdio, ULONG cmd, ULONG *cmdValue)
 
         //PacketDump(sdio, p, "WiFi");
 
-        PutMsg(sdio->s_ReceiverPort, &mpkt->pm_Message);
-        WaitPort(port);
-        GetMsg(port);
+        CtrlRoundTrip(sdio, mpkt);
 
         if (c->c_Flags & LE16(BCDC_DCMD_ERROR))
         {
             error_code = LE32(c->c_Status);
-            D(bug("[WiFi] PacketCmdIntGet ended with error. Code: %s", (ULONG)brcmf_fil_errstr[-error_code]));
+            LOG(WiFiBase, LOG_WARN, "[WiFi] PacketCmdIntGet ended with error. Code: %s\n", (ULONG)brcmf_fil_errstr[-error_code]);
         }
         else
         {
             *cmdValue = LE32(*cmdValue);
         }
 
-        FreePooled(WiFiBase->w_MemPool, mpkt, totalLen);
+        FreeCtrl(WiFiBase, mpkt, totalLen);
         DeleteMsgPort(port);
     }
 
@@ -2105,7 +3249,7 @@ int PacketGetVar(struct SDIO *sdio, char *varName, void *getBuffer, int getSize)
     else
         totalLen += getSize;
 
-    mpkt = AllocPooledClear(WiFiBase->w_MemPool, totalLen);
+    mpkt = AllocCtrl(WiFiBase, totalLen);
     pkt = (APTR)&mpkt->pm_PacketHeader[0];
 
     mpkt->pm_Message.mn_ReplyPort = port;
@@ -2152,17 +3296,15 @@ int PacketGetVar(struct SDIO *sdio, char *varName, void *getBuffer, int getSize)
     
     CopyMem(varName, &param[0], varSize);
 
-    PutMsg(sdio->s_ReceiverPort, &mpkt->pm_Message);
-    WaitPort(port);
-    GetMsg(port);
+    CtrlRoundTrip(sdio, mpkt);
 
     if (c->c_Flags & LE16(BCDC_DCMD_ERROR))
     {
         error_code = LE32(c->c_Status);
-        D(bug("[WiFi] PacketGetVar ended with error. Code: %s", (ULONG)brcmf_fil_errstr[-error_code]));
+        LOG(WiFiBase, LOG_WARN, "[WiFi] PacketGetVar ended with error. Code: %s\n", (ULONG)brcmf_fil_errstr[-error_code]);
     }
 
-    FreePooled(WiFiBase->w_MemPool, mpkt, totalLen);
+    FreeCtrl(WiFiBase, mpkt, totalLen);
     DeleteMsgPort(port);
 
     return error_code;
@@ -2204,6 +3346,8 @@ int PacketUploadCLM(struct SDIO *sdio)
 
         if (upload)
         {
+            PoolUsed(WiFiBase, POOL_FIRMWARE, sizeof(struct UploadHeader) + MAX_CHUNK_LEN);
+
             // Upload CLM in chunks of size MAX_CHUNK_LEN
             do {
                 ULONG transferLen; 
@@ -2232,9 +3376,16 @@ int PacketUploadCLM(struct SDIO *sdio)
                 flag &= ~DL_BEGIN;
             } while (dataLen > 0);
 
+            PoolUsed(WiFiBase, POOL_FIRMWARE, -(LONG)(sizeof(struct UploadHeader) + MAX_CHUNK_LEN));
             FreePooled(WiFiBase->w_MemPool, upload, sizeof(struct UploadHeader) + MAX_CHUNK_LEN);
         }
 
+        /* CLM is not needed anymore, release it */
+        PoolUsed(WiFiBase, POOL_FIRMWARE, -VecPooledSize(sdio->s_Chip->c_CLMBase));
+        FreeVecPooled(WiFiBase->w_MemPool, sdio->s_Chip->c_CLMBase);
+        sdio->s_Chip->c_CLMBase = NULL;
+        sdio->s_Chip->c_CLMSize = 0;
+
         //D(bug("[WiFi] CLM upload complete. Getting status\n"));
         //PacketGetVar(sdio, "clmload_status", NULL, 32);
     }
@@ -2246,73 +3397,235 @@ int PacketUploadCLM(struct SDIO *sdio)
     return 1;
 }
 
-void StartNetworkScan(struct IOSana2Req *io)
+/* Translate scan description into escan request. Returns length of the request written to buffer */
+ULONG BuildEScanParams(struct SDIO *sdio, const struct ScanOptions *opts, UBYTE *buffer)
+{
+    struct SSID *ssid;
+    UBYTE *bssid;
+    UWORD *channels;
+    ULONG channelCount = opts->so_Channels ? opts->so_ChannelCount : 0;
+    ULONG length;
+
+    if (channelCount > SCAN_MAX_CHANNELS)
+        channelCount = SCAN_MAX_CHANNELS;
+
+    if (sdio->s_Chip->c_ScanVersion == ESCAN_REQ_VERSION_V2)
+    {
+        struct EScanParamsV2 *esp = (APTR)buffer;
+
+        _bzero(esp, sizeof(struct EScanParamsV2));
+
+        esp->esp_Version = LE32(ESCAN_REQ_VERSION_V2);
+        esp->esp_Action = LE16(ESCAN_ACTION_START);
+        esp->esp_SyncID = LE16(ESCAN_SYNC_ID);
+        esp->esp_Params.sp_Version = LE16(ESCAN_REQ_VERSION_V2);
+        esp->esp_Params.sp_Length = LE16(sizeof(struct ScanParamsV2));
+        esp->esp_Params.sp_BSSType = BSS_TYPE_ANY;
+        esp->esp_Params.sp_ScanType = LE32(opts->so_ScanType);
+        esp->esp_Params.sp_NProbes = LE32(opts->so_NProbes);
+        esp->esp_Params.sp_ActiveTime = LE32(opts->so_ActiveTime);
+        esp->esp_Params.sp_PassiveTime = LE32(opts->so_PassiveTime);
+        esp->esp_Params.sp_HomeTime = LE32(opts->so_HomeTime);
+        esp->esp_Params.sp_ChannelNum = LE32(channelCount);
+
+        ssid = &esp->esp_Params.sp_SSID;
+        bssid = esp->esp_Params.sp_BSSID;
+        channels = esp->esp_Params.sp_ChannelList;
+        length = sizeof(struct EScanParamsV2);
+    }
+    else
+    {
+        struct EScanParams *esp = (APTR)buffer;
+
+        _bzero(esp, sizeof(struct EScanParams));
+
+        esp->esp_Version = LE32(ESCAN_REQ_VERSION);
+        esp->esp_Action = LE16(ESCAN_ACTION_START);
+        esp->esp_SyncID = LE16(ESCAN_SYNC_ID);
+        esp->esp_Params.sp_BSSType = BSS_TYPE_ANY;
+        esp->esp_Params.sp_ScanType = opts->so_ScanType;
+        esp->esp_Params.sp_NProbes = LE32(opts->so_NProbes);
+        esp->esp_Params.sp_ActiveTime = LE32(opts->so_ActiveTime);
+        esp->esp_Params.sp_PassiveTime = LE32(opts->so_PassiveTime);
+        esp->esp_Params.sp_HomeTime = LE32(opts->so_HomeTime);
+        esp->esp_Params.sp_ChannelNum = LE32(channelCount);
+
+        ssid = &esp->esp_Params.sp_SSID;
+        bssid = esp->esp_Params.sp_BSSID;
+        channels = esp->esp_Params.sp_ChannelList;
+        length = sizeof(struct EScanParams);
+    }
+
+    if (opts->so_SSID != NULL && opts->so_SSIDLength != 0)
+    {
+        ULONG len = opts->so_SSIDLength > 32 ? 32 : opts->so_SSIDLength;
+
+        ssid->ssid_Length = LE32(len);
+        for (ULONG i=0; i < len; i++)
+            ssid->ssid_Value[i] = opts->so_SSID[i];
+    }
+
+    for (int i=0; i < 6; i++)
+        bssid[i] = opts->so_BSSID ? opts->so_BSSID[i] : 0xff;
+
+    /* Chanspecs depend on the D11 io type, build them for the firmware in use */
+    for (ULONG i=0; i < channelCount; i++)
+    {
+        struct ChannelInfo ci;
+
+        ci.ci_CHSpec = 0;
+        ci.ci_CHNum = opts->so_Channels[i];
+        ci.ci_Bandwidth = BRCMU_CHAN_BW_20;
+        ci.ci_Sideband = BRCMU_CHAN_SB_NONE;
+        EncodeChanSpec(&ci, sdio->s_Chip->c_D11Type);
+
+        channels[i] = LE16(ci.ci_CHSpec);
+    }
+
+    return length + channelCount * sizeof(UWORD);
+}
+
+/* Start escan described by opts. Results are collected for io, if given, and for the network cache */
+void StartScan(struct WiFiUnit *unit, struct IOSana2Req *io, const struct ScanOptions *opts)
 {
-    struct WiFiUnit *unit = (APTR)io->ios2_Req.io_Unit;
     struct WiFiBase *base = unit->wu_Base;
     struct ExecBase *SysBase = base->w_SysBase;
-    struct Library *UtilityBase = base->w_UtilityBase;
     struct SDIO *sdio = base->w_SDIO;
-    UBYTE *networkName = NULL;
-    struct TagItem *tags = io->ios2_StatData;
+    UBYTE params[ESCAN_PARAMS_MAX_SIZE];
+    ULONG length;
 
-    /* THis needs to be gone! The paramsv2 layout is known... */
-    static const UBYTE params[4+2+2+4+32+6+1+1+4*4+2+2+14*2+32+4] = {
-        1,0,0,0,
-        1,0,
-        0x34,0x12,
-        0,0,0,0,
-        0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
-        0xff,0xff,0xff,0xff,0xff,0xff,
-        2,
-        0,
-        0xff,0xff,0xff,0xff,
-        0xff,0xff,0xff,0xff,
-        0xff,0xff,0xff,0xff,
-        0xff,0xff,0xff,0xff,
-        14,0,
-        0,0,
-        0x01,0x2b,0x02,0x2b,0x03,0x2b,0x04,0x2b,0x05,0x2e,0x06,0x2e,0x07,0x2e,
-        0x08,0x2b,0x09,0x2b,0x0a,0x2b,0x0b,0x2b,0x0c,0x2b,0x0d,0x2b,0x0e,0x2b,
-        0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
-    };
-    UBYTE *data = (UBYTE*)params;
-    
-    D(bug("[WiFi] StartNetworkScan("));
+    length = BuildEScanParams(sdio, opts, params);
 
-    /* If tags were passed check if S2INFO_SSID was set */
-    if (tags != NULL) {
-        networkName = (UBYTE*)GetTagData(S2INFO_SSID, 0, tags);
+    if (io != NULL)
+    {
+        io->ios2_DataLength = 0;
     }
 
-    if (networkName) D(bug(networkName));
-    
-    D(bug(")\n"));
+    /* Drop leftovers of an aborted scan, if any */
+    ClearScanResults(unit);
+    unit->wu_ScanIncremental = FALSE;
+    unit->wu_ScanFinished = FALSE;
+    unit->wu_ScanDelivered = 0;
 
-    if (networkName)
+    unit->wu_ScanSSIDLength = 0;
+    if (opts->so_SSID != NULL && opts->so_SSIDLength != 0)
     {
-        ULONG len = _strlen(networkName);
-        data = AllocVecPooled(base->w_MemPool, sizeof(params));
+        unit->wu_ScanSSIDLength = opts->so_SSIDLength > 32 ? 32 : opts->so_SSIDLength;
+        CopyMem((APTR)opts->so_SSID, unit->wu_ScanSSID, unit->wu_ScanSSIDLength);
+    }
 
-        if (len > 32) len = 32;
+    unit->wu_ScanLimited = opts->so_BSSID != NULL || opts->so_ChannelCount != 0;
+    unit->wu_ScanHasBSSID = opts->so_BSSID != NULL;
+    if (opts->so_BSSID != NULL)
+        CopyMem((APTR)opts->so_BSSID, unit->wu_ScanBSSID, 6);
 
-        CopyMem((const APTR)params, data, sizeof(params));
-        
-        data[8] = len;
-        for (int i=0; i < data[8]; i++)
-            data[12 + i] = networkName[i];
+    unit->wu_ScanChannelCount = opts->so_Channels ? opts->so_ChannelCount : 0;
+    if (unit->wu_ScanChannelCount > SCAN_MAX_CHANNELS)
+        unit->wu_ScanChannelCount = SCAN_MAX_CHANNELS;
+    if (unit->wu_ScanChannelCount != 0)
+        CopyMem((APTR)opts->so_Channels, unit->wu_ScanChannels, unit->wu_ScanChannelCount);
+    unit->wu_ScanRequest = io;
+    unit->wu_ScanRefresh = FALSE;
+    unit->wu_ScanStarted = timer_us();
+    unit->wu_ScanActive = TRUE;
+
+    PacketCmdIntAsync(sdio, BRCMF_C_SET_PASSIVE_SCAN, opts->so_ScanType == SCAN_TYPE_PASSIVE);
+    PacketSetVarAsync(sdio, "escan", params, length);
+}
+
+void StartNetworkScan(struct WiFiUnit *unit, struct IOSana2Req *io)
+{
+    struct WiFiBase *base = unit->wu_Base;
+    struct Library *UtilityBase = base->w_UtilityBase;
+    struct TagItem *tags = io ? io->ios2_StatData : NULL;
+    struct ScanOptions opts;
+    UBYTE channel;
+
+    opts.so_SSID = NULL;
+    opts.so_SSIDLength = 0;
+    opts.so_BSSID = NULL;
+    opts.so_ScanType = SCAN_TYPE_ACTIVE;
+    opts.so_NProbes = -1;
+    opts.so_ActiveTime = -1;
+    opts.so_PassiveTime = -1;
+    opts.so_HomeTime = -1;
+    opts.so_Channels = NULL;
+    opts.so_ChannelCount = 0;
+
+    /* If tags were passed, limit the scan to given SSID, BSSID and channel */
+    if (tags != NULL)
+    {
+        opts.so_SSID = (UBYTE *)GetTagData(S2INFO_SSID, 0, tags);
+        opts.so_BSSID = (UBYTE *)GetTagData(S2INFO_BSSID, 0, tags);
+        channel = GetTagData(S2INFO_Channel, 0, tags);
+
+        if (opts.so_SSID)
+        {
+            ULONG len = _strlen(opts.so_SSID);
+            opts.so_SSIDLength = len > 32 ? 32 : len;
+        }
+
+        if (channel)
+        {
+            opts.so_Channels = &channel;
+            opts.so_ChannelCount = 1;
+        }
     }
 
-    io->ios2_DataLength = 0;
-    io->ios2_StatData = NULL;
+    LOG(base, LOG_DEBUG, "[WiFi] StartNetworkScan, SSID length %ld\n", opts.so_SSIDLength);
 
-    unit->wu_ScanRequest = io;
+    StartScan(unit, io, &opts);
 
-    PacketCmdIntAsync(sdio, BRCMF_C_SET_PASSIVE_SCAN, 0);
-    PacketSetVarAsync(sdio, "escan", data, sizeof(params));
-    
-    if(networkName)
-        FreeVecPooled(base->w_MemPool, data);
+    if (tags != NULL && FindTagItem(S2INFO_Incremental, tags) != NULL)
+        unit->wu_ScanIncremental = TRUE;
+}
+
+/* Scan for current SSID only, on channels where it was seen before if any */
+static void StartRoamScan(struct WiFiUnit *unit)
+{
+    struct WiFiBase *WiFiBase = unit->wu_Base;
+    struct ExecBase *SysBase = WiFiBase->w_SysBase;
+    struct ExtJoinParams *jp = &unit->wu_JoinParams;
+    ULONG ssidLength = LE32(jp->ej_SSID.ssid_Length);
+    UBYTE channels[SCAN_MAX_CHANNELS];
+    struct ScanOptions opts;
+    struct WiFiNetwork *net;
+    UBYTE count = 0;
+
+    ObtainSemaphoreShared(&WiFiBase->w_NetworkListLock);
+    ForeachNode(&WiFiBase->w_NetworkList, net)
+    {
+        int i;
+
+        if (net->wn_SSIDLength != ssidLength || _strncmp(net->wn_SSID, jp->ej_SSID.ssid_Value, ssidLength) != 0)
+            continue;
+
+        for (i=0; i < count; i++)
+            if (channels[i] == net->wn_ChannelInfo.ci_CHNum)
+                break;
+
+        if (i == count && count < SCAN_MAX_CHANNELS)
+            channels[count++] = net->wn_ChannelInfo.ci_CHNum;
+    }
+    ReleaseSemaphore(&WiFiBase->w_NetworkListLock);
+
+    opts.so_SSID = jp->ej_SSID.ssid_Value;
+    opts.so_SSIDLength = ssidLength;
+    opts.so_BSSID = NULL;
+    opts.so_ScanType = SCAN_TYPE_ACTIVE;
+    opts.so_NProbes = -1;
+    opts.so_ActiveTime = -1;
+    opts.so_PassiveTime = -1;
+    opts.so_HomeTime = -1;
+    opts.so_Channels = count ? channels : NULL;
+    opts.so_ChannelCount = count;
+
+    D(bug("[WiFi] Roam scan on %ld channels\n", count));
+
+    StartScan(unit, NULL, &opts);
+
+    /* Scan is active now, unit task waits for it to complete */
+    unit->wu_Roam.rs_State = ROAM_SCANNING;
 }
 
 #if 0
@@ -2379,7 +3692,7 @@ void StartPacketReceiver(struct SDIO *sdio)
     // Get all memory we need for the receiver task
     task = AllocMem(sizeof(struct Task), MEMF_PUBLIC | MEMF_CLEAR);
     ml = AllocMem(sizeof(struct MemList) + sizeof(struct MemEntry), MEMF_PUBLIC | MEMF_CLEAR);
-    stack = AllocMem(PACKET_RECV_STACKSIZE * sizeof(ULONG), MEMF_PUBLIC | MEMF_CLEAR);
+    stack = AllocMem(PACKET_RECV_STACKSIZE * sizeof(ULONG), MEMF_PUBLIC);
 
     // Prepare mem list, put task and its stack there
     ml->ml_NumEntries = 2;
@@ -2392,6 +3705,9 @@ void StartPacketReceiver(struct SDIO *sdio)
     // Task's UserData will contain pointer to SDIO
     task->tc_UserData = sdio;
 
+    // Fill stack with a pattern, used part of it can be found later with StackUsed
+    FillStack(stack, PACKET_RECV_STACKSIZE);
+
     // Set up stack
     task->tc_SPLower = &stack[0];
     task->tc_SPUpper = &stack[PACKET_RECV_STACKSIZE];
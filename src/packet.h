@@ -153,6 +153,8 @@
 #define BRCMF_E_LAST                            139
 
 struct WiFiNetwork;
+struct WiFiUnit;
+struct ScanOptions;
 
 void StartPacketReceiver(struct SDIO *sdio);
 int PacketSetVar(struct SDIO *sdio, char *varName, const void *setBuffer, int setSize);
@@ -164,7 +166,13 @@ void PacketSetVarAsync(struct SDIO *sdio, char *varName, const void *setBuffer,
 void PacketSetVarIntAsync(struct SDIO *sdio, char *varName, ULONG varValue);
 void PacketCmdIntAsync(struct SDIO *sdio, ULONG cmd, ULONG cmdValue);
 int PacketGetVar(struct SDIO *sdio, char *varName, void *getBuffer, int getSize);
-void StartNetworkScan(struct IOSana2Req *io);
+void StartNetworkScan(struct WiFiUnit *unit, struct IOSana2Req *io);
+void StartScan(struct WiFiUnit *unit, struct IOSana2Req *io, const struct ScanOptions *opts);
+ULONG BuildEScanParams(struct SDIO *sdio, const struct ScanOptions *opts, UBYTE *buffer);
+int GetCachedNetworks(struct IOSana2Req *io, ULONG maxAge);
+BOOL ApplyJoinHint(struct WiFiUnit *unit);
+BOOL FindRoamCandidate(struct WiFiUnit *unit, LONG rssi, UBYTE *bssid, UWORD *chanSpec);
+int PacketCmdSet(struct SDIO *sdio, ULONG cmd, const void *setBuffer, int setSize);
 int PacketUploadCLM(struct SDIO *sdio);
 int Connect(struct SDIO *sdio, struct WiFiNetwork *network);
 int SendDataPacket(struct SDIO *sdio, struct IOSana2Req *io);
@@ -224,6 +232,79 @@ struct JoinParams {
     struct AssocParams      j_Assoc;
 };
 
+#define ESCAN_REQ_VERSION       1
+#define ESCAN_REQ_VERSION_V2    2
+#define ESCAN_ACTION_START      1
+#define ESCAN_SYNC_ID           0x1234
+
+#define BSS_TYPE_ANY            2
+
+#define SCAN_TYPE_ACTIVE        0
+#define SCAN_TYPE_PASSIVE       1
+
+#define SCAN_MAX_CHANNELS       64
+
+/* scan params, version 1 */
+struct ScanParams {
+    struct SSID sp_SSID;            /* {0, ""}: wildcard scan */
+    UBYTE   sp_BSSID[6];            /* ff:ff:ff:ff:ff:ff: any BSS */
+    UBYTE   sp_BSSType;
+    UBYTE   sp_ScanType;
+    ULONG   sp_NProbes;             /* -1 use default, nr of probes per channel */
+    ULONG   sp_ActiveTime;          /* -1 use default, dwell time per channel for active scanning */
+    ULONG   sp_PassiveTime;         /* -1 use default, dwell time per channel for passive scanning */
+    ULONG   sp_HomeTime;            /* -1 use default, dwell time for the home channel between channel scans */
+    ULONG   sp_ChannelNum;          /* count of chanspecs in channel list, 0: all available channels */
+    UWORD   sp_ChannelList[];
+} __attribute__((packed));
+
+/* scan params, version 2 */
+struct ScanParamsV2 {
+    UWORD   sp_Version;
+    UWORD   sp_Length;              /* size of the structure without channel list */
+    struct SSID sp_SSID;
+    UBYTE   sp_BSSID[6];
+    UBYTE   sp_BSSType;
+    UBYTE   PAD;
+    ULONG   sp_ScanType;
+    ULONG   sp_NProbes;
+    ULONG   sp_ActiveTime;
+    ULONG   sp_PassiveTime;
+    ULONG   sp_HomeTime;
+    ULONG   sp_ChannelNum;
+    UWORD   sp_ChannelList[];
+} __attribute__((packed));
+
+struct EScanParams {
+    ULONG   esp_Version;
+    UWORD   esp_Action;
+    UWORD   esp_SyncID;
+    struct ScanParams esp_Params;
+} __attribute__((packed));
+
+struct EScanParamsV2 {
+    ULONG   esp_Version;
+    UWORD   esp_Action;
+    UWORD   esp_SyncID;
+    struct ScanParamsV2 esp_Params;
+} __attribute__((packed));
+
+#define ESCAN_PARAMS_MAX_SIZE   (sizeof(struct EScanParamsV2) + SCAN_MAX_CHANNELS * sizeof(UWORD))
+
+/* Description of a scan, translated by BuildEScanParams into the layout used by firmware */
+struct ScanOptions {
+    const UBYTE *   so_SSID;            /* NULL: wildcard scan */
+    UBYTE           so_SSIDLength;
+    const UBYTE *   so_BSSID;           /* NULL: any BSS */
+    UBYTE           so_ScanType;        /* SCAN_TYPE_ACTIVE or SCAN_TYPE_PASSIVE */
+    LONG            so_NProbes;         /* -1 for firmware defaults */
+    LONG            so_ActiveTime;      /* ms */
+    LONG            so_PassiveTime;     /* ms */
+    LONG            so_HomeTime;        /* ms */
+    const UBYTE *   so_Channels;        /* channel numbers, 2.4 and 5 GHz. NULL: all available channels */
+    UBYTE           so_ChannelCount;
+};
+
 #define TLV_LEN_OFF			1	/* length offset */
 #define TLV_HDR_LEN			2	/* header length */
 #define TLV_BODY_OFF			2	/* body offset */
@@ -247,6 +328,12 @@ struct JoinParams {
 #define RSN_AKM_SHA256_PSK              6       /* SHA256, Pre-shared Key */
 #define RSN_AKM_SAE                     8       /* SAE */
 
+#define WLAN_EID_COUNTRY                7
+#define WLAN_EID_HT_CAP                 45
+#define WLAN_EID_RSN                    48
+#define WLAN_EID_VHT_CAP                191
+#define VENDOR_SPECIFIC_IE              221
+
 #define WPA_OUI				(CONST_STRPTR)"\x00\x50\xF2"	/* WPA OUI */
 #define WPA_OUI_TYPE			1
 #define RSN_OUI				(CONST_STRPTR)"\x00\x0F\xAC"	/* RSN OUI */
@@ -271,7 +358,10 @@ struct VsTLV {
     UBYTE oui_type;
 };
 
-struct VsTLV * FindWPAIE(UBYTE *data, ULONG len);
-struct TLV * brcmf_parse_tlvs(void *buf, ULONG buflen, UBYTE key);
+struct IEIndex;
+
+void IndexIEs(struct IEIndex *index, const UBYTE *data, ULONG len);
+struct TLV * GetIndexedIE(const struct IEIndex *index, UBYTE *data, ULONG slot);
+ULONG IndexedIELength(const struct IEIndex *index, const UBYTE *data, ULONG mask);
 
 #endif /* _PACKET_H */
@@ -23,13 +23,10 @@
 void delay_us(ULONG us, struct WiFiBase *WiFiBase)
 {
     (void)WiFiBase;
-    ULONG timer = LE32(*(volatile ULONG*)0xf2003004);
-    ULONG end = timer + us;
+    ULONG start = timer_us();
 
-    if (end < timer) {
-        while (end < LE32(*(volatile ULONG*)0xf2003004)) asm volatile("nop");
-    }
-    while (end > LE32(*(volatile ULONG*)0xf2003004)) asm volatile("nop");
+    // Difference of unsigned timestamps stays correct when the counter wraps around
+    while (timer_us() - start < us) asm volatile("nop");
 }
 
 // Set the clock dividers to generate a target value
@@ -93,31 +90,37 @@ ULONG get_clock_divider(ULONG base_clock, ULONG target_rate)
 }
 
 // Switch the clock rate whilst running
-int switch_clock_rate(ULONG base_clock, ULONG target_rate, struct WiFiBase *WiFiBase)
+int switch_clock_rate(ULONG base_clock, ULONG target_rate, struct SDIO *sdio)
 {
+    struct ExecBase *SysBase = sdio->s_SysBase;
+
     // Decide on an appropriate divider
     ULONG divider = get_clock_divider(base_clock, target_rate);
 
-    // Wait for the command inhibit (CMD and DAT) bits to clear
-    while(rd32(WiFiBase->w_SDIOBase, EMMC_STATUS) & 0x3)
-        delay_us(1000, WiFiBase);
+    // Wait for the command inhibit (CMD and DAT) bits to clear, but do not hang on a stuck controller
+    TIMEOUT_WAIT((rd32(sdio->s_SDIO, EMMC_STATUS) & 0x3) == 0, 1000000);
+    if (rd32(sdio->s_SDIO, EMMC_STATUS) & 0x3)
+    {
+        D(bug("[WiFi] Timeout waiting for CMD/DAT inhibit to clear, status %08lx\n", rd32(sdio->s_SDIO, EMMC_STATUS)));
+        return -1;
+    }
 
     // Set the SD clock off
-    ULONG control1 = rd32(WiFiBase->w_SDIOBase, EMMC_CONTROL1);
+    ULONG control1 = rd32(sdio->s_SDIO, EMMC_CONTROL1);
     control1 &= ~(1 << 2);
-    wr32(WiFiBase->w_SDIOBase, EMMC_CONTROL1, control1);
-    delay_us(2000, WiFiBase);
+    wr32(sdio->s_SDIO, EMMC_CONTROL1, control1);
+    delay_us(2000, sdio->s_WiFiBase);
 
     // Write the new divider
     control1 &= ~0xffe0;		// Clear old setting + clock generator select
     control1 |= divider;
-    wr32(WiFiBase->w_SDIOBase, EMMC_CONTROL1, control1);
-    delay_us(2000, WiFiBase);
+    wr32(sdio->s_SDIO, EMMC_CONTROL1, control1);
+    delay_us(2000, sdio->s_WiFiBase);
 
     // Enable the SD clock
     control1 |= (1 << 2);
-    wr32(WiFiBase->w_SDIOBase, EMMC_CONTROL1, control1);
-    delay_us(2000, WiFiBase);
+    wr32(sdio->s_SDIO, EMMC_CONTROL1, control1);
+    delay_us(2000, sdio->s_WiFiBase);
 
     return 0;
 }
@@ -234,14 +237,14 @@ void cmd_int(ULONG cmd, ULONG arg, ULONG timeout, struct SDIO *sdio)
                 const ULONG word_count = sdio->s_BlockSize / 4;
                 ULONG cnt = (word_count + 7) / 8;
                 switch (word_count % 8) {
-                    case 0: do {    *(volatile ULONG *)((ULONG)sdio->s_SDIO + EMMC_DATA) = *cur_buf_addr++;
-                    case 7:         *(volatile ULONG *)((ULONG)sdio->s_SDIO + EMMC_DATA) = *cur_buf_addr++;
-                    case 6:         *(volatile ULONG *)((ULONG)sdio->s_SDIO + EMMC_DATA) = *cur_buf_addr++;
-                    case 5:         *(volatile ULONG *)((ULONG)sdio->s_SDIO + EMMC_DATA) = *cur_buf_addr++;
-                    case 4:         *(volatile ULONG *)((ULONG)sdio->s_SDIO + EMMC_DATA) = *cur_buf_addr++;
-                    case 3:         *(volatile ULONG *)((ULONG)sdio->s_SDIO + EMMC_DATA) = *cur_buf_addr++;
-                    case 2:         *(volatile ULONG *)((ULONG)sdio->s_SDIO + EMMC_DATA) = *cur_buf_addr++;
-                    case 1:         *(volatile ULONG *)((ULONG)sdio->s_SDIO + EMMC_DATA) = *cur_buf_addr++;
+                    case 0: do {    wr32fifo(sdio->s_SDIO, EMMC_DATA, *cur_buf_addr++);
+                    case 7:         wr32fifo(sdio->s_SDIO, EMMC_DATA, *cur_buf_addr++);
+                    case 6:         wr32fifo(sdio->s_SDIO, EMMC_DATA, *cur_buf_addr++);
+                    case 5:         wr32fifo(sdio->s_SDIO, EMMC_DATA, *cur_buf_addr++);
+                    case 4:         wr32fifo(sdio->s_SDIO, EMMC_DATA, *cur_buf_addr++);
+                    case 3:         wr32fifo(sdio->s_SDIO, EMMC_DATA, *cur_buf_addr++);
+                    case 2:         wr32fifo(sdio->s_SDIO, EMMC_DATA, *cur_buf_addr++);
+                    case 1:         wr32fifo(sdio->s_SDIO, EMMC_DATA, *cur_buf_addr++);
                     } while (--cnt > 0);
                 }
             }
@@ -250,14 +253,14 @@ void cmd_int(ULONG cmd, ULONG arg, ULONG timeout, struct SDIO *sdio)
                 const ULONG word_count = sdio->s_BlockSize / 4;
                 ULONG cnt = (word_count + 7) / 8;
                 switch (word_count % 8) {
-                    case 0: do {    *cur_buf_addr++ = *(volatile ULONG *)((ULONG)sdio->s_SDIO + EMMC_DATA);
-                    case 7:         *cur_buf_addr++ = *(volatile ULONG *)((ULONG)sdio->s_SDIO + EMMC_DATA);
-                    case 6:         *cur_buf_addr++ = *(volatile ULONG *)((ULONG)sdio->s_SDIO + EMMC_DATA);
-                    case 5:         *cur_buf_addr++ = *(volatile ULONG *)((ULONG)sdio->s_SDIO + EMMC_DATA);
-                    case 4:         *cur_buf_addr++ = *(volatile ULONG *)((ULONG)sdio->s_SDIO + EMMC_DATA);
-                    case 3:         *cur_buf_addr++ = *(volatile ULONG *)((ULONG)sdio->s_SDIO + EMMC_DATA);
-                    case 2:         *cur_buf_addr++ = *(volatile ULONG *)((ULONG)sdio->s_SDIO + EMMC_DATA);
-                    case 1:         *cur_buf_addr++ = *(volatile ULONG *)((ULONG)sdio->s_SDIO + EMMC_DATA);
+                    case 0: do {    *cur_buf_addr++ = rd32fifo(sdio->s_SDIO, EMMC_DATA);
+                    case 7:         *cur_buf_addr++ = rd32fifo(sdio->s_SDIO, EMMC_DATA);
+                    case 6:         *cur_buf_addr++ = rd32fifo(sdio->s_SDIO, EMMC_DATA);
+                    case 5:         *cur_buf_addr++ = rd32fifo(sdio->s_SDIO, EMMC_DATA);
+                    case 4:         *cur_buf_addr++ = rd32fifo(sdio->s_SDIO, EMMC_DATA);
+                    case 3:         *cur_buf_addr++ = rd32fifo(sdio->s_SDIO, EMMC_DATA);
+                    case 2:         *cur_buf_addr++ = rd32fifo(sdio->s_SDIO, EMMC_DATA);
+                    case 1:         *cur_buf_addr++ = rd32fifo(sdio->s_SDIO, EMMC_DATA);
                     } while (--cnt > 0);
                 }
             }
@@ -407,7 +410,6 @@ static void handle_interrupts(struct SDIO *sdio)
 
     if(irpts & SD_CARD_INTERRUPT)
     {
-        handle_card_interrupt(sdio);
         reset_mask |= SD_CARD_INTERRUPT;
     }
 
@@ -417,10 +419,79 @@ static void handle_interrupts(struct SDIO *sdio)
     }
 
     wr32(sdio->s_SDIO, EMMC_INTERRUPT, reset_mask);
+
+    // Ask the card only once the stale bits are cleared, cmd_int would take them for its own
+    if(irpts & SD_CARD_INTERRUPT)
+        handle_card_interrupt(sdio);
+}
+
+#if SDIO_TRACE
+static void sdio_trace(ULONG command, ULONG arg, ULONG start, struct SDIO *sdio)
+{
+    struct SDIOTrace *t = &sdio->s_Trace[sdio->s_TraceHead & (SDIO_TRACE_SIZE - 1)];
+    ULONG index = (command >> 24) & 0x3f;
+
+    // Only the IO_RW_DIRECT and IO_RW_EXTENDED commands are recorded
+    if (index != 52 && index != 53)
+        return;
+
+    t->st_Command = index;
+    t->st_Function = (arg >> 28) & 7;
+    t->st_Address = (arg >> 9) & 0x1ffff;
+    t->st_Start = start;
+    t->st_End = timer_us();
+    t->st_Error = sdio->s_LastCMDSuccess ? 0 : sdio->s_LastError;
+
+    if (index == 53)
+    {
+        t->st_Blocks = (arg & (1 << 27)) ? sdio->s_BlocksToTransfer : 0;
+        t->st_Length = sdio->s_BlockSize * sdio->s_BlocksToTransfer;
+    }
+    else
+    {
+        t->st_Blocks = 0;
+        t->st_Length = 1;
+    }
+
+    // Publish the entry only once it is complete
+    asm volatile("":::"memory");
+    sdio->s_TraceHead++;
+}
+#endif
+
+static void sdio_dump_trace(ULONG count, struct SDIO *sdio)
+{
+#if SDIO_TRACE
+    struct ExecBase *SysBase = sdio->s_SysBase;
+    ULONG head = sdio->s_TraceHead;
+
+    if (count > head)
+        count = head;
+    if (count > SDIO_TRACE_SIZE)
+        count = SDIO_TRACE_SIZE;
+
+    D(bug("[WiFi] SDIO trace, last %ld of %ld commands\n", count, head));
+
+    for (ULONG i = head - count; i != head; i++)
+    {
+        struct SDIOTrace *t = &sdio->s_Trace[i & (SDIO_TRACE_SIZE - 1)];
+
+        D(bug("[WiFi]   %08lx CMD%ld F%ld addr %05lx len %5ld blk %3ld %5ld us err %08lx\n",
+            t->st_Start, (ULONG)t->st_Command, (ULONG)t->st_Function, t->st_Address, t->st_Length,
+            (ULONG)t->st_Blocks, t->st_End - t->st_Start, t->st_Error));
+    }
+#else
+    (void)count;
+    (void)sdio;
+#endif
 }
 
 static void cmd(ULONG command, ULONG arg, ULONG timeout, struct SDIO *sdio)
 {
+#if SDIO_TRACE
+    ULONG start = timer_us();
+#endif
+
     // First, handle any pending interrupts
     handle_interrupts(sdio);
 
@@ -454,6 +525,15 @@ static void cmd(ULONG command, ULONG arg, ULONG timeout, struct SDIO *sdio)
     {
         sdio->s_LastCMD = command;
         cmd_int(command, arg, timeout, sdio);
+
+        if ((command & 0x3f000000) == SD_CMD_INDEX(52))
+            sdio->s_Cmd52Count++;
+        else if ((command & 0x3f000000) == SD_CMD_INDEX(53))
+            sdio->s_Cmd53Count++;
+
+#if SDIO_TRACE
+        sdio_trace(command, arg, start, sdio);
+#endif
     }
 }
 
@@ -557,6 +637,77 @@ static ULONG sdio_bak_read32(ULONG address, struct SDIO *sdio)
     return LE32(temp);
 }
 
+/*
+    Write larger block of data to the backplane memory. The window is switched only when
+    the 32 KB boundary is crossed. Within the window, data is sent with multi-block CMD53
+    transfers in units of function 1 block size, the tail (if any) goes in byte mode.
+    Returns 1 on success, 0 if any of transfers failed
+*/
+static int sdio_backplane_write(ULONG address, const void *data, ULONG length, struct SDIO *sdio)
+{
+    struct ExecBase *SysBase = sdio->s_SysBase;
+    const UBYTE *src = data;
+    int success = 1;
+
+    // Round up length to next 4 byte boundary
+    length = (length + 3) & ~3;
+
+    S_LOCK(sdio);
+
+    while (length != 0 && success)
+    {
+        ULONG offset = address & SBSDIO_SB_OFT_ADDR_MASK;
+        ULONG chunk = SBSDIO_SB_OFT_ADDR_LIMIT - offset;
+
+        if (chunk > length)
+            chunk = length;
+
+        sdio_backplane_window(address, sdio);
+
+        while (chunk != 0 && success)
+        {
+            ULONG addr = (offset | SBSDIO_SB_ACCESS_2_4B_FLAG) & 0x1ffff;
+            ULONG block_count = chunk / SDIO_BLOCK_SIZE_BAK;
+            ULONG sz;
+
+            if (block_count > SDIO_MAX_BLOCK_COUNT)
+                block_count = SDIO_MAX_BLOCK_COUNT;
+
+            sdio->s_Buffer = (APTR)src;
+
+            if (block_count)
+            {
+                sz = block_count * SDIO_BLOCK_SIZE_BAK;
+                sdio->s_BlockSize = SDIO_BLOCK_SIZE_BAK;
+                sdio->s_BlocksToTransfer = block_count;
+                cmd(IO_RW_EXTENDED | SD_DATA_WRITE | SD_CMD_MULTI_BLOCK | SD_CMD_BLKCNT_EN, 0x80000000 |
+                    ((SD_FUNC_BAK & 7) << 28) | (1 << 27) | (1 << 26) | (addr << 9) | (block_count & 0x1ff), 5000000, sdio);
+            }
+            else
+            {
+                sz = chunk;
+                sdio->s_BlockSize = sz;
+                sdio->s_BlocksToTransfer = 1;
+                cmd(IO_RW_EXTENDED | SD_DATA_WRITE, 0x80000000 |
+                    ((SD_FUNC_BAK & 7) << 28) | (1 << 26) | (addr << 9) | (sz & 0x1ff), 500000, sdio);
+            }
+
+            if (FAIL(sdio))
+                success = 0;
+
+            src += sz;
+            offset += sz;
+            address += sz;
+            chunk -= sz;
+            length -= sz;
+        }
+    }
+
+    S_UNLOCK(sdio);
+
+    return success;
+}
+
 static int is_error(struct SDIO *sdio)
 {
     return FAIL(sdio);
@@ -619,10 +770,10 @@ static int brcmf_sdio_htclk(struct SDIO *sdio, UBYTE on, UBYTE pendingOK)
         }
 
         /* Otherwise, wait here (polling) for HT Avail */
-        timeout = LE32(*(volatile ULONG*)0xf2003004) + PMU_MAX_TRANSITION_DLY * 10;
+        timeout = timer_us();
         while (!SBSDIO_CLKAV(clkctl, sdio->s_ALPOnly)) {
             clkctl = sdio->ReadByte(SD_FUNC_BAK, SBSDIO_FUNC1_CHIPCLKCSR, sdio);
-            if (timeout <= LE32(*(volatile ULONG*)0xf2003004))
+            if (timer_us() - timeout >= PMU_MAX_TRANSITION_DLY * 10)
                 break;
             delay_us(10000, sdio->s_WiFiBase);
             bug("[WiFi] Waiting...\n");
@@ -752,6 +903,10 @@ void sdio_sendpkt(UBYTE *pkt, ULONG length, struct SDIO *sdio)
         cmd(IO_RW_EXTENDED | SD_DATA_WRITE, 0x80000000 | ((SD_FUNC_RAD & 7) << 28) | (reminder & 0x1ff) | (0 << 26), 5000000, sdio);
     }
 
+    // Show what the bus was doing before the failed transfer
+    if (!sdio->s_LastCMDSuccess)
+        sdio_dump_trace(16, sdio);
+
     S_UNLOCK(sdio);
 }
 
@@ -786,6 +941,11 @@ void sdio_recvpkt(UBYTE *pkt, ULONG length, struct SDIO *sdio)
         sdio->s_BlocksToTransfer = 1;
         cmd(IO_RW_EXTENDED | SD_DATA_READ, ((SD_FUNC_RAD & 7) << 28) | (reminder & 0x1ff) | (0 << 26), 5000000, sdio);
     }
+
+    // Show what the bus was doing before the failed transfer
+    if (!sdio->s_LastCMDSuccess)
+        sdio_dump_trace(16, sdio);
+
     S_UNLOCK(sdio);
 }
 
@@ -834,11 +994,13 @@ struct SDIO *sdio_init(struct WiFiBase *WiFiBase)
     sdio->Read = sdio_read_bytes;
     sdio->Write32 = sdio_bak_write32;
     sdio->Read32 = sdio_bak_read32;
+    sdio->BackplaneWrite = sdio_backplane_write;
     sdio->ClkCTRL = sdio_clkctrl;
 
     sdio->SendPKT = sdio_sendpkt;
     sdio->RecvPKT = sdio_recvpkt;
     sdio->GetIntStatus = sdio_getintstatus;
+    sdio->DumpTrace = sdio_dump_trace;
 
     sdio->s_SDIO = WiFiBase->w_SDIOBase;
     sdio->s_WiFiBase = WiFiBase;
@@ -848,21 +1010,21 @@ struct SDIO *sdio_init(struct WiFiBase *WiFiBase)
     sdio->s_TXBuffer = AllocPooled(WiFiBase->w_MemPool, 65536);
     sdio->s_RXBuffer = AllocPooled(WiFiBase->w_MemPool, 65536);
 
-    ULONG ver = rd32(WiFiBase->w_SDIOBase, EMMC_SLOTISR_VER);
+    ULONG ver = rd32(sdio->s_SDIO, EMMC_SLOTISR_VER);
     ULONG vendor = ver >> 24;
     ULONG sdversion = (ver >> 16) & 0xff;
     ULONG slot_status = ver & 0xff;
 
     D(bug("[WiFi]   vendor %lx, sdversion %lx, slot_status %lx\n", vendor, sdversion, slot_status));
 
-    ULONG control1 = rd32(WiFiBase->w_SDIOBase, EMMC_CONTROL1);
+    ULONG control1 = rd32(sdio->s_SDIO, EMMC_CONTROL1);
     control1 |= (1 << 24);
     // Disable clock
     control1 &= ~(1 << 2);
     control1 &= ~(1 << 0);
-    wr32(WiFiBase->w_SDIOBase, EMMC_CONTROL1, control1);
-    TIMEOUT_WAIT((rd32(WiFiBase->w_SDIOBase, EMMC_CONTROL1) & (0x7 << 24)) == 0, 1000000);
-    if((rd32(WiFiBase->w_SDIOBase, EMMC_CONTROL1) & (7 << 24)) != 0)
+    wr32(sdio->s_SDIO, EMMC_CONTROL1, control1);
+    TIMEOUT_WAIT((rd32(sdio->s_SDIO, EMMC_CONTROL1) & (0x7 << 24)) == 0, 1000000);
+    if((rd32(sdio->s_SDIO, EMMC_CONTROL1) & (7 << 24)) != 0)
     {
         D(bug("[WiFi]   controller did not reset properly\n"));
         FreePooled(WiFiBase->w_MemPool, sdio, sizeof(struct SDIO));
@@ -870,12 +1032,12 @@ struct SDIO *sdio_init(struct WiFiBase *WiFiBase)
     }
 
     D(bug("[WiFi]   control0: %08lx, control1: %08lx, control2: %08lx\n", 
-            rd32(WiFiBase->w_SDIOBase, EMMC_CONTROL0),
-            rd32(WiFiBase->w_SDIOBase, EMMC_CONTROL1),
-            rd32(WiFiBase->w_SDIOBase, EMMC_CONTROL2)));
+            rd32(sdio->s_SDIO, EMMC_CONTROL0),
+            rd32(sdio->s_SDIO, EMMC_CONTROL1),
+            rd32(sdio->s_SDIO, EMMC_CONTROL2)));
 
-    TIMEOUT_WAIT(rd32(WiFiBase->w_SDIOBase, EMMC_STATUS) & (1 << 16), 500000);
-    ULONG status_reg = rd32(WiFiBase->w_SDIOBase, EMMC_STATUS);
+    TIMEOUT_WAIT(rd32(sdio->s_SDIO, EMMC_STATUS) & (1 << 16), 500000);
+    ULONG status_reg = rd32(sdio->s_SDIO, EMMC_STATUS);
     if((status_reg & (1 << 16)) == 0)
     {
         D(bug("[WiFi]   no SDIO connected?\n"));
@@ -886,9 +1048,9 @@ struct SDIO *sdio_init(struct WiFiBase *WiFiBase)
     D(bug("[WiFi]   status: %08lx\n", status_reg));
 
     // Clear control2
-    wr32(WiFiBase->w_SDIOBase, EMMC_CONTROL2, 0);
+    wr32(sdio->s_SDIO, EMMC_CONTROL2, 0);
 
-    control1 = rd32(WiFiBase->w_SDIOBase, EMMC_CONTROL1);
+    control1 = rd32(sdio->s_SDIO, EMMC_CONTROL1);
     control1 |= 1;      // enable clock
 
     // Set to identification frequency (400 kHz)
@@ -897,9 +1059,9 @@ struct SDIO *sdio_init(struct WiFiBase *WiFiBase)
     control1 |= f_id;
 
     control1 |= (7 << 16);		// data timeout = TMCLK * 2^10
-    wr32(WiFiBase->w_SDIOBase, EMMC_CONTROL1, control1);
-    TIMEOUT_WAIT((rd32(WiFiBase->w_SDIOBase, EMMC_CONTROL1) & 0x2), 1000000);
-    if((rd32(WiFiBase->w_SDIOBase, EMMC_CONTROL1) & 0x2) == 0)
+    wr32(sdio->s_SDIO, EMMC_CONTROL1, control1);
+    TIMEOUT_WAIT((rd32(sdio->s_SDIO, EMMC_CONTROL1) & 0x2), 1000000);
+    if((rd32(sdio->s_SDIO, EMMC_CONTROL1) & 0x2) == 0)
     {
         D(bug("[WiFI]   controller's clock did not stabilise within 1 second\n"));
         FreePooled(WiFiBase->w_MemPool, sdio, sizeof(struct SDIO));
@@ -907,33 +1069,33 @@ struct SDIO *sdio_init(struct WiFiBase *WiFiBase)
     }
 
     D(bug("[WiFi]   control0: %08lx, control1: %08lx\n",
-        rd32(WiFiBase->w_SDIOBase, EMMC_CONTROL0),
-        rd32(WiFiBase->w_SDIOBase, EMMC_CONTROL1)));
+        rd32(sdio->s_SDIO, EMMC_CONTROL0),
+        rd32(sdio->s_SDIO, EMMC_CONTROL1)));
 
     // Enable the SD clock
     delay_us(2000, WiFiBase);
-    control1 = rd32(WiFiBase->w_SDIOBase, EMMC_CONTROL1);
+    control1 = rd32(sdio->s_SDIO, EMMC_CONTROL1);
     control1 |= 4;
-    wr32(WiFiBase->w_SDIOBase, EMMC_CONTROL1, control1);
+    wr32(sdio->s_SDIO, EMMC_CONTROL1, control1);
     delay_us(2000, WiFiBase);
 
     // Mask off sending interrupts to the ARM
-    wr32(WiFiBase->w_SDIOBase, EMMC_IRPT_EN, 0);
+    wr32(sdio->s_SDIO, EMMC_IRPT_EN, 0);
     // Reset interrupts
-    wr32(WiFiBase->w_SDIOBase, EMMC_INTERRUPT, 0xffffffff);
+    wr32(sdio->s_SDIO, EMMC_INTERRUPT, 0xffffffff);
     
     // Have all interrupts sent to the INTERRUPT register
     uint32_t irpt_mask = 0xffffffff & (~SD_CARD_INTERRUPT);
 #ifdef SD_CARD_INTERRUPTS
     irpt_mask |= SD_CARD_INTERRUPT;
 #endif
-    wr32(WiFiBase->w_SDIOBase, EMMC_IRPT_MASK, irpt_mask);
+    wr32(sdio->s_SDIO, EMMC_IRPT_MASK, irpt_mask);
 
     delay_us(2000, WiFiBase);
 
     D(bug("[WiFi] Clock enabled, control0: %08lx, control1: %08lx\n",
-        rd32(WiFiBase->w_SDIOBase, EMMC_CONTROL0),
-        rd32(WiFiBase->w_SDIOBase, EMMC_CONTROL1)));
+        rd32(sdio->s_SDIO, EMMC_CONTROL0),
+        rd32(sdio->s_SDIO, EMMC_CONTROL1)));
 
     // Send CMD0 to the card (reset to idle state)
     cmd(GO_IDLE_STATE, 0, 500000, sdio);
@@ -958,7 +1120,7 @@ struct SDIO *sdio_init(struct WiFiBase *WiFiBase)
             return NULL;
         }
 
-        wr32(WiFiBase->w_SDIOBase, EMMC_INTERRUPT, SD_ERR_MASK_CMD_TIMEOUT);
+        wr32(sdio->s_SDIO, EMMC_INTERRUPT, SD_ERR_MASK_CMD_TIMEOUT);
     }
     else if(FAIL(sdio))
     {
@@ -1020,7 +1182,12 @@ struct SDIO *sdio_init(struct WiFiBase *WiFiBase)
     /* The card is SDIO. Increase speed to standard 25MHz and obtain CID as well as RCA */
     ULONG _clk = (SD_CLOCK_NORMAL + 50000) / 100000;
     D(bug("[WiFi] Switching clock to %ld.%ldMHz\n", _clk / 10, _clk % 10));
-    switch_clock_rate(WiFiBase->w_SDIOClock, SD_CLOCK_NORMAL, WiFiBase);
+    if (switch_clock_rate(WiFiBase->w_SDIOClock, SD_CLOCK_NORMAL, sdio))
+    {
+        D(bug("[WiFi] Failed to switch clock\n"));
+        FreePooled(WiFiBase->w_MemPool, sdio, sizeof(struct SDIO));
+        return NULL;
+    }
 
     delay_us(10000, WiFiBase);
 
@@ -252,8 +252,31 @@
 
 #define SDIO_FBR_ADDR(func, reg)    (((func) << 8) | (reg))
 
+#define SDIO_BLOCK_SIZE_BAK     64      // Block size of function 1 (backplane)
+#define SDIO_BLOCK_SIZE_RAD     512     // Block size of function 2 (radio)
+#define SDIO_MAX_BLOCK_COUNT    511     // Max block count of single CMD53
+
 struct WiFiBase;
 
+/*
+    Set SDIO_TRACE to 1 in order to record every CMD52/CMD53 in a fixed size ring. Entries are written by the
+    command issuer only (with s_Lock held), readers take s_TraceHead and walk backwards, so no lock is needed
+    to dump the ring. SDIO_TRACE_SIZE has to be a power of two.
+*/
+#define SDIO_TRACE              0
+#define SDIO_TRACE_SIZE         256
+
+struct SDIOTrace {
+    UBYTE   st_Command;     // 52 or 53
+    UBYTE   st_Function;
+    UWORD   st_Blocks;      // Block count of CMD53, 0 for byte mode and CMD52
+    ULONG   st_Address;
+    ULONG   st_Length;      // Total number of bytes transferred
+    ULONG   st_Start;       // timer_us at command issue
+    ULONG   st_End;         // timer_us at command completion
+    ULONG   st_Error;       // Error bits of EMMC_INTERRUPT, 0 on success
+};
+
 /* clkstate */
 #define CLK_NONE	0
 #define CLK_SDONLY	1
@@ -290,6 +313,9 @@ struct SDIO {
     ULONG               s_Res2;
     ULONG               s_Res3;
     ULONG               s_HostINTMask;
+    ULONG               s_Cmd52Count;
+    ULONG               s_Cmd53Count;
+    ULONG               s_CtrlTimeouts;     // Control messages failed by receiver after CTRL_TIMEOUT
     APTR                s_Buffer;
 
     APTR                s_TXBuffer;
@@ -301,6 +327,11 @@ struct SDIO {
     UWORD               s_CmdID;
     BOOL                s_GlomEnabled;
 
+#if SDIO_TRACE
+    ULONG               s_TraceHead;
+    struct SDIOTrace    s_Trace[SDIO_TRACE_SIZE];
+#endif
+
     struct Core *       s_CC;       // Chipcomm core
     struct Core *       s_SDIOC;    // SDIO core
     struct Chip *       s_Chip;
@@ -313,12 +344,17 @@ struct SDIO {
     void    (*Read)(UBYTE function, ULONG address, void *data, ULONG length, struct SDIO *sdio);
     void    (*Write32)(ULONG address, ULONG data, struct SDIO *sdio);
     ULONG   (*Read32)(ULONG address, struct SDIO *sdio);
+    int     (*BackplaneWrite)(ULONG address, const void *data, ULONG length, struct SDIO *sdio);
     int     (*ClkCTRL)(UBYTE target, UBYTE pendingOK, struct SDIO *sdio);
     void    (*SendPKT)(UBYTE *pkt, ULONG length, struct SDIO *);
     void    (*RecvPKT)(UBYTE *pkt, ULONG length, struct SDIO *);
     ULONG   (*GetIntStatus)(struct SDIO *);
+    void    (*DumpTrace)(ULONG count, struct SDIO *);
 };
 
 struct SDIO * sdio_init(struct WiFiBase *WiFiBase);
+ULONG get_clock_divider(ULONG base_clock, ULONG target_rate);
+int switch_clock_rate(ULONG base_clock, ULONG target_rate, struct SDIO *sdio);
+void cmd_int(ULONG cmd, ULONG arg, ULONG timeout, struct SDIO *sdio);
 
 #endif /* _SDIO_H */
@@ -30,10 +30,294 @@
 #include "brcm.h"
 #include "brcm_wifi.h"
 
+/* Synchronous bug() output, only compiled in when LOG_DEBUG records are */
+#if LOG_COMPILE_LEVEL >= LOG_DEBUG
 #define D(x) x
+#else
+#define D(x)
+#endif
 #define UNIT_STACK_SIZE (32768 / sizeof(ULONG))
 #define UNIT_TASK_PRIORITY 10
 
+/*
+    Host driven roaming, called once a second from the unit task. RSSI of current BSS is averaged. If it stays
+    below ROAM_TRIGGER, receiver is asked for a scan of current SSID. Once the scan is over, the unit
+    reassociates to a clearly better BSS, if one was found. Called with wu_Lock held, the lock is released
+    while waiting for replies to control messages so that requests are not held up by slow firmware.
+*/
+static void RoamTick(struct WiFiUnit *unit)
+{
+    struct WiFiBase *WiFiBase = unit->wu_Base;
+    struct ExecBase *SysBase = WiFiBase->w_SysBase;
+    struct TimerBase *TimerBase = unit->wu_TimerBase;
+    struct SDIO *sdio = WiFiBase->w_SDIO;
+    struct RoamState *rs = &unit->wu_Roam;
+    struct timeval now;
+    ULONG rssi;
+    int error;
+
+    if ((unit->wu_Flags & IFF_CONNECTED) == 0)
+    {
+        rs->rs_State = ROAM_IDLE;
+        return;
+    }
+
+    GetSysTime(&now);
+
+    switch (rs->rs_State)
+    {
+        case ROAM_SCAN_PENDING:
+            return;
+
+        case ROAM_SCANNING:
+        {
+            struct AssocParams ap;
+            UWORD chanSpec;
+
+            if (unit->wu_ScanActive)
+                return;
+
+            rs->rs_State = ROAM_IDLE;
+
+            if (FindRoamCandidate(unit, rs->rs_RSSI, ap.ap_BSSID, &chanSpec))
+            {
+                LOG(WiFiBase, LOG_INFO, "[WiFi.0] Roaming to %02lx:%02lx:%02lx:%02lx:%02lx:%02lx, chanspec %04lx\n",
+                    ap.ap_BSSID[0], ap.ap_BSSID[1], ap.ap_BSSID[2], ap.ap_BSSID[3], ap.ap_BSSID[4], ap.ap_BSSID[5], chanSpec);
+
+                ap.ap_ChanspecNum = LE32(1);
+                ap.ap_ChanSpecList[0] = LE16(chanSpec);
+
+                rs->rs_Attempts++;
+                rs->rs_State = ROAM_REASSOC;
+                rs->rs_LastScan = now.tv_sec;
+
+                ReleaseSemaphore(&unit->wu_Lock);
+                error = PacketCmdSet(sdio, BRCMF_C_REASSOC, &ap, sizeof(ap));
+                ObtainSemaphore(&unit->wu_Lock);
+
+                if (error != 0 && rs->rs_State == ROAM_REASSOC)
+                    rs->rs_State = ROAM_IDLE;
+
+                return;
+            }
+            break;
+        }
+
+        case ROAM_REASSOC:
+            /* No E_REASSOC from firmware, give up waiting */
+            if (now.tv_sec - rs->rs_LastScan < ROAM_SCAN_INTERVAL)
+                return;
+            rs->rs_State = ROAM_IDLE;
+            break;
+    }
+
+    ReleaseSemaphore(&unit->wu_Lock);
+    error = PacketCmdIntGet(sdio, BRCMF_C_GET_RSSI, &rssi);
+    ObtainSemaphore(&unit->wu_Lock);
+
+    /* Connection may have gone while the lock was released */
+    if (error != 0 || (unit->wu_Flags & IFF_CONNECTED) == 0)
+        return;
+
+    if (rs->rs_RSSI == 0)
+        rs->rs_RSSI = (LONG)rssi;
+    else
+        rs->rs_RSSI = (3 * rs->rs_RSSI + (LONG)rssi) / 4;
+
+    if (rs->rs_RSSI >= ROAM_TRIGGER)
+        rs->rs_LowCount = 0;
+    else if (rs->rs_LowCount < 255)
+        rs->rs_LowCount++;
+
+    if (rs->rs_LowCount >= ROAM_TRIGGER_COUNT && !unit->wu_ScanActive &&
+        now.tv_sec - rs->rs_LastScan >= ROAM_SCAN_INTERVAL)
+    {
+        LOG(WiFiBase, LOG_DEBUG, "[WiFi.0] RSSI %ld dBm, starting roam scan\n", rs->rs_RSSI);
+
+        rs->rs_Scans++;
+        rs->rs_LastScan = now.tv_sec;
+        rs->rs_State = ROAM_SCAN_PENDING;
+    }
+}
+
+/*
+    Firmware "counters" iovar. Legacy firmware returns wl_cnt_t (version below 30) with the counters directly
+    after version and length fields. Newer firmware returns a list of XTLVs, the generic WLC block has the same
+    leading counters as wl_cnt_t. Only the leading counters are used, their position is the same in all versions.
+*/
+#define COUNTERS_BUFFER_SIZE    2048
+#define COUNTERS_XTLV_VERSION   30
+#define COUNTERS_XTLV_WLC       0x100
+
+#define CNT_TXRETRANS           2
+#define CNT_TXERROR             3
+#define CNT_TXNOBUF             7
+#define CNT_TXUFLO              12
+#define CNT_RXERROR             17
+#define CNT_RXNOBUF             19
+#define CNT_RXOFLO              31
+#define CNT_MIN_COUNT           32
+
+static ULONG * FindCounters(UBYTE *buffer)
+{
+    UWORD version = buffer[0] | (buffer[1] << 8);
+    ULONG length = buffer[2] | (buffer[3] << 8);
+
+    if (length > COUNTERS_BUFFER_SIZE)
+        length = COUNTERS_BUFFER_SIZE;
+
+    if (version < COUNTERS_XTLV_VERSION)
+    {
+        if (length < 4 + CNT_MIN_COUNT * 4)
+            return NULL;
+
+        return (ULONG *)&buffer[4];
+    }
+
+    /* Length field of XTLV variant does not include the header */
+    length += 4;
+    if (length > COUNTERS_BUFFER_SIZE)
+        length = COUNTERS_BUFFER_SIZE;
+
+    for (ULONG pos = 4; pos + 4 <= length; )
+    {
+        UWORD id = buffer[pos] | (buffer[pos + 1] << 8);
+        UWORD len = buffer[pos + 2] | (buffer[pos + 3] << 8);
+
+        if (pos + 4 + len > length)
+            break;
+
+        if (id == COUNTERS_XTLV_WLC)
+            return len >= CNT_MIN_COUNT * 4 ? (ULONG *)&buffer[pos + 4] : NULL;
+
+        pos = (pos + 4 + len + 3) & ~3;
+    }
+
+    return NULL;
+}
+
+/*
+    Called once a second from the unit task. Every COUNTERS_INTERVAL seconds the firmware counters are fetched,
+    the difference to previous snapshot goes into special stats and into global stats of the unit. Called with
+    wu_Lock held, the lock is released while waiting for the firmware.
+*/
+static void CountersTick(struct WiFiUnit *unit)
+{
+    struct WiFiBase *WiFiBase = unit->wu_Base;
+    struct ExecBase *SysBase = WiFiBase->w_SysBase;
+    struct FWCounters *last = &unit->wu_FWCounters;
+    struct FWCounters now;
+    UBYTE *buffer;
+    ULONG *cnt;
+    int error;
+
+    if ((unit->wu_Flags & IFF_ONLINE) == 0)
+        return;
+
+    if (++unit->wu_FWCountersTick < COUNTERS_INTERVAL)
+        return;
+
+    unit->wu_FWCountersTick = 0;
+
+    buffer = AllocPooledClear(WiFiBase->w_MemPool, COUNTERS_BUFFER_SIZE);
+    if (buffer == NULL)
+        return;
+
+    ReleaseSemaphore(&unit->wu_Lock);
+    error = PacketGetVar(WiFiBase->w_SDIO, "counters", buffer, COUNTERS_BUFFER_SIZE);
+    ObtainSemaphore(&unit->wu_Lock);
+
+    /* Unit may have gone offline while the lock was released, the snapshot would then be stale */
+    if (error != 0 || (unit->wu_Flags & IFF_ONLINE) == 0 || (cnt = FindCounters(buffer)) == NULL)
+    {
+        FreePooled(WiFiBase->w_MemPool, buffer, COUNTERS_BUFFER_SIZE);
+        return;
+    }
+
+    now.fc_TXRetrans = LE32(cnt[CNT_TXRETRANS]);
+    now.fc_TXError = LE32(cnt[CNT_TXERROR]);
+    now.fc_TXNoBuf = LE32(cnt[CNT_TXNOBUF]);
+    now.fc_TXUnderflow = LE32(cnt[CNT_TXUFLO]);
+    now.fc_RXError = LE32(cnt[CNT_RXERROR]);
+    now.fc_RXNoBuf = LE32(cnt[CNT_RXNOBUF]);
+    now.fc_RXOverflow = LE32(cnt[CNT_RXOFLO]);
+
+    FreePooled(WiFiBase->w_MemPool, buffer, COUNTERS_BUFFER_SIZE);
+
+    /* First snapshot after going online is the reference only */
+    if (unit->wu_FWCountersValid)
+    {
+        unit->wu_SpecialStats[SS_FW_TX_RETRIES] += now.fc_TXRetrans - last->fc_TXRetrans;
+        unit->wu_SpecialStats[SS_FW_TX_UNDERRUNS] += now.fc_TXUnderflow - last->fc_TXUnderflow;
+        unit->wu_SpecialStats[SS_FW_TX_ERRORS] += now.fc_TXError - last->fc_TXError;
+        unit->wu_SpecialStats[SS_FW_TX_DROPS] += now.fc_TXNoBuf - last->fc_TXNoBuf;
+        unit->wu_SpecialStats[SS_FW_RX_ERRORS] += now.fc_RXError - last->fc_RXError;
+        unit->wu_SpecialStats[SS_FW_RX_DROPS] += now.fc_RXNoBuf - last->fc_RXNoBuf;
+        unit->wu_SpecialStats[SS_FW_RX_OVERFLOWS] += now.fc_RXOverflow - last->fc_RXOverflow;
+
+        unit->wu_Stats.BadData += now.fc_RXError - last->fc_RXError;
+        unit->wu_Stats.Overruns += (now.fc_RXOverflow - last->fc_RXOverflow) + (now.fc_RXNoBuf - last->fc_RXNoBuf);
+    }
+
+    *last = now;
+    unit->wu_FWCountersValid = TRUE;
+}
+
+/*
+    Called once a second from the unit task. If write requests or control messages are waiting, or control
+    messages timed out, and no packet moved for STALL_TIMEOUT seconds, firmware console and trap record are
+    dumped to the log. Returns TRUE while a stall is suspected or the receiver is gone, the caller should not
+    send control messages then, so that the ticks keep coming once a second.
+*/
+static BOOL StallTick(struct WiFiUnit *unit)
+{
+    struct WiFiBase *WiFiBase = unit->wu_Base;
+    struct ExecBase *SysBase = WiFiBase->w_SysBase;
+    struct SDIO *sdio = WiFiBase->w_SDIO;
+    struct MinList *ctrlWait;
+    struct List *sendQueue;
+    ULONG progress = unit->wu_Stats.PacketsReceived + unit->wu_Stats.PacketsSent;
+    ULONG timeouts = sdio->s_CtrlTimeouts;
+    BOOL pending;
+
+    /* Wait list lives on the stack of the receiver, Forbid keeps it from going away while it is checked */
+    Forbid();
+    ctrlWait = sdio->s_CtrlWaitList;
+    if (sdio->s_ReceiverTask == NULL || ctrlWait == NULL)
+    {
+        Permit();
+        return TRUE;
+    }
+
+    sendQueue = &sdio->s_SenderPort->mp_MsgList;
+    pending = sendQueue->lh_TailPred != (struct Node *)sendQueue ||
+              ctrlWait->mlh_TailPred != (struct MinNode *)ctrlWait ||
+              timeouts != unit->wu_StallTimeouts;
+    Permit();
+
+    unit->wu_StallTimeouts = timeouts;
+
+    /*
+        Once suspected, the stall lasts until a packet moves, control messages are not sent meanwhile so their
+        timeouts would not show up as pending work. It is given up after the dump if nothing is pending anymore
+    */
+    if (progress != unit->wu_StallProgress ||
+        (!pending && (unit->wu_StallSeconds == 0 || unit->wu_StallSeconds >= STALL_TIMEOUT)))
+    {
+        unit->wu_StallProgress = progress;
+        unit->wu_StallSeconds = 0;
+        return FALSE;
+    }
+
+    if (unit->wu_StallSeconds < 255 && ++unit->wu_StallSeconds == STALL_TIMEOUT)
+    {
+        LOG(WiFiBase, LOG_ERROR, "[WiFi.0] No progress for %ld seconds, dumping firmware state\n", STALL_TIMEOUT);
+        chip_dump_firmware_state(sdio->s_Chip, LOG_ERROR);
+    }
+
+    return TRUE;
+}
+
 void UnitTask(struct WiFiUnit *unit, struct Task *parent)
 {
     struct WiFiBase *WiFiBase = unit->wu_Base;
@@ -48,13 +332,17 @@ void UnitTask(struct WiFiUnit *unit, struct Task *parent)
     tr = (struct timerequest *)CreateIORequest(port, sizeof(struct timerequest));
     unit->wu_CmdQueue = CreateMsgPort();
     unit->wu_ScanQueue = CreateMsgPort();
+    unit->wu_ScanContinue = CreateMsgPort();
+    unit->wu_ScanRiders = CreateMsgPort();
 
     unit->wu_Task = FindTask(NULL);
 
-    if (port == NULL || tr == NULL || unit->wu_CmdQueue == NULL) // || unit->wu_WriteQueue == NULL)
+    if (port == NULL || tr == NULL || unit->wu_CmdQueue == NULL || unit->wu_ScanQueue == NULL || unit->wu_ScanContinue == NULL || unit->wu_ScanRiders == NULL)
     {
         D(bug("[WiFi.0] Failed to create requested MsgPorts\n"));
         
+        DeleteMsgPort(unit->wu_ScanRiders);
+        DeleteMsgPort(unit->wu_ScanContinue);
         DeleteMsgPort(unit->wu_ScanQueue);
         DeleteMsgPort(unit->wu_CmdQueue);
         DeleteIORequest((struct IORequest *)tr);
@@ -70,6 +358,8 @@ void UnitTask(struct WiFiUnit *unit, struct Task *parent)
         DeleteMsgPort(port);
         DeleteMsgPort(unit->wu_CmdQueue);
         DeleteMsgPort(unit->wu_ScanQueue);
+        DeleteMsgPort(unit->wu_ScanContinue);
+        DeleteMsgPort(unit->wu_ScanRiders);
         unit->wu_CmdQueue = NULL;
         return;
     }
@@ -146,6 +436,24 @@ void UnitTask(struct WiFiUnit *unit, struct Task *parent)
                 scanDelay = 20;
             }
 #endif
+            // Ticks send control messages, skip them once shutdown is requested or the receiver is gone
+            if ((sigset & SIGBREAKF_CTRL_C) == 0 && WiFiBase->w_SDIO->s_ReceiverTask != NULL)
+            {
+                ObtainSemaphore(&unit->wu_Lock);
+                if (!StallTick(unit))
+                {
+                    RoamTick(unit);
+                    CountersTick(unit);
+                }
+
+                if (++unit->wu_ConsoleTick >= CONSOLE_INTERVAL)
+                {
+                    unit->wu_ConsoleTick = 0;
+                    chip_dump_firmware_state(WiFiBase->w_SDIO->s_Chip, LOG_DEBUG);
+                }
+                ReleaseSemaphore(&unit->wu_Lock);
+            }
+
             // Restart timer request
             tr->tr_node.io_Command = TR_ADDREQUEST;
             tr->tr_time.tv_sec = 1;
@@ -193,13 +501,16 @@ void UnitTask(struct WiFiUnit *unit, struct Task *parent)
     DeleteMsgPort(port);
     DeleteMsgPort(unit->wu_CmdQueue);
     DeleteMsgPort(unit->wu_ScanQueue);
+    DeleteMsgPort(unit->wu_ScanContinue);
+    DeleteMsgPort(unit->wu_ScanRiders);
+
+    D(bug("[WiFi.0] Unit task used %ld of %ld bytes of stack\n", StackUsed(unit->wu_Task), UNIT_STACK_SIZE * sizeof(ULONG)));
     unit->wu_Task = NULL;
 }
 
 void StartUnit(struct WiFiUnit *unit)
 {
     struct WiFiBase *WiFiBase = unit->wu_Base;
-    struct ExecBase *SysBase = WiFiBase->w_SysBase;
 
 #if 0
     if (WiFiBase->w_DosBase)
@@ -223,9 +534,9 @@ void StartUnit(struct WiFiUnit *unit)
 
     PacketGetVar(WiFiBase->w_SDIO, "cur_etheraddr", unit->wu_OrigEtherAddr, 6);
 
-    D(bug("[WiFi.0] Ethernet addr: %02lx:%02lx:%02lx:%02lx:%02lx:%02lx\n",
+    LOG(WiFiBase, LOG_INFO, "[WiFi.0] Ethernet addr: %02lx:%02lx:%02lx:%02lx:%02lx:%02lx\n",
         unit->wu_OrigEtherAddr[0], unit->wu_OrigEtherAddr[1], unit->wu_OrigEtherAddr[2],
-        unit->wu_OrigEtherAddr[3], unit->wu_OrigEtherAddr[4], unit->wu_OrigEtherAddr[5]));
+        unit->wu_OrigEtherAddr[3], unit->wu_OrigEtherAddr[4], unit->wu_OrigEtherAddr[5]);
 
     /* Don't set EtherAddr yet. */
     _bzero(unit->wu_EtherAddr, 6);
@@ -248,7 +559,7 @@ void StartUnitTask(struct WiFiUnit *unit)
     // Get all memory we need for the receiver task
     task = AllocMem(sizeof(struct Task), MEMF_PUBLIC | MEMF_CLEAR);
     ml = AllocMem(sizeof(struct MemList) + sizeof(struct MemEntry), MEMF_PUBLIC | MEMF_CLEAR);
-    stack = AllocMem(UNIT_STACK_SIZE * sizeof(ULONG), MEMF_PUBLIC | MEMF_CLEAR);
+    stack = AllocMem(UNIT_STACK_SIZE * sizeof(ULONG), MEMF_PUBLIC);
 
     // Prepare mem list, put task and its stack there
     ml->ml_NumEntries = 2;
@@ -258,6 +569,9 @@ void StartUnitTask(struct WiFiUnit *unit)
     ml->ml_ME[1].me_Un.meu_Addr = &stack[0];
     ml->ml_ME[1].me_Length = UNIT_STACK_SIZE * sizeof(ULONG);
 
+    // Fill stack with a pattern, used part of it can be found later with StackUsed
+    FillStack(stack, UNIT_STACK_SIZE);
+
     // Set up stack
     task->tc_SPLower = &stack[0];
     task->tc_SPUpper = &stack[UNIT_STACK_SIZE];
@@ -298,7 +612,7 @@ static const UWORD WiFi_SupportedCommands[] = {
     // S2_TRACKTYPE,
     // S2_UNTRACKTYPE,
     // S2_GETTYPESTATS,
-//    S2_GETSPECIALSTATS, <-- not used yet!
+    S2_GETSPECIALSTATS,
     S2_GETGLOBALSTATS,
     S2_ONEVENT,
     S2_READORPHAN,
@@ -394,7 +708,7 @@ static int Do_S2_ONEVENT(struct IOSana2Req *io)
     if (unit->wu_Flags & IFF_ONLINE) preset = S2EVENT_ONLINE;
     else preset = S2EVENT_OFFLINE;
 
-    D(bug("[WiFi.0] S2_ONEVENT(%08lx)\n", io->ios2_WireError));
+    LOG(unit->wu_Base, LOG_DEBUG, "[WiFi.0] S2_ONEVENT(%08lx)\n", io->ios2_WireError);
 
     /* If any unsupported events are requested, report an error */
     if (io->ios2_WireError & ~(EVENT_MASK))
@@ -412,7 +726,7 @@ static int Do_S2_ONEVENT(struct IOSana2Req *io)
     }
     else
     {
-        D(bug("[WiFi] Event listener moved into list\n"));
+        LOG(unit->wu_Base, LOG_DEBUG, "[WiFi] Event listener moved into list\n");
         /* Remove QUICK flag and put message on event listener list */
         struct Opener *opener = io->ios2_BufferManagement;
         io->ios2_Req.io_Flags &= ~IOF_QUICK;
@@ -425,9 +739,8 @@ static int Do_S2_GETSIGNALQUALITY(struct IOSana2Req *io)
 {
     struct WiFiUnit *unit = (struct WiFiUnit *)io->ios2_Req.io_Unit;
     struct WiFiBase *WiFiBase = unit->wu_Base;
-    struct ExecBase *SysBase = unit->wu_Base->w_SysBase;
 
-    D(bug("[WiFi.0] S2_GETSIGNALQUALITY\n"));
+    LOG(WiFiBase, LOG_DEBUG, "[WiFi.0] S2_GETSIGNALQUALITY\n");
 
     /* If expected flags match preset, return back (almost) immediately */
     if ((unit->wu_Flags & IFF_ONLINE) == 0)
@@ -449,11 +762,118 @@ static int Do_S2_GETSIGNALQUALITY(struct IOSana2Req *io)
         PacketCmdIntGet(WiFiBase->w_SDIO, BRCMF_C_GET_RSSI, (APTR)&quality->SignalLevel);
         PacketCmdIntGet(WiFiBase->w_SDIO, BRCMF_C_GET_PHY_NOISE, (APTR)&quality->NoiseLevel);
 
-        D(bug("[WiFi.0] Signal: %ld, Noise: %ld\n", quality->SignalLevel, quality->NoiseLevel));
+        LOG(WiFiBase, LOG_DEBUG, "[WiFi.0] Signal: %ld, Noise: %ld\n", quality->SignalLevel, quality->NoiseLevel);
         return 1;
     }
 }
 
+static const struct {
+    ULONG       ss_Type;
+    ULONG       ss_Slot;
+    const char *ss_Name;
+} SpecialStats[] = {
+    { S2SS_WIFIPI_RX_BYTES,         SS_RX_BYTES,            "Bytes received" },
+    { S2SS_WIFIPI_TX_BYTES,         SS_TX_BYTES,            "Bytes sent" },
+    { S2SS_WIFIPI_RX_GLOM_FRAMES,   SS_RX_GLOM_FRAMES,      "Glom frames received" },
+    { S2SS_WIFIPI_RX_GLOM_PACKETS,  SS_RX_GLOM_PACKETS,     "Packets in received glom frames" },
+    { S2SS_WIFIPI_TX_GLOM_FRAMES,   SS_TX_GLOM_FRAMES,      "Glom frames sent" },
+    { S2SS_WIFIPI_TX_GLOM_PACKETS,  SS_TX_GLOM_PACKETS,     "Packets in sent glom frames" },
+    { S2SS_WIFIPI_SDIO_CMD52,       SS_SDIO_CMD52,          "SDIO CMD52 issued" },
+    { S2SS_WIFIPI_SDIO_CMD53,       SS_SDIO_CMD53,          "SDIO CMD53 issued" },
+    { S2SS_WIFIPI_POLL_DATA,        SS_POLL_DATA,           "Poll wakeups with data" },
+    { S2SS_WIFIPI_POLL_IDLE,        SS_POLL_IDLE,           "Poll wakeups without data" },
+    { S2SS_WIFIPI_TX_PASS_PEAK,     SS_TX_PASS_PEAK,        "Peak write requests per pass" },
+    { S2SS_WIFIPI_CTRL_QUEUE_PEAK,  SS_CTRL_QUEUE_PEAK,     "Peak control queue depth" },
+    { S2SS_ETHERNET_RETRIES,        SS_FW_TX_RETRIES,       "Retransmissions" },
+    { S2SS_ETHERNET_FIFO_UNDERRUNS, SS_FW_TX_UNDERRUNS,     "Transmit FIFO underruns" },
+    { S2SS_WIFIPI_FW_TX_ERRORS,     SS_FW_TX_ERRORS,        "Firmware transmit errors" },
+    { S2SS_WIFIPI_FW_TX_DROPS,      SS_FW_TX_DROPS,         "Firmware transmit drops" },
+    { S2SS_WIFIPI_FW_RX_ERRORS,     SS_FW_RX_ERRORS,        "Firmware receive errors" },
+    { S2SS_WIFIPI_FW_RX_DROPS,      SS_FW_RX_DROPS,         "Firmware receive drops" },
+    { S2SS_WIFIPI_FW_RX_OVERFLOWS,  SS_FW_RX_OVERFLOWS,     "Firmware receive FIFO overflows" },
+    { S2SS_WIFIPI_CTRL_RTT,         SS_CTRL_RTT,            "Control round trip < 250us" },
+    { S2SS_WIFIPI_CTRL_RTT + 1,     SS_CTRL_RTT + 1,        "Control round trip < 1ms" },
+    { S2SS_WIFIPI_CTRL_RTT + 2,     SS_CTRL_RTT + 2,        "Control round trip < 4ms" },
+    { S2SS_WIFIPI_CTRL_RTT + 3,     SS_CTRL_RTT + 3,        "Control round trip >= 4ms" },
+    { S2SS_WIFIPI_RX_LATENCY,       SS_RX_LATENCY,          "RX to reply latency < 250us" },
+    { S2SS_WIFIPI_RX_LATENCY + 1,   SS_RX_LATENCY + 1,      "RX to reply latency < 1ms" },
+    { S2SS_WIFIPI_RX_LATENCY + 2,   SS_RX_LATENCY + 2,      "RX to reply latency < 4ms" },
+    { S2SS_WIFIPI_RX_LATENCY + 3,   SS_RX_LATENCY + 3,      "RX to reply latency >= 4ms" },
+    { S2SS_WIFIPI_ROAM_SCANS,       SS_ROAM_SCANS,          "Roam scans" },
+    { S2SS_WIFIPI_ROAM_ATTEMPTS,    SS_ROAM_ATTEMPTS,       "Roam attempts" },
+    { S2SS_WIFIPI_ROAM_SUCCESSES,   SS_ROAM_SUCCESSES,      "Successful roams" },
+    { S2SS_WIFIPI_BOOT_INIT,        SS_BOOT + BOOT_INIT,    "Boot: init (us)" },
+    { S2SS_WIFIPI_BOOT_DT,          SS_BOOT + BOOT_DT,      "Boot: device tree and clocks (us)" },
+    { S2SS_WIFIPI_BOOT_SDIO,        SS_BOOT + BOOT_SDIO,    "Boot: SDIO init (us)" },
+    { S2SS_WIFIPI_BOOT_EROM,        SS_BOOT + BOOT_EROM,    "Boot: EROM scan (us)" },
+    { S2SS_WIFIPI_BOOT_FIRMWARE,    SS_BOOT + BOOT_FIRMWARE,"Boot: firmware upload (us)" },
+    { S2SS_WIFIPI_BOOT_CHIP,        SS_BOOT + BOOT_CHIP,    "Boot: chip init (us)" },
+    { S2SS_WIFIPI_BOOT_TASKS,       SS_BOOT + BOOT_TASKS,   "Boot: task start (us)" },
+    { S2SS_WIFIPI_BOOT_CLM,         SS_BOOT + BOOT_CLM,     "Boot: CLM upload (us)" },
+    { S2SS_WIFIPI_BOOT_CONFIG,      SS_BOOT + BOOT_CONFIG,  "Boot: configuration (us)" },
+    { S2SS_WIFIPI_STACK_RECEIVER,   SS_STACK + STACK_RECEIVER,  "Stack used: receiver" },
+    { S2SS_WIFIPI_STACK_UNIT,       SS_STACK + STACK_UNIT,      "Stack used: unit" },
+    { S2SS_WIFIPI_STACK_LOG,        SS_STACK + STACK_LOG,       "Stack used: log" },
+    { S2SS_WIFIPI_POOL_CTRL,        SS_POOL + POOL_CTRL,        "Pool: control messages" },
+    { S2SS_WIFIPI_POOL_SCAN,        SS_POOL + POOL_SCAN,        "Pool: scan results" },
+    { S2SS_WIFIPI_POOL_MULTICAST,   SS_POOL + POOL_MULTICAST,   "Pool: multicast lists" },
+    { S2SS_WIFIPI_POOL_FIRMWARE,    SS_POOL + POOL_FIRMWARE,    "Pool: firmware images" },
+    { S2SS_WIFIPI_POOL_CTRL_PEAK,   SS_POOL_PEAK + POOL_CTRL,   "Pool peak: control messages" },
+    { S2SS_WIFIPI_POOL_SCAN_PEAK,   SS_POOL_PEAK + POOL_SCAN,   "Pool peak: scan results" },
+    { S2SS_WIFIPI_POOL_MULTICAST_PEAK, SS_POOL_PEAK + POOL_MULTICAST, "Pool peak: multicast lists" },
+    { S2SS_WIFIPI_POOL_FIRMWARE_PEAK,  SS_POOL_PEAK + POOL_FIRMWARE,  "Pool peak: firmware images" },
+};
+
+static int Do_S2_GETSPECIALSTATS(struct IOSana2Req *io)
+{
+    struct WiFiUnit *unit = (struct WiFiUnit *)io->ios2_Req.io_Unit;
+    struct WiFiBase *WiFiBase = unit->wu_Base;
+    struct ExecBase *SysBase = unit->wu_Base->w_SysBase;
+    struct Sana2SpecialStatHeader *header = io->ios2_StatData;
+    struct Sana2SpecialStatRecord *record = (APTR)(header + 1);
+    ULONG count = sizeof(SpecialStats) / sizeof(SpecialStats[0]);
+
+    LOG(WiFiBase, LOG_DEBUG, "[WiFi.0] S2_GETSPECIALSTATS\n");
+
+    unit->wu_SpecialStats[SS_SDIO_CMD52] = WiFiBase->w_SDIO->s_Cmd52Count;
+    unit->wu_SpecialStats[SS_SDIO_CMD53] = WiFiBase->w_SDIO->s_Cmd53Count;
+    unit->wu_SpecialStats[SS_ROAM_SCANS] = unit->wu_Roam.rs_Scans;
+    unit->wu_SpecialStats[SS_ROAM_ATTEMPTS] = unit->wu_Roam.rs_Attempts;
+    unit->wu_SpecialStats[SS_ROAM_SUCCESSES] = unit->wu_Roam.rs_Roams;
+    CopyMem(WiFiBase->w_BootTime, &unit->wu_SpecialStats[SS_BOOT], sizeof(WiFiBase->w_BootTime));
+
+    for (ULONG i = 0; i < POOL_USER_COUNT; i++)
+    {
+        unit->wu_SpecialStats[SS_POOL + i] = WiFiBase->w_PoolUsage[i].pu_Current;
+        unit->wu_SpecialStats[SS_POOL_PEAK + i] = WiFiBase->w_PoolUsage[i].pu_Peak;
+    }
+
+    /* Forbid keeps the tasks from exiting and freeing their stacks while they are checked */
+    Forbid();
+    if (WiFiBase->w_SDIO->s_ReceiverTask)
+        unit->wu_SpecialStats[SS_STACK + STACK_RECEIVER] = StackUsed(WiFiBase->w_SDIO->s_ReceiverTask);
+    if (unit->wu_Task)
+        unit->wu_SpecialStats[SS_STACK + STACK_UNIT] = StackUsed(unit->wu_Task);
+    if (WiFiBase->w_Log && WiFiBase->w_Log->l_Task)
+        unit->wu_SpecialStats[SS_STACK + STACK_LOG] = StackUsed(WiFiBase->w_Log->l_Task);
+    Permit();
+
+    if (count > header->RecordCountMax)
+        count = header->RecordCountMax;
+
+    for (ULONG i = 0; i < count; i++)
+    {
+        record[i].Type = SpecialStats[i].ss_Type;
+        record[i].Count = unit->wu_SpecialStats[SpecialStats[i].ss_Slot];
+        record[i].String = (const TEXT *)SpecialStats[i].ss_Name;
+    }
+
+    header->RecordCountSupplied = count;
+    io->ios2_Req.io_Error = 0;
+
+    return 1;
+}
+
 static int Do_S2_SETKEY(struct IOSana2Req *io)
 {
     struct WiFiUnit *unit = (struct WiFiUnit *)io->ios2_Req.io_Unit;
@@ -645,12 +1065,17 @@ static int Do_S2_SETOPTIONS(struct IOSana2Req *io)
         CopyMem(ssid, &unit->wu_JoinParams.ej_SSID.ssid_Value, len);
     }
 
-    /* Get BSSID or put broadcast BSSID */
+    /* All channels unless BSSID and chanspec are known from previous join */
+    unit->wu_JoinParams.ej_Assoc.ap_ChanspecNum = 0;
+    unit->wu_JoinParams.ej_Assoc.ap_ChanSpecList[0] = 0;
+    unit->wu_JoinHinted = FALSE;
+
+    /* Get BSSID, use join hint or put broadcast BSSID */
     if ((ti = FindTagItem(S2INFO_BSSID, io->ios2_Data)))
     {
         CopyMem((APTR)ti->ti_Data, &unit->wu_JoinParams.ej_Assoc.ap_BSSID, 6);
     }
-    else
+    else if (!ApplyJoinHint(unit))
     {
         unit->wu_JoinParams.ej_Assoc.ap_BSSID[0] = 0xff;
         unit->wu_JoinParams.ej_Assoc.ap_BSSID[1] = 0xff;
@@ -660,10 +1085,6 @@ static int Do_S2_SETOPTIONS(struct IOSana2Req *io)
         unit->wu_JoinParams.ej_Assoc.ap_BSSID[5] = 0xff;
     }
 
-    /* TODO: Fill chan spec! */
-    unit->wu_JoinParams.ej_Assoc.ap_ChanspecNum = 0;
-    unit->wu_JoinParams.ej_Assoc.ap_ChanSpecList[0] = 0;
-
     ti = FindTagItem(S2INFO_WPAInfo, io->ios2_Data);
     if (ti != NULL && ti->ti_Data != 0)
     {
@@ -695,7 +1116,11 @@ static int Do_S2_SETOPTIONS(struct IOSana2Req *io)
         ULONG pval = 0;
         ULONG mfp = 0;
         ULONG wpa_auth = 0;
-        int is_rsn_ie = !FindWPAIE(ie_b, length);
+        struct IEIndex index;
+        int is_rsn_ie;
+
+        IndexIEs(&index, ie_b, length);
+        is_rsn_ie = GetIndexedIE(&index, ie_b, IE_WPA) == NULL;
 
         D(bug("[WiFi.0] WPAInfo is %s\n", (ULONG)(is_rsn_ie ? "RSN":"WPA")));
 
@@ -1030,7 +1455,7 @@ static int Do_CMD_FLUSH(struct IOSana2Req *io)
     struct IOSana2Req *req;
     struct Opener *opener;
 
-    D(bug("[WiFi.0] CMD_FLUSH\n"));
+    LOG(unit->wu_Base, LOG_DEBUG, "[WiFi.0] CMD_FLUSH\n");
 
     /* Flush and cancel all write requests */
     while ((req = (struct IOSana2Req *)GetMsg(sdio->s_SenderPort)))
@@ -1058,6 +1483,18 @@ static int Do_CMD_FLUSH(struct IOSana2Req *io)
         req->ios2_WireError = 0;
         ReplyMsg((struct Message *)req);
     }
+    while ((req = (struct IOSana2Req *)GetMsg(unit->wu_ScanContinue)))
+    {
+        req->ios2_Req.io_Error = IOERR_ABORTED;
+        req->ios2_WireError = 0;
+        ReplyMsg((struct Message *)req);
+    }
+    while ((req = (struct IOSana2Req *)GetMsg(unit->wu_ScanRiders)))
+    {
+        req->ios2_Req.io_Error = IOERR_ABORTED;
+        req->ios2_WireError = 0;
+        ReplyMsg((struct Message *)req);
+    }
     Enable();
 
     /* For every opener, flush orphan and even queues */
@@ -1084,12 +1521,11 @@ static int Do_CMD_FLUSH(struct IOSana2Req *io)
 static int Do_NSCMD_DEVICEQUERY(struct IOStdReq *io)
 {
     struct WiFiUnit *unit = (struct WiFiUnit *)io->io_Unit;
-    struct ExecBase *SysBase = unit->wu_Base->w_SysBase;
 
     struct NSDeviceQueryResult *dq;
     dq = io->io_Data;
 
-    D(bug("[WiFi.0] NSCMD_DEVICEQUERY\n"));
+    LOG(unit->wu_Base, LOG_DEBUG, "[WiFi.0] NSCMD_DEVICEQUERY\n");
 
     /* Fill out structure */
     dq->nsdqr_DeviceType = NSDEVTYPE_SANA2;
@@ -1128,7 +1564,7 @@ static int Do_S2_READORPHAN(struct IOSana2Req *io)
     struct WiFiUnit *unit = (struct WiFiUnit *)io->ios2_Req.io_Unit;
     struct ExecBase *SysBase = unit->wu_Base->w_SysBase;
 
-    D(bug("[WiFi.0] CMD_READORPHAN\n"));
+    LOG(unit->wu_Base, LOG_DEBUG, "[WiFi.0] CMD_READORPHAN\n");
 
     // If interface is up, put the read request in units read queue
     if (unit->wu_Flags & IFF_UP)
@@ -1186,27 +1622,22 @@ static void UpdateMCastList(struct WiFiUnit *unit)
     UBYTE *list = AllocVecPooled(WiFiBase->w_MemPool, totalCount * 6 + 4);
     UBYTE *dst = list + 4;
 
+    PoolUsed(WiFiBase, POOL_MULTICAST, VecPooledSize(list));
+
     /* Put number of entries in the list first */
     *(ULONG*)list = LE32(totalCount);
 
     ForeachNode(&unit->wu_MulticastRanges, range)
     {
-        union {
-            uint64_t    u64;
-            uint8_t     u8[8];
-            uint16_t    u16[4];
-            uint32_t    u32[2];
-        } u;
-
-        for (u.u64 = range->mr_LowerBound; u.u64 <= range->mr_UpperBound; u.u64++)
+        for (uint64_t mac = range->mr_LowerBound; mac <= range->mr_UpperBound; mac++)
         {
-            *(UWORD*)dst = u.u16[1]; dst+=2;
-            *(ULONG*)dst = u.u32[1]; dst+=4;
+            for (int i=0; i < 6; i++) *dst++ = mac >> (40 - 8 * i);
         }
     }
 
     PacketSetVar(sdio, "mcast_list", list, totalCount * 6 + 4);
 
+    PoolUsed(WiFiBase, POOL_MULTICAST, -VecPooledSize(list));
     FreeVecPooled(WiFiBase->w_MemPool, list);
 }
 
@@ -1216,49 +1647,28 @@ static int Do_S2_ADDMULTICASTADDRESSES(struct IOSana2Req *io)
     struct WiFiBase *WiFiBase = unit->wu_Base;
     struct ExecBase *SysBase = WiFiBase->w_SysBase;
 
-    D(bug("[WiFi.0] S2_ADDMULTICASTADDRESS%s\n", (ULONG)(io->ios2_Req.io_Command == S2_ADDMULTICASTADDRESSES ? "ES":"")));
+    LOG(WiFiBase, LOG_DEBUG, "[WiFi.0] S2_ADDMULTICASTADDRESS%s\n", (ULONG)(io->ios2_Req.io_Command == S2_ADDMULTICASTADDRESSES ? "ES":""));
 
     struct MulticastRange *range;
-    union {
-        uint64_t u64;
-        uint8_t u8[8];
-    } u;
-
-    u.u8[0] = u.u8[1] = 0;
     uint64_t lower_bound, upper_bound;
-    u.u8[2] = io->ios2_SrcAddr[0];
-    u.u8[3] = io->ios2_SrcAddr[1];
-    u.u8[4] = io->ios2_SrcAddr[2];
-    u.u8[5] = io->ios2_SrcAddr[3];
-    u.u8[6] = io->ios2_SrcAddr[4];
-    u.u8[7] = io->ios2_SrcAddr[5];
-    lower_bound = u.u64;
+    lower_bound = 0;
+    for (int i=0; i < 6; i++) lower_bound = (lower_bound << 8) | io->ios2_SrcAddr[i];
     if (io->ios2_Req.io_Command == S2_ADDMULTICASTADDRESS)
     {
         upper_bound = lower_bound;
     }
     else
     {
-        u.u8[2] = io->ios2_DstAddr[0];
-        u.u8[3] = io->ios2_DstAddr[1];
-        u.u8[4] = io->ios2_DstAddr[2];
-        u.u8[5] = io->ios2_DstAddr[3];
-        u.u8[6] = io->ios2_DstAddr[4];
-        u.u8[7] = io->ios2_DstAddr[5];
-        upper_bound = u.u64;
+        upper_bound = 0;
+        for (int i=0; i < 6; i++) upper_bound = (upper_bound << 8) | io->ios2_DstAddr[i];
     }
 
     for (uint64_t mac = lower_bound; mac <= upper_bound; mac++)
     {
-        union {
-            uint64_t u64;
-            uint8_t u8[8];
-        } u;
-        u.u64 = mac;
-
         D(bug("[WiFi.0] * "));
         D(bug("%02lx:%02lx:%02lx:%02lx:%02lx:%02lx\n", 
-                u.u8[2], u.u8[3], u.u8[4], u.u8[5], u.u8[6], u.u8[7]));
+                (ULONG)(mac >> 40) & 0xff, (ULONG)(mac >> 32) & 0xff, (ULONG)(mac >> 24) & 0xff,
+                (ULONG)(mac >> 16) & 0xff, (ULONG)(mac >> 8) & 0xff, (ULONG)mac & 0xff));
     }
 
     /* Go through already registered multicast ranges. If one is found, increase use count and return */
@@ -1273,6 +1683,7 @@ static int Do_S2_ADDMULTICASTADDRESSES(struct IOSana2Req *io)
 
     /* No range was found. Create new one and add the multicast range on the WiFi module */
     range = AllocPooledClear(WiFiBase->w_MemPool, sizeof(struct MulticastRange));
+    PoolUsed(WiFiBase, POOL_MULTICAST, sizeof(struct MulticastRange));
     range->mr_UseCount = 1;
     range->mr_LowerBound = lower_bound;
     range->mr_UpperBound = upper_bound;
@@ -1290,37 +1701,20 @@ static int Do_S2_DELMULTICASTADDRESSES(struct IOSana2Req *io)
     struct WiFiBase *WiFiBase = unit->wu_Base;
     struct ExecBase *SysBase = WiFiBase->w_SysBase;
 
-    D(bug("[WiFi.0] S2_DELMULTICASTADDRESS%s\n", (ULONG)(io->ios2_Req.io_Command == S2_DELMULTICASTADDRESSES ? "ES":"")));
-
-    union {
-        uint64_t u64;
-        uint8_t u8[8];
-    } u;
-
-    u.u8[0] = u.u8[1] = 0;
+    LOG(WiFiBase, LOG_DEBUG, "[WiFi.0] S2_DELMULTICASTADDRESS%s\n", (ULONG)(io->ios2_Req.io_Command == S2_DELMULTICASTADDRESSES ? "ES":""));
 
     struct MulticastRange *range;
     uint64_t lower_bound, upper_bound;
-    u.u8[2] = io->ios2_SrcAddr[0];
-    u.u8[3] = io->ios2_SrcAddr[1];
-    u.u8[4] = io->ios2_SrcAddr[2];
-    u.u8[5] = io->ios2_SrcAddr[3];
-    u.u8[6] = io->ios2_SrcAddr[4];
-    u.u8[7] = io->ios2_SrcAddr[5];
-    lower_bound = u.u64;
+    lower_bound = 0;
+    for (int i=0; i < 6; i++) lower_bound = (lower_bound << 8) | io->ios2_SrcAddr[i];
     if (io->ios2_Req.io_Command == S2_ADDMULTICASTADDRESS)
     {
         upper_bound = lower_bound;
     }
     else
     {
-        u.u8[2] = io->ios2_DstAddr[0];
-        u.u8[3] = io->ios2_DstAddr[1];
-        u.u8[4] = io->ios2_DstAddr[2];
-        u.u8[5] = io->ios2_DstAddr[3];
-        u.u8[6] = io->ios2_DstAddr[4];
-        u.u8[7] = io->ios2_DstAddr[5];
-        upper_bound = u.u64;
+        upper_bound = 0;
+        for (int i=0; i < 6; i++) upper_bound = (upper_bound << 8) | io->ios2_DstAddr[i];
     }
 
     /* Go through already registered multicast ranges. Once found, decrease use count */
@@ -1334,6 +1728,7 @@ static int Do_S2_DELMULTICASTADDRESSES(struct IOSana2Req *io)
             if (range->mr_UseCount == 0)
             {
                 Remove((struct Node *)range);
+                PoolUsed(WiFiBase, POOL_MULTICAST, -(LONG)sizeof(struct MulticastRange));
                 FreePooled(WiFiBase->w_MemPool, range, sizeof(struct MulticastRange));
 
                 /* Remove the range on WiFi now... */
@@ -1351,14 +1746,30 @@ static int Do_S2_GETNETWORKS(struct IOSana2Req *io)
     struct WiFiUnit *unit = (struct WiFiUnit *)io->ios2_Req.io_Unit;
     struct WiFiBase *WiFiBase = unit->wu_Base;
     struct ExecBase *SysBase = WiFiBase->w_SysBase;
+    struct Library *UtilityBase = WiFiBase->w_UtilityBase;
+    struct TagItem *tags = io->ios2_StatData;
+    ULONG maxAge = 0;
+
+    D(bug("[WiFi.0] S2_GETNETWORKS\n"));
+
+    if (tags != NULL)
+        maxAge = GetTagData(S2INFO_MaxAge, 0, tags);
+
+    /* Caller accepts cached networks. Answer now if the cache is recent enough and refresh it in background */
+    if (maxAge != 0 && GetCachedNetworks(io, maxAge))
+    {
+        unit->wu_ScanRefresh = TRUE;
+        return 1;
+    }
 
     /* GetNetworks is never quick */
     io->ios2_Req.io_Flags &= ~IOF_QUICK;
-    
-    D(bug("[WiFi.0] S2_GETNETWORKS\n"));
 
-    /* Put it into scan queue */
-    PutMsg(unit->wu_ScanQueue, (struct Message *)io);
+    /* Follow-up of incremental scan collects networks found since previous reply, otherwise queue new scan */
+    if (tags != NULL && FindTagItem(S2INFO_Incremental, tags) != NULL && unit->wu_ScanIncremental)
+        PutMsg(unit->wu_ScanContinue, (struct Message *)io);
+    else
+        PutMsg(unit->wu_ScanQueue, (struct Message *)io);
 
     return 0;
 }
@@ -1367,11 +1778,10 @@ int Do_S2_DEVICEQUERY(struct IOSana2Req *io)
 {
     struct WiFiUnit *unit = (struct WiFiUnit *)io->ios2_Req.io_Unit;
     struct WiFiBase *WiFiBase = unit->wu_Base;
-    struct ExecBase *SysBase = WiFiBase->w_SysBase;
     struct Sana2DeviceQuery *info = io->ios2_StatData;
     ULONG size;
 
-    D(bug("[WiFi.0] S2_DEVICEQUERY\n"));
+    LOG(WiFiBase, LOG_DEBUG, "[WiFi.0] S2_DEVICEQUERY\n");
 
     size = info->SizeAvailable;
     if (size < sizeof(*info))
@@ -1394,20 +1804,21 @@ static int Do_S2_ONLINE(struct IOSana2Req *io)
 {
     struct WiFiUnit *unit = (struct WiFiUnit *)io->ios2_Req.io_Unit;
     struct WiFiBase *WiFiBase = unit->wu_Base;
-    struct ExecBase *SysBase = WiFiBase->w_SysBase;
     struct TimerBase *TimerBase = unit->wu_TimerBase;
 
-    D(bug("[WiFi.0] S2_ONLINE\n"));
+    LOG(WiFiBase, LOG_DEBUG, "[WiFi.0] S2_ONLINE\n");
 
     // Bring all stats to 0
     _bzero(&unit->wu_Stats, sizeof(struct Sana2DeviceStats));
+    _bzero(unit->wu_SpecialStats, sizeof(unit->wu_SpecialStats));
+    unit->wu_FWCountersValid = FALSE;
     
     // Get last start time
     GetSysTime(&unit->wu_Stats.LastStart);
 
     /* If unit was not yet online, report event now */
 
-    D(bug("[WiFi.0] unit->wu_Flags = %08lx\n", unit->wu_Flags));
+    LOG(WiFiBase, LOG_DEBUG, "[WiFi.0] unit->wu_Flags = %08lx\n", unit->wu_Flags);
 
     if ((unit->wu_Flags & IFF_ONLINE) == 0)
     {
@@ -1435,6 +1846,8 @@ static int Do_S2_CONFIGINTERFACE(struct IOSana2Req *io)
     }
     else
     {
+        ULONG phaseStart = timer_us();
+
         /* Try to set HW addr */
         PacketSetVar(sdio, "cur_etheraddr", io->ios2_SrcAddr, 6);
 
@@ -1448,11 +1861,29 @@ static int Do_S2_CONFIGINTERFACE(struct IOSana2Req *io)
         static const char * const types[]= { "UNKNOWN", "N", "AC" };
         if (0 == PacketCmdIntGet(sdio, BRCMF_C_GET_VERSION, &d11Type))
         {
-            D(bug("[WiFi] D11 Version: %s\n", (ULONG)types[d11Type]));
+            LOG(WiFiBase, LOG_INFO, "[WiFi] D11 Version: %s\n", (ULONG)types[d11Type]);
             sdio->s_Chip->c_D11Type = d11Type;
+
+            /* Built once, before any scan. Until then chanspecs are decoded directly */
+            if (!sdio->s_Chip->c_ChanSpecReady)
+            {
+                BuildChanSpecTable(sdio->s_Chip->c_ChanSpecTable, d11Type);
+                sdio->s_Chip->c_ChanSpecReady = TRUE;
+            }
+        }
+
+        /* Newer firmwares report version of scan parameters they expect, the others use version 1 */
+        UWORD scanVersion[3] = { 0, 0, 0 };
+        sdio->s_Chip->c_ScanVersion = ESCAN_REQ_VERSION;
+        if (0 == PacketGetVar(sdio, "scan_ver", scanVersion, sizeof(scanVersion)) && LE16(scanVersion[2]) == ESCAN_REQ_VERSION_V2)
+        {
+            sdio->s_Chip->c_ScanVersion = ESCAN_REQ_VERSION_V2;
         }
+        D(bug("[WiFi] Scan parameters version %ld\n", sdio->s_Chip->c_ScanVersion));
 
+        BOOT_PHASE(WiFiBase, BOOT_CONFIG, phaseStart);
         PacketUploadCLM(sdio);
+        BOOT_PHASE(WiFiBase, BOOT_CLM, phaseStart);
 
         PacketSetVarInt(sdio, "assoc_listen", 10);
 
@@ -1492,6 +1923,7 @@ static int Do_S2_CONFIGINTERFACE(struct IOSana2Req *io)
 #define EVENT_BIT(mask, i) (mask)[(i) / 8] |= 1 << ((i) % 8)
 #define EVENT_BIT_CLEAR(mask, i) (mask)[(i) / 8] &= ~(1 << ((i) % 8))
         EVENT_BIT(ev_mask, BRCMF_E_IF);
+        EVENT_BIT(ev_mask, BRCMF_E_SET_SSID);
         EVENT_BIT(ev_mask, BRCMF_E_LINK);
         EVENT_BIT(ev_mask, BRCMF_E_AUTH);
         EVENT_BIT(ev_mask, BRCMF_E_ASSOC);
@@ -1538,6 +1970,8 @@ static int Do_S2_CONFIGINTERFACE(struct IOSana2Req *io)
         PacketCmdInt(sdio, BRCMF_C_SET_PROMISC, 0);
         PacketCmdInt(sdio, BRCMF_C_UP, 1);
 
+        BOOT_PHASE(WiFiBase, BOOT_CONFIG, phaseStart);
+
         // If Network Config is already set up, attempt to connect.
         // For now, only open networks are supported
         if (WiFiBase->w_NetworkConfig.nc_Open && WiFiBase->w_NetworkConfig.nc_SSID)
@@ -1595,6 +2029,18 @@ static int Do_S2_OFFLINE(struct IOSana2Req *io)
         req->ios2_WireError = 0;
         ReplyMsg((struct Message *)req);
     }
+    while ((req = (struct IOSana2Req *)GetMsg(unit->wu_ScanContinue)))
+    {
+        req->ios2_Req.io_Error = IOERR_ABORTED;
+        req->ios2_WireError = 0;
+        ReplyMsg((struct Message *)req);
+    }
+    while ((req = (struct IOSana2Req *)GetMsg(unit->wu_ScanRiders)))
+    {
+        req->ios2_Req.io_Error = IOERR_ABORTED;
+        req->ios2_WireError = 0;
+        ReplyMsg((struct Message *)req);
+    }
     Enable();
 
     /* Flush and cancel all write requests */
@@ -1649,15 +2095,19 @@ void HandleRequest(struct IOSana2Req *io)
                 break;
         
             case S2_GETSTATIONADDRESS:
-                D(bug("[WiFi.0] S2_GETSTATIONADDRESS\n"));
+                LOG(WiFiBase, LOG_DEBUG, "[WiFi.0] S2_GETSTATIONADDRESS\n");
                 CopyMem(unit->wu_OrigEtherAddr, io->ios2_DstAddr, 6);
                 CopyMem(unit->wu_EtherAddr, io->ios2_SrcAddr, 6);
                 io->ios2_Req.io_Error = 0;
                 complete = 1;
                 break;
 
+            case S2_GETSPECIALSTATS:
+                complete = Do_S2_GETSPECIALSTATS(io);
+                break;
+
             case S2_GETGLOBALSTATS:
-                D(bug("[WiFi.0] S2_GETGLOBALSTATS\n"));
+                LOG(WiFiBase, LOG_DEBUG, "[WiFi.0] S2_GETGLOBALSTATS\n");
                 CopyMem(&unit->wu_Stats, io->ios2_StatData, sizeof(struct Sana2DeviceStats));
                 io->ios2_Req.io_Error = 0;
                 complete = 1;
@@ -1738,7 +2188,7 @@ void HandleRequest(struct IOSana2Req *io)
                 break;
 
             default:
-                D(bug("[WiFi.0] Unknown command %ld\n", io->ios2_Req.io_Command));
+                LOG(WiFiBase, LOG_DEBUG, "[WiFi.0] Unknown command %ld\n", io->ios2_Req.io_Command);
                 io->ios2_Req.io_Error = IOERR_NOCMD;
                 complete = 1;
                 break;
@@ -42,13 +42,10 @@
 static inline void delay_us(ULONG us, struct WiFiBase *WiFiBase)
 {
     (void)WiFiBase;
-    ULONG timer = LE32(*(volatile ULONG*)0xf2003004);
-    ULONG end = timer + us;
+    ULONG start = timer_us();
 
-    if (end < timer) {
-        while (end < LE32(*(volatile ULONG*)0xf2003004)) asm volatile("nop");
-    }
-    while (end > LE32(*(volatile ULONG*)0xf2003004)) asm volatile("nop");
+    // Difference of unsigned timestamps stays correct when the counter wraps around
+    while (timer_us() - start < us) asm volatile("nop");
 }
 
 static struct Core *brcm_chip_get_core(struct Chip *chip, UWORD coreID)
@@ -1052,12 +1049,12 @@ int chip_init(struct SDIO *sdio)
     D(bug("[WiFi] Setting block sizes for backplane and radio functions\n"));
 
     /* Set blocksize for function 1 to 64 bytes */
-    sdio->WriteByte(SD_FUNC_CIA, SDIO_FBR_ADDR(1, 0x10), 0x40, sdio);   // Function 1 - backplane
-    sdio->WriteByte(SD_FUNC_CIA, SDIO_FBR_ADDR(1, 0x11), 0x00, sdio);
+    sdio->WriteByte(SD_FUNC_CIA, SDIO_FBR_ADDR(1, 0x10), SDIO_BLOCK_SIZE_BAK & 0xff, sdio);   // Function 1 - backplane
+    sdio->WriteByte(SD_FUNC_CIA, SDIO_FBR_ADDR(1, 0x11), SDIO_BLOCK_SIZE_BAK >> 8, sdio);
 
     /* Set blocksize for function 2 to 512 bytes */
-    sdio->WriteByte(SD_FUNC_CIA, SDIO_FBR_ADDR(2, 0x10), 0x00, sdio);    // Function 2 - radio
-    sdio->WriteByte(SD_FUNC_CIA, SDIO_FBR_ADDR(2, 0x11), 0x02, sdio);
+    sdio->WriteByte(SD_FUNC_CIA, SDIO_FBR_ADDR(2, 0x10), SDIO_BLOCK_SIZE_RAD & 0xff, sdio);    // Function 2 - radio
+    sdio->WriteByte(SD_FUNC_CIA, SDIO_FBR_ADDR(2, 0x11), SDIO_BLOCK_SIZE_RAD >> 8, sdio);
 
     /* Enable backplane function */
     D(bug("[WiFi] Enabling function 1 (backplane)\n"));
@@ -1103,7 +1100,10 @@ int chip_init(struct SDIO *sdio)
         chip->IsCoreUp = brcm_chip_ai_iscoreup;
         chip->DisableCore = brcm_chip_ai_disablecore;
         chip->ResetCore = brcm_chip_ai_resetcore;
+
+        ULONG eromStart = timer_us();
         brcm_chip_dmp_erom_scan(chip);
+        BOOT_PHASE(WiFiBase, BOOT_EROM, eromStart);
     }
     // SOCI_SB - force cores at fixed addresses. Actually it is most likely not really the
     // case on RaspberryPi
@@ -1163,69 +1163,30 @@ int chip_init(struct SDIO *sdio)
 
     sdio->s_ALPOnly = TRUE;
 
-    // Load firmware files from disk
-    LoadFirmware(chip);
-
-    D(bug("[WiFi] Firmware at %08lx\n", (ULONG)chip->c_FirmwareBase));
-    D(bug("[WiFi] NVRAM at %08lx\n", (ULONG)chip->c_ConfigBase));
-    D(bug("[WiFi] CLM at %08lx\n", (ULONG)chip->c_CLMBase));
-
     sdio->ClkCTRL(CLK_AVAIL, FALSE, sdio);
 
-    if (chip->c_FirmwareBase && chip->c_FirmwareSize)
-    {
-        ULONG ram_base = chip->c_RAMBase;
-        D(bug("[WiFi] Uploading firmware to %08lx...\n", ram_base));
-        ULONG remaining = (ULONG)chip->c_FirmwareSize;
-        UBYTE *sdio_bin = chip->c_FirmwareBase;
-        ULONG pos;
-    
-        for (pos = 0; pos < (ULONG)chip->c_FirmwareSize; )
-        {
-            ULONG sz = remaining > 64 ? 64 : remaining;
-            ULONG addr = sdio->BackplaneAddr(ram_base + pos, sdio);
-
-            sz = (sz + 3) & ~3;
+    ULONG uploadStart = timer_us();
 
-            sdio->Write(SD_FUNC_BAK, SB_32BIT_WIN + addr, &sdio_bin[pos], sz, sdio);
-            if (sdio->IsError(sdio))
-            {
-                D(bug("[WiFi] Firmware write error!\n"));
-            }
-            pos += sz;
-            remaining -= sz;
-        }
-
-        D(bug("[WiFi] wrote %ld bytes\n", pos));
-    }
-
-    if (chip->c_ConfigBase && chip->c_ConfigSize)
+    // Load firmware files from disk, firmware and NVRAM are streamed directly to the chip
+    if (!LoadFirmware(chip))
     {
-        ULONG ram_base = chip->c_RAMBase + chip->c_RAMSize - chip->c_ConfigSize;
-        D(bug("[WiFi] Uploading NVRAM to %08lx...\n", ram_base));
-        ULONG remaining = (ULONG)chip->c_ConfigSize;
-        UBYTE *nvram_bin = chip->c_ConfigBase;
-        ULONG pos;
+        struct Core *core;
 
-        for (pos = 0; pos < (ULONG)chip->c_ConfigSize; )
+        D(bug("[WiFi] Failed to load firmware\n"));
+        while ((core = (struct Core *)RemHead((struct List *)&chip->c_Cores)))
         {
-            ULONG sz = remaining > 64 ? 64 : remaining;
-            ULONG addr = sdio->BackplaneAddr(ram_base + pos, sdio);
-
-            sz = (sz + 3) & ~3;
-
-            sdio->Write(SD_FUNC_BAK, SB_32BIT_WIN + addr, &nvram_bin[pos], sz, sdio);
-            if (sdio->IsError(sdio))
-            {
-                D(bug("[WiFi] NVRAM write error!\n"));
-            }
-            pos += sz;
-            remaining -= sz;
+            FreePooled(WiFiBase->w_MemPool, core, sizeof(struct Core));
         }
-        D(bug("[WiFi] wrote %ld bytes\n", pos));
+        FreePooled(WiFiBase->w_MemPool, chip, sizeof(struct Chip));
+        return 0;
     }
 
-    ULONG resetVector = LE32(*(ULONG*)chip->c_FirmwareBase);
+    chip->c_UploadTime = timer_us() - uploadStart;
+    WiFiBase->w_BootTime[BOOT_FIRMWARE] = chip->c_UploadTime;
+    D(bug("[WiFi] Upload completed in %ld us\n", chip->c_UploadTime));
+    D(bug("[WiFi] CLM at %08lx\n", (ULONG)chip->c_CLMBase));
+
+    ULONG resetVector = chip->c_ResetVector;
 
     /* Take ARM out of reset */
     D(bug("[WiFi] Taking WiFi's ARM out of reset. Vector: %08lx\n", resetVector));
@@ -1391,3 +1352,141 @@ int chip_init(struct SDIO *sdio)
     
     return 1;
 }
+
+/*
+    The firmware puts address of its sdpcm_shared structure into the last word of RAM, until then the word
+    holds the NVRAM length token. The shared structure points to the console ring buffer and to the trap
+    record which is filled if the ARM core crashes.
+*/
+#define SHARED_FLAGS            0
+#define SHARED_TRAP_ADDR        1
+#define SHARED_ASSERT_LINE      4
+#define SHARED_CONSOLE_ADDR     5
+#define SHARED_WORDS            6
+
+#define SHARED_VERSION_MASK     0x00ff
+#define SHARED_VERSION          3
+#define SHARED_ASSERT           0x0200
+#define SHARED_TRAP             0x0400
+
+#define CONSOLE_LOG_BUF         2
+#define CONSOLE_LOG_BUFSZ       3
+#define CONSOLE_LOG_IDX         4
+
+#define TRAP_TYPE               0
+#define TRAP_EPC                1
+#define TRAP_CPSR               2
+#define TRAP_R0                 4
+#define TRAP_SP                 17
+#define TRAP_LR                 18
+#define TRAP_PC                 19
+#define TRAP_WORDS              20
+
+#define CONSOLE_MAX_SIZE        65536
+
+static BOOL chip_read_shared(struct Chip *chip, ULONG *shared)
+{
+    struct SDIO *sdio = chip->c_SDIO;
+    ULONG addr = sdio->Read32(chip->c_RAMBase + chip->c_RAMSize - 4, sdio);
+
+    if (addr == 0 || ((~addr >> 16) & 0xffff) == (addr & 0xffff))
+        return FALSE;
+
+    for (int i=0; i < SHARED_WORDS; i++)
+        shared[i] = sdio->Read32(addr + 4 * i, sdio);
+
+    if ((shared[SHARED_FLAGS] & SHARED_VERSION_MASK) > SHARED_VERSION)
+        return FALSE;
+
+    return TRUE;
+}
+
+static void chip_forward_console(struct Chip *chip, ULONG level)
+{
+    struct WiFiBase *WiFiBase = chip->c_WiFiBase;
+    struct SDIO *sdio = chip->c_SDIO;
+    ULONG buf = sdio->Read32(chip->c_ConsoleAddr + 4 * CONSOLE_LOG_BUF, sdio);
+    ULONG size = sdio->Read32(chip->c_ConsoleAddr + 4 * CONSOLE_LOG_BUFSZ, sdio);
+    ULONG idx = sdio->Read32(chip->c_ConsoleAddr + 4 * CONSOLE_LOG_IDX, sdio);
+    ULONG pos = chip->c_ConsolePos;
+    char line[80];
+    ULONG lineLength = 0;
+    ULONG word = 0;
+    ULONG wordAddr = 0xffffffff;
+
+    if (size == 0 || size > CONSOLE_MAX_SIZE || idx >= size)
+        return;
+
+    if (pos >= size)
+        pos = 0;
+
+    // Console is a byte ring in chip RAM, fetch it word by word
+    while (pos != idx)
+    {
+        if (wordAddr != buf + (pos & ~3))
+        {
+            wordAddr = buf + (pos & ~3);
+            word = sdio->Read32(wordAddr, sdio);
+        }
+
+        char c = (word >> (8 * (pos & 3))) & 0xff;
+
+        if (c != '\r' && c != 0)
+            line[lineLength++] = c;
+
+        if (c == '\n' || lineLength == sizeof(line))
+        {
+            LOG_TEXT(WiFiBase, level, line, lineLength);
+            lineLength = 0;
+        }
+
+        if (++pos == size)
+            pos = 0;
+    }
+
+    if (lineLength != 0)
+        LOG_TEXT(WiFiBase, level, line, lineLength);
+
+    chip->c_ConsolePos = pos;
+}
+
+/* Forward new firmware console output and trap or assert record, if any, to the log */
+void chip_dump_firmware_state(struct Chip *chip, ULONG level)
+{
+    struct WiFiBase *WiFiBase = chip->c_WiFiBase;
+    struct SDIO *sdio = chip->c_SDIO;
+    ULONG shared[SHARED_WORDS];
+
+    if (!LOG_ENABLED(WiFiBase, level))
+        return;
+
+    if (!chip_read_shared(chip, shared))
+    {
+        LOG(WiFiBase, level, "[WiFi] Firmware shared structure not found\n");
+        return;
+    }
+
+    if (chip->c_ConsoleAddr == 0)
+        chip->c_ConsoleAddr = shared[SHARED_CONSOLE_ADDR];
+
+    if (chip->c_ConsoleAddr != 0)
+        chip_forward_console(chip, level);
+
+    if ((shared[SHARED_FLAGS] & SHARED_TRAP) && !chip->c_TrapReported)
+    {
+        ULONG trap[TRAP_WORDS];
+
+        for (int i=0; i < TRAP_WORDS; i++)
+            trap[i] = sdio->Read32(shared[SHARED_TRAP_ADDR] + 4 * i, sdio);
+
+        LOG(WiFiBase, LOG_ERROR, "[WiFi] Firmware trap %lx at pc %08lx, lr %08lx, sp %08lx, epc %08lx, cpsr %08lx\n",
+            trap[TRAP_TYPE], trap[TRAP_PC], trap[TRAP_LR], trap[TRAP_SP], trap[TRAP_EPC], trap[TRAP_CPSR]);
+        LOG(WiFiBase, LOG_ERROR, "[WiFi]   r0 %08lx, r1 %08lx, r2 %08lx, r3 %08lx\n",
+            trap[TRAP_R0], trap[TRAP_R0 + 1], trap[TRAP_R0 + 2], trap[TRAP_R0 + 3]);
+
+        chip->c_TrapReported = TRUE;
+    }
+
+    if (shared[SHARED_FLAGS] & SHARED_ASSERT)
+        LOG(WiFiBase, level, "[WiFi] Firmware assert at line %ld\n", shared[SHARED_ASSERT_LINE]);
+}
@@ -16,6 +16,7 @@
 #include "sdio.h"
 #include "d11.h"
 #include "packet.h"
+#include "log.h"
 
 #define STR(s) #s
 #define XSTR(s) STR(s)
@@ -32,6 +33,44 @@ struct NetworkConfig {
     UBYTE       nc_Open;
 };
 
+/* Bring-up phases timed with timer_us, durations in microseconds are kept in w_BootTime */
+enum BootPhases {
+    BOOT_INIT,                              // WiFi_Init until bring-up starts
+    BOOT_DT,                                // Device tree walk, clocks and GPIO setup
+    BOOT_SDIO,                              // sdio_init, card enumeration
+    BOOT_EROM,                              // EROM scan of the chip
+    BOOT_FIRMWARE,                          // Firmware and NVRAM load and upload
+    BOOT_CHIP,                              // Rest of chip_init
+    BOOT_TASKS,                             // Start of receiver and unit tasks
+    BOOT_CLM,                               // CLM upload
+    BOOT_CONFIG,                            // Configuration iovars of S2_CONFIGINTERFACE
+    BOOT_PHASE_COUNT
+};
+
+/* Tasks started with their stack filled with STACK_PATTERN, used part is found by looking for the pattern */
+enum StackUsers {
+    STACK_RECEIVER,
+    STACK_UNIT,
+    STACK_LOG,
+    STACK_USER_COUNT
+};
+
+#define STACK_PATTERN   0xdeadbeef
+
+/* Subsystems which account their allocations from w_MemPool in w_PoolUsage */
+enum PoolUsers {
+    POOL_CTRL,                              // Control messages and their replies
+    POOL_SCAN,                              // Scan chunks, networks and scan result arrays
+    POOL_MULTICAST,                         // Multicast ranges and address lists
+    POOL_FIRMWARE,                          // Firmware, NVRAM and CLM images and their buffers
+    POOL_USER_COUNT
+};
+
+struct PoolUsage {
+    ULONG               pu_Current;         // Bytes in use
+    ULONG               pu_Peak;
+};
+
 struct WiFiBase
 {
     struct Device       w_Device;
@@ -52,19 +91,63 @@ struct WiFiBase
     UBYTE *             w_NetworkConfigVar;
     ULONG               w_NetworkConfigLength;
     struct NetworkConfig    w_NetworkConfig;
+    struct SignalSemaphore  w_InitLock;         // Held by bring-up process until hardware is ready
+    struct MinList          w_NetworkList;      // Networks seen by recent scans
+    struct SignalSemaphore  w_NetworkListLock;
+    ULONG                   w_NetworkListUpdated;   // System time (seconds) of last full scan, 0 if none yet
+    struct Log *            w_Log;              // Deferred logging, NULL until log task is started
+    ULONG                   w_BootStart;        // timer_us() at WiFi_Init
+    ULONG                   w_BootTime[BOOT_PHASE_COUNT];
+    struct PoolUsage        w_PoolUsage[POOL_USER_COUNT];
+};
+
+/* Well known IEs indexed in a single pass over the IE blob of a network. Order matches S2IEF_* bits */
+enum IEIndexSlots {
+    IE_RSN,
+    IE_WPA,
+    IE_HT,
+    IE_VHT,
+    IE_WMM,
+    IE_COUNTRY,
+    IE_INDEX_COUNT
+};
+
+#define IE_NOT_PRESENT      0xffff
+
+struct IEIndex {
+    UWORD               ii_Offset[IE_INDEX_COUNT];  // Offset of IE header within the blob or IE_NOT_PRESENT
 };
 
+/*
+    Networks found by a scan are carved from chunks of memory sized after the escan events. A chunk is freed
+    once the last network in it is dropped from scan results or network cache.
+*/
+struct ScanChunk {
+    ULONG               sc_Refs;            // Networks in the chunk plus one while scan allocates from it
+    ULONG               sc_Size;
+    ULONG               sc_Used;
+    ULONG               sc_Data[];
+};
+
+#define SCAN_CHUNK_SIZE         4096
+
 struct WiFiNetwork {
     struct MinNode      wn_Node;
+    struct ScanChunk *  wn_Chunk;           // Chunk the network is allocated from
+    struct WiFiNetwork *wn_HashNext;        // Next network in the same hash bucket
     UBYTE               wn_BSID[6];         // MAC of broadcast station
     WORD                wn_RSSI;            // Relative signal strength
     UBYTE               wn_SSIDLength;      // Length of network SSID
     UBYTE               wn_SSID[33];        // SSID
     UBYTE               wn_LastUpdated;     // Cleared on update, increased of not updated
+    ULONG               wn_LastSeen;        // System time (seconds) of last update
     UWORD               wn_BeaconPeriod;
+    UWORD               wn_Capability;
+    BYTE                wn_Noise;
     struct ChannelInfo  wn_ChannelInfo;     // Channel spec and info
     ULONG               wn_IELength;
     UBYTE *             wn_IE;
+    struct IEIndex      wn_IEIndex;
 };
 
 struct Chip;
@@ -90,13 +173,12 @@ struct Chip {
     ULONG               c_PMUCaps;
     ULONG               c_PMURev;
 
-    APTR                c_FirmwareBase;
+    ULONG               c_ResetVector;
     ULONG               c_FirmwareSize;
 
-    APTR                c_CLMBase;
+    APTR                c_CLMBase;          // Freed once uploaded to the firmware
     ULONG               c_CLMSize;
 
-    APTR                c_ConfigBase;
     ULONG               c_ConfigSize;
 
     ULONG               c_RAMBase;
@@ -106,6 +188,15 @@ struct Chip {
     struct MinList      c_Cores;
 
     UBYTE               c_D11Type;
+    BOOL                c_ChanSpecReady;    // c_ChanSpecTable is built for c_D11Type
+    struct ChanSpecDecode   c_ChanSpecTable[256];
+    UBYTE               c_ScanVersion;      // Layout of escan parameters understood by firmware
+
+    ULONG               c_UploadTime;       // Time (in microseconds) needed to load and upload firmware and NVRAM
+
+    ULONG               c_ConsoleAddr;      // Firmware console structure in chip RAM, 0 if not located yet
+    ULONG               c_ConsolePos;       // Index in console ring up to which it was forwarded to the log
+    BOOL                c_TrapReported;
 
     struct Core *       (*GetCore)(struct Chip *chip, UWORD coreID);
     void                (*SetPassive)(struct Chip *);
@@ -139,6 +230,105 @@ struct Key
     ULONG k_RXCount;
 };
 
+#define JOIN_HINT_COUNT         4
+
+/* BSSID and chanspec of last successful join to given SSID */
+struct JoinHint {
+    UBYTE                   jh_SSIDLength;      // 0 if unused
+    UBYTE                   jh_SSID[32];
+    UBYTE                   jh_BSSID[6];
+    UWORD                   jh_ChanSpec;        // 0 if not known
+};
+
+#define ROAM_TRIGGER            -75         // dBm, roam scan is considered below this level
+#define ROAM_TRIGGER_COUNT      3           // Consecutive samples below trigger needed to start roam scan
+#define ROAM_DELTA              8           // dB, candidate must be that much better than current BSS
+#define ROAM_SCAN_INTERVAL      30          // seconds, minimal time between roam scans
+
+enum RoamStates {
+    ROAM_IDLE = 0,
+    ROAM_SCAN_PENDING,                      // Unit task asked receiver for a scan
+    ROAM_SCANNING,                          // Scan for current SSID is running
+    ROAM_REASSOC                            // Reassociation to better BSS requested
+};
+
+struct RoamState {
+    LONG                    rs_RSSI;            // Averaged RSSI of current BSS, 0 if not sampled yet
+    UBYTE                   rs_LowCount;        // Consecutive samples below ROAM_TRIGGER
+    UBYTE                   rs_State;
+    ULONG                   rs_LastScan;        // System time (seconds) of last roam scan
+    ULONG                   rs_Scans;
+    ULONG                   rs_Attempts;
+    ULONG                   rs_Roams;
+};
+
+#define SCAN_HASH_SIZE          64
+#define SCAN_INITIAL_CAPACITY   16
+#define SCAN_TIMEOUT            15000000    // us, scan is given up if firmware does not complete it
+#define SCAN_MIN_INTERVAL       2000000     // us, requests within this time after a full scan get its results
+#define SCAN_TX_IDLE            100000      // us without transmit before a scan may start
+#define SCAN_MAX_DEFER          3000000     // us, longest time a scan waits for transmit to become idle
+
+#define NETWORK_CACHE_MISSES    3           // Full scans a network may be missing from before it is dropped
+#define NETWORK_CACHE_EXPIRE    300         // seconds
+
+#define LATENCY_BUCKETS         4           // <250us, <1ms, <4ms, slower
+#define COUNTERS_INTERVAL       10          // seconds between snapshots of firmware counters
+#define CONSOLE_INTERVAL        5           // seconds between reads of firmware console at LOG_DEBUG level
+#define STALL_TIMEOUT           5           // seconds without progress on pending work before firmware state is dumped
+
+/* Subset of firmware "counters" iovar, absolute values of last snapshot */
+struct FWCounters {
+    ULONG                   fc_TXRetrans;
+    ULONG                   fc_TXError;
+    ULONG                   fc_TXNoBuf;
+    ULONG                   fc_TXUnderflow;
+    ULONG                   fc_RXError;
+    ULONG                   fc_RXNoBuf;
+    ULONG                   fc_RXOverflow;
+};
+
+/* Driver statistics kept in wu_SpecialStats and reported by S2_GETSPECIALSTATS */
+enum SpecialStatSlots {
+    SS_RX_BYTES,
+    SS_TX_BYTES,
+    SS_RX_GLOM_FRAMES,
+    SS_RX_GLOM_PACKETS,
+    SS_TX_GLOM_FRAMES,
+    SS_TX_GLOM_PACKETS,
+    SS_SDIO_CMD52,                          // Copied from SDIO on request, counted since driver start
+    SS_SDIO_CMD53,
+    SS_POLL_DATA,                           // Timer wakeups of receiver which found a frame
+    SS_POLL_IDLE,                           // Timer wakeups of receiver with nothing to do
+    SS_TX_PASS_PEAK,                        // Most write requests sent in one receiver pass
+    SS_CTRL_QUEUE_PEAK,                     // Most control messages waiting for reply
+    SS_FW_TX_RETRIES,                       // SS_FW_* are differences of firmware counters snapshots
+    SS_FW_TX_UNDERRUNS,
+    SS_FW_TX_ERRORS,
+    SS_FW_TX_DROPS,
+    SS_FW_RX_ERRORS,
+    SS_FW_RX_DROPS,
+    SS_FW_RX_OVERFLOWS,
+    SS_ROAM_SCANS,                          // SS_ROAM_* are copied from wu_Roam on request
+    SS_ROAM_ATTEMPTS,
+    SS_ROAM_SUCCESSES,
+    SS_CTRL_RTT,                                        // LATENCY_BUCKETS slots
+    SS_RX_LATENCY = SS_CTRL_RTT + LATENCY_BUCKETS,      // LATENCY_BUCKETS slots, frame fetch to request reply
+    SS_BOOT = SS_RX_LATENCY + LATENCY_BUCKETS,          // BOOT_PHASE_COUNT slots, copied from w_BootTime on request
+    SS_STACK = SS_BOOT + BOOT_PHASE_COUNT,              // STACK_USER_COUNT slots, measured on request
+    SS_POOL = SS_STACK + STACK_USER_COUNT,              // POOL_USER_COUNT slots, copied from w_PoolUsage on request
+    SS_POOL_PEAK = SS_POOL + POOL_USER_COUNT,           // POOL_USER_COUNT slots
+    SS_COUNT = SS_POOL_PEAK + POOL_USER_COUNT
+};
+
+static inline ULONG LatencyBucket(ULONG us)
+{
+    if (us < 250) return 0;
+    if (us < 1000) return 1;
+    if (us < 4000) return 2;
+    return 3;
+}
+
 struct WiFiUnit
 {
     struct Unit             wu_Unit;
@@ -150,8 +340,42 @@ struct WiFiUnit
     struct SignalSemaphore  wu_Lock;
     struct MsgPort *        wu_CmdQueue;
     struct MsgPort *        wu_ScanQueue;
+    struct MsgPort *        wu_ScanContinue;    // Follow-up requests of incremental scan
+    struct MsgPort *        wu_ScanRiders;      // Requests answered from results of current scan
     struct IOSana2Req *     wu_ScanRequest;
+    struct WiFiNetwork **   wu_ScanResults;     // Networks found by current scan, in discovery order
+    ULONG                   wu_ScanCount;
+    ULONG                   wu_ScanCapacity;
+    struct WiFiNetwork *    wu_ScanHash[SCAN_HASH_SIZE];
+    struct ScanChunk *      wu_ScanChunk;       // Chunk new networks are allocated from
+    ULONG                   wu_ScanStarted;     // timer_us() at scan start
+    BOOL                    wu_ScanActive;      // Firmware is scanning, with or without a request
+    BOOL                    wu_ScanRefresh;     // Background refresh of network cache requested
+    BOOL                    wu_ScanIncremental; // Networks are replied as they arrive
+    BOOL                    wu_ScanFinished;    // Incremental scan is over, waiting for request to take the rest
+    ULONG                   wu_ScanDelivered;   // Number of networks already replied in incremental mode
+    UBYTE                   wu_ScanSSIDLength;  // SSID the current scan is limited to, 0 if none
+    UBYTE                   wu_ScanSSID[32];
+    BOOL                    wu_ScanLimited;     // Current scan is limited to channels or BSSID
+    BOOL                    wu_ScanHasBSSID;
+    UBYTE                   wu_ScanBSSID[6];    // BSSID the current scan is limited to, if wu_ScanHasBSSID
+    UBYTE                   wu_ScanChannelCount;    // Channels the current scan is limited to, 0 if none
+    UBYTE                   wu_ScanChannels[SCAN_MAX_CHANNELS];
+    BOOL                    wu_ScanWasFull;     // Last completed scan covered all networks
+    BOOL                    wu_ScanWaiting;     // Scan is wanted but deferred
+    ULONG                   wu_ScanEnded;       // timer_us() at end of last scan
+    ULONG                   wu_ScanWaitStart;   // timer_us() when scan was first deferred
+    ULONG                   wu_LastTX;          // timer_us() of last data transmit
     struct Sana2DeviceStats wu_Stats;
+    ULONG                   wu_SpecialStats[SS_COUNT];
+    ULONG                   wu_RXStart;         // timer_us() when frame being processed was fetched
+    struct FWCounters       wu_FWCounters;
+    BOOL                    wu_FWCountersValid; // wu_FWCounters holds a snapshot to diff against
+    UBYTE                   wu_FWCountersTick;
+    UBYTE                   wu_ConsoleTick;
+    UBYTE                   wu_StallSeconds;    // Seconds with work pending but no packet moved
+    ULONG                   wu_StallProgress;   // Packets sent and received at last check
+    ULONG                   wu_StallTimeouts;   // s_CtrlTimeouts at last check
     struct TimerBase *      wu_TimerBase;
     ULONG                   wu_Flags;
     UBYTE                   wu_OrigEtherAddr[6];
@@ -159,6 +383,9 @@ struct WiFiUnit
 
     struct Key              wu_Keys[4];
     struct ExtJoinParams    wu_JoinParams;
+    struct JoinHint         wu_JoinHints[JOIN_HINT_COUNT];  // Most recently used first
+    BOOL                    wu_JoinHinted;      // Current join is restricted by a hint
+    struct RoamState        wu_Roam;
     UBYTE *                 wu_AssocIE;
     UWORD                   wu_AssocIELength;
     UBYTE *                 wu_WPAInfo;
@@ -210,6 +437,23 @@ struct Opener
 #define IFF_ONLINE      0x080000         /* interface online */
 #define IFF_CONNECTED   0x100000         /* interface connected to network */
 
+/* Wire formats are little endian (SDIO, firmware structures) or network order (Ethernet, firmware events) */
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+static inline uint64_t LE64(uint64_t x) { return __builtin_bswap64(x); }
+static inline uint32_t LE32(uint32_t x) { return __builtin_bswap32(x); }
+static inline uint16_t LE16(uint16_t x) { return __builtin_bswap16(x); }
+static inline uint32_t BE32(uint32_t x) { return x; }
+static inline uint16_t BE16(uint16_t x) { return x; }
+#else
+static inline uint64_t LE64(uint64_t x) { return x; }
+static inline uint32_t LE32(uint32_t x) { return x; }
+static inline uint16_t LE16(uint16_t x) { return x; }
+static inline uint32_t BE32(uint32_t x) { return __builtin_bswap32(x); }
+static inline uint16_t BE16(uint16_t x) { return __builtin_bswap16(x); }
+#endif
+
+#ifdef __m68k__
+
 static inline __attribute__((always_inline)) void putch(REGARG(UBYTE data, "d0"), REGARG(APTR ignore, "a3"))
 {
     (void)ignore;
@@ -218,9 +462,11 @@ static inline __attribute__((always_inline)) void putch(REGARG(UBYTE data, "d0")
 }
 
 
-static inline uint64_t LE64(uint64_t x) { return __builtin_bswap64(x); }
-static inline uint32_t LE32(uint32_t x) { return __builtin_bswap32(x); }
-static inline uint16_t LE16(uint16_t x) { return __builtin_bswap16(x); }
+/* exec.library base kept at absolute address 4 */
+static inline struct ExecBase * GetAbsExecBase(void) { return *(struct ExecBase **)4UL; }
+
+/* Free running 1MHz system timer */
+static inline ULONG timer_us(void) { return LE32(*(volatile ULONG*)0xf2003004); }
 
 static inline ULONG rd32(APTR addr, ULONG offset)
 {
@@ -252,6 +498,36 @@ static inline void wr32be(APTR addr, ULONG offset, ULONG val)
     asm volatile("nop");
 }
 
+/* Data port of a FIFO, words are moved as they are, bytes stay in memory order */
+static inline ULONG rd32fifo(APTR addr, ULONG offset)
+{
+    return *(volatile ULONG *)((ULONG)addr + offset);
+}
+
+static inline void wr32fifo(APTR addr, ULONG offset, ULONG val)
+{
+    *(volatile ULONG *)((ULONG)addr + offset) = val;
+}
+
+#else
+
+/* Host build (see host/), console, timer and registers are provided by the simulated board */
+void putch(REGARG(UBYTE data, "d0"), REGARG(APTR ignore, "a3"));
+struct ExecBase * GetAbsExecBase(void);
+ULONG timer_us(void);
+ULONG rd32(APTR addr, ULONG offset);
+void wr32(APTR addr, ULONG offset, ULONG val);
+ULONG rd32be(APTR addr, ULONG offset);
+void wr32be(APTR addr, ULONG offset, ULONG val);
+ULONG rd32fifo(APTR addr, ULONG offset);
+void wr32fifo(APTR addr, ULONG offset, ULONG val);
+
+#endif
+
+/* Add time since t to given boot phase and restart t for the next phase */
+#define BOOT_PHASE(base, phase, t) \
+    do { ULONG now = timer_us(); (base)->w_BootTime[phase] += now - (t); (t) = now; } while(0)
+
 struct WiFiBase * WiFi_Init(REGARG(struct WiFiBase *base, "d0"), REGARG(BPTR seglist, "a0"),
                             REGARG(struct ExecBase *SysBase, "a6"));
 
@@ -262,6 +538,7 @@ struct WiFiBase * WiFi_Init(REGARG(struct WiFiBase *base, "d0"), REGARG(BPTR seg
 BOOL LoadFirmware(struct Chip *chip);
 
 int chip_init(struct SDIO *sdio);
+void chip_dump_firmware_state(struct Chip *chip, ULONG level);
 
 void _NewList(APTR listPTR);
 void _bzero(APTR ptr, ULONG sz);
@@ -278,8 +555,13 @@ APTR AllocPooledClear(APTR pool, ULONG byteSize);
 APTR AllocVecPooledClear(APTR pool, ULONG byteSize);
 APTR AllocVecPooled(APTR pool, ULONG byteSize);
 void FreeVecPooled(APTR pool, APTR buf);
+ULONG VecPooledSize(APTR buf);
+void PoolUsed(struct WiFiBase *WiFiBase, ULONG user, LONG delta);
+void FillStack(ULONG *stack, ULONG count);
+ULONG StackUsed(struct Task *task);
 void ProcessDataPacket(struct SDIO *, UBYTE *, ULONG);
 void ParseConfig(struct WiFiBase *WiFiBase);
 void ReportEvents(struct WiFiUnit *unit, ULONG eventSet);
+BOOL WaitForInit(struct WiFiBase *WiFiBase);
 
 #endif